@@ -1,17 +1,57 @@
 // This is the Main file for the ESP32-C3, which will be used to retrieve the time via the network and send it to the Teensy 4.1 via i2c.
+// The I2C slave is started before anything else, so the Teensy always gets an answer right after power on. Until NTP has set
+// the clock, the answer says the time isn't synced yet. WiFi setup (including the config portal) and NTP run in the background.
+// The NTP client (NtpClient.h) polls several servers, filters out the bad ones, and passes how sure it is on to the Teensy.
 
 
 #include <Arduino.h>
 #include <Wire.h> // Include Wire library for I2C communication
 #include <WiFi.h> // Include WiFi library for ESP32
 #include <WiFiManager.h>
-#include <time.h> // Include time library for time-related functions
 
+#include "NtpClient.h" // Keeps the clock synced from several NTP servers
 
-const char* publicNTPServerPool = "pool.ntp.org"; // Public NTP server address
-const long gmtOffset_sec = -5 * 3600; // GMT offset in seconds (EST)
-const int daylightOffset_sec = 3600; // Daylight saving time offset in seconds
 
+//	*************************************************************************************************
+//	Structs for the Time Module
+//	*************************************************************************************************
+
+// The answer to the Teensy's I2C request. This must match Esp32TimeResponse in the Teensy's TimeManager.cpp
+typedef struct __attribute__((packed)) {
+	uint32_t unixTime;		// The time in seconds since 1970, UTC
+	uint8_t flags;			// TIME_FLAG_* bits
+	uint16_t syncAgeS;		// The seconds since NTP last set the clock, up to 0xFFFF
+	int32_t offsetUs;		// How far NTP last moved the clock, in microseconds
+	uint32_t uncertaintyUs;	// How far off the clock could be as of then, in microseconds
+	uint8_t servers;		// The servers that agreed in the high nibble, and the servers answering in the low nibble
+	uint8_t checksum;		// The inverted sum of the bytes before it, so a bus full of 0x00 or 0xFF isn't taken as a time
+} TimeResponse;
+
+#define TIME_FLAG_SYNCED	(1 << 0)	// NTP has set the clock since the ESP32 started, so the time can be used
+#define TIME_FLAG_WIFI		(1 << 1)	// WiFi is connected
+#define TIME_FLAG_PORTAL	(1 << 2)	// The WiFi config portal is open, waiting for someone to set up the network
+
+
+
+
+
+//	*************************************************************************************************
+//	Variables for the Time Module
+//	*************************************************************************************************
+
+const uint8_t I2cAddress = 4; // The address the Teensy reads the time from
+
+WiFiManager wifiManager; // Kept for the whole run, so the config portal can be serviced from loop()
+
+bool ntpStarted = false; // If the NTP client has been started. It needs the network up first
+
+
+
+
+
+//	*************************************************************************************************
+//	Functions for the Time Module
+//	*************************************************************************************************
 
 void configModeCallback (WiFiManager *myWiFiManager) {
 	Serial.println("Entered config mode");
@@ -21,41 +61,85 @@ void configModeCallback (WiFiManager *myWiFiManager) {
 
 
 
-time_t getUnixTime() {
-	struct tm timeinfo;
-	if (!getLocalTime(&timeinfo)) { // Get local time
-		Serial.println("Failed to obtain time");
-		return 0; // Return 0 if failed to obtain time
-	}
-	return mktime(&timeinfo); // Convert struct tm to Unix time
+// Start the NTP client once the network is up. It keeps the clock synced in the background from then on
+void startNtp() {
+	InitNtpClient();
+	ntpStarted = true;
+	Serial.println("NTP started");
 }
 
 
 
-// Handle an I2C request from the Teensy / main microcontroller
+// Handle an I2C request from the Teensy / main microcontroller. This never waits on the network, it answers with whatever
+// the clock says right now and flags whether that can be trusted.
 void requestEvent() {
-	time_t unixTime = getUnixTime(); // Get current Unix time
-	Wire.write((byte*)&unixTime, sizeof(unixTime)); // Send Unix time to master
+	TimeResponse response;
+	response.unixTime = NtpUnixTime(); // Current Unix time. This counts from 0 at power on until NTP sets it
+	response.flags = 0;
+	response.syncAgeS = 0xFFFF;
+	response.offsetUs = 0;
+	response.uncertaintyUs = UINT32_MAX;
+	response.servers = (NtpSurvivors() << 4) | NtpCandidates();
+	if (NtpClockSynced()) {
+		response.flags |= TIME_FLAG_SYNCED;
+		uint32_t ageS = NtpSyncAgeMs() / 1000;
+		response.syncAgeS = (ageS > 0xFFFF) ? 0xFFFF : ageS;
+		int64_t offsetUs = NtpLastOffsetUs();
+		response.offsetUs = (offsetUs > INT32_MAX) ? INT32_MAX : ((offsetUs < INT32_MIN) ? INT32_MIN : offsetUs);
+		int64_t uncertaintyUs = NtpUncertaintyUs();
+		response.uncertaintyUs = (uncertaintyUs > UINT32_MAX) ? UINT32_MAX : uncertaintyUs;
+	}
+	if (WiFi.status() == WL_CONNECTED) {
+		response.flags |= TIME_FLAG_WIFI;
+	}
+	if (wifiManager.getConfigPortalActive()) {
+		response.flags |= TIME_FLAG_PORTAL;
+	}
+
+	uint8_t sum = 0;
+	for (size_t i = 0; i < offsetof(TimeResponse, checksum); i++) {
+		sum += ((uint8_t*)&response)[i];
+	}
+	response.checksum = ~sum;
+
+	Wire.write((byte*)&response, sizeof(response)); // Send the time to the master
 }
 
 
 
 void setup() {
+	Wire.begin(I2cAddress); // Join I2C bus with address #4 before anything else, so the Teensy gets an answer right away
+	Wire.onRequest(requestEvent); // Register event handler for request
+
 	Serial.begin(115200); // Initialize serial communication
-	WiFiManager wifiManager; // Create WiFiManager object
+
+	WiFi.mode(WIFI_STA);
+	wifiManager.setConfigPortalBlocking(false); // Open the config portal in the background instead of waiting in it
 	wifiManager.setAPCallback(configModeCallback); // Set callback for config mode
-	wifiManager.autoConnect("Clock_Config_WiFi", "password"); // Connect to WiFi network
-	Serial.println("WiFi connected!"); // Print message indicating WiFi connection
+	if (wifiManager.autoConnect("Clock_Config_WiFi", "password")) { // Connect to WiFi network, or open the config portal
+		Serial.println("WiFi connected!"); // Print message indicating WiFi connection
+		startNtp();
+	}
 	// Serial.print("\nESP Board MAC Address: ");
 	// Serial.println(WiFi.macAddress()); // Print MAC address of ESP board
 	// Serial.println("\n");
-	configTime(gmtOffset_sec, daylightOffset_sec, "10.128.10.31", "10.128.10.30", publicNTPServerPool); // Configure time settings
-	Wire.begin(4); // Join I2C bus with address #4
-	Wire.onRequest(requestEvent); // Register event handler for request
 }
 
 
 
 void loop() {
-	delay(100); // Small delay to prevent excessive looping
-}
\ No newline at end of file
+	wifiManager.process(); // Service the config portal, if it is open
+
+	if (!ntpStarted && (WiFi.status() == WL_CONNECTED)) { // Connected through the portal, or the network came back
+		Serial.println("WiFi connected!");
+		startNtp();
+	}
+
+	UpdateNtpClient(); // Poll the NTP servers and correct the clock
+
+	if (Serial.available() && (Serial.read() == 'n')) { // Send an 'n' to see how the NTP servers are doing
+		PrintNtpStatus();
+	}
+
+	delay(1); // Short, since a reply waiting here is counted as network delay
+}
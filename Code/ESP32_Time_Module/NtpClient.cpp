@@ -0,0 +1,359 @@
+// The NTP client for the ESP32. See NtpClient.h for what it does, and NtpFilter.h for how the servers are filtered and combined.
+// The clock is kept as an offset from the microsecond timer, so it never runs backwards between corrections and the I2C
+// request handler can read it without waiting. Everything the handler reads is guarded by ntpClockMux, since it runs in
+// its own task and a 64 bit value could be read half written.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_timer.h>
+
+#include "NtpClient.h"
+#include "NtpFilter.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the NTP Client
+//	*************************************************************************************************
+
+// Struct to hold where to reach a server
+typedef struct {
+	const char *host;		// The host name or IP address
+	uint16_t port;			// The UDP port, 123 for a real server
+} NtpServerAddress;
+
+
+
+// Struct to hold the state of a poll to a server
+typedef struct {
+	IPAddress ip;			// The server's address, once it has been looked up
+	bool resolved;			// If the address has been looked up
+	bool waiting;			// If a request is out that hasn't been answered
+	bool answered;			// If the server answered this poll
+	uint8_t originStamp[8];	// The transmit timestamp sent, which the reply has to echo back
+	int64_t sentAtUs;		// When the request was sent, by our clock
+} NtpServerState;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the NTP Client
+//	*************************************************************************************************
+
+// The servers to poll. To test with Code/Tools/ntp_standin.py, point these at the computer running it, on the ports it serves
+const NtpServerAddress NtpServers[] = {
+	{"10.128.10.31", 123},
+	{"10.128.10.30", 123},
+	{"pool.ntp.org", 123}
+};
+const uint8_t NumNtpServers = sizeof(NtpServers) / sizeof(NtpServers[0]);
+static_assert(NumNtpServers <= NtpMaxServers, "Too many NTP servers for the selection");
+
+const uint16_t NtpLocalPort = 4123;				// The port the replies come back to
+const uint8_t NtpPacketSize = 48;				// The size of an NTP packet without extensions
+const int64_t NtpUnixEpochSeconds = 2208988800LL;	// The seconds from 1900 (the NTP epoch) to 1970
+
+const uint32_t NtpBurstPollMs = 2000;			// The time between polls at startup, to fill the filters quickly
+const uint8_t NtpBurstPolls = 4;				// The number of polls at startup
+const uint32_t NtpPollMs = 64000;				// The time between polls after that
+const uint32_t NtpReplyTimeoutMs = 1500;		// How long to wait for replies before the poll is closed
+
+WiFiUDP ntpUdp;
+NtpServerState ntpServers[NumNtpServers];
+NtpServerFilter ntpFilters[NumNtpServers];
+NtpSelection ntpSelection;					// The result of the last poll. Guarded by ntpClockMux
+
+bool ntpRunning = false;					// If InitNtpClient() has been called
+bool ntpPollOpen = false;					// If a poll is waiting on replies
+uint32_t pollStartedMs = 0;					// When the last poll was sent, in millis
+uint8_t pollsDone = 0;						// The number of polls since startup, up to NtpBurstPolls
+
+portMUX_TYPE ntpClockMux = portMUX_INITIALIZER_UNLOCKED;	// Guards clockOffsetUs, ntpSelection and lastOffsetUs, which the I2C handler reads from its own task
+int64_t clockOffsetUs = 0;					// Our clock is the microsecond timer plus this, in microseconds since 1970
+volatile bool clockSynced = false;			// If the clock has been corrected since startup
+volatile uint32_t lastSyncMs = 0;			// When the clock was last corrected, in millis
+int64_t lastOffsetUs = 0;					// The last correction. Guarded by ntpClockMux
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the NTP Client
+//	*************************************************************************************************
+
+/// Get the time from our clock
+/// @return The time in microseconds since 1970.
+int64_t NtpLocalUs(){
+	portENTER_CRITICAL(&ntpClockMux);
+	int64_t offsetUs = clockOffsetUs;
+	portEXIT_CRITICAL(&ntpClockMux);
+	return esp_timer_get_time() + offsetUs;
+}// End of NtpLocalUs()
+
+
+
+/// Write a time into a packet as an NTP timestamp (big endian seconds since 1900, then a 32 bit fraction)
+/// @param buffer Where to write the 8 bytes.
+/// @param unixUs The time in microseconds since 1970.
+void NtpWriteTimestamp(uint8_t *buffer, int64_t unixUs){
+	uint32_t seconds = (uint32_t)(unixUs / 1000000 + NtpUnixEpochSeconds);
+	uint32_t fraction = (uint32_t)(((uint64_t)(unixUs % 1000000) << 32) / 1000000);
+	for(uint8_t i = 0; i < 4; i++){
+		buffer[i] = seconds >> (24 - 8 * i);
+		buffer[4 + i] = fraction >> (24 - 8 * i);
+	}
+}// End of NtpWriteTimestamp()
+
+
+
+/// Read an NTP timestamp from a packet
+/// @param buffer The 8 bytes of the timestamp.
+/// @return The time in microseconds since 1970.
+int64_t NtpReadTimestamp(const uint8_t *buffer){
+	uint32_t seconds = 0;
+	uint32_t fraction = 0;
+	for(uint8_t i = 0; i < 4; i++){
+		seconds = (seconds << 8) | buffer[i];
+		fraction = (fraction << 8) | buffer[4 + i];
+	}
+	return ((int64_t)seconds - NtpUnixEpochSeconds) * 1000000 + (int64_t)(((uint64_t)fraction * 1000000) >> 32);
+}// End of NtpReadTimestamp()
+
+
+
+// Send a request to every server at once, so they all see the same state of our clock
+void SendNtpRequests(){
+	pollStartedMs = millis();
+	ntpPollOpen = true;
+
+	for(uint8_t i = 0; i < NumNtpServers; i++){
+		NtpServerState *server = &ntpServers[i];
+		server->answered = false;
+		server->waiting = false;
+		if(!server->resolved){// Look it up again each poll until it works
+			server->resolved = (WiFi.hostByName(NtpServers[i].host, server->ip) == 1);
+			if(!server->resolved){
+				continue;
+			}
+		}
+
+		uint8_t packet[NtpPacketSize] = {0};
+		packet[0] = (0 << 6) | (4 << 3) | 3;	// No leap second warning, version 4, client mode
+		server->sentAtUs = NtpLocalUs();
+		NtpWriteTimestamp(&packet[40], server->sentAtUs);
+		memcpy(server->originStamp, &packet[40], sizeof(server->originStamp));
+
+		ntpUdp.beginPacket(server->ip, NtpServers[i].port);
+		ntpUdp.write(packet, NtpPacketSize);
+		server->waiting = (ntpUdp.endPacket() == 1);
+	}
+}// End of SendNtpRequests()
+
+
+
+// Read any replies that have arrived, and add them to their server's filter
+void ReadNtpReplies(){
+	while(ntpUdp.parsePacket() > 0){
+		int64_t receivedAtUs = NtpLocalUs();	// As soon as possible, since any time here is counted as network delay
+
+		uint8_t packet[NtpPacketSize];
+		if(ntpUdp.read(packet, NtpPacketSize) != NtpPacketSize){
+			continue;
+		}
+
+		for(uint8_t i = 0; i < NumNtpServers; i++){
+			NtpServerState *server = &ntpServers[i];
+			if(!server->waiting || (ntpUdp.remoteIP() != server->ip) || (memcmp(&packet[24], server->originStamp, sizeof(server->originStamp)) != 0)){
+				continue;
+			}
+			server->waiting = false;
+
+			uint8_t mode = packet[0] & 0b111;
+			uint8_t stratum = packet[1];
+			if((mode != 4) || (stratum == 0) || (stratum >= 16)){// Not a server reply, a kiss-o'-death, or not synced itself
+				break;
+			}
+
+			int64_t offsetUs, delayUs;
+			NtpMeasure(server->sentAtUs, NtpReadTimestamp(&packet[32]), NtpReadTimestamp(&packet[40]), receivedAtUs, &offsetUs, &delayUs);
+			NtpAddSample(&ntpFilters[i], offsetUs, delayUs, millis());
+			server->answered = true;
+			break;
+		}
+	}
+}// End of ReadNtpReplies()
+
+
+
+// Close the poll once every server has answered or timed out, and correct the clock if the servers agree
+void CloseNtpPoll(){
+	ntpPollOpen = false;
+	if(pollsDone < NtpBurstPolls){
+		pollsDone++;
+	}
+
+	for(uint8_t i = 0; i < NumNtpServers; i++){
+		if(!ntpServers[i].answered){
+			NtpMissedPoll(&ntpFilters[i], millis());
+		}
+		ntpServers[i].waiting = false;
+	}
+
+	NtpSelection selection = NtpSelect(ntpFilters, NumNtpServers);
+	if(!selection.valid){
+		portENTER_CRITICAL(&ntpClockMux);
+		ntpSelection = selection;
+		portEXIT_CRITICAL(&ntpClockMux);
+		Serial.printf("NTP: no agreement, %u servers answering\n", selection.candidates);
+		return;
+	}
+
+	portENTER_CRITICAL(&ntpClockMux);
+	clockOffsetUs += selection.offsetUs;
+	ntpSelection = selection;
+	lastOffsetUs = selection.offsetUs;
+	lastSyncMs = millis();
+	clockSynced = true;
+	portEXIT_CRITICAL(&ntpClockMux);
+	NtpShiftSamples(ntpFilters, NumNtpServers, selection.offsetUs);
+
+	Serial.printf("NTP: corrected by %lld us, uncertainty %lld us, %u of %u servers\n", selection.offsetUs, selection.uncertaintyUs,
+		selection.survivors, selection.candidates);
+}// End of CloseNtpPoll()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the NTP Client
+//	*************************************************************************************************
+
+/// Start the NTP client. Call this once the network is up.
+void InitNtpClient(){
+	if(ntpRunning){
+		return;
+	}
+
+	for(uint8_t i = 0; i < NumNtpServers; i++){
+		ntpServers[i].resolved = false;
+		ntpServers[i].waiting = false;
+		ntpServers[i].answered = false;
+		NtpResetFilter(&ntpFilters[i]);
+	}
+
+	ntpUdp.begin(NtpLocalPort);
+	pollStartedMs = millis() - NtpPollMs;	// Poll right away
+	ntpRunning = true;
+}// End of InitNtpClient()
+
+
+
+/// Send polls, read replies, and correct the clock when a poll is done. This function will be called in the main loop.
+void UpdateNtpClient(){
+	if(!ntpRunning){
+		return;
+	}
+
+	ReadNtpReplies();
+
+	if(ntpPollOpen){
+		bool waiting = false;
+		for(uint8_t i = 0; i < NumNtpServers; i++){
+			waiting |= ntpServers[i].waiting;
+		}
+		if(!waiting || ((millis() - pollStartedMs) >= NtpReplyTimeoutMs)){
+			CloseNtpPoll();
+		}
+		return;
+	}
+
+	uint32_t periodMs = ((pollsDone < NtpBurstPolls) || !clockSynced) ? NtpBurstPollMs : NtpPollMs;
+	if((millis() - pollStartedMs) >= periodMs){
+		SendNtpRequests();
+	}
+}// End of UpdateNtpClient()
+
+
+
+/// Check if the clock has been set from NTP since startup
+/// @return True once the servers have agreed on the time at least once.
+bool NtpClockSynced(){
+	return clockSynced;
+}// End of NtpClockSynced()
+
+
+
+/// Get the time from the NTP corrected clock
+/// @return The time in seconds since 1970, UTC. This counts from 0 at power on until the clock is synced.
+uint32_t NtpUnixTime(){
+	return (uint32_t)(NtpLocalUs() / 1000000);
+}// End of NtpUnixTime()
+
+
+
+/// Get the time since the clock was last corrected
+/// @return The time in milliseconds.
+uint32_t NtpSyncAgeMs(){
+	return millis() - lastSyncMs;
+}// End of NtpSyncAgeMs()
+
+
+
+/// Get the last correction made to the clock
+/// @return How far the clock was moved forward, in microseconds.
+int64_t NtpLastOffsetUs(){
+	portENTER_CRITICAL(&ntpClockMux);
+	int64_t offsetUs = lastOffsetUs;
+	portEXIT_CRITICAL(&ntpClockMux);
+	return offsetUs;
+}// End of NtpLastOffsetUs()
+
+
+
+/// Get how far off the clock could be, as of the last correction
+/// @return The uncertainty in microseconds.
+int64_t NtpUncertaintyUs(){
+	portENTER_CRITICAL(&ntpClockMux);
+	int64_t uncertaintyUs = ntpSelection.uncertaintyUs;
+	portEXIT_CRITICAL(&ntpClockMux);
+	return uncertaintyUs;
+}// End of NtpUncertaintyUs()
+
+
+
+/// Get how many servers went into the last correction
+/// @return The number of servers that agreed.
+uint8_t NtpSurvivors(){
+	portENTER_CRITICAL(&ntpClockMux);
+	uint8_t survivors = ntpSelection.survivors;
+	portEXIT_CRITICAL(&ntpClockMux);
+	return survivors;
+}// End of NtpSurvivors()
+
+
+
+/// Get how many servers have answered recently
+/// @return The number of servers with recent samples.
+uint8_t NtpCandidates(){
+	portENTER_CRITICAL(&ntpClockMux);
+	uint8_t candidates = ntpSelection.candidates;
+	portEXIT_CRITICAL(&ntpClockMux);
+	return candidates;
+}// End of NtpCandidates()
+
+
+
+/// Print the state of each server and the last correction over serial
+void PrintNtpStatus(){
+	for(uint8_t i = 0; i < NumNtpServers; i++){
+		const NtpServerFilter *filter = &ntpFilters[i];
+		Serial.printf("%-16s reach %03o, offset %lld us, delay %lld us, jitter %lld us%s\n", NtpServers[i].host, filter->reach,
+			filter->offsetUs, filter->delayUs, filter->jitterUs, filter->usable ? "" : " (no recent samples)");
+	}
+	Serial.printf("Last correction %lld us, %lu s ago, uncertainty %lld us, %u of %u servers\n", lastOffsetUs,
+		NtpSyncAgeMs() / 1000, ntpSelection.uncertaintyUs, ntpSelection.survivors, ntpSelection.candidates);
+}// End of PrintNtpStatus()
@@ -0,0 +1,58 @@
+// The NTP client for the ESP32. All the servers are polled at once, each reply goes through the clock filter in NtpFilter.h,
+// and the ESP32's clock is corrected with the offset of the servers that agree with each other. The offset and how sure it
+// is are kept, so they can be passed on to the Teensy.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Functions for the NTP Client
+//	*************************************************************************************************
+
+/// Start the NTP client. Call this once the network is up.
+void InitNtpClient();
+
+
+/// Send polls, read replies, and correct the clock when a poll is done. This function will be called in the main loop.
+void UpdateNtpClient();
+
+
+/// Check if the clock has been set from NTP since startup
+/// @return True once the servers have agreed on the time at least once.
+bool NtpClockSynced();
+
+
+/// Get the time from the NTP corrected clock
+/// @return The time in seconds since 1970, UTC. This counts from 0 at power on until the clock is synced.
+uint32_t NtpUnixTime();
+
+
+/// Get the time since the clock was last corrected
+/// @return The time in milliseconds.
+uint32_t NtpSyncAgeMs();
+
+
+/// Get the last correction made to the clock
+/// @return How far the clock was moved forward, in microseconds.
+int64_t NtpLastOffsetUs();
+
+
+/// Get how far off the clock could be, as of the last correction
+/// @return The uncertainty in microseconds.
+int64_t NtpUncertaintyUs();
+
+
+/// Get how many servers went into the last correction
+/// @return The number of servers that agreed.
+uint8_t NtpSurvivors();
+
+
+/// Get how many servers have answered recently
+/// @return The number of servers with recent samples.
+uint8_t NtpCandidates();
+
+
+/// Print the state of each server and the last correction over serial
+void PrintNtpStatus();
@@ -0,0 +1,261 @@
+// The clock filter and selection for the NTP client. See NtpFilter.h for how it works.
+
+#include <math.h>
+
+#include "NtpFilter.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the NTP Filter
+//	*************************************************************************************************
+
+// One end of a server's correctness interval, for the intersection
+typedef struct {
+	int64_t valueUs;	// The offset at this end
+	int8_t type;		// -1 for the low end, +1 for the high end
+} NtpEndpoint;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the NTP Filter
+//	*************************************************************************************************
+
+/// Get how far a server's offset could be from the true offset
+/// @param filter The server's filter.
+/// @return The distance, in microseconds.
+int64_t NtpRootDistance(const NtpServerFilter *filter){
+	return (filter->delayUs / 2) + filter->jitterUs + NtpMinDispersionUs;
+}// End of NtpRootDistance()
+
+
+
+/// Pick the lowest delay sample of a server as its offset, and work out the jitter of its samples
+/// @param filter The server's filter.
+/// @param nowMs The time now, in millis.
+void NtpFilterServer(NtpServerFilter *filter, uint32_t nowMs){
+	const NtpSample *best = nullptr;
+	for(uint8_t i = 0; i < NtpFilterSamples; i++){
+		const NtpSample *sample = &filter->samples[i];
+		if(!sample->valid || ((nowMs - sample->takenAtMs) > NtpSampleMaxAgeMs)){
+			continue;
+		}
+		if((best == nullptr) || (sample->delayUs < best->delayUs)){
+			best = sample;
+		}
+	}
+
+	filter->usable = (best != nullptr);
+	if(!filter->usable){
+		return;
+	}
+	filter->offsetUs = best->offsetUs;
+	filter->delayUs = best->delayUs;
+
+	double sumSquares = 0;
+	uint8_t count = 0;
+	for(uint8_t i = 0; i < NtpFilterSamples; i++){
+		const NtpSample *sample = &filter->samples[i];
+		if(!sample->valid || ((nowMs - sample->takenAtMs) > NtpSampleMaxAgeMs) || (sample == best)){
+			continue;
+		}
+		double difference = (double)(sample->offsetUs - best->offsetUs);
+		sumSquares += difference * difference;
+		count++;
+	}
+	filter->jitterUs = (count == 0) ? 0 : (int64_t)sqrt(sumSquares / count);
+}// End of NtpFilterServer()
+
+
+
+/// Sort the interval ends, low to high. Low ends go first on a tie, so touching intervals count as overlapping.
+/// @param ends The ends to sort.
+/// @param count The number of ends.
+void NtpSortEndpoints(NtpEndpoint *ends, uint8_t count){
+	for(uint8_t i = 1; i < count; i++){// Insertion sort, there are only a few
+		NtpEndpoint end = ends[i];
+		int8_t j = i - 1;
+		while((j >= 0) && ((ends[j].valueUs > end.valueUs) || ((ends[j].valueUs == end.valueUs) && (ends[j].type > end.type)))){
+			ends[j + 1] = ends[j];
+			j--;
+		}
+		ends[j + 1] = end;
+	}
+}// End of NtpSortEndpoints()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the NTP Filter
+//	*************************************************************************************************
+
+/// Clear a server's samples
+/// @param filter The server's filter.
+void NtpResetFilter(NtpServerFilter *filter){
+	for(uint8_t i = 0; i < NtpFilterSamples; i++){
+		filter->samples[i].valid = false;
+	}
+	filter->next = 0;
+	filter->reach = 0;
+	filter->offsetUs = 0;
+	filter->delayUs = 0;
+	filter->jitterUs = 0;
+	filter->usable = false;
+}// End of NtpResetFilter()
+
+
+
+/// Get the offset and delay from the four timestamps of an exchange with a server
+/// @param t1 When the request was sent, by our clock, in microseconds.
+/// @param t2 When the server got the request, by its clock.
+/// @param t3 When the server sent the reply, by its clock.
+/// @param t4 When the reply arrived, by our clock.
+/// @param offsetUs Set to how far the server's clock is ahead of ours.
+/// @param delayUs Set to the round trip delay.
+void NtpMeasure(int64_t t1, int64_t t2, int64_t t3, int64_t t4, int64_t *offsetUs, int64_t *delayUs){
+	*offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+	*delayUs = (t4 - t1) - (t3 - t2);
+	if(*delayUs < 0){// The clocks can't resolve it, so it was quicker than they can tell
+		*delayUs = 0;
+	}
+}// End of NtpMeasure()
+
+
+
+/// Add a sample from a server and update its filtered offset
+/// @param filter The server's filter.
+/// @param offsetUs How far the server's clock is ahead of ours.
+/// @param delayUs The round trip delay.
+/// @param nowMs The time now, in millis.
+void NtpAddSample(NtpServerFilter *filter, int64_t offsetUs, int64_t delayUs, uint32_t nowMs){
+	NtpSample *sample = &filter->samples[filter->next];
+	sample->offsetUs = offsetUs;
+	sample->delayUs = delayUs;
+	sample->takenAtMs = nowMs;
+	sample->valid = true;
+	filter->next = (filter->next + 1) % NtpFilterSamples;
+	filter->reach = (filter->reach << 1) | 1;
+
+	NtpFilterServer(filter, nowMs);
+}// End of NtpAddSample()
+
+
+
+/// Note that a server didn't answer a poll
+/// @param filter The server's filter.
+/// @param nowMs The time now, in millis, to age out old samples.
+void NtpMissedPoll(NtpServerFilter *filter, uint32_t nowMs){
+	filter->reach <<= 1;
+	NtpFilterServer(filter, nowMs);
+}// End of NtpMissedPoll()
+
+
+
+/// Move all the samples after our clock has been corrected, so they are relative to the new clock
+/// @param filters The servers' filters.
+/// @param count The number of servers.
+/// @param correctionUs How far our clock was moved forward.
+void NtpShiftSamples(NtpServerFilter *filters, uint8_t count, int64_t correctionUs){
+	for(uint8_t i = 0; i < count; i++){
+		for(uint8_t j = 0; j < NtpFilterSamples; j++){
+			filters[i].samples[j].offsetUs -= correctionUs;
+		}
+		filters[i].offsetUs -= correctionUs;
+	}
+}// End of NtpShiftSamples()
+
+
+
+/// Pick the servers that agree with each other and combine their offsets
+/// @param filters The servers' filters.
+/// @param count The number of servers, no more than NtpMaxServers.
+/// @return The combined offset, and how many servers went into it.
+NtpSelection NtpSelect(const NtpServerFilter *filters, uint8_t count){
+	NtpSelection selection = {0, 0, 0, 0, false};
+
+	// Each server that has answered recently says the true offset is within its root distance of its own offset
+	const NtpServerFilter *candidates[NtpMaxServers];
+	NtpEndpoint ends[NtpMaxServers * 2];
+	for(uint8_t i = 0; (i < count) && (i < NtpMaxServers); i++){
+		if(!filters[i].usable || (filters[i].reach == 0)){
+			continue;
+		}
+		int64_t distance = NtpRootDistance(&filters[i]);
+		ends[selection.candidates * 2] = {filters[i].offsetUs - distance, -1};
+		ends[selection.candidates * 2 + 1] = {filters[i].offsetUs + distance, 1};
+		candidates[selection.candidates++] = &filters[i];
+	}
+	if(selection.candidates == 0){
+		return selection;
+	}
+	NtpSortEndpoints(ends, selection.candidates * 2);
+
+	// Find the smallest interval that a majority of the intervals overlap, allowing for as few falsetickers as possible
+	int64_t lowUs = 0;
+	int64_t highUs = 0;
+	bool found = false;
+	for(uint8_t falsetickers = 0; (2 * falsetickers < selection.candidates) && !found; falsetickers++){
+		uint8_t needed = selection.candidates - falsetickers;
+		bool lowFound = false;
+		bool highFound = false;
+
+		int8_t overlapping = 0;
+		for(uint8_t i = 0; i < selection.candidates * 2; i++){// Go up from the bottom until enough intervals have started
+			overlapping -= ends[i].type;
+			if(overlapping >= needed){
+				lowUs = ends[i].valueUs;
+				lowFound = true;
+				break;
+			}
+		}
+
+		overlapping = 0;
+		for(int8_t i = selection.candidates * 2 - 1; i >= 0; i--){// Go down from the top until enough intervals have ended
+			overlapping += ends[i].type;
+			if(overlapping >= needed){
+				highUs = ends[i].valueUs;
+				highFound = true;
+				break;
+			}
+		}
+
+		found = lowFound && highFound && (lowUs <= highUs);
+	}
+	if(!found){// The servers don't agree, so none of them can be trusted
+		return selection;
+	}
+
+	// Average the servers whose intervals reach the majority's, weighted by how close they are to the true time
+	double weightedSum = 0;
+	double weights = 0;
+	int64_t bestDistance = INT64_MAX;
+	const NtpServerFilter *survivors[NtpMaxServers];
+	for(uint8_t i = 0; i < selection.candidates; i++){
+		int64_t distance = NtpRootDistance(candidates[i]);
+		if(((candidates[i]->offsetUs + distance) < lowUs) || ((candidates[i]->offsetUs - distance) > highUs)){// A falseticker
+			continue;
+		}
+		double weight = 1.0 / (double)distance;
+		weightedSum += weight * (double)candidates[i]->offsetUs;
+		weights += weight;
+		if(distance < bestDistance){
+			bestDistance = distance;
+		}
+		survivors[selection.survivors++] = candidates[i];
+	}
+	selection.offsetUs = (int64_t)(weightedSum / weights);
+
+	// The uncertainty is the best server's distance, plus how much the survivors disagree with each other
+	double sumSquares = 0;
+	for(uint8_t i = 0; i < selection.survivors; i++){
+		double difference = (double)(survivors[i]->offsetUs - selection.offsetUs);
+		sumSquares += difference * difference;
+	}
+	selection.uncertaintyUs = bestDistance + (int64_t)sqrt(sumSquares / selection.survivors);
+	selection.valid = true;
+	return selection;
+}// End of NtpSelect()
@@ -0,0 +1,111 @@
+// The clock filter and selection for the NTP client, after the ones in RFC 5905 but cut down for a handful of servers.
+// Each server keeps its last few samples, and the one with the lowest round trip delay is taken as that server's offset,
+// since it had the least time to pick up queuing delays. Then the servers are checked against each other: each one says the
+// true time is within its offset plus or minus its delay and jitter, and only the servers that agree with the majority are
+// averaged. A server that is far off (a falseticker) gets voted out instead of pulling the clock.
+// This has no Arduino code in it, so it can be tested on a computer.
+
+#pragma once // Include this file only once
+
+#include <stdint.h>
+
+
+//	*************************************************************************************************
+//	Shared Constants for the NTP Filter
+//	*************************************************************************************************
+
+const uint8_t NtpFilterSamples = 8;				// The samples kept per server
+const uint8_t NtpMaxServers = 4;				// The most servers the selection can handle
+const uint32_t NtpSampleMaxAgeMs = 3600000;		// Samples older than this aren't used
+const int64_t NtpMinDispersionUs = 500;			// Added to every server's error, for the resolution of the clocks
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Structs for the NTP Filter
+//	*************************************************************************************************
+
+// Struct to hold one measurement from a server
+typedef struct {
+	int64_t offsetUs;		// How far the server's clock is ahead of ours
+	int64_t delayUs;		// The round trip time, minus the time the server held the request
+	uint32_t takenAtMs;		// When the sample was taken, in millis
+	bool valid;				// If this slot has a sample in it
+} NtpSample;
+
+
+
+// Struct to hold the samples and filtered result for one server
+typedef struct {
+	NtpSample samples[NtpFilterSamples];	// The last few samples, oldest overwritten first
+	uint8_t next;							// The slot the next sample goes in
+	uint8_t reach;							// One bit per poll, 1 if the server answered. The newest poll is bit 0
+
+	int64_t offsetUs;						// The offset of the lowest delay sample
+	int64_t delayUs;						// The delay of that sample
+	int64_t jitterUs;						// The RMS difference between the samples' offsets and that offset
+	bool usable;							// If the server has a recent sample
+} NtpServerFilter;
+
+
+
+// Struct to hold the result of the selection across all the servers
+typedef struct {
+	int64_t offsetUs;		// The combined offset of the servers that agree
+	int64_t uncertaintyUs;	// How far off that offset could be
+	uint8_t candidates;		// The servers with recent samples
+	uint8_t survivors;		// The servers that agreed with the majority and were averaged
+	bool valid;				// If a majority of the servers agreed, so the offset can be used
+} NtpSelection;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the NTP Filter
+//	*************************************************************************************************
+
+/// Clear a server's samples
+/// @param filter The server's filter.
+void NtpResetFilter(NtpServerFilter *filter);
+
+
+/// Get the offset and delay from the four timestamps of an exchange with a server
+/// @param t1 When the request was sent, by our clock, in microseconds.
+/// @param t2 When the server got the request, by its clock.
+/// @param t3 When the server sent the reply, by its clock.
+/// @param t4 When the reply arrived, by our clock.
+/// @param offsetUs Set to how far the server's clock is ahead of ours.
+/// @param delayUs Set to the round trip delay.
+void NtpMeasure(int64_t t1, int64_t t2, int64_t t3, int64_t t4, int64_t *offsetUs, int64_t *delayUs);
+
+
+/// Add a sample from a server and update its filtered offset
+/// @param filter The server's filter.
+/// @param offsetUs How far the server's clock is ahead of ours.
+/// @param delayUs The round trip delay.
+/// @param nowMs The time now, in millis.
+void NtpAddSample(NtpServerFilter *filter, int64_t offsetUs, int64_t delayUs, uint32_t nowMs);
+
+
+/// Note that a server didn't answer a poll
+/// @param filter The server's filter.
+/// @param nowMs The time now, in millis, to age out old samples.
+void NtpMissedPoll(NtpServerFilter *filter, uint32_t nowMs);
+
+
+/// Move all the samples after our clock has been corrected, so they are relative to the new clock
+/// @param filters The servers' filters.
+/// @param count The number of servers.
+/// @param correctionUs How far our clock was moved forward.
+void NtpShiftSamples(NtpServerFilter *filters, uint8_t count, int64_t correctionUs);
+
+
+/// Pick the servers that agree with each other and combine their offsets
+/// @param filters The servers' filters.
+/// @param count The number of servers, no more than NtpMaxServers.
+/// @return The combined offset, and how many servers went into it.
+NtpSelection NtpSelect(const NtpServerFilter *filters, uint8_t count);
@@ -1,8 +1,15 @@
 // Code to manage the blocks
 
 #include <Arduino.h>
+#include <TimeLib.h>
 
 #include "BlockManager.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "FaceLayout.h"
+#include "StressTest.h"
+#include "UsageCounters.h"
+#include "PowerManager.h"
 
 
 //	*************************************************************************************************
@@ -25,6 +32,32 @@
 //	Local Variables for the block management code
 //	*************************************************************************************************
 
+// All the blocks on the clock, in BlockType order. The second digits are split over two blocks each, which share a column
+// and swap between the display row and the storage rows. Paired blocks going into the same row lets both be swapped at once.
+// Which digits are on which faces is in BlockDigitFaces (FaceLayout.h), and InitBlocks() sets the values of face 0.
+Block blocks[NUM_BLOCKS] = {
+//	 blockType,					value,		face,	stored,	stepsPerFace,							column,						storageRow
+	{HOURS_FIRST_DIGIT,			BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		HOURS_FIRST_DIGIT_COLUMN,	MIDDLE_ROW},
+	{HOURS_SECOND_DIGIT_ONE,	BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		HOURS_SECOND_DIGIT_COLUMN,	MIDDLE_ROW},
+	{HOURS_SECOND_DIGIT_TWO,	BLANK_FACE,	0,		true,	DISPLAY_STEPS_PER_REV / MAX_FACES,		HOURS_SECOND_DIGIT_COLUMN,	BACK_ROW},
+	{MINS_FIRST_DIGIT,			BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		MINS_FIRST_DIGIT_COLUMN,	MIDDLE_ROW},
+	{MINS_SECOND_DIGIT_ONE,		BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		MINS_SECOND_DIGIT_COLUMN,	MIDDLE_ROW},
+	{MINS_SECOND_DIGIT_TWO,		BLANK_FACE,	0,		true,	DISPLAY_STEPS_PER_REV / MAX_FACES,		MINS_SECOND_DIGIT_COLUMN,	BACK_ROW},
+#if SHOW_SECONDS
+	{SECS_FIRST_DIGIT,			BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		SECS_FIRST_DIGIT_COLUMN,	MIDDLE_ROW},
+	{SECS_SECOND_DIGIT_ONE,		BLANK_FACE,	0,		false,	DISPLAY_STEPS_PER_REV / MAX_FACES,		SECS_SECOND_DIGIT_COLUMN,	MIDDLE_ROW},
+	{SECS_SECOND_DIGIT_TWO,		BLANK_FACE,	0,		true,	DISPLAY_STEPS_PER_REV / MAX_FACES,		SECS_SECOND_DIGIT_COLUMN,	BACK_ROW},
+#endif
+};
+
+
+time_t lastBlockUpdate = 0;		// The time the blocks were last set for
+bool blocksChanged = true;		// If a swap has finished since the blocks were last set, so they need setting again
+uint32_t swappingColumns = 0;	// The columns with a swap in progress, built with BLOCK_STEPPER_MASK()
+
+const time_t BlockSwapSeconds = 8;	// About how long a swap takes. stress_sim averages 8.0 s
+
+
 
 
 
@@ -33,6 +66,137 @@
 //	Local Functions for the block management code
 //	*************************************************************************************************
 
+/// Get the digit a column should show at a time
+/// @param column The column.
+/// @param t The time.
+/// @return The digit.
+uint8_t ColumnDigit(BlockColumn column, time_t t){
+	switch(column){
+		case HOURS_FIRST_DIGIT_COLUMN:
+			return hour(t) / 10;
+		case HOURS_SECOND_DIGIT_COLUMN:
+			return hour(t) % 10;
+		case MINS_FIRST_DIGIT_COLUMN:
+			return minute(t) / 10;
+		case MINS_SECOND_DIGIT_COLUMN:
+			return minute(t) % 10;
+#if SHOW_SECONDS
+		case SECS_FIRST_DIGIT_COLUMN:
+			return second(t) / 10;
+		case SECS_SECOND_DIGIT_COLUMN:
+			return second(t) % 10;
+#endif
+		default:
+			return 0;
+	}
+}// End of ColumnDigit()
+
+
+
+/// Get how often a column's digit can change
+/// @param column The column.
+/// @return The period in seconds.
+time_t ColumnPeriod(BlockColumn column){
+	switch(column){
+		case HOURS_FIRST_DIGIT_COLUMN:
+		case HOURS_SECOND_DIGIT_COLUMN:
+			return SECS_PER_HOUR;
+		case MINS_FIRST_DIGIT_COLUMN:
+		case MINS_SECOND_DIGIT_COLUMN:
+			return SECS_PER_MIN;
+		default:
+			return 1;
+	}
+}// End of ColumnPeriod()
+
+
+
+/// Get the next digit a column will show after a time
+/// @param column The column.
+/// @param t The time.
+/// @return The digit the column changes to next.
+uint8_t NextColumnDigit(BlockColumn column, time_t t){
+	time_t period = ColumnPeriod(column);
+	uint8_t digit = ColumnDigit(column, t);
+	time_t next = t - (t % period);
+	for(uint8_t i = 0; i < 60; i++){// Every column changes within 24 of its periods
+		next += period;
+		uint8_t nextDigit = ColumnDigit(column, next);
+		if(nextDigit != digit){
+			return nextDigit;
+		}
+	}
+	return digit;
+}// End of NextColumnDigit()
+
+
+
+/// Get when a displayed block will next need to be swapped out, which is when its column changes to a digit on its partner
+/// @param block The displayed block.
+/// @param t The time.
+/// @return The time of the swap, t if it is due now, or 0 if the column never leaves the block.
+time_t NextSwapTime(Block *block, time_t t){
+	if(GetDigitFace(block, ColumnDigit(block->column, t)) < 0){
+		return t;
+	}
+
+	time_t period = ColumnPeriod(block->column);
+	time_t next = t - (t % period);
+	for(uint8_t i = 0; i < 60; i++){// Every column goes through all its digits within 24 of its periods
+		next += period;
+		if(GetDigitFace(block, ColumnDigit(block->column, next)) < 0){
+			return next;
+		}
+	}
+	return 0;
+}// End of NextSwapTime()
+
+
+
+/// Check if a displayed block will sit still until it is swapped out. That is once it is on face 0, where it gets stored
+/// from, and the column's next digit is on its partner.
+/// @param block The displayed block.
+/// @param t The time.
+/// @return True if the block won't rotate again before its swap.
+bool ColumnIdleUntilSwap(Block *block, time_t t){
+	if(block->currentFace != 0){// Still has to turn, maybe once the Gantry is out of the way
+		return false;
+	}
+	uint8_t digit = ColumnDigit(block->column, t);
+	if(GetDigitFace(block, digit) < 0){// The swap is due now
+		return true;
+	}
+	return (GetDigitFace(block, digit) == 0) && (GetDigitFace(block, NextColumnDigit(block->column, t)) < 0);
+}// End of ColumnIdleUntilSwap()
+
+
+
+/// Tell the Gantry which swap is coming next, and if its column will sit still until then. The fastest changing column
+/// with two blocks always swaps first, so that is the one the Gantry should wait for. The Power Manager is told when the
+/// first swap of any column is, so the Gantry drivers are only brought back to full power before a swap.
+/// @param t The time.
+void PlanUpcomingSwap(time_t t){
+	bool planned = false;
+	time_t swapTime = 0;
+	for(int8_t i = NUM_COLUMNS - 1; i >= 0; i--){
+		Block *block = GetDisplayedBlock((BlockColumn)i);
+		if((block == nullptr) || (GetPartnerBlock(block) == nullptr)){
+			continue;
+		}
+
+		if(!planned){
+			PlanNextSwap(block, nullptr, !StressTestRunning() && ColumnIdleUntilSwap(block, t));	// The stress test turns blocks to any face at any time
+			planned = true;
+		}
+		time_t blockSwapTime = NextSwapTime(block, t);
+		if((blockSwapTime != 0) && ((swapTime == 0) || (blockSwapTime < swapTime))){
+			swapTime = blockSwapTime;
+		}
+	}
+
+	SetNextMotionTime(StressTestRunning() ? 0 : swapTime);	// The stress test swaps whenever it is ready, so leave it to the default
+}// End of PlanUpcomingSwap()
+
 
 
 
@@ -43,7 +207,10 @@
 
 /// Initialize the blocks
 void InitBlocks(){
-
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){// The blocks start on face 0, where they are stored
+		blocks[i].currentFace = 0;
+		blocks[i].currentValue = GetFaceDigit(&blocks[i], 0);
+	}
 }
 
 
@@ -52,4 +219,163 @@ void InitBlocks(){
 /// @return True if all the blocks are present, false otherwise.
 bool VerifyBlocks(){
 	
-}
\ No newline at end of file
+}
+
+
+
+/// Get one of the blocks
+/// @param type The block to get.
+/// @return The block, or nullptr if the type is not a block.
+Block *GetBlock(BlockType type){
+	if(type >= NUM_BLOCKS){
+		return nullptr;
+	}
+	return &blocks[type];
+}// End of GetBlock()
+
+
+
+/// Get the face a digit is on
+/// @param block The block.
+/// @param digit The digit, 0 to 9.
+/// @return The face, or -1 if the digit isn't on the block.
+int8_t GetDigitFace(const Block *block, uint8_t digit){
+	if(digit > 9){
+		return -1;
+	}
+	return BlockDigitFaces[block->blockType][digit];
+}// End of GetDigitFace()
+
+
+
+/// Get the digit on a face
+/// @param block The block.
+/// @param face The face, 0 to MAX_FACES - 1.
+/// @return The digit, or BLANK_FACE if the face has no digit.
+uint8_t GetFaceDigit(const Block *block, uint8_t face){
+	for(uint8_t digit = 0; digit <= 9; digit++){
+		if(BlockDigitFaces[block->blockType][digit] == face){
+			return digit;
+		}
+	}
+	return BLANK_FACE;
+}// End of GetFaceDigit()
+
+
+
+/// Get the block that is currently in the display row of a column
+/// @param column The column to check.
+/// @return The displayed block, or nullptr if no block in that column is displayed (it is being swapped).
+Block *GetDisplayedBlock(BlockColumn column){
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		if((blocks[i].column == column) && !blocks[i].isStored){
+			return &blocks[i];
+		}
+	}
+	return nullptr;
+}// End of GetDisplayedBlock()
+
+
+
+/// Get the block that shares a column with a block, and swaps places with it
+/// @param block The block to find the partner of.
+/// @return The partner block, or nullptr if the block is the only one in its column.
+Block *GetPartnerBlock(Block *block){
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		if((&blocks[i] != block) && (blocks[i].column == block->column)){
+			return &blocks[i];
+		}
+	}
+	return nullptr;
+}// End of GetPartnerBlock()
+
+
+
+/// Record that a block has been swapped with its partner by the Gantry. The block's storage flags are flipped.
+/// @param block The block that was taken out of the display row.
+void BlockSwapped(Block *block){
+	Block *partner = GetPartnerBlock(block);
+	if(partner == nullptr){
+		return;
+	}
+	block->isStored = true;
+	partner->isStored = false;
+	CountBlockMove(block->blockType);
+	CountBlockMove(partner->blockType);
+
+	swappingColumns &= ~BLOCK_STEPPER_MASK(block->column);
+	blocksChanged = true;
+	PlanUpcomingSwap(now());	// Before the Gantry parks, so it parks for the next swap
+}// End of BlockSwapped()
+
+
+
+/// Set the blocks to show the current time. Each column is rotated to the right face, and any column that needs the
+/// other block has it swapped in. This only does anything once a second (or once a swap finishes). A swap takes about
+/// 8 seconds, so the seconds ones digit, which needs two swaps every 10 seconds, can't keep up: a swap is skipped
+/// if the column would need its old block back before it is done, and the column keeps showing its last digit until the
+/// next swap that is worth making. This function will be called in the main loop.
+void UpdateBlocks(){
+	time_t t = now();
+	if((t == lastBlockUpdate) && !blocksChanged){
+		return;
+	}
+	lastBlockUpdate = t;
+	blocksChanged = false;
+
+	Block *swapBlocks[2] = {nullptr, nullptr};	// The blocks to swap out. Up to 2 can be swapped at once if they go to the same row
+	for(uint8_t i = 0; i < NUM_COLUMNS; i++){
+		BlockColumn column = (BlockColumn)i;
+		if(swappingColumns & BLOCK_STEPPER_MASK(column)){// Leave it alone until the swap is done
+			continue;
+		}
+
+		Block *block = GetDisplayedBlock(column);
+		if(block == nullptr){
+			continue;
+		}
+
+		uint8_t digit = ColumnDigit(column, t);
+		int8_t face = GetDigitFace(block, digit);
+		if(face >= 0){// This block has the digit
+			if((block->currentFace != face) && GantryClearOfColumn(column)){// Otherwise try again once the Gantry is out of the way
+				RotateToFace(column, block, face);
+			}
+			continue;
+		}
+
+		// The other block has the digit. Leave this one showing its last digit if the column would be back on it before a swap
+		// could be done, which only happens with the seconds
+		if(GetDigitFace(block, ColumnDigit(column, t + BlockSwapSeconds)) >= 0){
+			continue;
+		}
+
+		// Turn this one back to face 0 so it gets stored, and the new one gets placed, lined up
+		if(block->currentFace != 0){
+			if(!GantryClearOfColumn(column)){// Try again once the Gantry is out of the way
+				continue;
+			}
+			RotateToFace(column, block, 0);
+		}
+		if(swapBlocks[0] == nullptr){
+			swapBlocks[0] = block;
+		}else if((swapBlocks[1] == nullptr) && (swapBlocks[0]->storageRow == block->storageRow)){
+			swapBlocks[1] = block;
+		}
+	}
+
+	PlanUpcomingSwap(t);	// After the rotations are started, so the Gantry knows if the column it waits over has stopped moving
+	if(swapBlocks[0] == nullptr){
+		return;
+	}
+	GantryState state = GetGantryState();
+	if((state != GANTRY_IDLE) && (state != GANTRY_PARKING)){// Try again next second
+		return;
+	}
+
+	SwapBlocks(swapBlocks[0], swapBlocks[1]);
+	swappingColumns |= BLOCK_STEPPER_MASK(swapBlocks[0]->column);
+	if(swapBlocks[1] != nullptr){
+		swappingColumns |= BLOCK_STEPPER_MASK(swapBlocks[1]->column);
+	}
+}// End of UpdateBlocks()
\ No newline at end of file
@@ -43,4 +43,49 @@ void InitBlocks();
 
 /// Verify that all the blocks are present.
 /// @return True if all the blocks are present, false otherwise.
-bool VerifyBlocks();
\ No newline at end of file
+bool VerifyBlocks();
+
+
+/// Get one of the blocks
+/// @param type The block to get.
+/// @return The block, or nullptr if the type is not a block.
+Block *GetBlock(BlockType type);
+
+
+/// Get the face a digit is on
+/// @param block The block.
+/// @param digit The digit, 0 to 9.
+/// @return The face, or -1 if the digit isn't on the block.
+int8_t GetDigitFace(const Block *block, uint8_t digit);
+
+
+/// Get the digit on a face
+/// @param block The block.
+/// @param face The face, 0 to MAX_FACES - 1.
+/// @return The digit, or BLANK_FACE if the face has no digit.
+uint8_t GetFaceDigit(const Block *block, uint8_t face);
+
+
+/// Get the block that is currently in the display row of a column
+/// @param column The column to check.
+/// @return The displayed block, or nullptr if no block in that column is displayed (it is being swapped).
+Block *GetDisplayedBlock(BlockColumn column);
+
+
+/// Get the block that shares a column with a block, and swaps places with it
+/// @param block The block to find the partner of.
+/// @return The partner block, or nullptr if the block is the only one in its column.
+Block *GetPartnerBlock(Block *block);
+
+
+/// Record that a block has been swapped with its partner by the Gantry. The block's storage flags are flipped.
+/// @param block The block that was taken out of the display row.
+void BlockSwapped(Block *block);
+
+
+/// Set the blocks to show the current time. Each column is rotated to the right face, and any column that needs the
+/// other block has it swapped in. This only does anything once a second (or once a swap finishes). A swap takes about
+/// 8 seconds, so the seconds ones digit, which needs two swaps every 10 seconds, can't keep up: a swap is skipped
+/// if the column would need its old block back before it is done, and the column keeps showing its last digit until the
+/// next swap that is worth making. This function will be called in the main loop.
+void UpdateBlocks();
\ No newline at end of file
@@ -4,8 +4,12 @@
 
 #include <Arduino.h>
 
+#include "Config.h"
+
 
 #define MAX_FACES 6 // The maximum number of faces on one number block
+#define DISPLAY_STEPS_PER_REV 2048 // The number of steps per revolution of the display steppers
+#define BLANK_FACE 0xFF // The value of a face with no digit on it
 
 
 //	*************************************************************************************************
@@ -20,6 +24,11 @@ typedef enum {
 	MINS_FIRST_DIGIT,
 	MINS_SECOND_DIGIT_ONE,
 	MINS_SECOND_DIGIT_TWO,
+#if SHOW_SECONDS
+	SECS_FIRST_DIGIT,
+	SECS_SECOND_DIGIT_ONE,
+	SECS_SECOND_DIGIT_TWO,
+#endif
 	NUM_BLOCKS // Number of blocks
 } BlockType;
 
@@ -31,6 +40,10 @@ typedef enum {
 	HOURS_SECOND_DIGIT_COLUMN,
 	MINS_FIRST_DIGIT_COLUMN,
 	MINS_SECOND_DIGIT_COLUMN,
+#if SHOW_SECONDS
+	SECS_FIRST_DIGIT_COLUMN,
+	SECS_SECOND_DIGIT_COLUMN,
+#endif
 	NUM_COLUMNS // 	 of columns
 } BlockColumn;
 
@@ -60,12 +73,10 @@ typedef enum {
 // Struct to hold the information of a block
 typedef struct {
 	const BlockType blockType;					// The type of the block
-	uint8_t currentValue;						// The current value of the block
+	uint8_t currentValue;						// The current value of the block, or BLANK_FACE
+	uint8_t currentFace;						// The face the block is turned to. Face 0 is the one it is stored on
 	bool isStored;								// If the block is currently stored
-	const uint8_t numFaces;						// The number of faces on the block
-	const uint8_t stepsPerFace;					// The number of steps per face
-	const uint8_t minValue;						// The minimum value of the block
-	const uint8_t maxValue;						// The maximum value of the block
+	const uint16_t stepsPerFace;				// The number of steps per face
 	const BlockColumn column;					// The column where the block belongs
 	const BlockRow storageRow;					// The row where the block gets stored
 } Block;	
\ No newline at end of file
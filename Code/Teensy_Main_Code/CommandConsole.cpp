@@ -0,0 +1,475 @@
+// Code for the serial command console. Characters are moved from serial into a ring buffer every pass of the main loop,
+// and parsed a few at a time into a line. Once a full line is in, it is split into words in place and looked up in the
+// command table. Nothing is allocated, and nothing here waits on serial.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "CommandConsole.h"
+#include "BlockManager.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "DisplayCalibration.h"
+#include "SpiBus.h"
+#include "Lighting.h"
+#include "TimeManager.h"
+#include "ThermalModel.h"
+#include "StressTest.h"
+#include "InputCapture.h"
+#include "UsageCounters.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Command Console code
+//	*************************************************************************************************
+
+// Struct to hold one of the console commands
+typedef struct {
+	const char *name;								// The word that runs the command
+	uint8_t minArgs;								// The fewest words the command needs, including its name
+	uint16_t budgetUs;								// How long the command can take to run. It waits until no step is due for this long
+	void (*handler)(uint8_t argc, char *argv[]);	// The function that runs the command
+	const char *help;								// The usage of the command
+} ConsoleCommand;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Command Console code
+//	*************************************************************************************************
+
+// The characters received from serial, waiting to be parsed
+char consoleBuffer[ConsoleBufferSize];
+uint8_t consoleHead = 0;	// Where the next received character goes
+uint8_t consoleTail = 0;	// The next character to parse
+
+// The line being parsed
+char consoleLine[ConsoleLineSize];
+uint8_t consoleLineLength = 0;
+bool consoleLineTooLong = false;	// If characters were lost because the line was too long
+
+// The command waiting for a gap between steps to run
+char *consoleArgs[ConsoleMaxArgs];
+uint8_t consoleArgCount = 0;
+const ConsoleCommand *pendingCommand = nullptr;
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Command Console code
+//	*************************************************************************************************
+
+/// Parse a whole number, with an optional sign
+/// @param text The text to parse.
+/// @param value Where to put the number.
+/// @return True if the whole text was a number.
+bool ParseNumber(const char *text, int32_t *value){
+	bool negative = (*text == '-');
+	if((*text == '-') || (*text == '+')){
+		text++;
+	}
+	if(*text == '\0'){
+		return false;
+	}
+
+	int32_t result = 0;
+	for(; *text != '\0'; text++){
+		if((*text < '0') || (*text > '9')){
+			return false;
+		}
+		result = result * 10 + (*text - '0');
+	}
+
+	*value = negative ? -result : result;
+	return true;
+}// End of ParseNumber()
+
+
+
+/// Parse a number and make sure it is in a range, printing an error if it isn't
+/// @param text The text to parse.
+/// @param min The smallest allowed value.
+/// @param max The largest allowed value.
+/// @param value Where to put the number.
+/// @return True if the text was a number in the range.
+bool ParseArg(const char *text, int32_t min, int32_t max, int32_t *value){
+	if(!ParseNumber(text, value) || (*value < min) || (*value > max)){
+		SERIAL_PRINTF("Expected a number from %ld to %ld, got \"%s\"\n", min, max, text);
+		return false;
+	}
+	return true;
+}// End of ParseArg()
+
+
+
+// Jog the Gantry or a display stepper
+void JogCommand(uint8_t argc, char *argv[]){
+	int32_t steps;
+	if(strcmp(argv[1], "disp") == 0){// Jog a display stepper
+		int32_t column;
+		if((argc < 4) || !ParseArg(argv[2], 0, NUM_BLOCK_STEPPERS - 1, &column) || !ParseArg(argv[3], INT8_MIN, INT8_MAX, &steps)){
+			return;
+		}
+		if(!GantryClearOfColumn((BlockColumn)column)){
+			SERIAL_PRINTF("%s\n", "Gantry is over that column, try again once it has moved up");
+			return;
+		}
+		RotateSteps((BlockStepper)column, (int8_t)steps);
+		return;
+	}
+
+	GantryDirection dir = GANTRY_NO_DIR;
+	if(strcmp(argv[1], "up") == 0){
+		dir = GANTRY_UP;
+	}else if(strcmp(argv[1], "down") == 0){
+		dir = GANTRY_DOWN;
+	}else if(strcmp(argv[1], "fw") == 0){
+		dir = GANTRY_FW;
+	}else if(strcmp(argv[1], "bw") == 0){
+		dir = GANTRY_BW;
+	}else{
+		SERIAL_PRINTF("Unknown jog axis \"%s\"\n", argv[1]);
+		return;
+	}
+
+	if((argc < 3) || !ParseArg(argv[2], 1, UINT16_MAX, &steps)){
+		return;
+	}
+	if(!JogGantry(dir, (uint16_t)steps)){
+		SERIAL_PRINTF("%s\n", "Gantry is busy");
+	}
+}// End of JogCommand()
+
+
+
+// Swap displayed block(s) with their partners
+void SwapCommand(uint8_t argc, char *argv[]){
+	int32_t blockNums[2];
+	Block *swapBlocks[2] = {nullptr, nullptr};
+
+	for(uint8_t i = 0; i < (argc - 1) && i < 2; i++){
+		if(!ParseArg(argv[i + 1], 0, NUM_BLOCKS - 1, &blockNums[i])){
+			return;
+		}
+		swapBlocks[i] = GetBlock((BlockType)blockNums[i]);
+		if(swapBlocks[i]->isStored || (GetPartnerBlock(swapBlocks[i]) == nullptr)){
+			SERIAL_PRINTF("Block %ld is not a displayed block with a partner\n", blockNums[i]);
+			return;
+		}
+	}
+
+	if(GetGantryState() != GANTRY_IDLE){
+		SERIAL_PRINTF("%s\n", "Gantry is busy");
+		return;
+	}
+	SwapBlocks(swapBlocks[0], swapBlocks[1]);
+}// End of SwapCommand()
+
+
+
+// Rotate the block displayed in a column to a face
+void FaceCommand(uint8_t, char *argv[]){
+	int32_t column;
+	int32_t face;
+	if(!ParseArg(argv[1], 0, NUM_COLUMNS - 1, &column)){
+		return;
+	}
+
+	Block *block = GetDisplayedBlock((BlockColumn)column);
+	if(block == nullptr){
+		SERIAL_PRINTF("No block is displayed in column %ld\n", column);
+		return;
+	}
+	if(!ParseArg(argv[2], 0, MAX_FACES - 1, &face)){
+		return;
+	}
+	if(!GantryClearOfColumn((BlockColumn)column)){
+		SERIAL_PRINTF("%s\n", "Gantry is over that column, try again once it has moved up");
+		return;
+	}
+	RotateToFace((BlockStepper)column, block, (uint8_t)face);
+}// End of FaceCommand()
+
+
+
+// Measure the steps per revolution of display steppers, or print the calibration
+void CalCommand(uint8_t, char *argv[]){
+	if(strcmp(argv[1], "show") == 0){
+		PrintDisplayCalibration();
+		return;
+	}
+
+	uint32_t stepperMask = BLOCK_STEPPER_MASK(NUM_BLOCK_STEPPERS) - 1;
+	if(strcmp(argv[1], "all") != 0){
+		int32_t column;
+		if(!ParseArg(argv[1], 0, NUM_BLOCK_STEPPERS - 1, &column)){
+			return;
+		}
+		stepperMask = BLOCK_STEPPER_MASK(column);
+	}
+	StartDisplayCalibration(stepperMask);
+}// End of CalCommand()
+
+
+
+// Set the trim of a face of a block
+void TrimCommand(uint8_t, char *argv[]){
+	int32_t block;
+	int32_t face;
+	int32_t steps;
+	if(!ParseArg(argv[1], 0, NUM_BLOCKS - 1, &block) || !ParseArg(argv[2], 0, MAX_FACES - 1, &face) ||
+		!ParseArg(argv[3], -MaxFaceTrimSteps, MaxFaceTrimSteps, &steps)){
+		return;
+	}
+	SetFaceTrim((BlockType)block, (uint8_t)face, (int8_t)steps);
+}// End of TrimCommand()
+
+
+
+// Home the Gantry, unless it is in the middle of something
+void HomeCommand(uint8_t, char *[]){
+	GantryState state = GetGantryState();
+	if((state != GANTRY_IDLE) && (state != GANTRY_ERROR)){
+		SERIAL_PRINTF("%s\n", "Gantry is busy");
+		return;
+	}
+	HomeGantry();
+}// End of HomeCommand()
+
+
+
+// Get the time from the ESP32 now
+void SyncCommand(uint8_t, char *[]){
+	SyncTime();
+}// End of SyncCommand()
+
+
+
+// Print the state of everything
+void StatusCommand(uint8_t, char *[]){
+	PrintTimeStatus();
+	PrintGantryStatus();
+	PrintDisplayStepperStatus();
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		Block *block = GetBlock((BlockType)i);
+		SERIAL_PRINTF("Block %u: value %u, face %u, %s\n", i, block->currentValue, block->currentFace, block->isStored ? "stored" : "displayed");
+	}
+}// End of StatusCommand()
+
+
+
+// Print the SPI bus stats, and start counting again
+void SpiCommand(uint8_t, char *[]){
+	PrintSpiStats();
+	ResetSpiStats();
+}// End of SpiCommand()
+
+
+
+// Print the lighting frame stats
+void LightsCommand(uint8_t, char *[]){
+	PrintLightingStats();
+}// End of LightsCommand()
+
+
+
+// Print the estimated motor temperatures and the throttling
+void ThermalCommand(uint8_t, char *[]){
+	PrintThermalStatus();
+}// End of ThermalCommand()
+
+
+
+// Start, stop, or report on the swap stress test
+void StressCommand(uint8_t argc, char *argv[]){
+	if(strcmp(argv[1], "stop") == 0){
+		StopStressTest();
+		return;
+	}
+	if(strcmp(argv[1], "report") == 0){
+		PrintStressReport();
+		return;
+	}
+
+	int32_t iterations;
+	int32_t minutes = 0;
+	if(!ParseArg(argv[1], 0, INT32_MAX, &iterations)){
+		return;
+	}
+	if((argc > 2) && !ParseArg(argv[2], 0, 10080, &minutes)){
+		return;
+	}
+	if(!StartStressTest(iterations, minutes)){
+		SERIAL_PRINTF("%s\n", "Stress test is already running, or no limit was given");
+	}
+}// End of StressCommand()
+
+
+
+// Start, stop, send, or check on the input capture
+void CaptureCommand(uint8_t, char *argv[]){
+	if(strcmp(argv[1], "start") == 0){
+		StartInputCapture();
+	}else if(strcmp(argv[1], "stop") == 0){
+		StopInputCapture();
+	}else if(strcmp(argv[1], "send") == 0){
+		SendInputCapture();
+		return;
+	}else if(strcmp(argv[1], "status") != 0){
+		SERIAL_PRINTF("Unknown capture command \"%s\"\n", argv[1]);
+		return;
+	}
+	PrintInputCaptureStatus();
+}// End of CaptureCommand()
+
+
+
+// Print the lifetime usage counts, or save them once nothing is moving
+void UsageCommand(uint8_t argc, char *argv[]){
+	if((argc > 1) && (strcmp(argv[1], "save") == 0)){
+		SaveUsageCounters();
+		return;
+	}
+	PrintUsageCounters();
+}// End of UsageCommand()
+
+
+
+void HelpCommand(uint8_t argc, char *argv[]);
+
+// The commands the console knows
+const ConsoleCommand ConsoleCommands[] = {
+//	 name,		minArgs,	budgetUs,	handler,		help
+	{"jog",		3,			100,		JogCommand,		"jog <up|down|fw|bw> <steps> | jog disp <column> <steps>"},
+	{"swap",	2,			100,		SwapCommand,	"swap <block> [block]"},
+	{"face",	3,			100,		FaceCommand,	"face <column> <face>"},
+	{"home",	1,			100,		HomeCommand,	"home"},
+	{"cal",		2,			300,		CalCommand,		"cal <column|all> | cal show"},
+	{"trim",	4,			100,		TrimCommand,	"trim <block> <face> <steps>"},
+	{"sync",	1,			1500,		SyncCommand,	"sync"},
+	{"status",	1,			1000,		StatusCommand,	"status"},
+	{"spi",		1,			500,		SpiCommand,		"spi"},
+	{"lights",	1,			300,		LightsCommand,	"lights"},
+	{"thermal",	1,			300,		ThermalCommand,	"thermal"},
+	{"stress",	2,			1500,		StressCommand,	"stress <swaps> [minutes] | stress stop | stress report"},
+	{"capture",	2,			300,		CaptureCommand,	"capture <start|stop|send|status>"},
+	{"usage",	1,			1500,		UsageCommand,	"usage | usage save"},
+	{"help",	1,			500,		HelpCommand,	"help"}
+};
+const uint8_t NumConsoleCommands = sizeof(ConsoleCommands) / sizeof(ConsoleCommands[0]);
+
+
+
+// List the commands
+void HelpCommand(uint8_t, char *[]){
+	for(uint8_t i = 0; i < NumConsoleCommands; i++){
+		SERIAL_PRINTF("%s\n", ConsoleCommands[i].help);
+	}
+}// End of HelpCommand()
+
+
+
+// Split the finished line into words and find its command. Sets pendingCommand if the line is a valid command.
+void ParseConsoleLine(){
+	consoleArgCount = 0;
+	char *c = consoleLine;
+	while(*c != '\0'){
+		while(*c == ' ' || *c == '\t'){// Skip to the start of the next word
+			*c++ = '\0';
+		}
+		if(*c == '\0'){
+			break;
+		}
+		if(consoleArgCount == ConsoleMaxArgs){
+			SERIAL_PRINTF("Too many words, commands take at most %u\n", ConsoleMaxArgs);
+			return;
+		}
+		consoleArgs[consoleArgCount++] = c;
+		while((*c != '\0') && (*c != ' ') && (*c != '\t')){// Skip to the end of the word
+			c++;
+		}
+	}
+
+	if(consoleArgCount == 0){// Empty line
+		return;
+	}
+
+	for(uint8_t i = 0; i < NumConsoleCommands; i++){
+		if(strcmp(consoleArgs[0], ConsoleCommands[i].name) == 0){
+			if(consoleArgCount < ConsoleCommands[i].minArgs){
+				SERIAL_PRINTF("Usage: %s\n", ConsoleCommands[i].help);
+				return;
+			}
+			pendingCommand = &ConsoleCommands[i];
+			return;
+		}
+	}
+	SERIAL_PRINTF("Unknown command \"%s\", try help\n", consoleArgs[0]);
+}// End of ParseConsoleLine()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Command Console code
+//	*************************************************************************************************
+
+/// Initialize the command console
+void InitConsole(){
+	consoleHead = 0;
+	consoleTail = 0;
+	consoleLineLength = 0;
+	consoleLineTooLong = false;
+	pendingCommand = nullptr;
+}// End of InitConsole()
+
+
+
+/// Read and run commands from serial. Nothing here waits on serial, and a finished command is held until it can run
+/// without making the Gantry or display steppers late for a step. This function will be called in the main loop.
+void UpdateConsole(){
+	#if SERIAL_ENABLED
+		// Move whatever has come in into the ring buffer. Anything past a full buffer stays queued in the serial driver.
+		while((Serial.available() > 0) && (((consoleHead + 1) % ConsoleBufferSize) != consoleTail)){
+			consoleBuffer[consoleHead] = Serial.read();
+			consoleHead = (consoleHead + 1) % ConsoleBufferSize;
+		}
+
+		// Run the waiting command once there's enough time before the next step
+		if(pendingCommand != nullptr){
+			if((GetGantryStepSlackUs() < pendingCommand->budgetUs) || (GetDisplayStepperSlackUs() < pendingCommand->budgetUs)){
+				return;
+			}
+			pendingCommand->handler(consoleArgCount, consoleArgs);
+			pendingCommand = nullptr;
+			return;
+		}
+
+		// Parse a few characters
+		for(uint8_t i = 0; (i < ConsoleBytesPerPass) && (consoleTail != consoleHead); i++){
+			char c = consoleBuffer[consoleTail];
+			consoleTail = (consoleTail + 1) % ConsoleBufferSize;
+
+			if((c == '\n') || (c == '\r')){// End of the line
+				consoleLine[consoleLineLength] = '\0';
+				if(consoleLineTooLong){
+					SERIAL_PRINTF("Command too long, the limit is %u characters\n", ConsoleLineSize - 1);
+				}else{
+					ParseConsoleLine();
+				}
+				consoleLineLength = 0;
+				consoleLineTooLong = false;
+				return;// Only one line per pass, so the command runs before the next one is parsed
+			}
+
+			if(consoleLineLength < (ConsoleLineSize - 1)){
+				consoleLine[consoleLineLength++] = c;
+			}else{
+				consoleLineTooLong = true;
+			}
+		}
+	#endif
+}// End of UpdateConsole()
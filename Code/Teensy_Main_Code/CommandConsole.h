@@ -0,0 +1,48 @@
+// Header for the serial command console. Commands are typed over USB serial to drive the clock by hand, for testing swaps,
+// jogging the Gantry and display steppers, and checking on the state of things without reflashing.
+//
+// Commands (numbers are the enum values from Blocks.h):
+//	jog <up|down|fw|bw> <steps>		Jog the Gantry some full steps
+//	jog disp <column> <steps>		Jog a display stepper some steps (negative for counter clockwise)
+//	swap <block> [block]			Swap displayed block(s) with their partners
+//	face <column> <face>			Rotate the block displayed in a column to a face
+//	home							Home (and square) the Gantry
+//	cal <column|all>				Measure the steps per revolution of display steppers, and save them
+//	cal show						Print the display stepper calibration
+//	trim <block> <face> <steps>		Set how far a face of a block is past its even spacing, and save it
+//	sync							Get the time from the ESP32 now
+//	status							Print the state of the Gantry and display steppers
+//	spi								Print how much each client has used the SPI bus, then reset the counts
+//	lights							Print how long the lighting frames take to draw
+//	capture <start|stop|send|status>	Record the inputs, or send the recording through the log for replay_sim
+//	help							List the commands
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Command Console code
+//	*************************************************************************************************
+
+const uint8_t ConsoleBufferSize = 128;		// The size of the buffer for characters waiting to be parsed
+const uint8_t ConsoleLineSize = 48;			// The longest command that can be typed
+const uint8_t ConsoleMaxArgs = 4;			// The most words in a command, including the command itself
+const uint8_t ConsoleBytesPerPass = 16;		// The most characters parsed on one pass of the main loop
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Command Console code
+//	*************************************************************************************************
+
+/// Initialize the command console
+void InitConsole();
+
+
+/// Read and run commands from serial. Nothing here waits on serial, and a finished command is held until it can run
+/// without making the Gantry or display steppers late for a step. This function will be called in the main loop.
+void UpdateConsole();
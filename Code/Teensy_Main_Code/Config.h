@@ -3,7 +3,11 @@
 #pragma once // Include this file only once
 
 
+#define SHOW_SECONDS 0 // Add the seconds columns to the clock (HH:MM:SS instead of HH:MM)
+
+
 #define SERIAL_ENABLED 1 // Enable Serial Debugging
+#define DEFERRED_LOGGING 1 // Send LOG_MSG() messages as binary records decoded on the computer, instead of formatting them on the Teensy
 
 
 #if SERIAL_ENABLED	// Macro to print to serial if serial is enabled, otherwise do nothing
@@ -14,4 +18,13 @@
 
 
 
-#define SD_LOGGING 0 // Enable SD Logging
\ No newline at end of file
+#define FIXED_POINT_CHECKS 0 // Check the stepper position math for overflow (for debugging, it slows down every step)
+
+
+#define SD_LOGGING 0 // Enable SD Logging
+
+
+#define CAPTURE_INPUTS_AT_BOOT 0 // Record the inputs from power on, so a run can be replayed on a computer with Code/Tools/replay_sim.cpp
+
+
+#define STATUS_DISPLAY 1 // Enable the status LCD
\ No newline at end of file
@@ -0,0 +1,167 @@
+// Code for deferred logging. Records are copied into a ring buffer by LOG_MSG(), and FlushLog() COBS encodes them and
+// sends them over USB serial whenever the serial port has room. Each frame ends with a 0 byte, which COBS guarantees
+// doesn't show up anywhere else in the frame.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "DeferredLog.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Deferred Log code
+//	*************************************************************************************************
+
+// The formats of the messages, only kept when they get printed on the Teensy
+#if !DEFERRED_LOGGING
+	#define LOG_MESSAGE_FORMAT(id, format) format,
+	const char *const LogFormats[NUM_LOG_MESSAGES] = {
+		LOG_MESSAGE_LIST(LOG_MESSAGE_FORMAT)
+	};
+	#undef LOG_MESSAGE_FORMAT
+#endif
+
+
+// The ring buffer for the records. Each record is stored as a length byte followed by the record.
+uint8_t logBuffer[LogBufferSize];
+uint16_t logHead = 0;			// Where the next record gets written
+uint16_t logTail = 0;			// Where the next record to send starts
+uint16_t logReservedHead = 0;	// Where the record being written ends
+
+uint32_t logDropped = 0;		// The number of records dropped because the buffer was full
+
+const uint8_t LogMaxRecordSize = sizeof(uint32_t) + sizeof(uint16_t) + LogMaxArgs * sizeof(uint32_t);	// The largest record
+uint8_t logFrame[LogMaxRecordSize + 2 + 1];		// A COBS encoded record. COBS adds at most 1 byte per 254, plus 1, plus the 0 delimiter
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Deferred Log code
+//	*************************************************************************************************
+
+/// Get the free space in the log buffer
+/// @return The number of bytes that can still be written.
+uint16_t LogFreeSpace(){
+	return (logTail + LogBufferSize - logHead - 1) % LogBufferSize;
+}// End of LogFreeSpace()
+
+
+
+/// COBS encode a record into logFrame, including the 0 delimiter
+/// @param length The length of the record, which starts at logTail + 1 in the ring buffer.
+/// @return The length of the frame.
+uint8_t EncodeLogFrame(uint8_t length){
+	uint8_t codeIndex = 0;	// Where the current code byte goes
+	uint8_t frameLength = 1;
+	uint8_t code = 1;
+
+	for(uint8_t i = 0; i < length; i++){
+		uint8_t byte = logBuffer[(logTail + 1 + i) % LogBufferSize];
+		if(byte == 0){// End the current block
+			logFrame[codeIndex] = code;
+			codeIndex = frameLength++;
+			code = 1;
+		}else{
+			logFrame[frameLength++] = byte;
+			code++;
+		}
+	}
+	logFrame[codeIndex] = code;
+	logFrame[frameLength++] = 0;	// Frame delimiter
+
+	return frameLength;
+}// End of EncodeLogFrame()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Deferred Log code
+//	*************************************************************************************************
+
+/// Reserve space for a record in the log buffer
+/// @param length The length of the record.
+/// @return A pointer to write the record to, or nullptr if the buffer is full and the record has to be dropped.
+uint8_t *LogReserve(uint8_t length){
+	// Records are kept in one piece so they can be written with a plain pointer, so skip to the start if it doesn't fit before the end
+	uint16_t start = logHead;
+	if((start + 1 + length) > LogBufferSize){
+		if(LogFreeSpace() < (LogBufferSize - start) + 1 + length){
+			logDropped++;
+			return nullptr;
+		}
+		logBuffer[start] = 0;	// A 0 length marks the rest of the buffer as unused
+		start = 0;
+	}else if(LogFreeSpace() < (1 + length)){
+		logDropped++;
+		return nullptr;
+	}
+
+	logBuffer[start] = length;
+	logReservedHead = (start + 1 + length) % LogBufferSize;
+	logHead = start;
+	return &logBuffer[start + 1];
+}// End of LogReserve()
+
+
+
+/// Finish a record that was reserved with LogReserve(), so it can be sent
+void LogCommit(){
+	logHead = logReservedHead;
+}// End of LogCommit()
+
+
+
+/// Check if the log buffer has room for any message right now, so a burst of messages can wait instead of being dropped
+/// @return True if the largest message would fit.
+bool LogHasRoom(){
+	// A record that doesn't fit before the end of the buffer skips the space left there, so allow for that too
+	return LogFreeSpace() >= 2 * (1 + LogMaxRecordSize);
+}// End of LogHasRoom()
+
+
+
+/// Send whatever records are waiting, as long as the serial port can take them without blocking.
+/// This function will be called in the main loop.
+void FlushLog(){
+	#if SERIAL_ENABLED && DEFERRED_LOGGING
+		if((logDropped > 0) && (LogFreeSpace() > LogMaxRecordSize)){// Let the computer know some messages were lost
+			uint32_t dropped = logDropped;
+			logDropped = 0;
+			LOG_MSG(LOG_DROPPED, dropped);
+		}
+
+		while(logTail != logHead){
+			uint8_t length = logBuffer[logTail];
+			if(length == 0){// Unused space at the end of the buffer
+				logTail = 0;
+				continue;
+			}
+
+			if(Serial.availableForWrite() < (length + 3)){// Don't block, the rest will go out next time
+				return;
+			}
+
+			uint8_t frameLength = EncodeLogFrame(length);
+			Serial.write(logFrame, frameLength);
+			logTail = (logTail + 1 + length) % LogBufferSize;
+		}
+	#endif
+}// End of FlushLog()
+
+
+
+/// Get the format of a log message. Only used when deferred logging is turned off and messages are printed right away.
+/// @param id The message.
+/// @return The printf format of the message.
+const char *LogFormat(LogMessageId id){
+	#if DEFERRED_LOGGING
+		(void)id;	// The formats aren't kept on the Teensy
+		return "";
+	#else
+		return LogFormats[id];
+	#endif
+}// End of LogFormat()
@@ -0,0 +1,120 @@
+// Header for the deferred logging code. Instead of formatting text on the Teensy, LOG_MSG() copies a message ID and the raw
+// argument bytes into a buffer, which gets COBS framed and sent over USB serial from the main loop. The text is rebuilt on
+// the computer by Code/Tools/log_decoder.py, using the formats in LogMessages.h.
+//
+// Each record is: [timestamp (micros, 4 bytes)][message ID (2 bytes)][arguments (4 bytes each)], all little endian.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "LogMessages.h"
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Deferred Log code
+//	*************************************************************************************************
+
+const uint16_t LogBufferSize = 1024;	// The size of the buffer the records are stored in until they are sent
+const uint8_t LogMaxArgs = 8;			// The most arguments a single message can have
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Deferred Log code
+//	*************************************************************************************************
+
+/// Reserve space for a record in the log buffer
+/// @param length The length of the record.
+/// @return A pointer to write the record to, or nullptr if the buffer is full and the record has to be dropped.
+uint8_t *LogReserve(uint8_t length);
+
+
+/// Finish a record that was reserved with LogReserve(), so it can be sent
+void LogCommit();
+
+
+/// Check if the log buffer has room for any message right now, so a burst of messages can wait instead of being dropped
+/// @return True if the largest message would fit.
+bool LogHasRoom();
+
+
+/// Send whatever records are waiting, as long as the serial port can take them without blocking.
+/// This function will be called in the main loop.
+void FlushLog();
+
+
+/// Get the format of a log message. Only used when deferred logging is turned off and messages are printed right away.
+/// @param id The message.
+/// @return The printf format of the message.
+const char *LogFormat(LogMessageId id);
+
+
+
+
+
+//	*************************************************************************************************
+//	Templates for packing the log arguments
+//	*************************************************************************************************
+
+/// Copy one argument into a record as 4 little endian bytes. Integers are sent as 32 bits, anything floating point as a float.
+/// @param record Where to write the argument. Moved past the argument.
+/// @param arg The argument.
+template <typename T>
+inline void LogPackArg(uint8_t *&record, T arg){
+	uint32_t word = (uint32_t)arg;
+	memcpy(record, &word, sizeof(word));
+	record += sizeof(word);
+}
+
+inline void LogPackArg(uint8_t *&record, float arg){
+	memcpy(record, &arg, sizeof(arg));
+	record += sizeof(arg);
+}
+
+inline void LogPackArg(uint8_t *&record, double arg){
+	LogPackArg(record, (float)arg);
+}
+
+
+/// Copy a log message into the buffer. Use LOG_MSG() instead of calling this directly.
+/// @param id The message.
+/// @param args The arguments of the message.
+template <typename... Args>
+inline void LogDeferred(LogMessageId id, Args... args){
+	static_assert(sizeof...(args) <= LogMaxArgs, "Too many arguments for a log message");
+
+	uint8_t *record = LogReserve(sizeof(uint32_t) + sizeof(uint16_t) + sizeof...(args) * sizeof(uint32_t));
+	if(record == nullptr){// Buffer is full, this one gets dropped and counted
+		return;
+	}
+
+	uint32_t timestamp = micros();
+	uint16_t messageId = id;
+	memcpy(record, &timestamp, sizeof(timestamp));
+	memcpy(record + sizeof(timestamp), &messageId, sizeof(messageId));
+	record += sizeof(timestamp) + sizeof(messageId);
+
+	(LogPackArg(record, args), ...);
+
+	LogCommit();
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	Macros for logging
+//	*************************************************************************************************
+
+#if SERIAL_ENABLED && DEFERRED_LOGGING	// Log a message without formatting it on the Teensy
+	#define LOG_MSG(id, ...) LogDeferred(id, ##__VA_ARGS__)
+#elif SERIAL_ENABLED					// Print the message right away
+	#define LOG_MSG(id, ...) Serial.printf(LogFormat(id), ##__VA_ARGS__)
+#else
+	#define LOG_MSG(id, ...) {}
+#endif
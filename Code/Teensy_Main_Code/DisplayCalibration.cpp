@@ -0,0 +1,236 @@
+// Code for the Display Calibration. A measurement homes a display stepper and goes on round until its home switch comes on
+// again, and the steps between the two edges are its true steps per revolution. The faces are spaced evenly over that
+// revolution, and each face of each block has a trim for blocks that aren't evenly indexed. The trims are set by hand with
+// the console's trim command, since the home switch only shows where a turn starts, not where the faces are. Both are kept in EEPROM, checked with a version
+// and a checksum so blank or old EEPROM falls back to the nominal DISPLAY_STEPS_PER_REV.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Config.h"
+#include "DeferredLog.h"
+#include "DisplayCalibration.h"
+#include "ShiftRegSteppers.h"
+#include "Gantry.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Display Calibration code
+//	*************************************************************************************************
+
+// The calibration as it is saved in EEPROM
+typedef struct __attribute__((packed)) {
+	uint16_t version;										// DisplayCalibrationVersion
+	uint16_t stepsPerRevolution[NUM_BLOCK_STEPPERS];		// The measured steps per revolution of each stepper
+	int8_t faceTrim[NUM_BLOCKS][MAX_FACES];					// How far each face of each block is past its even spacing, in steps
+	uint8_t checksum;										// The inverted sum of the bytes before it
+} DisplayCalibrationData;
+static_assert(sizeof(DisplayCalibrationData) <= DisplayCalibrationEepromSize, "The calibration doesn't fit in its EEPROM");
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Display Calibration code
+//	*************************************************************************************************
+
+DisplayCalibrationData calibration;		// The calibration in use
+bool calibrationSaved = true;			// If the calibration in use matches EEPROM
+uint32_t measuringMask = 0;				// The steppers being measured, built with BLOCK_STEPPER_MASK()
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Display Calibration code
+//	*************************************************************************************************
+
+/// Get the checksum of the calibration
+/// @param data The calibration.
+/// @return The inverted sum of the bytes before the checksum.
+uint8_t CalibrationChecksum(const DisplayCalibrationData *data){
+	uint8_t sum = 0;
+	for(size_t i = 0; i < offsetof(DisplayCalibrationData, checksum); i++){
+		sum += ((const uint8_t*)data)[i];
+	}
+	return ~sum;
+}// End of CalibrationChecksum()
+
+
+
+/// Check if a measured revolution is close enough to the nominal one to be believed
+/// @param steps The steps per revolution.
+/// @return True if it can be used.
+bool RevolutionValid(uint32_t steps){
+	return (steps >= (DISPLAY_STEPS_PER_REV - MaxRevolutionErrorSteps)) && (steps <= (DISPLAY_STEPS_PER_REV + MaxRevolutionErrorSteps));
+}// End of RevolutionValid()
+
+
+
+/// Check if saved calibration is whole and makes sense
+/// @param data The calibration.
+/// @return True if it can be used.
+bool CalibrationValid(const DisplayCalibrationData *data){
+	if((data->version != DisplayCalibrationVersion) || (data->checksum != CalibrationChecksum(data))){
+		return false;
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		if(!RevolutionValid(data->stepsPerRevolution[i])){
+			return false;
+		}
+	}
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		for(uint8_t j = 0; j < MAX_FACES; j++){
+			if((data->faceTrim[i][j] > MaxFaceTrimSteps) || (data->faceTrim[i][j] < -MaxFaceTrimSteps)){
+				return false;
+			}
+		}
+	}
+	return true;
+}// End of CalibrationValid()
+
+
+
+/// Set the calibration to the nominal revolution with no trims
+void DefaultCalibration(){
+	calibration.version = DisplayCalibrationVersion;
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		calibration.stepsPerRevolution[i] = DISPLAY_STEPS_PER_REV;
+	}
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		for(uint8_t j = 0; j < MAX_FACES; j++){
+			calibration.faceTrim[i][j] = 0;
+		}
+	}
+}// End of DefaultCalibration()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Display Calibration code
+//	*************************************************************************************************
+
+/// Initialize the Display Calibration, loading the saved calibration from EEPROM. Call this before InitShiftRegSteppers().
+void InitDisplayCalibration(){
+	EEPROM.get(DisplayCalibrationEepromAddress, calibration);
+	if(!CalibrationValid(&calibration)){
+		SERIAL_PRINTF("%s\n", "No display calibration saved, using the nominal steps per revolution");
+		DefaultCalibration();
+	}
+	calibrationSaved = true;
+	measuringMask = 0;
+}// End of InitDisplayCalibration()
+
+
+
+/// Start measuring the steps per revolution of some display steppers. Each one goes round through two home switch edges and
+/// then back to its face, and the result is saved once they are all done.
+/// @param stepperMask The steppers to measure, built with BLOCK_STEPPER_MASK()
+void StartDisplayCalibration(uint32_t stepperMask){
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		if(stepperMask & BLOCK_STEPPER_MASK(i)){
+			MeasureRevolution((BlockStepper)i);
+			measuringMask |= BLOCK_STEPPER_MASK(i);
+		}
+	}
+}// End of StartDisplayCalibration()
+
+
+
+/// Check if any display steppers are being measured
+/// @return True while a measurement is running.
+bool DisplayCalibrationRunning(){
+	return measuringMask != 0;
+}// End of DisplayCalibrationRunning()
+
+
+
+/// Get the steps per revolution of a display stepper
+/// @param stepper The stepper.
+/// @return The measured steps, or DISPLAY_STEPS_PER_REV if it hasn't been measured.
+uint16_t GetStepsPerRevolution(BlockStepper stepper){
+	return calibration.stepsPerRevolution[stepper];
+}// End of GetStepsPerRevolution()
+
+
+
+/// Get where a face of a block is on a display stepper, from the stepper's measured revolution and the block's trim for the face
+/// @param stepper The stepper the block is on.
+/// @param block The block.
+/// @param face The face, 0 to MAX_FACES - 1.
+/// @return The position in steps from home.
+int32_t GetFacePosition(BlockStepper stepper, const Block *block, uint8_t face){
+	// The block's stepsPerFace is for the nominal revolution, so scale it to the measured one, rounding to the nearest step
+	int32_t nominal = (int32_t)face * block->stepsPerFace;
+	int32_t position = (nominal * calibration.stepsPerRevolution[stepper] + (DISPLAY_STEPS_PER_REV / 2)) / DISPLAY_STEPS_PER_REV;
+	if(face < MAX_FACES){
+		position += calibration.faceTrim[block->blockType][face];
+	}
+	return position;
+}// End of GetFacePosition()
+
+
+
+/// Set the trim of a face of a block, and save it. The trims are kept for each block rather than each stepper, since the
+/// blocks that take turns on a stepper are different parts and can be indexed differently.
+/// @param block The block.
+/// @param face The face, from 0 to MAX_FACES - 1.
+/// @param trimSteps How far past its even spacing the face is, from -MaxFaceTrimSteps to MaxFaceTrimSteps.
+void SetFaceTrim(BlockType block, uint8_t face, int8_t trimSteps){
+	calibration.faceTrim[block][face] = trimSteps;
+	calibrationSaved = false;
+}// End of SetFaceTrim()
+
+
+
+/// Print the calibration of each display stepper and the face trims of each block over serial
+void PrintDisplayCalibration(){
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		SERIAL_PRINTF("Display stepper %u: %u steps per revolution%s\n", i, calibration.stepsPerRevolution[i], (measuringMask & BLOCK_STEPPER_MASK(i)) ? " (measuring)" : "");
+	}
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		SERIAL_PRINTF("Block %u: face trims", i);
+		for(uint8_t j = 0; j < MAX_FACES; j++){
+			SERIAL_PRINTF(" %d", calibration.faceTrim[i][j]);
+		}
+		SERIAL_PRINTF("%s\n", "");
+	}
+	SERIAL_PRINTF("Display calibration %s\n", calibrationSaved ? "saved" : "not saved yet");
+}// End of PrintDisplayCalibration()
+
+
+
+// Pick up finished measurements and save changes to EEPROM once nothing is moving. This function will be called in the main loop.
+void UpdateDisplayCalibration(){
+	uint32_t pending = measuringMask;
+	while(pending != 0){
+		uint8_t i = __builtin_ctz(pending);
+		pending &= pending - 1;
+		if(!DisplaySteppersIdle(BLOCK_STEPPER_MASK(i))){
+			continue;
+		}
+
+		measuringMask &= ~BLOCK_STEPPER_MASK(i);
+		uint16_t measured = GetMeasuredRevolution((BlockStepper)i);
+		if(!RevolutionValid(measured)){
+			LOG_MSG(LOG_DISPLAY_CALIBRATION_FAILED, i, (uint32_t)measured);
+			continue;
+		}
+		LOG_MSG(LOG_DISPLAY_CALIBRATED, i, (uint32_t)measured);
+		calibration.stepsPerRevolution[i] = measured;
+		SetDisplayRevolution((BlockStepper)i, measured);
+		calibrationSaved = false;
+	}
+
+	// Writing EEPROM can stall for milliseconds while flash is erased, so wait until no stepper would miss a step
+	if(!calibrationSaved && DisplaySteppersIdle() && (GetGantryStepSlackUs() == UINT32_MAX)){
+		calibration.version = DisplayCalibrationVersion;
+		calibration.checksum = CalibrationChecksum(&calibration);
+		EEPROM.put(DisplayCalibrationEepromAddress, calibration);
+		calibrationSaved = true;
+	}
+}// End of UpdateDisplayCalibration()
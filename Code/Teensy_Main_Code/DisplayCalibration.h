@@ -0,0 +1,72 @@
+// Header for the Display Calibration, which measures the true steps per revolution of each display stepper against its home
+// switch, keeps a small trim for each face of each block, and saves both to EEPROM so they survive a power cycle.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Blocks.h"
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Display Calibration code
+//	*************************************************************************************************
+
+const uint16_t DisplayCalibrationEepromAddress = 0;		// Where the calibration is saved in EEPROM
+const uint16_t DisplayCalibrationEepromSize = 128;		// The EEPROM kept for the calibration, so what comes after it doesn't move if it grows
+const uint16_t DisplayCalibrationVersion = 0xCA02;		// Marks saved calibration, and changes if its layout does
+
+const uint16_t MaxRevolutionErrorSteps = DISPLAY_STEPS_PER_REV / 20;	// How far a measured revolution can be from the nominal one
+const int8_t MaxFaceTrimSteps = 60;									// The largest trim for a face, either way
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Display Calibration code
+//	*************************************************************************************************
+
+/// Initialize the Display Calibration, loading the saved calibration from EEPROM. Call this before InitShiftRegSteppers().
+void InitDisplayCalibration();
+
+
+/// Start measuring the steps per revolution of some display steppers. Each one goes round through two home switch edges and
+/// then back to its face, and the result is saved once they are all done.
+/// @param stepperMask The steppers to measure, built with BLOCK_STEPPER_MASK()
+void StartDisplayCalibration(uint32_t stepperMask);
+
+
+/// Check if any display steppers are being measured
+/// @return True while a measurement is running.
+bool DisplayCalibrationRunning();
+
+
+/// Get the steps per revolution of a display stepper
+/// @param stepper The stepper.
+/// @return The measured steps, or DISPLAY_STEPS_PER_REV if it hasn't been measured.
+uint16_t GetStepsPerRevolution(BlockStepper stepper);
+
+
+/// Get where a face of a block is on a display stepper, from the stepper's measured revolution and the block's trim for the face
+/// @param stepper The stepper the block is on.
+/// @param block The block.
+/// @param face The face, 0 to MAX_FACES - 1.
+/// @return The position in steps from home.
+int32_t GetFacePosition(BlockStepper stepper, const Block *block, uint8_t face);
+
+
+/// Set the trim of a face of a block, and save it. The trims are kept for each block rather than each stepper, since the
+/// blocks that take turns on a stepper are different parts and can be indexed differently.
+/// @param block The block.
+/// @param face The face, from 0 to MAX_FACES - 1.
+/// @param trimSteps How far past its even spacing the face is, from -MaxFaceTrimSteps to MaxFaceTrimSteps.
+void SetFaceTrim(BlockType block, uint8_t face, int8_t trimSteps);
+
+
+/// Print the calibration of each display stepper and the face trims of each block over serial
+void PrintDisplayCalibration();
+
+
+// Pick up finished measurements and save changes to EEPROM once nothing is moving. This function will be called in the main loop.
+void UpdateDisplayCalibration();
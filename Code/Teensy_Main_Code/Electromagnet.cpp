@@ -0,0 +1,221 @@
+// Code for driving the electromagnets on the Gantry. Each electromagnet is turned on at full current to pull in,
+// then dropped to a lower PWM hold current while carrying a block. Releasing drives the coil in reverse for a short
+// pulse to knock down the remanence, so the block drops right away instead of hanging on the magnet.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "Electromagnet.h"
+#include "UsageCounters.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Electromagnet code
+//	*************************************************************************************************
+
+// Struct to hold the information of an electromagnet
+typedef struct {
+	EmagState state;			// The state of the electromagnet
+	elapsedMicros timeInState;	// The time since the electromagnet entered its current state
+} EmagInfo;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Electromagnet code
+//	*************************************************************************************************
+
+EmagInfo emags[NUM_EMAGS];	// The information of the electromagnets
+
+const uint8_t EmagFullDuty = 255;	// The PWM duty for full current
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Electromagnet code
+//	*************************************************************************************************
+
+/// Get the electromagnet for a column
+/// @param column The column to get the electromagnet for.
+/// @return The electromagnet over the column, or NUM_EMAGS if the Gantry has none there.
+GantryEmag GetColumnEmag(BlockColumn column){
+	switch(column){
+		case HOURS_SECOND_DIGIT_COLUMN:
+			return HOURS_SECOND_DIGIT_EMAG_ID;
+		case MINS_SECOND_DIGIT_COLUMN:
+			return MINS_SECOND_DIGIT_EMAG_ID;
+#if SHOW_SECONDS
+		case SECS_SECOND_DIGIT_COLUMN:
+			return SECS_SECOND_DIGIT_EMAG_ID;
+#endif
+		default:
+			return NUM_EMAGS;
+	}
+}// End of GetColumnEmag()
+
+
+
+/// Drive an electromagnet and change its state
+/// @param emag The electromagnet to drive.
+/// @param state The new state of the electromagnet.
+void SetEmagState(GantryEmag emag, EmagState state){
+	switch(state){
+		case EMAG_OFF:
+			analogWrite(EmagPins[emag], 0);
+			digitalWriteFast(EmagReversePins[emag], LOW);
+			break;
+		case EMAG_PULL_IN:
+			digitalWriteFast(EmagReversePins[emag], LOW);
+			analogWrite(EmagPins[emag], EmagFullDuty);
+			break;
+		case EMAG_HOLDING:
+			analogWrite(EmagPins[emag], EmagHoldDuty);
+			break;
+		case EMAG_RELEASING:
+			analogWrite(EmagPins[emag], 0);
+			digitalWriteFast(EmagReversePins[emag], HIGH);
+			break;
+	}
+
+	emags[emag].state = state;
+	emags[emag].timeInState = 0;
+}// End of SetEmagState()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Electromagnet code
+//	*************************************************************************************************
+
+/// Initialize the electromagnets and make sure they are all off
+void InitElectromagnets(){
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		pinMode(EmagPins[i], OUTPUT);
+		pinMode(EmagReversePins[i], OUTPUT);
+		analogWriteFrequency(EmagPins[i], EmagPwmFrequency);
+
+		SetEmagState((GantryEmag)i, EMAG_OFF);
+	}
+}// End of InitElectromagnets()
+
+
+
+/// Check if a column has an electromagnet on the Gantry
+/// @param column The column to check.
+/// @return True if the Gantry has an electromagnet over that column, false otherwise.
+bool ColumnHasEmag(BlockColumn column){
+	return GetColumnEmag(column) != NUM_EMAGS;
+}// End of ColumnHasEmag()
+
+
+
+/// Start energizing the electromagnet for a column. Does nothing if it is already on.
+/// @param column The column of the block to pick up.
+void EnergizeEmag(BlockColumn column){
+	GantryEmag emag = GetColumnEmag(column);
+	if(emag == NUM_EMAGS){
+		return;
+	}
+
+	if((emags[emag].state == EMAG_PULL_IN) || (emags[emag].state == EMAG_HOLDING)){// Already on
+		return;
+	}
+
+	SetEmagState(emag, EMAG_PULL_IN);
+	CountEmagPull(emag);
+}// End of EnergizeEmag()
+
+
+
+/// Start releasing the electromagnet for a column with a short reverse pulse.
+/// @param column The column of the block to release.
+void ReleaseEmag(BlockColumn column){
+	GantryEmag emag = GetColumnEmag(column);
+	if((emag == NUM_EMAGS) || (emags[emag].state == EMAG_OFF) || (emags[emag].state == EMAG_RELEASING)){
+		return;
+	}
+
+	SetEmagState(emag, EMAG_RELEASING);
+}// End of ReleaseEmag()
+
+
+
+/// Start releasing all of the electromagnets
+void ReleaseAllEmags(){
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		if((emags[i].state == EMAG_PULL_IN) || (emags[i].state == EMAG_HOLDING)){
+			SetEmagState((GantryEmag)i, EMAG_RELEASING);
+		}
+	}
+}// End of ReleaseAllEmags()
+
+
+
+/// Check if all of the energized electromagnets have finished pulling in
+/// @return True if no electromagnet is still pulling in, false otherwise.
+bool EmagsReady(){
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		if(emags[i].state == EMAG_PULL_IN){
+			return false;
+		}
+	}
+	return true;
+}// End of EmagsReady()
+
+
+
+/// Check if all of the electromagnets have finished releasing
+/// @return True if no electromagnet is still releasing, false otherwise.
+bool EmagsReleased(){
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		if(emags[i].state == EMAG_RELEASING){
+			return false;
+		}
+	}
+	return true;
+}// End of EmagsReleased()
+
+
+
+/// Get the state of the electromagnet for a column
+/// @param column The column to check.
+/// @return The state of the electromagnet, or EMAG_OFF if the column has no electromagnet.
+EmagState GetEmagState(BlockColumn column){
+	GantryEmag emag = GetColumnEmag(column);
+	if(emag == NUM_EMAGS){
+		return EMAG_OFF;
+	}
+	return emags[emag].state;
+}// End of GetEmagState()
+
+
+
+// Update the electromagnet drive levels. This function will be called in the main loop,
+// and handles the pull-in to hold and release to off transitions.
+void UpdateElectromagnets(){
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		switch(emags[i].state){
+			case EMAG_OFF:
+			case EMAG_HOLDING:
+				// Nothing to do until the Gantry asks for a change
+				break;
+			case EMAG_PULL_IN:
+				if(emags[i].timeInState >= EmagPullInUs){// The flux has built, drop to the hold current
+					SetEmagState((GantryEmag)i, EMAG_HOLDING);
+				}
+				break;
+			case EMAG_RELEASING:
+				if(emags[i].timeInState >= EmagReleasePulseUs){// The remanence has been cancelled, turn the coil off
+					SetEmagState((GantryEmag)i, EMAG_OFF);
+				}
+				break;
+		}
+	}
+}// End of UpdateElectromagnets()
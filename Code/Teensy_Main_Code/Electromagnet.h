@@ -0,0 +1,86 @@
+// Header for the code that drives the electromagnets on the Gantry, which pick up and release the blocks.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Blocks.h"
+
+
+//	*************************************************************************************************
+//	Enumerations for the Electromagnets
+//	*************************************************************************************************
+
+// The states of an Electromagnet
+typedef enum {
+	EMAG_OFF,			// No current through the coil
+	EMAG_PULL_IN,		// Full current to build the flux as quickly as possible
+	EMAG_HOLDING,		// Reduced (PWM) current while the block is being carried
+	EMAG_RELEASING		// Short reverse pulse to cancel the remanence so the block lets go right away
+} EmagState;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Electromagnet code
+//	*************************************************************************************************
+
+const uint8_t EmagPreEnergizeSteps = 20;	// The number of Gantry steps before reaching a block that the electromagnet gets turned on
+const uint16_t EmagPullInUs = 15000;		// How long the electromagnet gets full current before dropping to the hold current
+const uint16_t EmagReleasePulseUs = 3000;	// How long the electromagnet is driven in reverse when releasing a block
+const uint8_t EmagHoldDuty = 90;			// The PWM duty (out of 255) used to hold a block while it is carried
+const uint32_t EmagPwmFrequency = 20000;	// The PWM frequency for the electromagnets. Kept above hearing range so the coils don't whine
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Electromagnet code
+//	*************************************************************************************************
+
+/// Initialize the electromagnets and make sure they are all off
+void InitElectromagnets();
+
+
+/// Check if a column has an electromagnet on the Gantry
+/// @param column The column to check.
+/// @return True if the Gantry has an electromagnet over that column, false otherwise.
+bool ColumnHasEmag(BlockColumn column);
+
+
+/// Start energizing the electromagnet for a column. Does nothing if it is already on.
+/// @param column The column of the block to pick up.
+void EnergizeEmag(BlockColumn column);
+
+
+/// Start releasing the electromagnet for a column with a short reverse pulse.
+/// @param column The column of the block to release.
+void ReleaseEmag(BlockColumn column);
+
+
+/// Start releasing all of the electromagnets
+void ReleaseAllEmags();
+
+
+/// Check if all of the energized electromagnets have finished pulling in
+/// @return True if no electromagnet is still pulling in, false otherwise.
+bool EmagsReady();
+
+
+/// Check if all of the electromagnets have finished releasing
+/// @return True if no electromagnet is still releasing, false otherwise.
+bool EmagsReleased();
+
+
+/// Get the state of the electromagnet for a column
+/// @param column The column to check.
+/// @return The state of the electromagnet, or EMAG_OFF if the column has no electromagnet.
+EmagState GetEmagState(BlockColumn column);
+
+
+// Update the electromagnet drive levels. This function will be called in the main loop,
+// and handles the pull-in to hold and release to off transitions.
+void UpdateElectromagnets();
@@ -0,0 +1,203 @@
+// Fixed point positions and velocities for all the steppers. Positions are signed 32 bit counts of full steps, with the
+// low bits holding the fraction of a step, so a microstepping motor can be tracked exactly and a full step driver just
+// moves in whole steps. With 8 fraction bits, positions cover +-8 million steps down to 1/256 of a step.
+//
+// Set FIXED_POINT_CHECKS in Config.h to check every add and subtract for overflow. An overflow is printed over serial and
+// the result is clamped, instead of silently wrapping around.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Config.h"
+
+
+//	*************************************************************************************************
+//	Constants for the Fixed Point code
+//	*************************************************************************************************
+
+const uint8_t StepFractionBits = 8;							// The bits below the whole steps
+const int32_t StepOne = (int32_t)1 << StepFractionBits;		// One full step in fixed point
+
+
+
+
+
+//	*************************************************************************************************
+//	Checked arithmetic for the Fixed Point code
+//	*************************************************************************************************
+
+/// Add two fixed point values, checking for overflow if FIXED_POINT_CHECKS is set
+inline int32_t FixedAdd(int32_t a, int32_t b){
+#if FIXED_POINT_CHECKS
+	int32_t result;
+	if(__builtin_add_overflow(a, b, &result)){
+		SERIAL_PRINTF("ERROR: Fixed point overflow adding %ld and %ld\n", a, b);
+		return (b > 0) ? INT32_MAX : INT32_MIN;
+	}
+	return result;
+#else
+	return (int32_t)((uint32_t)a + (uint32_t)b);
+#endif
+}
+
+
+/// Subtract two fixed point values, checking for overflow if FIXED_POINT_CHECKS is set
+inline int32_t FixedSub(int32_t a, int32_t b){
+#if FIXED_POINT_CHECKS
+	int32_t result;
+	if(__builtin_sub_overflow(a, b, &result)){
+		SERIAL_PRINTF("ERROR: Fixed point overflow subtracting %ld from %ld\n", b, a);
+		return (b < 0) ? INT32_MAX : INT32_MIN;
+	}
+	return result;
+#else
+	return (int32_t)((uint32_t)a - (uint32_t)b);
+#endif
+}
+
+
+/// Turn a count of whole steps into fixed point, checking it fits if FIXED_POINT_CHECKS is set
+inline int32_t FixedFromSteps(int32_t steps){
+#if FIXED_POINT_CHECKS
+	if((steps > (INT32_MAX >> StepFractionBits)) || (steps < (INT32_MIN >> StepFractionBits))){
+		SERIAL_PRINTF("ERROR: Fixed point overflow converting %ld steps\n", steps);
+		return (steps > 0) ? INT32_MAX : INT32_MIN;
+	}
+#endif
+	return (int32_t)((uint32_t)steps << StepFractionBits);
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	Step Position
+//	*************************************************************************************************
+
+// A position in steps, with a fraction of a step
+class StepPosition {
+	public:
+		constexpr StepPosition() : raw(0) {}
+
+		/// Make a position from a raw fixed point value
+		static constexpr StepPosition FromRaw(int32_t raw){
+			return StepPosition(raw, 0);
+		}
+
+		/// Make a position from whole steps
+		static StepPosition FromSteps(int32_t steps){
+			return StepPosition(FixedFromSteps(steps), 0);
+		}
+
+		/// Make a position from microsteps
+		/// @param count The number of microsteps.
+		/// @param microsteps The microsteps per full step. Must be a power of 2 no more than 1 << StepFractionBits.
+		static StepPosition FromMicrosteps(int32_t count, uint16_t microsteps){
+			return StepPosition(FixedFromSteps(count) / microsteps, 0);
+		}
+
+		/// Get the raw fixed point value
+		constexpr int32_t Raw() const{
+			return raw;
+		}
+
+		/// Get the whole steps, rounded down
+		constexpr int32_t Steps() const{
+			return raw >> StepFractionBits;
+		}
+
+		/// Get the fraction of a step, in 1/256ths of a step
+		constexpr uint8_t Fraction() const{
+			return raw & (StepOne - 1);
+		}
+
+		/// Get the position rounded to the nearest whole step
+		StepPosition Rounded() const{
+			return StepPosition(FixedAdd(raw, StepOne / 2) & ~(StepOne - 1), 0);
+		}
+
+		/// Check if the position is on a whole step
+		constexpr bool WholeStep() const{
+			return (raw & (StepOne - 1)) == 0;
+		}
+
+		StepPosition operator+(StepPosition other) const{ return StepPosition(FixedAdd(raw, other.raw), 0); }
+		StepPosition operator-(StepPosition other) const{ return StepPosition(FixedSub(raw, other.raw), 0); }
+		StepPosition operator-() const{ return StepPosition(FixedSub(0, raw), 0); }
+		StepPosition &operator+=(StepPosition other){ raw = FixedAdd(raw, other.raw); return *this; }
+		StepPosition &operator-=(StepPosition other){ raw = FixedSub(raw, other.raw); return *this; }
+
+		constexpr bool operator==(StepPosition other) const{ return raw == other.raw; }
+		constexpr bool operator!=(StepPosition other) const{ return raw != other.raw; }
+		constexpr bool operator<(StepPosition other) const{ return raw < other.raw; }
+		constexpr bool operator<=(StepPosition other) const{ return raw <= other.raw; }
+		constexpr bool operator>(StepPosition other) const{ return raw > other.raw; }
+		constexpr bool operator>=(StepPosition other) const{ return raw >= other.raw; }
+
+	private:
+		int32_t raw;	// The position in 1/256ths of a step
+
+		constexpr StepPosition(int32_t value, int) : raw(value) {}
+};
+
+
+
+/// Make a position from whole steps. Shorthand for StepPosition::FromSteps().
+inline StepPosition FullSteps(int32_t steps){
+	return StepPosition::FromSteps(steps);
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	Step Velocity
+//	*************************************************************************************************
+
+// A velocity in steps per second, with a fraction of a step
+class StepVelocity {
+	public:
+		constexpr StepVelocity() : raw(0) {}
+
+		/// Make a velocity from the time between steps
+		/// @param periodUs The time between (micro)steps.
+		/// @param microsteps The microsteps per full step.
+		static StepVelocity FromPeriodUs(uint32_t periodUs, uint16_t microsteps){
+			if(periodUs == 0){
+				return StepVelocity(0);
+			}
+			return StepVelocity((int32_t)(((uint64_t)1000000 << StepFractionBits) / ((uint64_t)periodUs * microsteps)));
+		}
+
+		/// Get the raw fixed point value
+		constexpr int32_t Raw() const{
+			return raw;
+		}
+
+		/// Get the whole steps per second, rounded down
+		constexpr int32_t StepsPerSecond() const{
+			return raw >> StepFractionBits;
+		}
+
+		/// Get how far this velocity goes in some time
+		/// @param timeUs The time in microseconds.
+		/// @return The distance covered.
+		StepPosition DistanceIn(uint32_t timeUs) const{
+			int64_t distance = (int64_t)raw * timeUs / 1000000;
+#if FIXED_POINT_CHECKS
+			if((distance > INT32_MAX) || (distance < INT32_MIN)){
+				SERIAL_PRINTF("ERROR: Fixed point overflow moving for %lu us\n", timeUs);
+				return StepPosition::FromRaw((distance > 0) ? INT32_MAX : INT32_MIN);
+			}
+#endif
+			return StepPosition::FromRaw((int32_t)distance);
+		}
+
+	private:
+		int32_t raw;	// The velocity in 1/256ths of a step per second
+
+		constexpr explicit StepVelocity(int32_t value) : raw(value) {}
+};
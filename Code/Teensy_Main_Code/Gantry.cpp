@@ -7,8 +7,17 @@
 
 
 #include "Config.h"
+#include "DeferredLog.h" // Logging without formatting text on the Teensy
 #include "Gantry.h" // Include the header file for the Gantry code
+#include "Electromagnet.h" // The electromagnets that pick up the blocks
 #include "ShiftRegSteppers.h" // Needed to check if the display steppers are idle
+#include "BlockManager.h" // Needed to record which blocks have been swapped
+#include "SpiBus.h" // The stepper drivers share the SPI bus
+#include "StepperBackends.h" // The stepper drivers are stepped through the DRV8711 backend
+#include "FixedPoint.h" // Positions are fixed point, so microsteps are tracked exactly
+#include "ThermalModel.h" // Slows the Gantry down if the motors are getting too hot
+#include "InputCapture.h" // Limit switch and driver status reads are recorded while capturing
+#include "UsageCounters.h" // Swaps, limit stops and homings are counted for maintenance
 #include "Pins.h"
 
 //	*************************************************************************************************
@@ -30,6 +39,7 @@ typedef enum {
 typedef enum {
 	GANTRY_TOP = 0,
 	GANTRY_MIDDLE_VT = 100,
+	GANTRY_STAGING_VT = 170,	// Where the Gantry waits for a swap when nothing under it will rotate. Just above where the electromagnets get pre-energized
 	GANTRY_BLOCK_TOP = 200,
 	GANTRY_ABS_BOTTOM = 400
 } GantryVtPosition;
@@ -62,19 +72,41 @@ typedef enum {
 	GANTRY_SWAP_RAISE_NEW,				// Move the new block up
 	GANTRY_SWAP_MOVE_NEW_FORWARD,		// Move the new block to the display row
 	GANTRY_SWAP_PLACE_NEW,				// Place the new block in the display row
-	GANTRY_SWAP_END						// End of the block swap process (move to middle position)
+	GANTRY_SWAP_END,					// End of the block swap process (move to middle position)
+	NUM_SWAP_STEPS
 } GantryBlockSwapStep;
 
 
 
 // The steps of the Homing Process
 typedef enum {
-	GANTRY_HOMEING_UP,
-	GANTRY_HOMING_FORWARD
+	GANTRY_HOMEING_UP,				// Run up fast until the up limit switch trips or the motors stall
+	GANTRY_HOMING_UP_BACKOFF,		// Back off down
+	GANTRY_HOMING_UP_SEEK,			// Creep back up onto the up limit switch, which sets the position
+	GANTRY_HOMING_FORWARD,			// Run forward fast until the forward limit switch trips or the motors stall
+	GANTRY_HOMING_FORWARD_BACKOFF,	// Back off backward
+	GANTRY_HOMING_FORWARD_SEEK		// Creep back forward onto the forward limit switch, which sets the position
 } GantryHomeStep;
 
 
 
+// The steps of the Squaring Process
+typedef enum {
+	GANTRY_SQUARE_UP,			// Drive each side up to its own up limit switch
+	GANTRY_SQUARE_FORWARD		// Drive each side forward to its own forward limit switch
+} GantrySquareStep;
+
+
+
+// The steps of the Parking Process
+typedef enum {
+	GANTRY_PARK_UP,				// Move to the top so the Gantry can cross the rows
+	GANTRY_PARK_ACROSS,			// Move to the parking row
+	GANTRY_PARK_VERTICAL		// Move to the parking height
+} GantryParkStep;
+
+
+
 
 
 //	*************************************************************************************************
@@ -90,19 +122,64 @@ typedef struct {
 		GantryCalibrationStep calStep;	// The current step of the calibration process
 		GantryBlockSwapStep swapStep;	// The current step of the block swap process
 		GantryHomeStep homeStep;		// The current step of the homing process
+		GantryParkStep parkStep;		// The current step of the parking process
+		GantrySquareStep squareStep;	// The current step of the squaring process
 	};
 
 	Block *block1;	// The first block to swap
 	Block *block2;	// The second block to swap
 	
-	uint8_t currentX;	// The current X position of the Gantry
-	uint8_t currentY;	// The current Y position of the Gantry
-	uint8_t targetX;	// The target X position of the Gantry
-	uint8_t targetY;	// The target Y position of the Gantry
+	StepPosition currentX;	// The current X position of the Gantry, in steps back from the front
+	StepPosition currentY;	// The current Y position of the Gantry, in steps down from the top
+	StepPosition targetX;	// The target X position of the Gantry
+	StepPosition targetY;	// The target Y position of the Gantry
+
+	bool dwelling;		// If the Gantry is stopped at a block waiting on the electromagnet(s)
+
+	uint8_t microsteps;		// The number of microsteps per full step in the current step mode
+	uint8_t microstepCount;	// The number of microsteps taken toward the next full step
+	uint16_t stepPeriodUs;	// The time between (micro)steps in the current step mode
+
+	bool stalled;					// If a stall was detected on one of the motors
+	uint32_t stallCheckUs;			// The step time built up toward the next driver status read, counted once for each driver
+	uint8_t nextStallCheckMotor;	// The motor whose driver status gets read next
+
+	int16_t sideOffset[2][NUM_GANTRY_SIDES];	// The steps each side still has to move on the horizontal [0] and vertical [1] axes, relative to the Gantry. Positive is back or down
+	uint8_t extraStepMask;					// The sides still to get an extra step half way through this step period
+	bool sideSquared[NUM_GANTRY_SIDES];		// If each side has reached its limit switch while squaring
+	int16_t skewSteps;						// The steps the second side took after the first side reached its limit switch while squaring
+	int16_t skew[2];						// The last measured skew on the horizontal [0] and vertical [1] axes
+
+	uint16_t jogSteps;		// The full steps left to move in a jog
+	uint16_t homeSteps;		// The full steps taken on the current homing move
 } GantryInfo;
 
 
 
+// Struct to hold the next swap the Gantry is expected to do, used to decide where to park
+typedef struct {
+	bool planned;		// If BlockManager has told the Gantry about the next swap
+	bool columnsIdle;	// If the display steppers under the block(s) won't move before the swap
+	Block *block1;		// The first block of the next swap
+	Block *block2;		// The second block of the next swap
+} NextSwapInfo;
+
+
+
+// Struct to hold the stats of one step of the block swap process, for the stress test
+const uint8_t SwapStatsBuckets = 16;
+typedef struct {
+	uint32_t count;				// The number of times the step finished
+	uint32_t totalUs;			// The total time spent in the step
+	uint32_t minUs;				// The shortest time the step took
+	uint32_t maxUs;				// The longest time the step took
+	uint16_t histogram[SwapStatsBuckets];	// The number of times the step took under 1, 2, 4, ... ms. The last bucket has everything longer
+	uint32_t limitEnds;			// The number of times the step ended on a limit switch before reaching its target
+	uint32_t maxLimitErrorSteps;	// The biggest gap between the position and the target when a limit switch ended the step
+} SwapStepStats;
+
+
+
 
 
 //	*************************************************************************************************
@@ -111,45 +188,321 @@ typedef struct {
 
 GantryInfo gantryInfo;	// The information of the Gantry
 
-HighPowerStepperDriver stepperDrivers[NUM_MOTORS];	// The stepper drivers for the Gantry motors
+NextSwapInfo nextSwap;	// The next swap the Gantry is expected to do
+bool gantryStagingEnabled = true;	// If the Gantry may wait for a swap at GANTRY_STAGING_VT
+int8_t swapParkingSpot = -1;		// Where the current swap started: 0 from the default parking spot, 1 from the staging height, -1 from anywhere else
+uint32_t parkedSwaps[2];			// The swaps started from the default parking spot [0] and from the staging height [1]
+uint32_t parkedSwapMs[2];			// How long those swaps took in total
+
+GantryPowerLevel gantryPower = GANTRY_POWER_FULL;	// The power level of the stepper drivers
+uint16_t gantryCurrentLimit = StepperCurrentLimit;	// The current used at full power. Turned down by the Thermal Model if the motors get too hot
+
+uint32_t gantryMotorSteps[NUM_MOTORS];	// The step pulses sent to each motor since power on
+uint32_t gantryMotorReversals[NUM_MOTORS];	// The times each motor has been turned round since power on
+uint8_t gantryMotorDirs = 0;			// The direction last sent to each motor, one bit per motor
+uint8_t gantryMotorDirsSent = 0;		// The motors that have been sent a direction since power on
+
+SwapStepStats swapStats[NUM_SWAP_STEPS];	// The stats of each step of the block swap process
+elapsedMicros swapStepTimer;				// The time since the current swap step started
+elapsedMillis gantrySwapTimer;					// The time since the current swap started
+bool legEndedOnLimit = false;				// If the last leg checked by SwapLegDone() ended on a limit switch
+uint32_t legLimitErrorSteps = 0;			// How far the position was from the target when that leg ended
+uint32_t swapMissedSteps = 0;				// The number of legs that ended on a limit switch more than GantryMissedStepTolerance from their target
+uint32_t swapStalls = 0;					// The number of swaps stopped by a stall
+
+// Names of the states and directions, for printing the status of the Gantry
+const char *const GantryStateNames[] = {"IDLE", "CALIBRATING", "SWAPPING_BLOCKS", "HOMING", "PARKING", "SQUARING", "JOGGING", "ERROR"};
+const char *const GantryDirectionNames[] = {"NONE", "UP", "DOWN", "FW", "BW"};
+const char *const GantrySwapStepNames[NUM_SWAP_STEPS] = {"START", "MOVE_FORWARD", "PICKUP_OLD", "RAISE_OLD", "GO_TO_OLD_ROW", "PLACE_OLD",
+	"UP_FROM_OLD", "MOVE_TO_NEW", "PICKUP_NEW", "RAISE_NEW", "MOVE_NEW_FORWARD", "PLACE_NEW", "END"};
+
+Drv8711Driver stepperDrivers[NUM_MOTORS];	// The stepper drivers for the Gantry motors
+
+const SPISettings GantryDriverSpiSettings(500000, MSBFIRST, SPI_MODE0);	// The same SPI settings the Pololu library uses for the drivers
+
+// Steps and directions are queued for all the drivers, then written in one SPI transaction
+typedef Drv8711Backend<NUM_MOTORS, stepperDrivers, StepperDriverCSPins, &GantryDriverSpiSettings> GantryBackend;
 
 elapsedMicros timeSinceLastStep;	// The time since the last step of the Gantry motors
 
+elapsedMicros emagDwellTimer;		// The time the Gantry has been stopped at a block waiting on the electromagnet(s)
+
 
 uint8_t blockDropHeightOffset = 50;	// The offset for the height to drop the blocks from the electromagnet
 
 
+// Step modes. The Gantry travels at full steps for speed, and switches to microstepping for the end of the legs that pick up
+// and place blocks, for smooth, accurate placement. Everything else (parking, homing, jogging, raising) stays at full steps.
+const HPSDStepMode GantryTravelStepMode = HPSDStepMode::MicroStep1;		// The step mode for travelling
+const uint8_t GantryTravelMicrosteps = 1;								// The microsteps per full step for travelling
+const HPSDStepMode GantryApproachStepMode = HPSDStepMode::MicroStep8;	// The step mode for approaching the blocks
+const uint8_t GantryApproachMicrosteps = 8;								// The microsteps per full step for approaching the blocks
+const uint16_t GantryApproachStepPeriodUs = 250;						// The time between microsteps when approaching the blocks. 2 ms per full step, no slower than the old full stepping
+const uint8_t GantryApproachSteps = 30;									// How many full steps above the storage row drop height the Gantry starts microstepping
+
+
+// Stall detection. The DRV8711 detects stalls from the motor back-EMF, which only works at speed, so it is only checked while full stepping.
+const uint16_t GantryStallCheckPeriodUs = 3000;		// The longest time between reads of each driver's status, so a stall is caught within a few ms
+const uint16_t GantryStallRegister = 0x0340;			// STALL register: VDIV = /32, SDCNT = 8 steps, SDTHR = 0x40
+const uint16_t GantryHomingStepPeriodUs = 500;			// The time between steps when homing. Homing runs into the hard stops, so it can go fast
+const uint16_t GantryHomingStartPeriodUs = StepPeriodUs;	// The time between steps a fast homing move starts at, ramping down to GantryHomingStepPeriodUs
+const uint16_t GantryHomingRampSteps = 50;				// The steps the homing ramp takes. A stall before the ramp is done is a lost start, not the hard stop
+const uint16_t GantryHomingBackoffSteps = 20;			// How far the Gantry backs off a hard stop or limit switch before creeping back onto the switch
+const uint16_t GantryHomingSeekPeriodUs = 3000;			// The time between steps when creeping back onto the limit switch
+const uint8_t GantryStallStatusMask = (1 << (uint8_t)HPSDStatusBit::StD) | (1 << (uint8_t)HPSDStatusBit::StDLat);	// The status bits for a stall
+
+
+// Squaring
+const uint8_t GantryMissedStepTolerance = 2;							// How far from its target a swap leg can end on a limit switch before it counts as missed steps
+const int16_t GantryMaxSkewSteps = 200;									// The most skew squaring will correct before giving up with an error
+const int16_t GantrySquareTrim[2][NUM_GANTRY_SIDES] = {{0, 0}, {0, 0}};	// The steps each side is moved back [0] or down [1] after squaring, to make up for limit switches that aren't perfectly lined up
+const bool GantrySquareAfterHoming = true;								// If the Gantry gets squared every time it is homed
+
+
+// The display steppers that have to be idle before the Gantry can go below GANTRY_MIDDLE_VT over a block, by the block's column and row.
+// Only the display row has steppers under it, so the storage rows never have to wait. Columns the Gantry isn't touching keep rotating.
+const uint32_t GantryInterlockMap[NUM_COLUMNS][NUM_ROWS] = {
+//	 DISPLAY_ROW,											MIDDLE_ROW,	BACK_ROW
+	{BLOCK_STEPPER_MASK(HOURS_FIRST_DIGIT_COLUMN),			0,			0},	// HOURS_FIRST_DIGIT_COLUMN
+	{BLOCK_STEPPER_MASK(HOURS_SECOND_DIGIT_COLUMN),			0,			0},	// HOURS_SECOND_DIGIT_COLUMN
+	{BLOCK_STEPPER_MASK(MINS_FIRST_DIGIT_COLUMN),			0,			0},	// MINS_FIRST_DIGIT_COLUMN
+	{BLOCK_STEPPER_MASK(MINS_SECOND_DIGIT_COLUMN),			0,			0},	// MINS_SECOND_DIGIT_COLUMN
+#if SHOW_SECONDS
+	{BLOCK_STEPPER_MASK(SECS_FIRST_DIGIT_COLUMN),			0,			0},	// SECS_FIRST_DIGIT_COLUMN
+	{BLOCK_STEPPER_MASK(SECS_SECOND_DIGIT_COLUMN),			0,			0},	// SECS_SECOND_DIGIT_COLUMN
+#endif
+};
+
+
 
 
 //	*************************************************************************************************
 //	Local Functions for the Gantry code
 //	*************************************************************************************************
 
-/// Step the Gantry in the direction set
-void StepGantry(){
+/// Change the step mode of all the Gantry drivers. This should only be done on a full step, so the positions stay correct.
+/// @param mode The new step mode.
+/// @param microsteps The number of microsteps per full step in the new mode.
+/// @param periodUs The time between (micro)steps in the new mode.
+void SetGantryStepMode(HPSDStepMode mode, uint8_t microsteps, uint16_t periodUs){
+	gantryInfo.stepPeriodUs = periodUs;
+	if(gantryInfo.microsteps == microsteps){// Already in this mode
+		return;
+	}
+
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		stepperDrivers[i].setStepMode(mode);
+	}
+	SpiRelease();
+
+	gantryInfo.microsteps = microsteps;
+	gantryInfo.microstepCount = 0;
+}// End of SetGantryStepMode()
+
+
+
+/// Get the time between steps for the homing move the Gantry is on. The fast moves ramp up from rest, and the moves back
+/// onto the limit switches creep.
+/// @return The step period in microseconds.
+uint16_t HomingStepPeriodUs(){
+	switch(gantryInfo.homeStep){
+		case GANTRY_HOMEING_UP:
+		case GANTRY_HOMING_FORWARD:
+			if(gantryInfo.homeSteps >= GantryHomingRampSteps){
+				return GantryHomingStepPeriodUs;
+			}
+			return GantryHomingStartPeriodUs - (uint32_t)(GantryHomingStartPeriodUs - GantryHomingStepPeriodUs) * gantryInfo.homeSteps / GantryHomingRampSteps;
+		case GANTRY_HOMING_UP_SEEK:
+		case GANTRY_HOMING_FORWARD_SEEK:
+			return GantryHomingSeekPeriodUs;
+		default:
+			return StepPeriodUs;
+	}
+}// End of HomingStepPeriodUs()
+
+
+
+/// Check if the Gantry is on a leg of a swap that ends by picking up or placing a block
+/// @return True on the way down to a block or to a drop height.
+bool GantryOnApproachLeg(){
+	if((gantryInfo.state != GANTRY_SWAPPING_BLOCKS) || (gantryInfo.dir != GANTRY_DOWN)){
+		return false;
+	}
+	switch(gantryInfo.swapStep){
+		case GANTRY_SWAP_PICKUP_OLD:
+		case GANTRY_SWAP_PLACE_OLD:
+		case GANTRY_SWAP_PICKUP_NEW:
+		case GANTRY_SWAP_PLACE_NEW:
+			return true;
+		default:
+			return false;
+	}
+}// End of GantryOnApproachLeg()
+
+
+
+// Pick the step mode for the Gantry. Microstep near the end of the swap legs that pick up or place blocks, full step everywhere else.
+void UpdateGantryStepMode(){
+	if(GantryOnApproachLeg() && (gantryInfo.currentY >= FullSteps(GANTRY_BLOCK_TOP - blockDropHeightOffset - GantryApproachSteps))){
+		SetGantryStepMode(GantryApproachStepMode, GantryApproachMicrosteps, ThermalStepPeriodUs(GantryApproachStepPeriodUs));
+	}else{
+		SetGantryStepMode(GantryTravelStepMode, GantryTravelMicrosteps, ThermalStepPeriodUs((gantryInfo.state == GANTRY_HOMING) ? HomingStepPeriodUs() : StepPeriodUs));
+	}
+}// End of UpdateGantryStepMode()
+
+
+
+// Check the drivers for a stall. The drivers are read in turn, as many each step as it takes at the current step period
+// for every driver to be read within GantryStallCheckPeriodUs, so the SPI bus isn't tied up reading all four every step
+// at low speeds. The stall bit is latched, so a stall is still seen when its driver's turn comes.
+void CheckGantryStall(){
+	if(gantryInfo.microsteps != GantryTravelMicrosteps){// The back-EMF is too small to detect stalls while microstepping
+		gantryInfo.stallCheckUs = 0;
+		return;
+	}
+
+	gantryInfo.stallCheckUs += (uint32_t)gantryInfo.stepPeriodUs * NUM_MOTORS;
+	for(uint8_t i = 0; (i < NUM_MOTORS) && (gantryInfo.stallCheckUs >= GantryStallCheckPeriodUs); i++){
+		gantryInfo.stallCheckUs -= GantryStallCheckPeriodUs;
+
+		uint8_t motor = gantryInfo.nextStallCheckMotor;
+		gantryInfo.nextStallCheckMotor = (motor + 1) % NUM_MOTORS;
+
+		uint8_t status = stepperDrivers[motor].readStatus();
+		CaptureDriverStatus(motor, status);
+		if(status & (1 << (uint8_t)HPSDStatusBit::OTS)){// The driver is too hot, so the Thermal Model is behind
+			ThermalFaultDetected((GantryMotor)motor);
+		}
+		if(status & GantryStallStatusMask){
+			stepperDrivers[motor].clearStatus();
+			gantryInfo.stalled = true;
+		}
+	}
+	if(gantryInfo.stallCheckUs >= GantryStallCheckPeriodUs){// Slower than one step per GantryStallCheckPeriodUs, so every driver was read
+		gantryInfo.stallCheckUs = 0;
+	}
+}// End of CheckGantryStall()
+
+
+
+// Clear any stall that has been detected, including the latched status on all the drivers
+void ClearGantryStall(){
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		stepperDrivers[i].clearStatus();
+	}
+	SpiRelease();
+	gantryInfo.stalled = false;
+	gantryInfo.stallCheckUs = 0;
+}// End of ClearGantryStall()
+
+
+
+/// Step the motors of some sides of the Gantry, all in one SPI transaction
+/// @param sideMask The sides to step, with bit 0 for the left side and bit 1 for the right side.
+void StepGantrySides(uint8_t sideMask){
+	// The motors are in the order left top, left bottom, right top, right bottom, so each side is a pair
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		if(sideMask & (1 << (i / 2))){
+			GantryBackend::Step(i);
+			gantryMotorSteps[i]++;
+		}
+	}
+
+	GantryBackend::Commit();
+}// End of StepGantrySides()
+
+
+
+/// Check the limit switch on one side of the Gantry in a direction
+/// @param side The side to check.
+/// @param dir The direction the Gantry is moving.
+/// @return True if that side's limit switch for that direction is tripped.
+bool GantrySideAtLimit(GantrySide side, GantryDirection dir){
+	bool left = (side == GANTRY_LEFT_SIDE);
+	switch(dir){
+		case GANTRY_UP:
+			return CaptureRead(GantryLimitSwitchPins[left ? GANTRY_LEFT_UP_LIMIT_SWITCH : GANTRY_RIGHT_UP_LIMIT_SWITCH]);
+		case GANTRY_DOWN:
+			return CaptureRead(GantryLimitSwitchPins[left ? GANTRY_LEFT_DOWN_LIMIT_SWITCH : GANTRY_RIGHT_DOWN_LIMIT_SWITCH]);
+		case GANTRY_FW:
+			return CaptureRead(GantryLimitSwitchPins[left ? GANTRY_LEFT_FW_LIMIT_SWITCH : GANTRY_RIGHT_FW_LIMIT_SWITCH]);
+		case GANTRY_BW:
+			return CaptureRead(GantryLimitSwitchPins[left ? GANTRY_LEFT_BW_LIMIT_SWITCH : GANTRY_RIGHT_BW_LIMIT_SWITCH]);
+		default:
+			return false;
+	}
+}// End of GantrySideAtLimit()
+
+
+
+/// Move the Gantry's position in the direction set. Y counts down from the top and X counts back from the front.
+/// @param distance How far the Gantry moved.
+void UpdateGantryPosition(StepPosition distance){
 	switch(gantryInfo.dir){
-		case GANTRY_NO_DIR:// If the Gantry is not moving, return
-			return;
 		case GANTRY_UP:// If the Gantry is moving up
-			gantryInfo.currentY++;
+			gantryInfo.currentY -= distance;
 			break;
 		case GANTRY_DOWN:// If the Gantry is moving down
-			gantryInfo.currentY--;
+			gantryInfo.currentY += distance;
 			break;
 		case GANTRY_FW:// If the Gantry is moving forward
-			gantryInfo.currentX++;
+			gantryInfo.currentX -= distance;
 			break;
 		case GANTRY_BW:// If the Gantry is moving backward
-			gantryInfo.currentX--;
+			gantryInfo.currentX += distance;
 			break;
 		default:
-			return;
+			break;
+	}
+}// End of UpdateGantryPosition()
+
+
+
+/// Step the Gantry in the direction set. When microstepping, the position moves by a fraction of a step.
+void StepGantry(){
+	if(gantryInfo.dir == GANTRY_NO_DIR){// If the Gantry is not moving, return
+		return;
 	}
 
-	for(uint8_t i = 0; i < NUM_MOTORS; i++){// Step each motor
-		stepperDrivers[i].step();
+	if(gantryInfo.microstepCount == 0){// Only change step modes on a full step
+		UpdateGantryStepMode();
+	}
+
+	// Work off any offset on the axis the Gantry is moving along. A side gets one step fewer to move against its offset, or
+	// an extra step half way through the period (from MoveGantry()) to move with it, so it never steps twice at once.
+	// Offsets are in full steps, so they are only worked off while full stepping.
+	bool fullStep = (gantryInfo.microsteps == GantryTravelMicrosteps);
+	bool vertical = (gantryInfo.dir == GANTRY_UP) || (gantryInfo.dir == GANTRY_DOWN);
+	int8_t sign = ((gantryInfo.dir == GANTRY_DOWN) || (gantryInfo.dir == GANTRY_BW)) ? 1 : -1;	// The way this move goes along the axis
+	uint8_t stepMask = 0;	// The sides to step
+	for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){
+		int16_t *offset = &gantryInfo.sideOffset[vertical][i];
+		if(fullStep && (*offset * sign < 0)){// This side has to end up further back the way it came, so skip its step
+			*offset += sign;
+			continue;
+		}
+		stepMask |= (1 << i);
+		if(fullStep && (*offset * sign > 0)){// This side has to end up further along, so give it an extra step
+			*offset -= sign;
+			gantryInfo.extraStepMask |= (1 << i);
+		}
 	}
 
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	StepGantrySides(stepMask);
+	CheckGantryStall();
+	SpiRelease();
+
+	UpdateGantryPosition(StepPosition::FromMicrosteps(1, gantryInfo.microsteps));
+
+	gantryInfo.microstepCount++;
+	if(gantryInfo.microstepCount < gantryInfo.microsteps){// Not at the next full step yet
+		return;
+	}
+	gantryInfo.microstepCount = 0;
+
 	// CHECK IF HITTING LIMITS
 	// switch(gantryInfo.dir){
 	// 	case GANTRY_UP:
@@ -181,6 +534,21 @@ void StepGantry(){
 
 
 
+/// Set the direction of one Gantry motor, counting a reversal if it was last sent the other way
+/// @param motor The motor.
+/// @param forward The direction for its driver.
+void SetGantryMotorDirection(GantryMotor motor, bool forward){
+	uint8_t bit = 1 << motor;
+	if((gantryMotorDirsSent & bit) && (((gantryMotorDirs & bit) != 0) != forward)){
+		gantryMotorReversals[motor]++;
+	}
+	gantryMotorDirsSent |= bit;
+	gantryMotorDirs = forward ? (gantryMotorDirs | bit) : (gantryMotorDirs & ~bit);
+	GantryBackend::SetDirection(motor, forward);
+}// End of SetGantryMotorDirection()
+
+
+
 /// Change the Gantry Direction
 /// @param dir The new direction of the Gantry.
 ///		Up and Down will move both motors of a pair in the same direction.
@@ -191,36 +559,70 @@ void ChangeGantryDirection(GantryDirection dir){
 		return;
 	}
 
-	// Check what stepper motors directions need to be changed from the current direction
+	// If the Gantry stopped part way through a full step (a limit switch tripped while microstepping), fix up the position
+	if(gantryInfo.microstepCount != 0){
+		bool reversing = ((gantryInfo.dir == GANTRY_UP) && (dir == GANTRY_DOWN)) || ((gantryInfo.dir == GANTRY_DOWN) && (dir == GANTRY_UP))
+						|| ((gantryInfo.dir == GANTRY_FW) && (dir == GANTRY_BW)) || ((gantryInfo.dir == GANTRY_BW) && (dir == GANTRY_FW));
+
+		if(reversing){// The position has the partial step in it, so just count the microsteps back to the full step it left
+			gantryInfo.microstepCount = gantryInfo.microsteps - gantryInfo.microstepCount;
+		}else{// Round the partial step off the axis the Gantry was moving on
+			if((gantryInfo.dir == GANTRY_UP) || (gantryInfo.dir == GANTRY_DOWN)){
+				gantryInfo.currentY = gantryInfo.currentY.Rounded();
+			}else{
+				gantryInfo.currentX = gantryInfo.currentX.Rounded();
+			}
+			gantryInfo.microstepCount = 0;
+		}
+	}
+
+	// An extra step still waiting for the middle of the period would go out in the new direction, so hand it back to the
+	// offset of the axis it was for. It gets worked off on the next move along that axis instead
+	if(gantryInfo.extraStepMask != 0){
+		bool vertical = (gantryInfo.dir == GANTRY_UP) || (gantryInfo.dir == GANTRY_DOWN);
+		int8_t sign = ((gantryInfo.dir == GANTRY_DOWN) || (gantryInfo.dir == GANTRY_BW)) ? 1 : -1;
+		for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){
+			if(gantryInfo.extraStepMask & (1 << i)){
+				gantryInfo.sideOffset[vertical][i] += sign;
+			}
+		}
+		gantryInfo.extraStepMask = 0;
+	}
+
+	// Set the direction of each stepper motor for the new direction, then write them all in one SPI transaction
 	switch(dir){
 		case GANTRY_UP:
-			stepperDrivers[GANTRY_LEFT_TOP_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_LEFT_BOTM_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_RIGHT_TOP_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_RIGHT_BOTM_MOTOR].setDirection(1);
+			SetGantryMotorDirection(GANTRY_LEFT_TOP_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_LEFT_BOTM_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_RIGHT_TOP_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_RIGHT_BOTM_MOTOR, 1);
 			break;
 		case GANTRY_DOWN:
-			stepperDrivers[GANTRY_LEFT_TOP_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_LEFT_BOTM_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_RIGHT_TOP_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_RIGHT_BOTM_MOTOR].setDirection(0);
+			SetGantryMotorDirection(GANTRY_LEFT_TOP_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_LEFT_BOTM_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_RIGHT_TOP_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_RIGHT_BOTM_MOTOR, 0);
 			break;
 		case GANTRY_FW:
-			stepperDrivers[GANTRY_LEFT_TOP_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_LEFT_BOTM_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_RIGHT_TOP_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_RIGHT_BOTM_MOTOR].setDirection(1);
+			SetGantryMotorDirection(GANTRY_LEFT_TOP_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_LEFT_BOTM_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_RIGHT_TOP_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_RIGHT_BOTM_MOTOR, 1);
 			break;
 		case GANTRY_BW:
-			stepperDrivers[GANTRY_LEFT_TOP_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_LEFT_BOTM_MOTOR].setDirection(0);
-			stepperDrivers[GANTRY_RIGHT_TOP_MOTOR].setDirection(1);
-			stepperDrivers[GANTRY_RIGHT_BOTM_MOTOR].setDirection(0);
+			SetGantryMotorDirection(GANTRY_LEFT_TOP_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_LEFT_BOTM_MOTOR, 0);
+			SetGantryMotorDirection(GANTRY_RIGHT_TOP_MOTOR, 1);
+			SetGantryMotorDirection(GANTRY_RIGHT_BOTM_MOTOR, 0);
 			break;
 		default:
 			return;
 	}
 
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	GantryBackend::Commit();
+	SpiRelease();
+
 	gantryInfo.dir = dir;
 }// End of ChangeGantryDirection()
 
@@ -228,14 +630,15 @@ void ChangeGantryDirection(GantryDirection dir){
 
 // Trigger the Gantry Homing Process
 void HomeGantry(){
+	// The position isn't trusted when homing, so always run into both hard stops. Homing is full stepping, where stalls can be seen
+	SetGantryStepMode(GantryTravelStepMode, GantryTravelMicrosteps, GantryHomingStartPeriodUs);
+	gantryInfo.microstepCount = 0;
+	ClearGantryStall();
+	CountGantryHoming();
 	gantryInfo.state = GANTRY_HOMING;
-	if(gantryInfo.currentY > GANTRY_TOP){// If the Gantry is not at the top, move it up
-		gantryInfo.homeStep = GANTRY_HOMEING_UP;
-	}else if(gantryInfo.currentX > GANTRY_FRONT){// If the Gantry is not at the front, move it forward
-		gantryInfo.homeStep = GANTRY_HOMING_FORWARD;
-	}else{
-		gantryInfo.state = GANTRY_IDLE;
-	}
+	gantryInfo.homeStep = GANTRY_HOMEING_UP;
+	gantryInfo.homeSteps = 0;
+	ChangeGantryDirection(GANTRY_UP);
 }// End of HomeGantry()
 
 
@@ -257,70 +660,289 @@ bool HasSecondBlock(){
 
 
 
+/// Check if either side of the Gantry is at its limit switch in a direction
+/// @param dir The direction to check.
+/// @return True if the left or right limit switch for that direction is tripped.
+bool GantryAtLimit(GantryDirection dir){
+	return GantrySideAtLimit(GANTRY_LEFT_SIDE, dir) || GantrySideAtLimit(GANTRY_RIGHT_SIDE, dir);
+}// End of GantryAtLimit()
+
+
+
+/// Check if a leg of a swap is done, by reaching its target or tripping a limit switch. A leg that ends on a limit switch
+/// is remembered, so it can be counted in the swap stats when the step ends.
+/// @param position The position on the axis the Gantry is moving on.
+/// @param target The position the leg should end at.
+/// @param atLimit If a limit switch that ends the leg is tripped.
+/// @return True if the leg is done.
+bool SwapLegDone(StepPosition position, StepPosition target, bool atLimit){
+	legEndedOnLimit = (position != target) && atLimit;
+	if(legEndedOnLimit){
+		StepPosition error = (position > target) ? (position - target) : (target - position);
+		legLimitErrorSteps = error.Steps();
+	}
+	return (position == target) || atLimit;
+}// End of SwapLegDone()
+
+
+
+/// Move on to the next step of the block swap process, and add the time the last step took to the swap stats
+/// @param step The next step.
+void SetSwapStep(GantryBlockSwapStep step){
+	SwapStepStats *stats = &swapStats[gantryInfo.swapStep];
+	uint32_t durationUs = swapStepTimer;
+	swapStepTimer = 0;
+
+	stats->count++;
+	stats->totalUs += durationUs;
+	if((stats->count == 1) || (durationUs < stats->minUs)){
+		stats->minUs = durationUs;
+	}
+	if(durationUs > stats->maxUs){
+		stats->maxUs = durationUs;
+	}
+
+	uint32_t durationMs = durationUs / 1000;
+	uint8_t bucket = (durationMs == 0) ? 0 : (32 - __builtin_clz(durationMs));	// Bucket n holds times under 2^n ms
+	if(bucket >= SwapStatsBuckets){
+		bucket = SwapStatsBuckets - 1;
+	}
+	stats->histogram[bucket]++;
+
+	if(legEndedOnLimit){
+		stats->limitEnds++;
+		CountLimitStop();
+		if(legLimitErrorSteps > stats->maxLimitErrorSteps){
+			stats->maxLimitErrorSteps = legLimitErrorSteps;
+		}
+		if(legLimitErrorSteps > GantryMissedStepTolerance){// The Gantry wasn't where it thought it was, so it lost (or gained) steps
+			swapMissedSteps++;
+		}
+	}
+	legEndedOnLimit = false;
+
+	gantryInfo.swapStep = step;
+}// End of SetSwapStep()
+
+
+
+// Check if the Gantry has reached the top of a block, or detects a block on one of its electromagnets
+bool GantryAtBlock(){
+	return (gantryInfo.currentY == FullSteps(GANTRY_BLOCK_TOP)) || CaptureRead(HOURS_SECOND_DIGIT_GANTRY_LS) || CaptureRead(MINS_SECOND_DIGIT_GANTRY_LS);
+}// End of GantryAtBlock()
+
+
+
+/// Check if the Gantry has reached the height to place the block(s) it is carrying
+/// @param placeY The vertical position to release the block(s) at.
+/// @return True if the Gantry is at that height or has hit a down limit switch, false otherwise.
+bool GantryAtPlaceHeight(int32_t placeY){
+	return SwapLegDone(gantryInfo.currentY, FullSteps(placeY), GantryAtLimit(GANTRY_DOWN));
+}// End of GantryAtPlaceHeight()
+
+
+
+/// Check if the Gantry can go below GANTRY_MIDDLE_VT over a row. Only the display steppers under the block(s)
+/// are checked, using GantryInterlockMap.
+/// @param block1 The first block the Gantry is going down to.
+/// @param block2 The second block the Gantry is going down to. May be nullptr.
+/// @param row The row the Gantry is going down into.
+/// @return True if the Gantry is above GANTRY_MIDDLE_VT or the steppers under the block(s) are idle, false otherwise.
+bool GantryInterlockClear(Block *block1, Block *block2, BlockRow row){
+	if(gantryInfo.currentY < FullSteps(GANTRY_MIDDLE_VT)){// Above the blocks, nothing to hit
+		return true;
+	}
+
+	uint32_t stepperMask = GantryInterlockMap[block1->column][row];
+	if(block2 != nullptr){
+		stepperMask |= GantryInterlockMap[block2->column][row];
+	}
+
+	return DisplaySteppersIdle(stepperMask);
+}// End of GantryInterlockClear()
+
+
+
+// Turn on the electromagnet(s) for the block(s) being swapped
+void EnergizeGantryEmags(){
+	EnergizeEmag(gantryInfo.block1->column);
+	if(HasSecondBlock()){
+		EnergizeEmag(gantryInfo.block2->column);
+	}
+}// End of EnergizeGantryEmags()
+
+
+
+/// Hold the Gantry at a block until the electromagnet(s) are done switching, and log how long it had to wait.
+/// @param emagsDone If the electromagnet(s) have finished pulling in or releasing.
+/// @return True once the Gantry can move on, false while it still needs to wait.
+bool EmagDwell(bool emagsDone){
+	if(!gantryInfo.dwelling){// Just arrived at the block
+		gantryInfo.dwelling = true;
+		emagDwellTimer = 0;
+	}
+
+	if(!emagsDone){
+		return false;
+	}
+
+	gantryInfo.dwelling = false;
+	LOG_MSG(LOG_GANTRY_DWELL, (uint32_t)emagDwellTimer);
+	return true;
+}// End of EmagDwell()
+
+
+
+/// Estimate how long a full stepping move takes
+/// @param steps The full steps in the move.
+/// @return The estimated time in microseconds.
+uint32_t EstimateTravelUs(uint32_t steps){
+	return steps * ThermalStepPeriodUs(StepPeriodUs);
+}// End of EstimateTravelUs()
+
+
+
+/// Estimate how long a leg down to a block or a drop height takes. The end of it is microstepped, like UpdateGantryStepMode() does.
+/// @param fromY The vertical position the leg starts at.
+/// @param toY The vertical position the leg ends at.
+/// @return The estimated time in microseconds.
+uint32_t EstimateApproachUs(uint16_t fromY, uint16_t toY){
+	uint16_t microstepY = GANTRY_BLOCK_TOP - blockDropHeightOffset - GantryApproachSteps;	// Where microstepping starts
+	uint32_t us = 0;
+	if(fromY < microstepY){
+		us += EstimateTravelUs(((toY < microstepY) ? toY : microstepY) - fromY);
+	}
+	if(toY > microstepY){
+		us += (uint32_t)(toY - ((fromY > microstepY) ? fromY : microstepY)) * GantryApproachMicrosteps * ThermalStepPeriodUs(GantryApproachStepPeriodUs);
+	}
+	return us;
+}// End of EstimateApproachUs()
+
+
+
+/// Estimate how long the moves of a swap will take, starting from a given position. This walks the same legs SwapBlocksProcess()
+/// does, at the speed each is stepped at. The time spent waiting on the electromagnets is the same from anywhere, so it is left out.
+/// @param block The (first) block that will be swapped.
+/// @param startX The horizontal position the Gantry starts the swap from.
+/// @param startY The vertical position the Gantry starts the swap from.
+/// @return The estimated time in microseconds.
+uint32_t EstimateSwapUs(Block *block, uint16_t startX, uint16_t startY){
+	uint16_t oldRowX = (block->storageRow == MIDDLE_ROW) ? GANTRY_MIDDLE_HZ : GANTRY_BACK;	// Where the displayed block gets stored
+	uint16_t newRowX = (block->storageRow == MIDDLE_ROW) ? GANTRY_BACK : GANTRY_MIDDLE_HZ;	// Where its partner is stored
+	uint16_t placeOldY = GANTRY_BLOCK_TOP - blockDropHeightOffset;							// Where the displayed block gets dropped
+	uint32_t us = 0;
+
+	// Get to the displayed block
+	if((startX == GANTRY_FRONT) && (startY <= GANTRY_BLOCK_TOP)){
+		us += EstimateApproachUs(startY, GANTRY_BLOCK_TOP);
+	}else{
+		us += EstimateTravelUs(startY + startX) + EstimateApproachUs(GANTRY_TOP, GANTRY_BLOCK_TOP);
+	}
+
+	us += EstimateTravelUs(GANTRY_BLOCK_TOP + oldRowX);									// Raise the old block and take it to its row
+	us += EstimateApproachUs(GANTRY_TOP, placeOldY) + EstimateTravelUs(placeOldY);		// Place it and come back up
+	us += EstimateTravelUs((newRowX > oldRowX) ? (newRowX - oldRowX) : (oldRowX - newRowX));	// Move to the new block
+	us += EstimateApproachUs(GANTRY_TOP, GANTRY_BLOCK_TOP) + EstimateTravelUs(GANTRY_BLOCK_TOP);	// Pick up the new block and raise it
+	us += EstimateTravelUs(newRowX) + EstimateApproachUs(GANTRY_TOP, GANTRY_BLOCK_TOP);	// Take it to the display row and place it
+
+	return us;
+}// End of EstimateSwapUs()
+
+
+
+// Decide where the Gantry should wait for the next swap, and start moving it there
+void ParkGantry(){
+	// Every swap starts by picking up the displayed block(s), so always wait at the front. Unless the display steppers under
+	// the next swap's block(s) are done moving, the Gantry has to stay above the display row clearance.
+	gantryInfo.targetX = FullSteps(GANTRY_FRONT);
+	gantryInfo.targetY = FullSteps(GANTRY_MIDDLE_VT);
+
+	if(nextSwap.planned){// Wait lower down if nothing under the block(s) will rotate first and it makes the swap faster, and log what it saves
+		uint32_t defaultUs = EstimateSwapUs(nextSwap.block1, GANTRY_FRONT, GANTRY_MIDDLE_VT);
+		uint32_t parkedUs = defaultUs;
+		if(nextSwap.columnsIdle && gantryStagingEnabled){
+			uint32_t stagedUs = EstimateSwapUs(nextSwap.block1, GANTRY_FRONT, GANTRY_STAGING_VT);
+			if(stagedUs < defaultUs){
+				gantryInfo.targetY = FullSteps(GANTRY_STAGING_VT);
+				parkedUs = stagedUs;
+			}
+		}
+		LOG_MSG(LOG_GANTRY_PARKING, gantryInfo.targetX.Steps(), gantryInfo.targetY.Steps(), parkedUs, defaultUs - parkedUs);
+	}
+
+	gantryInfo.state = GANTRY_PARKING;
+	if(gantryInfo.microstepCount == 0){// Back to full steps straight away if a swap just placed a block microstepping
+		UpdateGantryStepMode();
+	}
+	if(gantryInfo.currentX == gantryInfo.targetX){// Already in the right row, only move vertically
+		gantryInfo.parkStep = GANTRY_PARK_VERTICAL;
+		ChangeGantryDirection((gantryInfo.targetY > gantryInfo.currentY) ? GANTRY_DOWN : GANTRY_UP);
+	}else{
+		gantryInfo.parkStep = GANTRY_PARK_UP;
+		ChangeGantryDirection(GANTRY_UP);
+	}
+}// End of ParkGantry()
+
+
+
 // Handle the Swapping of Blocks
 void SwapBlocksProcess(){
+	if(gantryInfo.stalled){// A motor stalled, so the position can't be trusted anymore. Stop and wait to be homed
+		LOG_MSG(LOG_GANTRY_STALL, gantryInfo.swapStep);
+		swapStalls++;
+		gantryInfo.state = GANTRY_ERROR;
+		return;
+	}
+
 	switch(gantryInfo.swapStep){
 		case GANTRY_SWAP_START:
 			// Move the Gantry to the top
 			StepGantry();
-			if((gantryInfo.currentY == GANTRY_TOP) || digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentY, FullSteps(GANTRY_TOP), GantryAtLimit(GANTRY_UP))){
 				ChangeGantryDirection(GANTRY_FW);
-				gantryInfo.swapStep = GANTRY_SWAP_MOVE_FORWARD;
+				SetSwapStep(GANTRY_SWAP_MOVE_FORWARD);
 			}
 			break;
 		case GANTRY_SWAP_MOVE_FORWARD:
 			// Move the Gantry to the display row
 			StepGantry();
-			if((gantryInfo.currentX == GANTRY_FRONT) || digitalRead(GANTRY_LEFT_FW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_FW_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentX, FullSteps(GANTRY_FRONT), GantryAtLimit(GANTRY_FW))){
 				ChangeGantryDirection(GANTRY_DOWN);
-				gantryInfo.swapStep = GANTRY_SWAP_PICKUP_OLD;
+				SetSwapStep(GANTRY_SWAP_PICKUP_OLD);
 			}
 			break;
 		case GANTRY_SWAP_PICKUP_OLD:
 			// Pick up the old block
-			if(!((gantryInfo.currentY >= GANTRY_MIDDLE_VT) && (!DisplaySteppersIdle()))){// Wait for the display steppers to be idle if the Gantry is at or below the middle vertical position
-				StepGantry();
-			}
-			if((gantryInfo.currentY == GANTRY_BLOCK_TOP) || digitalRead(HOURS_SECOND_DIGIT_GANTRY_LS) || digitalRead(MINS_SECOND_DIGIT_GANTRY_LS)){// If the Gantry is at the block top position or detects a block
-				// Turn on the electromagnet(s) to pick up the block(s)
-				switch(gantryInfo.block1->column){
-					case HOURS_SECOND_DIGIT_COLUMN:
-						digitalWrite(HOURS_SECOND_DIGIT_EMAG, HIGH);
-						break;
-					case MINS_SECOND_DIGIT_COLUMN:
-						digitalWrite(MINS_SECOND_DIGIT_EMAG, HIGH);
-						break;
+			if(!GantryAtBlock()){
+				if(gantryInfo.currentY >= FullSteps(GANTRY_BLOCK_TOP - EmagPreEnergizeSteps)){// Turn on the electromagnet(s) early so the flux has built by the time the block is reached
+					EnergizeGantryEmags();
 				}
-
-				if(HasSecondBlock()){// If there is a second block, pick it up as well
-					switch(gantryInfo.block2->column){
-						case HOURS_SECOND_DIGIT_COLUMN:
-							digitalWrite(HOURS_SECOND_DIGIT_EMAG, HIGH);
-							break;
-						case MINS_SECOND_DIGIT_COLUMN:
-							digitalWrite(MINS_SECOND_DIGIT_EMAG, HIGH);
-							break;
-					}
+				if(GantryInterlockClear(gantryInfo.block1, gantryInfo.block2, DISPLAY_ROW)){// Wait for the display steppers under the block(s) to be idle if the Gantry is at or below the middle vertical position
+					StepGantry();
+				}
+			}
+			if(GantryAtBlock()){// If the Gantry is at the block top position or detects a block
+				EnergizeGantryEmags();// In case the block was found before the pre-energize point
+				if(EmagDwell(EmagsReady())){// Wait for the electromagnet(s) to finish pulling in
+					SetSwapStep(GANTRY_SWAP_RAISE_OLD);
+					ChangeGantryDirection(GANTRY_UP);
 				}
-
-				gantryInfo.swapStep = GANTRY_SWAP_RAISE_OLD;
-				ChangeGantryDirection(GANTRY_UP);
 			}
 			break;
 		case GANTRY_SWAP_RAISE_OLD:
 			// Raise the old block up
 			StepGantry();
-			if((gantryInfo.currentY == GANTRY_TOP) || digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentY, FullSteps(GANTRY_TOP), GantryAtLimit(GANTRY_UP))){
 				ChangeGantryDirection(GANTRY_BW);
-				gantryInfo.swapStep = GANTRY_SWAP_GO_TO_OLD_ROW;
+				SetSwapStep(GANTRY_SWAP_GO_TO_OLD_ROW);
 
 				// Save the block's storage position as the target position
 				switch(gantryInfo.block1->storageRow){
 					case MIDDLE_ROW:
-						gantryInfo.targetX = GANTRY_MIDDLE_HZ;
+						gantryInfo.targetX = FullSteps(GANTRY_MIDDLE_HZ);
 						break;
 					case BACK_ROW:
-						gantryInfo.targetX = GANTRY_BACK;
+						gantryInfo.targetX = FullSteps(GANTRY_BACK);
 						break;
 				}
 
@@ -329,144 +951,341 @@ void SwapBlocksProcess(){
 		case GANTRY_SWAP_GO_TO_OLD_ROW:
 			// Move the old block to the storage row
 			StepGantry();
-			if((gantryInfo.currentX == gantryInfo.targetX) || digitalRead(GANTRY_LEFT_BW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_BW_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentX, gantryInfo.targetX, GantryAtLimit(GANTRY_BW))){
 				ChangeGantryDirection(GANTRY_DOWN);
-				gantryInfo.swapStep = GANTRY_SWAP_PLACE_OLD;
+				SetSwapStep(GANTRY_SWAP_PLACE_OLD);
 			}
 			break;
 		case GANTRY_SWAP_PLACE_OLD:
 			// Place the old block in the storage row
-			StepGantry();
-			if((gantryInfo.currentY ==(GANTRY_BLOCK_TOP - blockDropHeightOffset)) || digitalRead(GANTRY_LEFT_DOWN_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_DOWN_LIMIT_SWITCH)){
-				// Turn off the electromagnet(s) to release the block(s)
-				digitalWrite(HOURS_SECOND_DIGIT_EMAG, LOW);
-				digitalWrite(MINS_SECOND_DIGIT_EMAG, LOW);
-
-				ChangeGantryDirection(GANTRY_UP);
-				gantryInfo.swapStep = GANTRY_SWAP_UP_FROM_OLD;
+			if(!GantryAtPlaceHeight(GANTRY_BLOCK_TOP - blockDropHeightOffset)){
+				StepGantry();
+			}
+			if(GantryAtPlaceHeight(GANTRY_BLOCK_TOP - blockDropHeightOffset)){
+				// Release the block(s), and wait for the release pulse to finish before moving away
+				ReleaseAllEmags();
+				if(EmagDwell(EmagsReleased())){
+					ChangeGantryDirection(GANTRY_UP);
+					SetSwapStep(GANTRY_SWAP_UP_FROM_OLD);
+				}
 			}
 			break; 
 		case GANTRY_SWAP_UP_FROM_OLD:
 			// Move up from the storage row
 			StepGantry();
-			if((gantryInfo.currentY == GANTRY_TOP) || digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
-				ChangeGantryDirection(GANTRY_FW);
-				gantryInfo.swapStep = GANTRY_SWAP_MOVE_TO_NEW;
+			if(SwapLegDone(gantryInfo.currentY, FullSteps(GANTRY_TOP), GantryAtLimit(GANTRY_UP))){
+				SetSwapStep(GANTRY_SWAP_MOVE_TO_NEW);
 				
 				// Save the new block's storage position (the row that this block was NOT fromas the target position
 				switch(gantryInfo.block1->storageRow){
 					case MIDDLE_ROW:
-						gantryInfo.targetX = GANTRY_BACK;
+						gantryInfo.targetX = FullSteps(GANTRY_BACK);
 						break;
 					case BACK_ROW:
-						gantryInfo.targetX = GANTRY_MIDDLE_HZ;
+						gantryInfo.targetX = FullSteps(GANTRY_MIDDLE_HZ);
 						break;
 				}
 
-				if(gantryInfo.targetX > gantryInfo.currentX){
-					ChangeGantryDirection(GANTRY_FW);
-				}else{
+				if(gantryInfo.targetX > gantryInfo.currentX){// X counts back from the front, so a bigger X is further back
 					ChangeGantryDirection(GANTRY_BW);
+				}else{
+					ChangeGantryDirection(GANTRY_FW);
 				}
 			}
 			break;
 		case GANTRY_SWAP_MOVE_TO_NEW:
 			// Move to the new block
 			StepGantry();
-			if((gantryInfo.currentX == gantryInfo.targetX) || digitalRead(GANTRY_LEFT_FW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_FW_LIMIT_SWITCH) || digitalRead(GANTRY_LEFT_BW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_BW_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentX, gantryInfo.targetX, GantryAtLimit(GANTRY_FW) || GantryAtLimit(GANTRY_BW))){
 				ChangeGantryDirection(GANTRY_DOWN);
-				gantryInfo.swapStep = GANTRY_SWAP_PICKUP_NEW;
+				SetSwapStep(GANTRY_SWAP_PICKUP_NEW);
 			}
 			break;
 		case GANTRY_SWAP_PICKUP_NEW:
 			// Pick up the new block
-			StepGantry();
-
-			if((gantryInfo.currentY == GANTRY_BLOCK_TOP) || digitalRead(HOURS_SECOND_DIGIT_GANTRY_LS) || digitalRead(MINS_SECOND_DIGIT_GANTRY_LS)){// If the Gantry is at the block top position or detects a block
-				// Turn on the electromagnet(s) to pick up the block(s)
-				switch(gantryInfo.block1->column){
-					case HOURS_SECOND_DIGIT_COLUMN:
-						digitalWrite(HOURS_SECOND_DIGIT_EMAG, HIGH);
-						break;
-					case MINS_SECOND_DIGIT_COLUMN:
-						digitalWrite(MINS_SECOND_DIGIT_EMAG, HIGH);
-						break;
+			if(!GantryAtBlock()){
+				if(gantryInfo.currentY >= FullSteps(GANTRY_BLOCK_TOP - EmagPreEnergizeSteps)){// Turn on the electromagnet(s) early so the flux has built by the time the block is reached
+					EnergizeGantryEmags();
 				}
-
-				if(HasSecondBlock()){// If there is a second block, pick it up as well
-					switch(gantryInfo.block2->column){
-						case HOURS_SECOND_DIGIT_COLUMN:
-							digitalWrite(HOURS_SECOND_DIGIT_EMAG, HIGH);
-							break;
-						case MINS_SECOND_DIGIT_COLUMN:
-							digitalWrite(MINS_SECOND_DIGIT_EMAG, HIGH);
-							break;
-					}
+				StepGantry();
+			}
+			if(GantryAtBlock()){// If the Gantry is at the block top position or detects a block
+				EnergizeGantryEmags();// In case the block was found before the pre-energize point
+				if(EmagDwell(EmagsReady())){// Wait for the electromagnet(s) to finish pulling in
+					SetSwapStep(GANTRY_SWAP_RAISE_NEW);
+					ChangeGantryDirection(GANTRY_UP);
 				}
-
-				gantryInfo.swapStep = GANTRY_SWAP_MOVE_NEW_FORWARD;
-				ChangeGantryDirection(GANTRY_UP);
 			}
 			break;
 		case GANTRY_SWAP_RAISE_NEW:
 			// Raise the new block up
 			StepGantry();
-			if((gantryInfo.currentY == GANTRY_TOP) || digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentY, FullSteps(GANTRY_TOP), GantryAtLimit(GANTRY_UP))){
 				ChangeGantryDirection(GANTRY_FW);
-				gantryInfo.swapStep = GANTRY_SWAP_MOVE_NEW_FORWARD;
+				SetSwapStep(GANTRY_SWAP_MOVE_NEW_FORWARD);
 			}
 			break;
 		case GANTRY_SWAP_MOVE_NEW_FORWARD:
 			// Move the new block to the display row
 			StepGantry();
-			if((gantryInfo.currentX == GANTRY_FRONT) || digitalRead(GANTRY_LEFT_FW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_FW_LIMIT_SWITCH)){
+			if(SwapLegDone(gantryInfo.currentX, FullSteps(GANTRY_FRONT), GantryAtLimit(GANTRY_FW))){
 				ChangeGantryDirection(GANTRY_DOWN);
-				gantryInfo.swapStep = GANTRY_SWAP_PLACE_NEW;
+				SetSwapStep(GANTRY_SWAP_PLACE_NEW);
 			}
 			break;
 		case GANTRY_SWAP_PLACE_NEW:
 			// Place the new block in the display row
-			StepGantry();
-			if((gantryInfo.currentY == GANTRY_BLOCK_TOP) || digitalRead(GANTRY_LEFT_DOWN_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_DOWN_LIMIT_SWITCH)){
-				// Turn off the electromagnet(s) to release the block(s)
-				digitalWrite(HOURS_SECOND_DIGIT_EMAG, LOW);
-				digitalWrite(MINS_SECOND_DIGIT_EMAG, LOW);
-
-				ChangeGantryDirection(GANTRY_UP);
-				gantryInfo.swapStep = GANTRY_SWAP_END;
+			if(!GantryAtPlaceHeight(GANTRY_BLOCK_TOP) && GantryInterlockClear(gantryInfo.block1, gantryInfo.block2, DISPLAY_ROW)){// Wait for the display steppers under the block(s) to be idle if the Gantry is at or below the middle vertical position
+				StepGantry();
+			}
+			if(GantryAtPlaceHeight(GANTRY_BLOCK_TOP)){
+				// Release the block(s), and wait for the release pulse to finish before moving away
+				ReleaseAllEmags();
+				if(EmagDwell(EmagsReleased())){
+					ChangeGantryDirection(GANTRY_UP);
+					SetSwapStep(GANTRY_SWAP_END);
+				}
 			}
 			break;
 		case GANTRY_SWAP_END:
-			// Move to the middle position
+			// Let BlockManager know which blocks are displayed now
+			BlockSwapped(gantryInfo.block1);
+			if(HasSecondBlock()){
+				BlockSwapped(gantryInfo.block2);
+			}
+
+			CountSwap(gantrySwapTimer);
+			if(swapParkingSpot >= 0){
+				parkedSwaps[swapParkingSpot]++;
+				parkedSwapMs[swapParkingSpot] += gantrySwapTimer;
+			}
+
+			// Park the Gantry wherever the next swap will start the fastest
+			ParkGantry();
+			break;
+		case NUM_SWAP_STEPS:// Only a count of the steps
+			break;
+	}
+}// End of SwapBlocksProcess()
+
+
+
+// Handle Parking the Gantry
+void ParkGantryProcess(){
+	switch(gantryInfo.parkStep){
+		case GANTRY_PARK_UP:
+			// Move the Gantry to the top so it can cross the rows
+			StepGantry();
+			if((gantryInfo.currentY == FullSteps(GANTRY_TOP)) || GantryAtLimit(gantryInfo.dir)){
+				ChangeGantryDirection((gantryInfo.targetX > gantryInfo.currentX) ? GANTRY_BW : GANTRY_FW);
+				gantryInfo.parkStep = GANTRY_PARK_ACROSS;
+			}
+			break;
+		case GANTRY_PARK_ACROSS:
+			// Move the Gantry to the parking row
+			StepGantry();
+			if((gantryInfo.currentX == gantryInfo.targetX) || GantryAtLimit(gantryInfo.dir)){// Only the switches ahead end the leg
+				ChangeGantryDirection(GANTRY_DOWN);
+				gantryInfo.parkStep = GANTRY_PARK_VERTICAL;
+			}
+			break;
+		case GANTRY_PARK_VERTICAL:
+			// Move the Gantry to the parking height
+			if(gantryInfo.currentY == gantryInfo.targetY){
+				gantryInfo.state = GANTRY_IDLE;
+				break;
+			}
+			if((gantryInfo.dir == GANTRY_DOWN) && nextSwap.planned && !GantryInterlockClear(nextSwap.block1, nextSwap.block2, DISPLAY_ROW)){// Don't go down into a column that is still rotating
+				break;
+			}
 			StepGantry();
-			if((gantryInfo.currentY == GANTRY_MIDDLE_VT) || digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
+			if((gantryInfo.currentY == gantryInfo.targetY) || GantryAtLimit(gantryInfo.dir)){// Only the switches ahead end the leg, not the one it is leaving
 				gantryInfo.state = GANTRY_IDLE;
 			}
 			break;
 	}
-}// End of SwapBlocksProcess()
+}// End of ParkGantryProcess()
 
 
 
-// Handle the Homing of the Gantry
+/// Move on to the next step of homing, starting its move from rest
+/// @param step The next step.
+void SetHomeStep(GantryHomeStep step){
+	ClearGantryStall();
+	gantryInfo.homeStep = step;
+	gantryInfo.homeSteps = 0;
+}// End of SetHomeStep()
+
+
+
+/// Run toward a hard stop until its limit switch trips or the motors stall. A stall while still ramping up is taken as a
+/// step lost starting off, not as the stop, so it is cleared and the move goes on.
+/// @param dir The direction of the hard stop.
+/// @param next The step to go on to once the stop is found.
+void HomingFastStep(GantryDirection dir, GantryHomeStep next){
+	ChangeGantryDirection(dir);
+	if(gantryInfo.stalled && (gantryInfo.homeSteps < GantryHomingRampSteps)){
+		ClearGantryStall();
+	}
+	if(gantryInfo.stalled || GantryAtLimit(dir)){
+		SetHomeStep(next);
+		return;
+	}
+	StepGantry();
+	gantryInfo.homeSteps++;
+}// End of HomingFastStep()
+
+
+
+/// Back off a hard stop, so the limit switch can be found again slowly
+/// @param dir The direction away from the hard stop.
+/// @param next The step to go on to once backed off.
+void HomingBackoffStep(GantryDirection dir, GantryHomeStep next){
+	ChangeGantryDirection(dir);
+	if(gantryInfo.homeSteps >= GantryHomingBackoffSteps){
+		SetHomeStep(next);
+		return;
+	}
+	StepGantry();
+	gantryInfo.homeSteps++;
+}// End of HomingBackoffStep()
+
+
+
+/// Creep back toward a hard stop until its limit switch trips. Only the switch sets the position, so a stall away from
+/// the stop (a jam) isn't taken as home. If the switch isn't found within twice the back off, the Gantry stops with an error.
+/// @param dir The direction of the hard stop.
+/// @return True once the limit switch has tripped.
+bool HomingSeekStep(GantryDirection dir){
+	ChangeGantryDirection(dir);
+	if(GantryAtLimit(dir)){
+		return true;
+	}
+	if(gantryInfo.homeSteps >= 2 * GantryHomingBackoffSteps){
+		LOG_MSG(LOG_GANTRY_HOME_NO_SWITCH, dir);
+		gantryInfo.state = GANTRY_ERROR;
+		return false;
+	}
+	StepGantry();
+	gantryInfo.homeSteps++;
+	return false;
+}// End of HomingSeekStep()
+
+
+
+// Handle the Homing of the Gantry. Each axis runs fast toward its hard stop until its limit switch trips or its motors stall,
+// then backs off and creeps back onto the limit switch, which is what sets the position.
 void HomeGantryProcess(){
 	switch(gantryInfo.homeStep){
 		case GANTRY_HOMEING_UP:
-			ChangeGantryDirection(GANTRY_UP);
-			StepGantry();
-			if(digitalRead(GANTRY_LEFT_UP_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_UP_LIMIT_SWITCH)){
-				gantryInfo.homeStep = GANTRY_HOMING_FORWARD;
+			HomingFastStep(GANTRY_UP, GANTRY_HOMING_UP_BACKOFF);
+			break;
+		case GANTRY_HOMING_UP_BACKOFF:
+			HomingBackoffStep(GANTRY_DOWN, GANTRY_HOMING_UP_SEEK);
+			break;
+		case GANTRY_HOMING_UP_SEEK:
+			if(HomingSeekStep(GANTRY_UP)){
+				gantryInfo.currentY = FullSteps(GANTRY_TOP);
+				SetHomeStep(GANTRY_HOMING_FORWARD);
 			}
 			break;
 		case GANTRY_HOMING_FORWARD:
-			ChangeGantryDirection(GANTRY_FW);
-			StepGantry();
-			if(digitalRead(GANTRY_LEFT_FW_LIMIT_SWITCH) || digitalRead(GANTRY_RIGHT_FW_LIMIT_SWITCH)){
+			HomingFastStep(GANTRY_FW, GANTRY_HOMING_FORWARD_BACKOFF);
+			break;
+		case GANTRY_HOMING_FORWARD_BACKOFF:
+			HomingBackoffStep(GANTRY_BW, GANTRY_HOMING_FORWARD_SEEK);
+			break;
+		case GANTRY_HOMING_FORWARD_SEEK:
+			if(HomingSeekStep(GANTRY_FW)){
+				gantryInfo.currentX = FullSteps(GANTRY_FRONT);
+				gantryInfo.stepPeriodUs = StepPeriodUs;
 				gantryInfo.state = GANTRY_IDLE;
+				if(GantrySquareAfterHoming){
+					SquareGantry();
+				}
 			}
 			break;
 	}
-}
+}// End of HomeGantryProcess()
+
+
+
+
+
+// Handle Squaring the Gantry. Each side is stepped on its own until its own limit switch trips, and the steps
+// the second side needs after the first one stops are the skew.
+void SquareGantryProcess(){
+	GantryDirection dir = (gantryInfo.squareStep == GANTRY_SQUARE_UP) ? GANTRY_UP : GANTRY_FW;
+	ChangeGantryDirection(dir);
+
+	for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){
+		if(!gantryInfo.sideSquared[i] && GantrySideAtLimit((GantrySide)i, dir)){
+			gantryInfo.sideSquared[i] = true;
+		}
+	}
+
+	bool leftDone = gantryInfo.sideSquared[GANTRY_LEFT_SIDE];
+	bool rightDone = gantryInfo.sideSquared[GANTRY_RIGHT_SIDE];
+
+	if(!leftDone || !rightDone){// Keep stepping the side(s) that haven't reached their switch
+		if(leftDone != rightDone){// One side is waiting on the other, so this step is skew
+			gantryInfo.skewSteps += leftDone ? 1 : -1;
+			if(abs(gantryInfo.skewSteps) > GantryMaxSkewSteps){
+				SERIAL_PRINTF("ERROR: Gantry skew is over %d steps, check the %s side\n", GantryMaxSkewSteps, leftDone ? "right" : "left");
+				gantryInfo.state = GANTRY_ERROR;
+				return;
+			}
+		}
+
+		uint8_t stepMask = 0;
+		for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){
+			if(!gantryInfo.sideSquared[i]){
+				stepMask |= (1 << i);
+			}
+		}
+		SpiAcquire(SPI_CLIENT_GANTRY);
+		StepGantrySides(stepMask);
+		SpiRelease();
+		return;
+	}
+
+	// Both sides are at their switches, so this axis is square
+	bool vertical = (gantryInfo.squareStep == GANTRY_SQUARE_UP);
+	gantryInfo.skew[vertical] = gantryInfo.skewSteps;
+	SERIAL_PRINTF("Gantry %s skew: %d steps\n", vertical ? "vertical" : "horizontal", gantryInfo.skewSteps);
+
+	gantryInfo.skewSteps = 0;
+	gantryInfo.sideSquared[GANTRY_LEFT_SIDE] = false;
+	gantryInfo.sideSquared[GANTRY_RIGHT_SIDE] = false;
+
+	if(vertical){
+		gantryInfo.currentY = FullSteps(GANTRY_TOP);
+		gantryInfo.squareStep = GANTRY_SQUARE_FORWARD;
+	}else{
+		gantryInfo.currentX = FullSteps(GANTRY_FRONT);
+		for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){// Trim out any misalignment of the limit switches on the next moves along each axis
+			gantryInfo.sideOffset[0][i] = GantrySquareTrim[0][i];
+			gantryInfo.sideOffset[1][i] = GantrySquareTrim[1][i];
+		}
+		gantryInfo.state = GANTRY_IDLE;
+	}
+}// End of SquareGantryProcess()
+
+
+
+// Handle Jogging the Gantry. The jog stops early at a limit switch or a stall, so a jog can't drive the Gantry into the frame.
+void JogGantryProcess(){
+	if((gantryInfo.jogSteps == 0) || gantryInfo.stalled || GantrySideAtLimit(GANTRY_LEFT_SIDE, gantryInfo.dir) || GantrySideAtLimit(GANTRY_RIGHT_SIDE, gantryInfo.dir)){
+		gantryInfo.jogSteps = 0;
+		gantryInfo.state = GANTRY_IDLE;
+		return;
+	}
+
+	StepGantry();
+	if(gantryInfo.microstepCount == 0){// Finished a full step
+		gantryInfo.jogSteps--;
+	}
+}// End of JogGantryProcess()
 
 
 
@@ -478,9 +1297,12 @@ void HomeGantryProcess(){
 
 // Initialize the Gantry
 void InitGantry(){
-	SPI.begin();
+	SpiAcquire(SPI_CLIENT_GANTRY);
 
 	// Set the Chip Select Pins for the Stepper Drivers
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		stepperDrivers[i].setChipSelectPin(StepperDriverCSPins[i]);
+	}
 
 	// Wait for the Stepper Drivers to initialize
 	delay(1);
@@ -496,28 +1318,81 @@ void InitGantry(){
 		// Set Current Limit for the Stepper Motor
 		stepperDrivers[i].setCurrentMilliamps36v4(StepperCurrentLimit);
 
-		// Set the Step Mode for the Stepper Motor
-		stepperDrivers[i].setStepMode(HPSDStepMode::MicroStep1);
+		// Set the Step Mode for the Stepper Motor. This gets changed while moving by UpdateGantryStepMode()
+		stepperDrivers[i].setStepMode(GantryTravelStepMode);
+
+		// Set up stall detection
+		stepperDrivers[i].driver.writeReg(HPSDRegAddr::STALL, GantryStallRegister);
 
 		// Enable the Motor Outputs
 		stepperDrivers[i].enableDriver();
 	}
 
-	// Set up and turn off the electromagnets
-	pinMode(HOURS_SECOND_DIGIT_EMAG, OUTPUT);
-	pinMode(MINS_SECOND_DIGIT_EMAG, OUTPUT);
+	SpiRelease();
 
-	digitalWrite(HOURS_SECOND_DIGIT_EMAG, LOW);
-	digitalWrite(MINS_SECOND_DIGIT_EMAG, LOW);
+	gantryInfo.microsteps = GantryTravelMicrosteps;
+	gantryInfo.microstepCount = 0;
+	gantryInfo.stepPeriodUs = StepPeriodUs;
+
+	// Set up and turn off the electromagnets
+	InitElectromagnets();
 
 
 	// Set up the Gantry Limit Switches
 
-	// Set the Gantry to the Home Position              TODO
+	// Set the Gantry to the Home Position
+	HomeGantry();
 }// End of InitGantry()
 
 
 
+/// Square the Gantry by driving each side up and then forward until its own limit switch trips. The skew between
+/// the sides is measured and logged. The Gantry ends up at the top front, just like after homing.
+void SquareGantry(){
+	// Squaring is done full stepping, since each side is stepped on its own
+	SetGantryStepMode(GantryTravelStepMode, GantryTravelMicrosteps, StepPeriodUs);
+
+	gantryInfo.state = GANTRY_SQUARING;
+	gantryInfo.squareStep = GANTRY_SQUARE_UP;
+	gantryInfo.skewSteps = 0;
+	for(uint8_t i = 0; i < NUM_GANTRY_SIDES; i++){
+		gantryInfo.sideSquared[i] = false;
+		gantryInfo.sideOffset[0][i] = 0;
+		gantryInfo.sideOffset[1][i] = 0;
+	}
+	gantryInfo.extraStepMask = 0;
+}// End of SquareGantry()
+
+
+
+/// Add a step offset to one side of the Gantry on one axis. The offset is worked off during the next moves along that
+/// axis, by giving that side an extra step when moving the way of the offset or one fewer when moving against it.
+/// @param side The side to offset.
+/// @param vertical True for the vertical axis, false for the horizontal axis.
+/// @param steps The number of steps to offset that side by. Positive is down or back.
+void SetGantrySideOffset(GantrySide side, bool vertical, int16_t steps){
+	gantryInfo.sideOffset[vertical][side] += steps;
+}// End of SetGantrySideOffset()
+
+
+
+/// Get the skew measured the last time the Gantry was squared
+/// @param vertical True for the skew on the vertical axis, false for the horizontal axis.
+/// @return The skew in steps. Positive means the left side reached its limit switch first.
+int16_t GetGantrySkew(bool vertical){
+	return gantryInfo.skew[vertical];
+}// End of GetGantrySkew()
+
+
+
+/// Check if a stall has been detected on the Gantry
+/// @return True if one of the motors stalled since the Gantry was last homed.
+bool GantryStalled(){
+	return gantryInfo.stalled;
+}
+
+
+
 /// Get the current state of the Gantry
 /// @return The current state of the Gantry.
 GantryState GetGantryState(){
@@ -526,6 +1401,235 @@ GantryState GetGantryState(){
 
 
 
+/// Get the name of a Gantry state, for printing or showing on the display
+/// @param state The state.
+/// @return The name of the state.
+const char *GetGantryStateName(GantryState state){
+	return GantryStateNames[state];
+}// End of GetGantryStateName()
+
+
+
+/// Get the step the Gantry is on in its current process (swapping, homing, parking, ...)
+/// @return The step number, from the enumeration for the current process.
+uint8_t GetGantryStep(){
+	switch(gantryInfo.state){
+		case GANTRY_CALIBRATING:
+			return gantryInfo.calStep;
+		case GANTRY_SWAPPING_BLOCKS:
+			return gantryInfo.swapStep;
+		case GANTRY_HOMING:
+			return gantryInfo.homeStep;
+		case GANTRY_PARKING:
+			return gantryInfo.parkStep;
+		case GANTRY_SQUARING:
+			return gantryInfo.squareStep;
+		default:
+			return 0;
+	}
+}// End of GetGantryStep()
+
+
+
+/// Jog the Gantry a number of full steps in one direction. The jog stops early at a limit switch or a stall.
+/// Only works while the Gantry is idle or stopped by an error.
+/// @param dir The direction to jog.
+/// @param steps The number of full steps to jog.
+/// @return True if the jog was started, false if the Gantry is busy.
+bool JogGantry(GantryDirection dir, uint16_t steps){
+	if(((gantryInfo.state != GANTRY_IDLE) && (gantryInfo.state != GANTRY_ERROR)) || (dir == GANTRY_NO_DIR)){
+		return false;
+	}
+
+	ClearGantryStall();
+	ChangeGantryDirection(dir);
+	gantryInfo.jogSteps = steps;
+	gantryInfo.state = GANTRY_JOGGING;
+	return true;
+}// End of JogGantry()
+
+
+
+/// Get the time until the Gantry takes its next step
+/// @return The time in microseconds, 0 if a step is due now, or UINT32_MAX if the Gantry isn't moving.
+uint32_t GetGantryStepSlackUs(){
+	if((gantryInfo.state == GANTRY_IDLE) || (gantryInfo.state == GANTRY_ERROR)){
+		return UINT32_MAX;
+	}
+
+	uint32_t sinceLastStep = timeSinceLastStep;
+	uint32_t nextStepUs = (gantryInfo.extraStepMask != 0) ? (gantryInfo.stepPeriodUs / 2) : gantryInfo.stepPeriodUs;	// An extra step is due half way through
+	if(sinceLastStep >= nextStepUs){
+		return 0;
+	}
+	return nextStepUs - sinceLastStep;
+}// End of GetGantryStepSlackUs()
+
+
+
+/// Print the state, position, and driver settings of the Gantry over serial
+void PrintGantryStatus(){
+	SERIAL_PRINTF("Gantry: state %s, dir %s, at %ld+%u/256, %ld+%u/256, target %ld, %ld\n", GantryStateNames[gantryInfo.state], GantryDirectionNames[gantryInfo.dir],
+		gantryInfo.currentX.Steps(), gantryInfo.currentX.Fraction(), gantryInfo.currentY.Steps(), gantryInfo.currentY.Fraction(), gantryInfo.targetX.Steps(), gantryInfo.targetY.Steps());
+	SERIAL_PRINTF("Gantry: 1/%u microstepping, %u us/step (%ld steps/s), %u mA, stalled %u, skew %d, %d\n", gantryInfo.microsteps, gantryInfo.stepPeriodUs,
+		StepVelocity::FromPeriodUs(gantryInfo.stepPeriodUs, gantryInfo.microsteps).StepsPerSecond(), GetGantryCurrent(), gantryInfo.stalled, gantryInfo.skew[0], gantryInfo.skew[1]);
+	SERIAL_PRINTF("Gantry: %lu swaps from the parking spot averaging %lu ms, %lu from the staging height averaging %lu ms\n", parkedSwaps[0],
+		(parkedSwaps[0] == 0) ? 0 : parkedSwapMs[0] / parkedSwaps[0], parkedSwaps[1], (parkedSwaps[1] == 0) ? 0 : parkedSwapMs[1] / parkedSwaps[1]);
+}// End of PrintGantryStatus()
+
+
+
+/// Change the power level of the Gantry stepper drivers. The drivers are brought back to full power
+/// automatically as soon as the Gantry needs to move.
+/// @param level The new power level.
+void SetGantryPower(GantryPowerLevel level){
+	if(gantryPower == level){
+		return;
+	}
+
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		switch(level){
+			case GANTRY_POWER_FULL:
+				stepperDrivers[i].setCurrentMilliamps36v4(gantryCurrentLimit);
+				stepperDrivers[i].enableDriver();
+				break;
+			case GANTRY_POWER_HOLD:
+				stepperDrivers[i].setCurrentMilliamps36v4(StepperHoldCurrent);
+				stepperDrivers[i].enableDriver();
+				break;
+			case GANTRY_POWER_OFF:
+				stepperDrivers[i].disableDriver();
+				break;
+		}
+	}
+	SpiRelease();
+
+	gantryPower = level;
+}// End of SetGantryPower()
+
+
+
+/// Get the power level of the Gantry stepper drivers
+/// @return The current power level.
+GantryPowerLevel GetGantryPower(){
+	return gantryPower;
+}
+
+
+
+/// Get the current going through each Gantry motor at the current power level
+/// @return The current in mA, or 0 if the drivers are off.
+uint16_t GetGantryCurrent(){
+	switch(gantryPower){
+		case GANTRY_POWER_FULL:
+			return gantryCurrentLimit;
+		case GANTRY_POWER_HOLD:
+			return StepperHoldCurrent;
+		default:
+			return 0;
+	}
+}
+
+
+
+/// Change the current used at full power, so the Thermal Model can turn it down. The drivers are only rewritten if
+/// the limit changed and they are at full power.
+/// @param currentMa The new current limit, no more than StepperCurrentLimit.
+void SetGantryCurrentLimit(uint16_t currentMa){
+	if(currentMa > StepperCurrentLimit){
+		currentMa = StepperCurrentLimit;
+	}
+	if(currentMa == gantryCurrentLimit){
+		return;
+	}
+	gantryCurrentLimit = currentMa;
+
+	if(gantryPower != GANTRY_POWER_FULL){// Picked up the next time the drivers are brought back to full power
+		return;
+	}
+
+	SpiAcquire(SPI_CLIENT_GANTRY);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		stepperDrivers[i].setCurrentMilliamps36v4(gantryCurrentLimit);
+	}
+	SpiRelease();
+}// End of SetGantryCurrentLimit()
+
+
+
+/// Print the time each step of the block swap process took, and how often it ended on a limit switch, over serial
+void PrintSwapStats(){
+	for(uint8_t i = 0; i < NUM_SWAP_STEPS; i++){
+		SwapStepStats *stats = &swapStats[i];
+		if(stats->count == 0){
+			continue;
+		}
+		SERIAL_PRINTF("%-16s n %lu, min %lu us, mean %lu us, max %lu us, limit ends %lu (max %lu steps off)\n", GantrySwapStepNames[i], stats->count,
+			stats->minUs, stats->totalUs / stats->count, stats->maxUs, stats->limitEnds, stats->maxLimitErrorSteps);
+
+		// The duration histogram, only the buckets that have something in them
+		SERIAL_PRINTF("%-16s", " ");
+		for(uint8_t b = 0; b < SwapStatsBuckets; b++){
+			if(stats->histogram[b] == 0){
+				continue;
+			}
+			if(b == SwapStatsBuckets - 1){
+				SERIAL_PRINTF(" >=%lums:%u", (uint32_t)1 << (b - 1), stats->histogram[b]);
+			}else{
+				SERIAL_PRINTF(" <%lums:%u", (uint32_t)1 << b, stats->histogram[b]);
+			}
+		}
+		SERIAL_PRINTF("%s\n", "");
+	}
+	SERIAL_PRINTF("Missed step detections: %lu, stalls: %lu\n", swapMissedSteps, swapStalls);
+}// End of PrintSwapStats()
+
+
+
+/// Clear the swap stats
+void ResetSwapStats(){
+	memset(swapStats, 0, sizeof(swapStats));
+	swapMissedSteps = 0;
+	swapStalls = 0;
+}// End of ResetSwapStats()
+
+
+
+/// Get the number of swap legs that ended on a limit switch too far from their target, which means steps were missed
+/// @return The number of missed step detections since the stats were reset.
+uint32_t GetSwapMissedSteps(){
+	return swapMissedSteps;
+}// End of GetSwapMissedSteps()
+
+
+
+/// Get the number of swaps stopped by a stall
+/// @return The number of stalls since the stats were reset.
+uint32_t GetSwapStalls(){
+	return swapStalls;
+}// End of GetSwapStalls()
+
+
+
+/// Get the number of step pulses sent to a Gantry motor since power on. Each microstep counts as a step pulse.
+/// @param motor The motor to check.
+/// @return The number of step pulses.
+uint32_t GetGantryMotorSteps(GantryMotor motor){
+	return gantryMotorSteps[motor];
+}// End of GetGantryMotorSteps()
+
+
+
+/// Get the number of times a Gantry motor has been turned round since power on
+/// @param motor The motor to check.
+/// @return The number of reversals.
+uint32_t GetGantryMotorReversals(GantryMotor motor){
+	return gantryMotorReversals[motor];
+}// End of GetGantryMotorReversals()
+
+
+
 /// Get the current direction of the Gantry
 /// @return The current direction of the Gantry.
 GantryDirection GetGantryDirection(){
@@ -538,10 +1642,10 @@ GantryDirection GetGantryDirection(){
 /// That should be handled by the calling function in BlockManager.
 /// @param block1 The first block to swap.
 /// @param block2 The second block to swap. If nullptr, only block1 will be swapped.
-void SwapBlocks(Block *block1, Block *block2 = nullptr){
+void SwapBlocks(Block *block1, Block *block2){
 	if(block2 != nullptr){
 		if(block1->storageRow != block2->storageRow){
-			SERIAL_PRINTF("ERROR: %s\n", "Gantry was told to move blocks that are not in the same row.");
+			LOG_MSG(LOG_SWAP_ROW_MISMATCH);
 			return;									// If the blocks are not in the same row, return. This should have been handled by the calling function.
 		}
 	}
@@ -550,13 +1654,32 @@ void SwapBlocks(Block *block1, Block *block2 = nullptr){
 	gantryInfo.block1 = block1;
 	gantryInfo.block2 = block2;
 
+	// This swap was planned for, so the Gantry can forget about it
+	nextSwap.planned = false;
+
+	// Note which parking spot the swap starts from, to compare how long they take
+	swapParkingSpot = -1;
+	if(gantryInfo.currentX == FullSteps(GANTRY_FRONT)){
+		if(gantryInfo.currentY == FullSteps(GANTRY_MIDDLE_VT)){
+			swapParkingSpot = 0;
+		}else if(gantryInfo.currentY == FullSteps(GANTRY_STAGING_VT)){
+			swapParkingSpot = 1;
+		}
+	}
+
 	// Set the Gantry to the Swap Blocks state
 	gantryInfo.state = GANTRY_SWAPPING_BLOCKS;
 	gantryInfo.swapStep = GANTRY_SWAP_START;
+	swapStepTimer = 0;
+	gantrySwapTimer = 0;
+	legEndedOnLimit = false;
 
-	if((gantryInfo.currentY == GANTRY_MIDDLE_VT) && (gantryInfo.currentX == GANTRY_FRONT)){// If the Gantry is at the middle vertical position, skip to pickup the old block
+	if((gantryInfo.currentX == FullSteps(GANTRY_FRONT)) && (gantryInfo.currentY <= FullSteps(GANTRY_BLOCK_TOP))){// If the Gantry is parked above the display row, skip to pickup the old block
 		gantryInfo.swapStep = GANTRY_SWAP_PICKUP_OLD;
 		ChangeGantryDirection(GANTRY_DOWN);
+	}else if(gantryInfo.currentY == FullSteps(GANTRY_TOP)){// If the Gantry is already at the top, skip to moving forward
+		gantryInfo.swapStep = GANTRY_SWAP_MOVE_FORWARD;
+		ChangeGantryDirection(GANTRY_FW);
 	}else{
 		gantryInfo.swapStep = GANTRY_SWAP_START;
 		ChangeGantryDirection(GANTRY_UP);
@@ -566,10 +1689,108 @@ void SwapBlocks(Block *block1, Block *block2 = nullptr){
 
 
 
+/// Tell the Gantry which block(s) the next swap will involve, so it can park where that swap will start the fastest.
+/// This should be called by BlockManager as soon as it knows what the next swap will be.
+/// @param block1 The first block of the next swap.
+/// @param block2 The second block of the next swap. If nullptr, only block1 will be swapped.
+/// @param columnsIdle True if the display steppers under the block(s) will not move again before the swap. Only then
+///		can the Gantry wait below the display row clearance (GANTRY_MIDDLE_VT).
+void PlanNextSwap(Block *block1, Block *block2, bool columnsIdle){
+	if(nextSwap.planned && (nextSwap.block1 == block1) && (nextSwap.block2 == block2) && (nextSwap.columnsIdle == columnsIdle)){// Nothing new, so stay parked where it is
+		return;
+	}
+
+	nextSwap.planned = true;
+	nextSwap.columnsIdle = columnsIdle;
+	nextSwap.block1 = block1;
+	nextSwap.block2 = block2;
+
+	if(gantryInfo.state == GANTRY_IDLE){// Move to the new parking spot now if the Gantry isn't busy
+		ParkGantry();
+	}
+}// End of PlanNextSwap()
+
+
+
+/// Check if the block displayed in a column can rotate without hitting the Gantry. Only the columns of the swap the Gantry
+/// is waiting for or doing are under it, and only below GANTRY_MIDDLE_VT. A Gantry waiting there is sent back up to
+/// GANTRY_MIDDLE_VT, and the rotation has to wait until it gets there.
+/// @param column The column to rotate.
+/// @return True if the column can rotate now, false if it has to wait for the Gantry.
+bool GantryClearOfColumn(BlockColumn column){
+	if((gantryInfo.currentX != FullSteps(GANTRY_FRONT)) || (gantryInfo.currentY <= FullSteps(GANTRY_MIDDLE_VT))){// Over the storage rows or above the display row clearance
+		return true;
+	}
+
+	uint32_t stepperMask = BLOCK_STEPPER_MASK(column);
+	switch(gantryInfo.state){
+		case GANTRY_SWAPPING_BLOCKS:
+			if(gantryInfo.block1->column == column){
+				return false;
+			}
+			return !HasSecondBlock() || (gantryInfo.block2->column != column);
+		case GANTRY_IDLE:
+		case GANTRY_PARKING:
+			if(nextSwap.planned){
+				uint32_t underMask = GantryInterlockMap[nextSwap.block1->column][DISPLAY_ROW];
+				if(nextSwap.block2 != nullptr){
+					underMask |= GantryInterlockMap[nextSwap.block2->column][DISPLAY_ROW];
+				}
+				if(!(underMask & stepperMask)){
+					return true;
+				}
+			}
+			// Lift the Gantry to the display row clearance, unless it is on its way. BlockManager won't plan to stage over the column
+			// again until it has turned
+			nextSwap.columnsIdle = false;
+			if((gantryInfo.state == GANTRY_IDLE) || (gantryInfo.targetY > FullSteps(GANTRY_MIDDLE_VT))){
+				ParkGantry();
+			}
+			return false;
+		default:// Anywhere else it is being moved by hand or is lost, so leave the display row alone
+			return false;
+	}
+}// End of GantryClearOfColumn()
+
+
+
+/// Let the Gantry wait for a swap at the staging height when the columns under it are idle. On by default, and turned
+/// off to measure what staging saves.
+/// @param enabled If the Gantry may wait at the staging height.
+void SetGantryStaging(bool enabled){
+	gantryStagingEnabled = enabled;
+}// End of SetGantryStaging()
+
+
+
+/// Get how many swaps started from one of the parking spots, and how long they took on average
+/// @param staged True for the staging height, false for the default parking spot.
+/// @param averageMs Set to the average time those swaps took, or 0 if there were none.
+/// @return The number of swaps.
+uint32_t GetParkedSwaps(bool staged, uint32_t *averageMs){
+	*averageMs = (parkedSwaps[staged] == 0) ? 0 : parkedSwapMs[staged] / parkedSwaps[staged];
+	return parkedSwaps[staged];
+}// End of GetParkedSwaps()
+
+
+
 // Move the Gantry toward the target position
 void MoveGantry(){
-	if(timeSinceLastStep >= StepPeriodUs){// If it is time to step the Gantry
+	if((gantryInfo.extraStepMask != 0) && (timeSinceLastStep >= gantryInfo.stepPeriodUs / 2)){// Half way through the period, so give the sides working off an offset their extra step
+		SpiAcquire(SPI_CLIENT_GANTRY);
+		StepGantrySides(gantryInfo.extraStepMask);
+		SpiRelease();
+		gantryInfo.extraStepMask = 0;
+	}
+
+	if(timeSinceLastStep >= gantryInfo.stepPeriodUs){// If it is time to step the Gantry
 		timeSinceLastStep = 0;
+
+		if((gantryInfo.state != GANTRY_IDLE) && (gantryInfo.state != GANTRY_ERROR) && (gantryPower != GANTRY_POWER_FULL)){// Make sure the drivers are at full power before moving
+			SetGantryPower(GANTRY_POWER_FULL);
+			return;
+		}
+
 		switch(gantryInfo.state){
 			case GANTRY_IDLE:
 			case GANTRY_ERROR:
@@ -583,6 +1804,16 @@ void MoveGantry(){
 				break;
 			case GANTRY_HOMING:
 				HomeGantryProcess();
+				break;
+			case GANTRY_PARKING:
+				ParkGantryProcess();
+				break;
+			case GANTRY_SQUARING:
+				SquareGantryProcess();
+				break;
+			case GANTRY_JOGGING:
+				JogGantryProcess();
+				break;
 		}
 	}
 }// End of MoveGantry()
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <Arduino.h>
 
 #include "Blocks.h"
+#include "Pins.h"		// For the GantryMotor enumeration
 
 
 //	*************************************************************************************************
@@ -17,6 +18,9 @@ typedef enum {
 	GANTRY_CALIBRATING,
 	GANTRY_SWAPPING_BLOCKS,
 	GANTRY_HOMING,
+	GANTRY_PARKING,
+	GANTRY_SQUARING,
+	GANTRY_JOGGING,
 	GANTRY_ERROR
 } GantryState;
 
@@ -37,14 +41,36 @@ typedef enum {
 
 
 
+// The power levels of the Gantry stepper drivers
+typedef enum {
+	GANTRY_POWER_FULL,	// Full current, ready to move
+	GANTRY_POWER_HOLD,	// Reduced current, holding position while idle
+	GANTRY_POWER_OFF	// Driver outputs disabled
+} GantryPowerLevel;
+
+
+
+
+
+// The sides of the Gantry. Each side has its own pair of motors and its own limit switches
+typedef enum {
+	GANTRY_LEFT_SIDE,
+	GANTRY_RIGHT_SIDE,
+	NUM_GANTRY_SIDES
+} GantrySide;
+
+
+
 
 
 //	*************************************************************************************************
 //	Shared Variables and Constants for the Gantry code
 //	*************************************************************************************************
 
-const uint16_t StepPeriodUs = 2000;
+const uint16_t StepPeriodUs = 1500;	// The time between full steps when travelling. Placement is done microstepping, so this can be fast
 const uint16_t StepperCurrentLimit = 1700; // 1700mA
+const uint16_t StepperHoldCurrent = 400; // 400mA, used to hold position while idle
+const uint16_t GantryCoilMilliohms = 1500; // The resistance of one phase of a Gantry motor
 
 
 
@@ -58,11 +84,121 @@ const uint16_t StepperCurrentLimit = 1700; // 1700mA
 void InitGantry();
 
 
+/// Home the Gantry by running it up and then forward toward the hard stops. The limit switches and stall detection
+/// both end the fast move, and then the Gantry backs off and creeps back onto the limit switch, which sets the position.
+/// This also clears a GANTRY_ERROR caused by a stall.
+void HomeGantry();
+
+
+/// Square the Gantry by driving each side up and then forward until its own limit switch trips. The skew between
+/// the sides is measured and logged. The Gantry ends up at the top front, just like after homing.
+void SquareGantry();
+
+
+/// Add a step offset to one side of the Gantry on one axis. The offset is worked off during the next moves along that
+/// axis, by giving that side an extra step when moving the way of the offset or one fewer when moving against it.
+/// @param side The side to offset.
+/// @param vertical True for the vertical axis, false for the horizontal axis.
+/// @param steps The number of steps to offset that side by. Positive is down or back.
+void SetGantrySideOffset(GantrySide side, bool vertical, int16_t steps);
+
+
+/// Get the skew measured the last time the Gantry was squared
+/// @param vertical True for the skew on the vertical axis, false for the horizontal axis.
+/// @return The skew in steps. Positive means the left side reached its limit switch first.
+int16_t GetGantrySkew(bool vertical);
+
+
+/// Check if a stall has been detected on the Gantry
+/// @return True if one of the motors stalled since the Gantry was last homed.
+bool GantryStalled();
+
+
 /// Get the current state of the Gantry
 /// @return The current state of the Gantry.
 GantryState GetGantryState();
 
 
+/// Get the name of a Gantry state, for printing or showing on the display
+/// @param state The state.
+/// @return The name of the state.
+const char *GetGantryStateName(GantryState state);
+
+
+/// Get the step the Gantry is on in its current process (swapping, homing, parking, ...)
+/// @return The step number, from the enumeration for the current process.
+uint8_t GetGantryStep();
+
+
+/// Jog the Gantry a number of full steps in one direction. The jog stops early at a limit switch or a stall.
+/// Only works while the Gantry is idle or stopped by an error.
+/// @param dir The direction to jog.
+/// @param steps The number of full steps to jog.
+/// @return True if the jog was started, false if the Gantry is busy.
+bool JogGantry(GantryDirection dir, uint16_t steps);
+
+
+/// Get the time until the Gantry takes its next step
+/// @return The time in microseconds, 0 if a step is due now, or UINT32_MAX if the Gantry isn't moving.
+uint32_t GetGantryStepSlackUs();
+
+
+/// Print the state, position, and driver settings of the Gantry over serial
+void PrintGantryStatus();
+
+
+/// Change the power level of the Gantry stepper drivers. The drivers are brought back to full power
+/// automatically as soon as the Gantry needs to move.
+/// @param level The new power level.
+void SetGantryPower(GantryPowerLevel level);
+
+
+/// Get the power level of the Gantry stepper drivers
+/// @return The current power level.
+GantryPowerLevel GetGantryPower();
+
+
+/// Get the current going through each Gantry motor at the current power level
+/// @return The current in mA, or 0 if the drivers are off.
+uint16_t GetGantryCurrent();
+
+
+/// Change the current used at full power, so the Thermal Model can turn it down. The drivers are only rewritten if
+/// the limit changed and they are at full power.
+/// @param currentMa The new current limit, no more than StepperCurrentLimit.
+void SetGantryCurrentLimit(uint16_t currentMa);
+
+
+/// Print the time each step of the block swap process took, and how often it ended on a limit switch, over serial
+void PrintSwapStats();
+
+
+/// Clear the swap stats
+void ResetSwapStats();
+
+
+/// Get the number of swap legs that ended on a limit switch too far from their target, which means steps were missed
+/// @return The number of missed step detections since the stats were reset.
+uint32_t GetSwapMissedSteps();
+
+
+/// Get the number of swaps stopped by a stall
+/// @return The number of stalls since the stats were reset.
+uint32_t GetSwapStalls();
+
+
+/// Get the number of step pulses sent to a Gantry motor since power on. Each microstep counts as a step pulse.
+/// @param motor The motor to check.
+/// @return The number of step pulses.
+uint32_t GetGantryMotorSteps(GantryMotor motor);
+
+
+/// Get the number of times a Gantry motor has been turned round since power on
+/// @param motor The motor to check.
+/// @return The number of reversals.
+uint32_t GetGantryMotorReversals(GantryMotor motor);
+
+
 /// Get the current direction of the Gantry
 /// @return The current direction of the Gantry.
 GantryDirection GetGantryDirection();
@@ -75,6 +211,35 @@ GantryDirection GetGantryDirection();
 void SwapBlocks(Block *block1, Block *block2 = nullptr);
 
 
+/// Tell the Gantry which block(s) the next swap will involve, so it can park where that swap will start the fastest.
+/// This should be called by BlockManager as soon as it knows what the next swap will be.
+/// @param block1 The first block of the next swap.
+/// @param block2 The second block of the next swap. If nullptr, only block1 will be swapped.
+/// @param columnsIdle True if the display steppers under the block(s) will not move again before the swap. Only then
+///		can the Gantry wait below the display row clearance (GANTRY_MIDDLE_VT).
+void PlanNextSwap(Block *block1, Block *block2 = nullptr, bool columnsIdle = false);
+
+
+/// Check if the block displayed in a column can rotate without hitting the Gantry. A Gantry waiting below the display row
+/// clearance over the column is sent back up, and the rotation has to wait until it gets there.
+/// @param column The column to rotate.
+/// @return True if the column can rotate now, false if it has to wait for the Gantry.
+bool GantryClearOfColumn(BlockColumn column);
+
+
+/// Let the Gantry wait for a swap at the staging height when the columns under it are idle. On by default, and turned
+/// off to measure what staging saves.
+/// @param enabled If the Gantry may wait at the staging height.
+void SetGantryStaging(bool enabled);
+
+
+/// Get how many swaps started from one of the parking spots, and how long they took on average
+/// @param staged True for the staging height, false for the default parking spot.
+/// @param averageMs Set to the average time those swaps took, or 0 if there were none.
+/// @return The number of swaps.
+uint32_t GetParkedSwaps(bool staged, uint32_t *averageMs);
+
+
 // Move the Gantry toward the target position. This function will be called at a
 // regular interval by the main loop to move the Gantry,
 // and it will only move the gantry if it needs to.
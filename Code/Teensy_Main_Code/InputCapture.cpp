@@ -0,0 +1,199 @@
+// Code for the Input Capture. Each changed input is one 8 byte record in a buffer in RAM2, so capturing costs a compare per
+// read and a few stores per change. The buffer isn't a ring, so a long capture keeps its start (and the boot it may hold)
+// and counts what didn't fit.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "DeferredLog.h"
+#include "InputCapture.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Input Capture code
+//	*************************************************************************************************
+
+// One captured input
+typedef struct __attribute__((packed)) {
+	uint32_t timeUs;		// micros() when it was read
+	uint8_t source;			// CaptureSource
+	uint8_t channel;		// The pin, motor, or byte offset
+	uint16_t value;			// The level, status, length, or bytes
+} CaptureRecord;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Input Capture code
+//	*************************************************************************************************
+
+const uint8_t CapturePins = 64;					// The pins that are kept track of
+const uint8_t CaptureUnknown = 0xFF;			// The last level of a pin that hasn't been read since the capture started
+const uint16_t CaptureUnknownStatus = 0xFFFF;	// The last status of a driver that hasn't been read since the capture started
+
+DMAMEM CaptureRecord captureBuffer[CaptureBufferRecords];	// The records, in RAM2 since it is only touched while capturing
+uint16_t captureCount = 0;					// The records in the buffer
+uint32_t captureLost = 0;					// The changes that didn't fit in the buffer
+uint16_t captureSent = 0;					// The records sent so far
+bool capturing = false;						// If inputs are being recorded
+bool captureSending = false;				// If the buffer is being sent
+
+uint8_t captureLastPin[CapturePins];		// The level each pin was last read at, or CaptureUnknown
+uint16_t captureLastStatus[NUM_MOTORS];		// The status each driver last had, or CaptureUnknownStatus
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Input Capture code
+//	*************************************************************************************************
+
+/// Add a record to the capture, or count it as lost if the buffer is full
+/// @param source Where it came from.
+/// @param channel The pin, motor, or byte offset.
+/// @param value The level, status, length, or bytes.
+void AddCaptureRecord(CaptureSource source, uint8_t channel, uint16_t value){
+	if(captureCount == CaptureBufferRecords){
+		captureLost++;
+		return;
+	}
+	CaptureRecord *record = &captureBuffer[captureCount++];
+	record->timeUs = micros();
+	record->source = source;
+	record->channel = channel;
+	record->value = value;
+}// End of AddCaptureRecord()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Input Capture code
+//	*************************************************************************************************
+
+/// Initialize the Input Capture, starting it if CAPTURE_INPUTS_AT_BOOT is set. Call this first, before anything reads inputs.
+void InitInputCapture(){
+	#if CAPTURE_INPUTS_AT_BOOT
+		StartInputCapture();
+	#endif
+}// End of InitInputCapture()
+
+
+
+/// Start capturing inputs, throwing away any capture that hasn't been sent
+void StartInputCapture(){
+	memset(captureLastPin, CaptureUnknown, sizeof(captureLastPin));
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		captureLastStatus[i] = CaptureUnknownStatus;
+	}
+	captureCount = 0;
+	captureLost = 0;
+	captureSending = false;
+	capturing = true;
+	AddCaptureRecord(CAPTURE_START, 0, CaptureVersion);
+}// End of StartInputCapture()
+
+
+
+/// Stop capturing inputs. The capture is kept until it is sent or a new one starts.
+void StopInputCapture(){
+	capturing = false;
+}// End of StopInputCapture()
+
+
+
+/// Check if inputs are being captured
+/// @return True while capturing.
+bool InputCaptureRunning(){
+	return capturing;
+}// End of InputCaptureRunning()
+
+
+
+/// Stop capturing and send the capture through the deferred log, a few records each pass of the main loop
+void SendInputCapture(){
+	capturing = false;
+	captureSent = 0;
+	captureSending = true;
+}// End of SendInputCapture()
+
+
+
+/// Check if a capture is still being sent
+/// @return True until the last record has gone into the log.
+bool InputCaptureSending(){
+	return captureSending;
+}// End of InputCaptureSending()
+
+
+
+/// Print how full the capture is over serial
+void PrintInputCaptureStatus(){
+	SERIAL_PRINTF("Input capture %s: %u of %u records, %lu changes lost%s\n", capturing ? "running" : "stopped", captureCount,
+		CaptureBufferRecords, captureLost, captureSending ? ", sending" : "");
+}// End of PrintInputCaptureStatus()
+
+
+
+/// Read a pin, recording it if it changed since the last read while capturing
+/// @param pin The pin.
+/// @return The level, like digitalRead().
+int CaptureRead(uint8_t pin){
+	int level = digitalRead(pin);
+	if(capturing && (pin < CapturePins) && (captureLastPin[pin] != level)){
+		captureLastPin[pin] = level;
+		AddCaptureRecord(CAPTURE_PIN, pin, level);
+	}
+	return level;
+}// End of CaptureRead()
+
+
+
+/// Record a Gantry stepper driver's status, if it changed since the last read while capturing
+/// @param motor The motor the driver is for.
+/// @param status The STATUS register.
+void CaptureDriverStatus(uint8_t motor, uint8_t status){
+	if(capturing && (motor < NUM_MOTORS) && (captureLastStatus[motor] != status)){
+		captureLastStatus[motor] = status;
+		AddCaptureRecord(CAPTURE_DRIVER_STATUS, motor, status);
+	}
+}// End of CaptureDriverStatus()
+
+
+
+/// Record the ESP32's answer to a time request while capturing
+/// @param bytes The bytes it answered.
+/// @param length The number of bytes, or 0 if it didn't answer.
+void CaptureTimeAnswer(const uint8_t *bytes, uint8_t length){
+	if(!capturing){
+		return;
+	}
+	AddCaptureRecord(CAPTURE_TIME_LENGTH, 0, length);
+	for(uint8_t i = 0; i < length; i += 2){
+		uint16_t pair = bytes[i] | (((i + 1) < length) ? (bytes[i + 1] << 8) : 0);
+		AddCaptureRecord(CAPTURE_TIME_BYTES, i, pair);
+	}
+}// End of CaptureTimeAnswer()
+
+
+
+// Send the next few records of a capture being sent, while the log has room. This function will be called in the main loop.
+void UpdateInputCapture(){
+	if(!captureSending){
+		return;
+	}
+
+	for(uint8_t i = 0; (i < CaptureSendPerPass) && (captureSent < captureCount) && LogHasRoom(); i++){
+		const CaptureRecord *record = &captureBuffer[captureSent++];
+		LOG_MSG(LOG_CAPTURE_INPUT, record->timeUs, record->source, record->channel, record->value);
+	}
+	if((captureSent == captureCount) && LogHasRoom()){
+		LOG_MSG(LOG_CAPTURE_SENT, (uint32_t)captureCount, captureLost);
+		captureSending = false;
+	}
+}// End of UpdateInputCapture()
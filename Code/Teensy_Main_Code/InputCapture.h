@@ -0,0 +1,98 @@
+// Header for the Input Capture, which records the inputs the clock acts on (limit and home switch edges, the stepper driver
+// status, and the ESP32's time answers) with their micros() timestamps. The records are kept in RAM while capturing, and
+// sent out through the deferred log afterwards. log_decoder.py --capture saves them to a file that Code/Tools/replay_sim.cpp
+// feeds back through the same code on a computer, so a failure seen in the field can be run again as often as needed.
+//
+// Only changes are recorded, so a switch that sits still costs nothing and one that chatters shows every bounce. A replay
+// follows the field run exactly only if the capture started at power on (CAPTURE_INPUTS_AT_BOOT), since the state of the
+// clock when a later capture starts isn't recorded.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Enumerations for the Input Capture code
+//	*************************************************************************************************
+
+// Where a captured input came from. The numbers are saved in the captures, so add new ones only at the end
+typedef enum {
+	CAPTURE_START,			// The capture started. The channel is 0 and the value is CaptureVersion
+	CAPTURE_PIN,			// A pin read with CaptureRead(). The channel is the pin and the value is its level
+	CAPTURE_DRIVER_STATUS,	// A Gantry stepper driver's STATUS register. The channel is the GantryMotor
+	CAPTURE_TIME_LENGTH,	// The ESP32 answered a time request. The value is the number of bytes, 0 if it didn't answer
+	CAPTURE_TIME_BYTES,		// Two bytes of the ESP32's answer. The channel is the offset of the first, and the first is the low byte
+	NUM_CAPTURE_SOURCES
+} CaptureSource;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Input Capture code
+//	*************************************************************************************************
+
+const uint16_t CaptureVersion = 1;				// Changes if what is captured changes, so old captures aren't replayed wrong
+const uint16_t CaptureBufferRecords = 4096;		// The records the capture can hold, 8 bytes each
+const uint8_t CaptureSendPerPass = 8;			// The most records sent on one pass of the main loop
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Input Capture code
+//	*************************************************************************************************
+
+/// Initialize the Input Capture, starting it if CAPTURE_INPUTS_AT_BOOT is set. Call this first, before anything reads inputs.
+void InitInputCapture();
+
+
+/// Start capturing inputs, throwing away any capture that hasn't been sent
+void StartInputCapture();
+
+
+/// Stop capturing inputs. The capture is kept until it is sent or a new one starts.
+void StopInputCapture();
+
+
+/// Check if inputs are being captured
+/// @return True while capturing.
+bool InputCaptureRunning();
+
+
+/// Stop capturing and send the capture through the deferred log, a few records each pass of the main loop
+void SendInputCapture();
+
+
+/// Check if a capture is still being sent
+/// @return True until the last record has gone into the log.
+bool InputCaptureSending();
+
+
+/// Print how full the capture is over serial
+void PrintInputCaptureStatus();
+
+
+/// Read a pin, recording it if it changed since the last read while capturing
+/// @param pin The pin.
+/// @return The level, like digitalRead().
+int CaptureRead(uint8_t pin);
+
+
+/// Record a Gantry stepper driver's status, if it changed since the last read while capturing
+/// @param motor The motor the driver is for.
+/// @param status The STATUS register.
+void CaptureDriverStatus(uint8_t motor, uint8_t status);
+
+
+/// Record the ESP32's answer to a time request while capturing
+/// @param bytes The bytes it answered.
+/// @param length The number of bytes, or 0 if it didn't answer.
+void CaptureTimeAnswer(const uint8_t *bytes, uint8_t length);
+
+
+/// Send the next few records of a capture being sent, while the log has room. This function will be called in the main loop.
+void UpdateInputCapture();
@@ -0,0 +1,135 @@
+// Code for the RGB accent lighting. The base color follows the state of the Gantry, and a sweep runs down the strip
+// every time the minute changes.
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <WS2812Serial.h>
+
+#include "Config.h"
+#include "Lighting.h"
+#include "LightingEffects.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Lighting code
+//	*************************************************************************************************
+
+uint32_t lightingFrame[RgbStripLength];				// The frame buffer the effects draw into
+byte ledDrawingMemory[RgbStripLength * 3];			// The WS2812Serial library's copy of the frame
+DMAMEM byte ledDisplayMemory[RgbStripLength * 12];	// The bits the DMA sends out
+
+WS2812Serial leds(RgbStripLength, ledDisplayMemory, ledDrawingMemory, RgbStripPin, WS2812_GRB);
+
+LightingScene lightingScene;		// What the effects should draw
+int8_t lastMinute = -1;				// The minute when the last sweep started
+
+elapsedMillis lightingFrameTimer;	// Time since the last frame was sent
+
+// Stats for drawing the frames
+uint32_t lightingFrames = 0;			// The number of frames drawn
+uint32_t lightingWorstRenderUs = 0;		// The longest a frame has taken to draw and start sending
+uint32_t lightingOverBudget = 0;		// The number of frames that took longer than LightingRenderBudgetUs
+
+const uint16_t LightingSlackMarginUs = 50;	// Extra time left before the next step
+
+
+
+// The base color for each state of the Gantry, and if it should pulse
+const uint32_t GantryStateColors[] = {
+	0x302010,	// GANTRY_IDLE, dim warm white
+	0xFF8000,	// GANTRY_CALIBRATING, amber
+	0x0040FF,	// GANTRY_SWAPPING_BLOCKS, blue
+	0xFF8000,	// GANTRY_HOMING, amber
+	0x00A0A0,	// GANTRY_PARKING, cyan
+	0xFF8000,	// GANTRY_SQUARING, amber
+	0x8000FF,	// GANTRY_JOGGING, purple
+	0xFF0000	// GANTRY_ERROR, red
+};
+
+const uint32_t LightingSweepColor = 0xFFFFFF;	// The color of the minute change sweep
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Lighting code
+//	*************************************************************************************************
+
+// Update the scene from the state of the clock
+void UpdateLightingScene(){
+	GantryState state = GetGantryState();
+	lightingScene.baseColor = GantryStateColors[state];
+	lightingScene.pulse = (state != GANTRY_IDLE);
+
+	if(minute() != lastMinute){// Start a sweep when the minute changes
+		lastMinute = minute();
+		lightingScene.sweepStartMs = millis();
+	}
+}// End of UpdateLightingScene()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Lighting code
+//	*************************************************************************************************
+
+/// Initialize the RGB strip and turn it off
+void InitLighting(){
+	leds.begin();
+
+	lightingScene.sweepColor = LightingSweepColor;
+	lightingScene.sweepStartMs = millis() - LightingSweepMs;	// No sweep on startup
+	lightingScene.brightness = LightingBrightness;
+	lastMinute = minute();
+
+	for(uint16_t i = 0; i < RgbStripLength; i++){
+		leds.setPixel(i, 0);
+	}
+	leds.show();
+}// End of InitLighting()
+
+
+
+/// Print how long frames have taken to draw, and how many went over budget
+void PrintLightingStats(){
+	SERIAL_PRINTF("Lighting: %lu frames, worst %lu us, %lu over the %u us budget\n", lightingFrames, lightingWorstRenderUs, lightingOverBudget, LightingRenderBudgetUs);
+}// End of PrintLightingStats()
+
+
+
+/// Draw and send the next frame when it is time to, the last frame is done sending, and there's time before the next step.
+/// This function will be called in the main loop.
+void UpdateLighting(){
+	if((lightingFrameTimer < LightingFrameMs) || leds.busy()){
+		return;
+	}
+
+	// Drawing takes a little while, so wait for a gap between steps
+	if((GetGantryStepSlackUs() < (LightingRenderBudgetUs + LightingSlackMarginUs)) || (GetDisplayStepperSlackUs() < (LightingRenderBudgetUs + LightingSlackMarginUs))){
+		return;
+	}
+	lightingFrameTimer = 0;
+
+	elapsedMicros renderTime;
+	UpdateLightingScene();
+	RenderLightingFrame(lightingFrame, RgbStripLength, &lightingScene, millis());
+	for(uint16_t i = 0; i < RgbStripLength; i++){
+		leds.setPixel(i, lightingFrame[i]);
+	}
+	leds.show();	// Starts the DMA and returns right away
+
+	uint32_t renderUs = renderTime;
+	lightingFrames++;
+	if(renderUs > lightingWorstRenderUs){
+		lightingWorstRenderUs = renderUs;
+	}
+	if(renderUs > LightingRenderBudgetUs){
+		lightingOverBudget++;
+	}
+}// End of UpdateLighting()
@@ -0,0 +1,36 @@
+// Header for the RGB accent lighting. Frames are drawn by LightingEffects into a frame buffer, and sent to the WS2812 strip
+// by the WS2812Serial library, which uses a serial port and DMA. Nothing here turns off interrupts, so the step timing
+// isn't touched.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Lighting code
+//	*************************************************************************************************
+
+const uint16_t LightingFrameMs = 20;			// The time between frames (50 frames per second)
+const uint16_t LightingRenderBudgetUs = 200;	// The most time drawing a frame should take
+const uint8_t LightingBrightness = 96;			// The brightness of the strip, from 0 to 255
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Lighting code
+//	*************************************************************************************************
+
+/// Initialize the RGB strip and turn it off
+void InitLighting();
+
+
+/// Print how long frames have taken to draw, and how many went over budget
+void PrintLightingStats();
+
+
+/// Draw and send the next frame when it is time to, the last frame is done sending, and there's time before the next step.
+/// This function will be called in the main loop.
+void UpdateLighting();
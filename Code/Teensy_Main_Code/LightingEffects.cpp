@@ -0,0 +1,96 @@
+// Code for the lighting effects. Everything is integer math on 0xRRGGBB colors, so a frame is cheap to draw.
+
+#include <stdint.h>
+
+#include "LightingEffects.h"
+
+
+//	*************************************************************************************************
+//	Local Functions for the Lighting Effects
+//	*************************************************************************************************
+
+/// Get the level of the base color while it is breathing
+/// @param nowMs The time of the frame, in milliseconds.
+/// @return The level, from LightingPulseMinLevel to 255.
+uint8_t PulseLevel(uint32_t nowMs){
+	uint32_t phase = nowMs % LightingPulsePeriodMs;
+	uint32_t half = LightingPulsePeriodMs / 2;
+	uint32_t rise = (phase < half) ? phase : (LightingPulsePeriodMs - phase);	// A triangle wave, 0 to half and back
+	return LightingPulseMinLevel + (rise * (255 - LightingPulseMinLevel)) / half;
+}// End of PulseLevel()
+
+
+
+/// Draw the minute change sweep over a frame. The sweep's head runs from the first pixel to past the last, with a fading tail behind it.
+/// @param frame The frame buffer to draw into.
+/// @param count The number of pixels in the frame.
+/// @param scene What to draw.
+/// @param nowMs The time of the frame, in milliseconds.
+void DrawSweep(uint32_t *frame, uint16_t count, const LightingScene *scene, uint32_t nowMs){
+	uint32_t sinceStart = nowMs - scene->sweepStartMs;
+	if(sinceStart >= LightingSweepMs){// Sweep is over
+		return;
+	}
+
+	int32_t head = (int32_t)((sinceStart * (count + LightingSweepTail)) / LightingSweepMs);
+	for(uint8_t i = 0; i <= LightingSweepTail; i++){
+		int32_t pixel = head - i;
+		if((pixel < 0) || (pixel >= count)){
+			continue;
+		}
+		uint8_t amount = 255 - (i * 255) / (LightingSweepTail + 1);
+		frame[pixel] = BlendColor(frame[pixel], scene->sweepColor, amount);
+	}
+}// End of DrawSweep()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Lighting Effects
+//	*************************************************************************************************
+
+/// Scale a color
+/// @param color The color.
+/// @param level The level to scale it to, from 0 (off) to 255 (unchanged).
+/// @return The scaled color.
+uint32_t ScaleColor(uint32_t color, uint8_t level){
+	uint32_t r = (((color >> 16) & 0xFF) * level) / 255;
+	uint32_t g = (((color >> 8) & 0xFF) * level) / 255;
+	uint32_t b = ((color & 0xFF) * level) / 255;
+	return (r << 16) | (g << 8) | b;
+}// End of ScaleColor()
+
+
+
+/// Mix two colors
+/// @param from The first color.
+/// @param to The second color.
+/// @param amount How much of the second color, from 0 (all the first color) to 255 (all the second color).
+/// @return The mixed color.
+uint32_t BlendColor(uint32_t from, uint32_t to, uint8_t amount){
+	return ScaleColor(from, 255 - amount) + ScaleColor(to, amount);
+}// End of BlendColor()
+
+
+
+/// Draw a frame of the lighting
+/// @param frame The frame buffer to draw into.
+/// @param count The number of pixels in the frame.
+/// @param scene What to draw.
+/// @param nowMs The time of the frame, in milliseconds.
+void RenderLightingFrame(uint32_t *frame, uint16_t count, const LightingScene *scene, uint32_t nowMs){
+	uint32_t base = scene->pulse ? ScaleColor(scene->baseColor, PulseLevel(nowMs)) : scene->baseColor;
+	for(uint16_t i = 0; i < count; i++){
+		frame[i] = base;
+	}
+
+	DrawSweep(frame, count, scene, nowMs);
+
+	if(scene->brightness != 255){
+		for(uint16_t i = 0; i < count; i++){
+			frame[i] = ScaleColor(frame[i], scene->brightness);
+		}
+	}
+}// End of RenderLightingFrame()
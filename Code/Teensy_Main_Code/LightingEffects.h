@@ -0,0 +1,64 @@
+// Header for the lighting effects. The effects only draw colors into a frame buffer, and don't touch any hardware or
+// Arduino functions, so they can be compiled and tested on a computer with Code/Tools/lighting_preview.cpp.
+// Colors are 0xRRGGBB, like the WS2812Serial library uses.
+
+#pragma once // Include this file only once
+
+#include <stdint.h>
+
+
+//	*************************************************************************************************
+//	Structs for the Lighting Effects
+//	*************************************************************************************************
+
+// Struct to hold everything the effects need to draw a frame
+typedef struct {
+	uint32_t baseColor;			// The color of the whole strip, set from the state of the clock
+	bool pulse;					// If the base color should breathe, to show something is moving
+	uint32_t sweepColor;		// The color of the sweep that runs down the strip when the minute changes
+	uint32_t sweepStartMs;		// When the last sweep started
+	uint8_t brightness;			// The brightness of everything, from 0 to 255
+} LightingScene;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Lighting Effects
+//	*************************************************************************************************
+
+const uint16_t LightingPulsePeriodMs = 2000;	// The time for one breath of the base color
+const uint8_t LightingPulseMinLevel = 64;		// The dimmest the base color gets while breathing
+const uint16_t LightingSweepMs = 1200;			// The time for the sweep to run down the strip
+const uint8_t LightingSweepTail = 8;			// The length of the fading tail behind the sweep, in pixels
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Lighting Effects
+//	*************************************************************************************************
+
+/// Scale a color
+/// @param color The color.
+/// @param level The level to scale it to, from 0 (off) to 255 (unchanged).
+/// @return The scaled color.
+uint32_t ScaleColor(uint32_t color, uint8_t level);
+
+
+/// Mix two colors
+/// @param from The first color.
+/// @param to The second color.
+/// @param amount How much of the second color, from 0 (all the first color) to 255 (all the second color).
+/// @return The mixed color.
+uint32_t BlendColor(uint32_t from, uint32_t to, uint8_t amount);
+
+
+/// Draw a frame of the lighting
+/// @param frame The frame buffer to draw into.
+/// @param count The number of pixels in the frame.
+/// @param scene What to draw.
+/// @param nowMs The time of the frame, in milliseconds.
+void RenderLightingFrame(uint32_t *frame, uint16_t count, const LightingScene *scene, uint32_t nowMs);
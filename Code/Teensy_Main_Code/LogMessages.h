@@ -0,0 +1,40 @@
+// The table of messages that can be logged with LOG_MSG(). Each message gets its ID from its place in this list, and the
+// host decoder (Code/Tools/log_decoder.py) reads this file to turn the IDs and raw arguments back into text.
+// Only add new messages to the end of the list, so logs captured with older firmware still decode correctly.
+// Arguments are sent as 32 bits each, so stick to integer and float conversions (no %s) in the formats.
+
+#pragma once // Include this file only once
+
+
+#define LOG_MESSAGE_LIST(X) \
+	X(LOG_TIME_ACQUIRED,			"Time acquired from ESP32: %lu\t%u/%u/%u %u:%u:%u\n") \
+	X(LOG_SWAP_ROW_MISMATCH,		"ERROR: Gantry was told to move blocks that are not in the same row.\n") \
+	X(LOG_GANTRY_DWELL,				"Gantry dwell at block: %lu us\n") \
+	X(LOG_GANTRY_PARKING,			"Gantry parking at %u, %u. Expected next swap: %lu us, %lu us saved\n") \
+	X(LOG_GANTRY_STALL,				"ERROR: Gantry stalled during swap step %u\n") \
+	X(LOG_DROPPED,					"Log buffer overflowed, %lu messages dropped\n") \
+	X(LOG_GANTRY_OVERTEMP,			"WARNING: Gantry motor %u driver over temperature, model was at %ld mC\n") \
+	X(LOG_GANTRY_THROTTLE,			"Gantry thermal throttle %u/256, hottest motor %ld mC, predicted %ld mC\n") \
+	X(LOG_TIME_QUALITY,				"ESP32 NTP correction %ld us, uncertainty %lu us, %u of %u servers agreed\n") \
+	X(LOG_DISPLAY_REZERO,			"Display stepper %u passed home %ld steps off, position corrected\n") \
+	X(LOG_DISPLAY_HOME_NOISE,		"WARNING: Display stepper %u home switch tripped %ld steps from home, ignored\n") \
+	X(LOG_DISPLAY_CALIBRATED,		"Display stepper %u measured %lu steps per revolution\n") \
+	X(LOG_DISPLAY_CALIBRATION_FAILED,	"ERROR: Display stepper %u measured %lu steps per revolution, calibration not changed\n") \
+	X(LOG_CAPTURE_INPUT,			"Captured input at %lu us: source %u, channel %u, value %u\n") \
+	X(LOG_CAPTURE_SENT,				"Input capture sent, %lu records, %lu changes lost\n") \
+	X(LOG_USAGE_SAVED,				"Usage counters saved in slot %u, save %lu\n") \
+	X(LOG_GANTRY_HOME_NO_SWITCH,	"ERROR: Gantry limit switch not found creeping back onto it while homing, direction %u\n")
+
+
+
+//	*************************************************************************************************
+//	Enumerations for the Log Messages
+//	*************************************************************************************************
+
+// The IDs of the log messages
+#define LOG_MESSAGE_ID(id, format) id,
+typedef enum {
+	LOG_MESSAGE_LIST(LOG_MESSAGE_ID)
+	NUM_LOG_MESSAGES
+} LogMessageId;
+#undef LOG_MESSAGE_ID
@@ -28,11 +28,27 @@ typedef enum {
 	HOURS_SECOND_DIGIT_SERVO,
 	MINS_FIRST_DIGIT_SERVO,
 	MINS_SECOND_DIGIT_SERVO,
+#if SHOW_SECONDS
+	SECS_FIRST_DIGIT_SERVO,
+	SECS_SECOND_DIGIT_SERVO,
+#endif
 	NUM_SERVOS
 } ServoMotors;
 
 
 
+// The Electromagnets on the Gantry
+typedef enum {
+	HOURS_SECOND_DIGIT_EMAG_ID,
+	MINS_SECOND_DIGIT_EMAG_ID,
+#if SHOW_SECONDS
+	SECS_SECOND_DIGIT_EMAG_ID,
+#endif
+	NUM_EMAGS
+} GantryEmag;
+
+
+
 
 //	*************************************************************************************************
 //	Pins for the Teensy 4.1
@@ -45,14 +61,18 @@ typedef enum {
 // const uint8_t I2C_SCL = 19; // I2C Serial Clock Line
 
 
-// Display block rotation stepper motor pins. These 3 pins are for a 74HC595 shift register
+// Display block rotation stepper motor pins. These 3 pins are for a chain of 74HC595 shift registers, 2 steppers per register
 const uint8_t DisplayStepperDataPin = 2; // Data pin for the shift register for the display block stepper motors           CHECK WHAT PINS THESE ARE
 const uint8_t DisplayStepperClockPin = 3; // Clock pin for the shift register for the display block stepper motors         CHECK WHAT PINS THESE ARE
 const uint8_t DisplayStepperLatchPin = 4; // Latch pin for the shift register for the display block stepper motors
 
 
 // Block Rotation Limit Switches
-const uint8_t BlockRotationLimitSwitchPins[NUM_BLOCK_STEPPERS] = {0, 0, 0, 0}; // Limit Switch Pins for the Block Rotation Steppers         CHECK WHAT PINS THESE ARE
+#if SHOW_SECONDS
+const uint8_t BlockRotationLimitSwitchPins[NUM_BLOCK_STEPPERS] = {30, 31, 32, 33, 34, 35}; // Limit Switch Pins for the Block Rotation Steppers         CHECK WHAT PINS THESE ARE
+#else
+const uint8_t BlockRotationLimitSwitchPins[NUM_BLOCK_STEPPERS] = {30, 31, 32, 33}; // Limit Switch Pins for the Block Rotation Steppers         CHECK WHAT PINS THESE ARE
+#endif
 
 
 // Large Stepper Motor Drivers. Other(shared) SPI pins are defined in pins_arduino.h
@@ -70,27 +90,48 @@ typedef enum {
 	GANTRY_RIGHT_FW_LIMIT_SWITCH,
 	GANTRY_RIGHT_BW_LIMIT_SWITCH,
 	NUM_LS
-} GantryLimitSwitchPins;
+} GantryLimitSwitch;
 
 
 // Block Detection Limit Switches
 
 
-// Electromagnets
+// Gantry Limit Switch Pins, in the order of GantryLimitSwitch. Each input has a pin of its own, so an input capture can tell them apart
+const uint8_t GantryLimitSwitchPins[NUM_LS] = {14, 15, 16, 17, 20, 21, 22, 23}; // Limit Switch Pins for the Gantry         CHECK WHAT PINS THESE ARE
+
+
+// Electromagnets. Each electromagnet is driven by an H-Bridge, so it can be PWM'd forward to hold and pulsed in reverse to release
 const uint8_t HOURS_SECOND_DIGIT_EMAG = 0; // Electromagnet for the Hours Second Digit Block         CHECK WHAT PINS THESE ARE
 const uint8_t MINS_SECOND_DIGIT_EMAG = 0; // Electromagnet for the Minutes Second Digit Block       CHECK WHAT PINS THESE ARE
+const uint8_t HOURS_SECOND_DIGIT_EMAG_REV = 0; // Reverse (demagnetize) input for the Hours Second Digit Electromagnet         CHECK WHAT PINS THESE ARE
+const uint8_t MINS_SECOND_DIGIT_EMAG_REV = 0; // Reverse (demagnetize) input for the Minutes Second Digit Electromagnet       CHECK WHAT PINS THESE ARE
+
+#if SHOW_SECONDS
+const uint8_t SECS_SECOND_DIGIT_EMAG = 0; // Electromagnet for the Seconds Second Digit Block       CHECK WHAT PINS THESE ARE
+const uint8_t SECS_SECOND_DIGIT_EMAG_REV = 0; // Reverse (demagnetize) input for the Seconds Second Digit Electromagnet       CHECK WHAT PINS THESE ARE
+
+const uint8_t EmagPins[NUM_EMAGS] = {HOURS_SECOND_DIGIT_EMAG, MINS_SECOND_DIGIT_EMAG, SECS_SECOND_DIGIT_EMAG};					// Forward (PWM) pins for the Electromagnets
+const uint8_t EmagReversePins[NUM_EMAGS] = {HOURS_SECOND_DIGIT_EMAG_REV, MINS_SECOND_DIGIT_EMAG_REV, SECS_SECOND_DIGIT_EMAG_REV};	// Reverse pins for the Electromagnets
+#else
+const uint8_t EmagPins[NUM_EMAGS] = {HOURS_SECOND_DIGIT_EMAG, MINS_SECOND_DIGIT_EMAG};				// Forward (PWM) pins for the Electromagnets
+const uint8_t EmagReversePins[NUM_EMAGS] = {HOURS_SECOND_DIGIT_EMAG_REV, MINS_SECOND_DIGIT_EMAG_REV};	// Reverse pins for the Electromagnets
+#endif
 
 
 // Gantry Electromagnet Limit Switches
-const uint8_t HOURS_SECOND_DIGIT_GANTRY_LS = 0; // Limit Switch for the Hours Second Digit Block Electromagnet         CHECK WHAT PINS THESE ARE
-const uint8_t MINS_SECOND_DIGIT_GANTRY_LS = 0; // Limit Switch for the Minutes Second Digit Block Electromagnet       CHECK WHAT PINS THESE ARE
+// These can't share a pin with the Gantry limit switches, or the Gantry thinks it has found a block at its limits
+const uint8_t HOURS_SECOND_DIGIT_GANTRY_LS = 40; // Limit Switch for the Hours Second Digit Block Electromagnet         CHECK WHAT PINS THESE ARE
+const uint8_t MINS_SECOND_DIGIT_GANTRY_LS = 41; // Limit Switch for the Minutes Second Digit Block Electromagnet       CHECK WHAT PINS THESE ARE
 
 
 // Time Mode Switch
 
 
-// LCD Screen
+// LCD Screen. This is an ST7920 128x64 LCD in serial (SPI) mode, sharing the SPI bus with the stepper drivers
+const uint8_t LcdCSPin = 9; // Chip Select Pin for the LCD. This is active high         CHECK WHAT PINS THESE ARE
 
 
-// RGB Strip Pins
+// RGB Strip Pins. The strip is driven by WS2812Serial, so the data pin has to be a serial TX pin (1, 8, 14, 17, 20, 24, 29, 35, 47, 53)
+const uint8_t RgbStripPin = 8; // Data pin for the WS2812 strip         CHECK WHAT PINS THESE ARE
+const uint16_t RgbStripLength = 30; // Number of LEDs on the strip         CHECK HOW MANY THERE ARE
 
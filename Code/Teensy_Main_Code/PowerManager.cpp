@@ -0,0 +1,180 @@
+// Code for the Power Manager. While the clock is idle, the Gantry drivers are dropped to a hold current (or turned off)
+// and the display stepper coils are turned off. Everything is brought back to full power just before the next motion.
+// The energy used by each part of the clock is estimated from the currents, so the savings can be checked.
+
+#include <Arduino.h>
+#include <TimeLib.h>
+
+#include "Config.h"
+#include "PowerManager.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "Electromagnet.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Power Manager code
+//	*************************************************************************************************
+
+// Electrical estimates used for the energy counters
+const uint16_t DisplayCoilMilliwatts = 500;			// The power of one energized display stepper coil (5V across a 50 ohm coil)
+const uint16_t EmagFullMilliwatts = 6000;			// The power of an electromagnet at full current
+const uint16_t EmagHoldMilliwatts = (uint32_t)EmagFullMilliwatts * EmagHoldDuty * EmagHoldDuty / (255UL * 255UL);	// The power of an electromagnet at the hold duty
+
+const uint16_t PowerUpdatePeriodMs = 10;			// How often the power levels and energy estimates are updated
+
+
+elapsedMillis powerUpdateTimer;			// Timer for updating the power levels
+elapsedMicros energyTimer;				// The time since the energy estimates were last updated
+elapsedMillis gantryIdleTimer;			// The time the Gantry has been idle
+elapsedMillis displayIdleTimer;			// The time the display steppers have been idle
+
+time_t nextMotionTime = 0;				// The time of the next scheduled motion. 0 means the start of the next minute
+
+uint64_t energyUsedUj[NUM_POWER_SUBSYSTEMS];	// The estimated energy used by each part of the clock, in microjoules
+uint64_t gantryFullPowerUj = 0;					// The energy the Gantry would have used if it was never turned down, in microjoules
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Power Manager code
+//	*************************************************************************************************
+
+/// Estimate the power used by the Gantry motors at a given current
+/// @param currentMa The current through each motor phase.
+/// @return The power in mW.
+uint32_t GantryPowerMw(uint16_t currentMa){
+	// Two phases per motor, P = I^2 * R
+	return (uint32_t)NUM_MOTORS * 2 * currentMa * currentMa / 1000 * GantryCoilMilliohms / 1000;
+}// End of GantryPowerMw()
+
+
+
+// Estimate the power used by the electromagnets right now
+uint32_t EmagPowerMw(){
+	uint32_t powerMw = 0;
+	for(uint8_t i = 0; i < NUM_COLUMNS; i++){
+		if(!ColumnHasEmag((BlockColumn)i)){
+			continue;
+		}
+
+		switch(GetEmagState((BlockColumn)i)){
+			case EMAG_PULL_IN:
+			case EMAG_RELEASING:
+				powerMw += EmagFullMilliwatts;
+				break;
+			case EMAG_HOLDING:
+				powerMw += EmagHoldMilliwatts;
+				break;
+			default:
+				break;
+		}
+	}
+	return powerMw;
+}// End of EmagPowerMw()
+
+
+
+// Add the energy used since the last update to the energy counters
+void UpdateEnergy(){
+	uint32_t elapsedUs = energyTimer;
+	energyTimer = 0;
+
+	// mW * us = nJ, so divide by 1000 for uJ
+	energyUsedUj[POWER_GANTRY] += (uint64_t)GantryPowerMw(GetGantryCurrent()) * elapsedUs / 1000;
+	energyUsedUj[POWER_DISPLAY_STEPPERS] += (uint64_t)DisplayCoilsEnergized() * DisplayCoilMilliwatts * elapsedUs / 1000;
+	energyUsedUj[POWER_EMAGS] += (uint64_t)EmagPowerMw() * elapsedUs / 1000;
+
+	gantryFullPowerUj += (uint64_t)GantryPowerMw(StepperCurrentLimit) * elapsedUs / 1000;
+}// End of UpdateEnergy()
+
+
+
+// Check if the next scheduled motion is close enough that everything should be at full power
+bool MotionComingUp(){
+	time_t motionTime = nextMotionTime;
+	if(motionTime == 0){// Nothing scheduled, so assume the start of the next minute
+		motionTime = now() - second() + 60;
+	}
+
+	return (now() + PowerRearmLeadSeconds) >= motionTime;
+}// End of MotionComingUp()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Power Manager code
+//	*************************************************************************************************
+
+/// Initialize the Power Manager
+void InitPowerManager(){
+	for(uint8_t i = 0; i < NUM_POWER_SUBSYSTEMS; i++){
+		energyUsedUj[i] = 0;
+	}
+	gantryFullPowerUj = 0;
+
+	energyTimer = 0;
+	gantryIdleTimer = 0;
+	displayIdleTimer = 0;
+}// End of InitPowerManager()
+
+
+
+/// Tell the Power Manager when the next motion is scheduled, so everything can be re-armed in time.
+/// If this isn't called, or is given 0, the next motion is assumed to be at the start of the next minute.
+/// @param time The time of the next motion, or 0 if it isn't known.
+void SetNextMotionTime(time_t time){
+	nextMotionTime = time;
+}// End of SetNextMotionTime()
+
+
+
+/// Get the estimated energy used by part of the clock since power on
+/// @param subsystem The part of the clock.
+/// @return The estimated energy in millijoules.
+uint32_t GetEnergyUsedMj(PowerSubsystem subsystem){
+	return energyUsedUj[subsystem] / 1000;
+}// End of GetEnergyUsedMj()
+
+
+
+/// Print the estimated energy used by each part of the clock, and how much was saved by idling, to serial
+void PrintPowerReport(){
+	SERIAL_PRINTF("Energy used - Gantry: %lu mJ, Display Steppers: %lu mJ, Electromagnets: %lu mJ\n",
+		GetEnergyUsedMj(POWER_GANTRY), GetEnergyUsedMj(POWER_DISPLAY_STEPPERS), GetEnergyUsedMj(POWER_EMAGS));
+	SERIAL_PRINTF("Energy saved by idling the Gantry: %lu mJ\n", (uint32_t)((gantryFullPowerUj - energyUsedUj[POWER_GANTRY]) / 1000));
+}// End of PrintPowerReport()
+
+
+
+// Update the power levels and the energy estimates. This function will be called in the main loop,
+// and only does anything at an interval managed internally.
+void UpdatePowerManager(){
+	if(powerUpdateTimer < PowerUpdatePeriodMs){
+		return;
+	}
+	powerUpdateTimer = 0;
+
+	UpdateEnergy();
+
+	// Gantry drivers
+	if(GetGantryState() != GANTRY_IDLE){
+		gantryIdleTimer = 0;
+	}else if(MotionComingUp()){// Re-arm the drivers so they are ready when the motion starts
+		SetGantryPower(GANTRY_POWER_FULL);
+	}else if(gantryIdleTimer >= GantryIdleTimeoutMs){
+		SetGantryPower(GantryCanDisableWhenIdle ? GANTRY_POWER_OFF : GANTRY_POWER_HOLD);
+	}
+
+	// Display stepper coils. These get energized again on their next step, so there is nothing to re-arm
+	if(!DisplaySteppersIdle()){
+		displayIdleTimer = 0;
+	}else if((displayIdleTimer >= DisplayIdleTimeoutMs) && (DisplayCoilsEnergized() > 0)){
+		clearSteppers();
+	}
+}// End of UpdatePowerManager()
@@ -0,0 +1,64 @@
+// Header for the Power Manager, which turns down the motors and coils while the clock is idle and keeps track of roughly how much energy each part of the clock uses.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+#include <TimeLib.h>
+
+
+//	*************************************************************************************************
+//	Enumerations for the Power Manager
+//	*************************************************************************************************
+
+// The parts of the clock that the Power Manager keeps track of
+typedef enum {
+	POWER_GANTRY,				// The Gantry stepper motors
+	POWER_DISPLAY_STEPPERS,		// The display block rotation steppers
+	POWER_EMAGS,				// The electromagnets on the Gantry
+	NUM_POWER_SUBSYSTEMS
+} PowerSubsystem;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Power Manager code
+//	*************************************************************************************************
+
+const uint32_t GantryIdleTimeoutMs = 2000;			// How long the Gantry has to be idle before its drivers are turned down
+const bool GantryCanDisableWhenIdle = false;		// If the Gantry drivers can be turned off completely while idle. Only if the Gantry can't drop or drift without holding current
+const uint32_t DisplayIdleTimeoutMs = 250;			// How long the display steppers have to be idle before their coils are turned off
+const uint8_t PowerRearmLeadSeconds = 2;			// How many seconds before the next scheduled motion everything is brought back to full power
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Power Manager code
+//	*************************************************************************************************
+
+/// Initialize the Power Manager
+void InitPowerManager();
+
+
+/// Tell the Power Manager when the next motion is scheduled, so everything can be re-armed in time.
+/// If this isn't called, or is given 0, the next motion is assumed to be at the start of the next minute.
+/// @param time The time of the next motion, or 0 if it isn't known.
+void SetNextMotionTime(time_t time);
+
+
+/// Get the estimated energy used by part of the clock since power on
+/// @param subsystem The part of the clock.
+/// @return The estimated energy in millijoules.
+uint32_t GetEnergyUsedMj(PowerSubsystem subsystem);
+
+
+/// Print the estimated energy used by each part of the clock, and how much was saved by idling, to serial
+void PrintPowerReport();
+
+
+// Update the power levels and the energy estimates. This function will be called in the main loop,
+// and only does anything at an interval managed internally.
+void UpdatePowerManager();
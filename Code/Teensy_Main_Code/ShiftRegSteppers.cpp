@@ -1,41 +1,15 @@
 // This file manages the stepper motors that rotate the displayed blocks. These motors are all connected via shift registers.
+// The motion itself is the shared StepperGroup code, run on the shift register coil backend.
 
+#include "Config.h"
 #include "ShiftRegSteppers.h"
+#include "StepperBackends.h"
+#include "StepperMotion.h"
 #include "Pins.h"
-
-
-
-//	*************************************************************************************************
-//	Local Enumerations for Shift Register Steppers
-//	*************************************************************************************************
-
-// Step Patterns for the Steppers
-typedef enum {
-	STEP_1,
-	STEP_2,
-	STEP_3,
-	STEP_4,
-	NUM_STEP_PATTERNS
-} Step;
-
-
-
-// The current state of a display stepper
-typedef enum {
-	SR_STEPPER_IDLE,
-	SR_STEPPER_MOVING,
-	SR_STEPPER_HOMING
-} SRStepperState;
-
-
-
-// The directions the steppers can move
-typedef enum {
-	SR_STEPPER_NO_DIR,
-	SR_STEPPER_CW,
-	SR_STEPPER_CCW
-} SRStepperDirection;
-
+#include "DeferredLog.h"
+#include "DisplayCalibration.h"
+#include "BlockManager.h"
+#include "InputCapture.h"
 
 
 
@@ -43,14 +17,12 @@ typedef enum {
 //	Local Structs for the Shift Register Steppers code
 //	*************************************************************************************************
 
-// Struct to hold the information of a display stepper
-typedef struct {
-	SRStepperState state;	// The state of the stepper
-	SRStepperDirection dir;	// The direction the stepper is moving
-	Step currentStep;		// The current step of the stepper
-	uint16_t currentPos;	// The current position of the stepper
-	uint16_t targetPos;		// The target position of the stepper
-} BlockStepperInfo;
+// The home sensor for the display steppers. The limit switches read low once a block reaches its home position
+struct DisplayHomeSensor {
+	static bool AtHome(uint8_t stepper){
+		return !CaptureRead(BlockRotationLimitSwitchPins[stepper]);
+	}
+};
 
 
 
@@ -59,126 +31,65 @@ typedef struct {
 //	Local Variables for the Shift Register Steppers code
 //	*************************************************************************************************
 
-BlockStepperInfo BlockSteppers[NUM_BLOCK_STEPPERS];	// The information of the Block Steppers
-
-uint16_t stepData = 0;						// The current step pattern for all of the display steppers.
+typedef ShiftRegCoilBackend<NUM_BLOCK_STEPPERS> DisplayStepperBackend;
 
-elapsedMillis displayStepperTimer;				// Timer for the stepper movement
+StepperGroup<DisplayStepperBackend, DisplayHomeSensor, NUM_BLOCK_STEPPERS> displaySteppers;	// The Block Steppers
 
-const byte stepPatterns[NUM_STEP_PATTERNS] = {0b1010, 0b0110, 0b0101, 0b1001};
+elapsedMicros displayStepperTimer;				// Timer for the stepper movement
 
 const uint16_t stepPeriodUs = 4900;				// The period of the steps in microseconds
 // const uint16_t clockPeriodNs = 40;				// The period of the shift register clock in nanoseconds
-const uint16_t stepsPerRevolution = 2048;		// The number of steps per revolution of the stepper motor
+const uint16_t rezeroWindowSteps = DISPLAY_STEPS_PER_REV / MAX_FACES / 4;	// How far off the home switch can trip while passing
+																			// home and still be trusted, a quarter of a face
 
 
 
 
 //	*************************************************************************************************
-//	Local Low Level Functions for the Shift Register Steppers code
+//	Shared Functions for the Shift Register Steppers code
 //	*************************************************************************************************
 
-// Shift the data out to the shift registers
-void outputStepData(){
-	digitalWriteFast(DisplayStepperLatchPin, LOW);
-
-	for (int8_t i = NUM_BLOCK_STEPPERS*4 -1; i >=0 ; i--){// Loop through all the stepper's pins
-		delayNanoseconds(20);								// Delay for the minimum pulse duration of the Data Clock
-		digitalWriteFast(DisplayStepperClockPin, LOW);
-
-		digitalWriteFast(DisplayStepperDataPin, bitRead(stepData, i));
-		delayNanoseconds(24); // Delay for the minimum time for Data before Clock
-		digitalWriteFast(DisplayStepperClockPin, HIGH);
-	}
-	
-	delayNanoseconds(18); // Delay for the minimum time for Data Clock before Latch Clock
-	digitalWriteFast(DisplayStepperLatchPin, HIGH);
-}// End of outputStepData
-
-
-
-
-
+// Initialize the shift register steppers
+void InitShiftRegSteppers(){
+	displaySteppers.Begin();
 
+	// Rotate to the home position
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		SetDisplayRevolution((BlockStepper)i, GetStepsPerRevolution((BlockStepper)i));
+		RotateToHome((BlockStepper)i);
+	}// End of for
+}// End of initShiftRegSteppers
 
 
-//	*************************************************************************************************
-//	Local Higher level Functions for the Shift Register Steppers code
-//	*************************************************************************************************
 
 /// Set all the pins for all steppers to off
 void clearSteppers(){
-	// Set all the pins for all steppers to off
-	stepData = 0;
-	outputStepData();
+	DisplayStepperBackend::ReleaseAll();
 }// End of clearSteppers
 
 
 
-// Clear a specific stepper
-void clearStepper(BlockStepper stepper){
-	BlockSteppers[stepper].state = SR_STEPPER_IDLE;
-	BlockSteppers[stepper].dir = SR_STEPPER_NO_DIR;
-	stepData = stepData & ~(0b1111 << (stepper * 4));
-}// End of clearStepper
-
-
-
-// Set the step pattern for a stepper
-void setNextStepData(BlockStepper stepper, Step currentStep, SRStepperDirection dir){
-	switch(dir){
-		case SR_STEPPER_NO_DIR:
-			clearStepper(stepper);
-			return;
-		case SR_STEPPER_CW:
-			BlockSteppers[stepper].currentStep = (Step)((currentStep + 1) % NUM_STEP_PATTERNS);
-			break;
-		case SR_STEPPER_CCW:
-			BlockSteppers[stepper].currentStep = (Step)((currentStep - 1) % NUM_STEP_PATTERNS);
-			break;
-	}
-	stepData = stepData & ~(0b1111 << (stepper * 4));		// Clear the current step's data
-	stepData = stepData | (stepPatterns[BlockSteppers[stepper].currentStep] << (stepper * 4));	// Set the new step's data
-}// End of setNextStepData
-
-
-
-
-//	*************************************************************************************************
-//	Shared Functions for the Shift Register Steppers code
-//	*************************************************************************************************
-
-// Initialize the shift register steppers
-void InitShiftRegSteppers(){
-	pinMode(DisplayStepperDataPin, OUTPUT);
-	pinMode(DisplayStepperClockPin, OUTPUT);
-	pinMode(DisplayStepperLatchPin, OUTPUT);
-
-	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){// Initialize the Block Steppers
-		BlockSteppers[i].state = SR_STEPPER_IDLE;
-		BlockSteppers[i].dir = SR_STEPPER_NO_DIR;
-		BlockSteppers[i].currentStep = STEP_1;
-		BlockSteppers[i].currentPos = 0;
-		BlockSteppers[i].targetPos = 0;
-	}// End of for
-
-	// Rotate to the home position
-	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
-		RotateToHome((BlockStepper)i);
-	}// End of for
-}// End of initShiftRegSteppers
+/// Get the number of display stepper coils that are currently energized
+/// @return The number of coils that are on.
+uint8_t DisplayCoilsEnergized(){
+	return DisplayStepperBackend::CoilsEnergized();
+}// End of DisplayCoilsEnergized
 
 
 
 /// Check if all the steppers are idle
 /// @return True if all the steppers are idle, false otherwise
 bool DisplaySteppersIdle(){
-	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
-		if(BlockSteppers[i].state != SR_STEPPER_IDLE){
-			return false;
-		}
-	}
-	return true;
+	return displaySteppers.Idle();
+}// End of DisplaySteppersIdle
+
+
+
+/// Check if all the steppers in a mask are idle
+/// @param stepperMask The steppers to check, built with BLOCK_STEPPER_MASK()
+/// @return True if all the steppers in the mask are idle, false otherwise
+bool DisplaySteppersIdle(uint32_t stepperMask){
+	return displaySteppers.Idle(stepperMask);
 }// End of DisplaySteppersIdle
 
 
@@ -187,93 +98,144 @@ bool DisplaySteppersIdle(){
 /// @param stepper The stepper to move
 /// @param steps The number of steps to move
 void RotateSteps(BlockStepper stepper, int8_t steps){
-	BlockSteppers[stepper].state = SR_STEPPER_MOVING;
-	BlockSteppers[stepper].dir = (steps > 0) ? SR_STEPPER_CW : SR_STEPPER_CCW;
-	BlockSteppers[stepper].targetPos = BlockSteppers[stepper].currentPos + steps;
+	displaySteppers.MoveBy(stepper, steps);
 }// End of rotateSteps
 
 
 
 /// Move a Stepper to a specific position
 /// @param stepper The stepper to move
-/// @param position The position to move to
-void RotateToPositition(BlockStepper stepper, uint8_t position){
-	BlockSteppers[stepper].state = SR_STEPPER_MOVING;
-	BlockSteppers[stepper].dir = (position > BlockSteppers[stepper].currentPos) ? SR_STEPPER_CW : SR_STEPPER_CCW;
-	BlockSteppers[stepper].targetPos = position;
+/// @param position The position to move to, in steps from home
+void RotateToPositition(BlockStepper stepper, int32_t position){
+	displaySteppers.MoveTo(stepper, FullSteps(position));
 }// End of rotateToPositition
 
 
 
-/// Move a stepper to a given block face
+/// Move a stepper to a given block face, going the short way round. Going forward past home lets the stepper correct its
+/// position on the home switch along the way.
 /// @param stepper The stepper to move
 /// @param block The block which is currently on the stepper
-/// @param face The face to move to
+/// @param face The face to move to, 0 to MAX_FACES - 1. Face 0 is the one the block is stored on
 void RotateToFace(BlockStepper stepper, Block *block, uint8_t face){
-	BlockSteppers[stepper].state = SR_STEPPER_MOVING;
-	BlockSteppers[stepper].dir = (face > block->currentValue) ? SR_STEPPER_CW : SR_STEPPER_CCW;
-	BlockSteppers[stepper].targetPos = face;
+	int32_t stepsPerRevolution = displaySteppers.Revolution(stepper).Steps();
+	bool findingHome = (displaySteppers.State(stepper) == STEPPER_HOMING) || (displaySteppers.State(stepper) == STEPPER_MEASURING);
+	int32_t current = findingHome ? 0 : displaySteppers.Position(stepper).Steps();	// A stepper finding home will start from 0
+	int32_t target = GetFacePosition(stepper, block, face);
+	target += current - (((current % stepsPerRevolution) + stepsPerRevolution) % stepsPerRevolution);	// In the same turn as the stepper
+	if((target - current) > (stepsPerRevolution / 2)){
+		target -= stepsPerRevolution;
+	}else if((current - target) > (stepsPerRevolution / 2)){
+		target += stepsPerRevolution;
+	}
+	displaySteppers.MoveTo(stepper, FullSteps(target));
+	block->currentFace = face;
+	block->currentValue = GetFaceDigit(block, face);
 }// End of rotateToFace
 
 
 
-/// Move a Stepper to the 0 position / Home (where limit switch is triggered)
+/// Move a Stepper to the 0 position / Home (where limit switch is triggered). Moves passing home correct the position on
+/// their own, so this is only needed at startup or after a fault.
 /// @param stepper The stepper to move to 0
 void RotateToHome(BlockStepper stepper){
-	BlockSteppers[stepper].state = SR_STEPPER_HOMING;
-	BlockSteppers[stepper].dir = SR_STEPPER_CW;
-	BlockSteppers[stepper].targetPos = 0;
+	displaySteppers.Home(stepper);
 }// End of rotateToHome
 
 
 
+/// Measure the steps per revolution of a stepper against its home switch. It goes back to where it was afterwards.
+/// @param stepper The stepper to measure
+void MeasureRevolution(BlockStepper stepper){
+	displaySteppers.Measure(stepper);
+}// End of MeasureRevolution
+
+
+
+/// Get the steps per revolution found by the last MeasureRevolution() of a stepper, once it is idle
+/// @param stepper The stepper
+/// @return The steps, or 0 if the home switch wasn't found
+uint16_t GetMeasuredRevolution(BlockStepper stepper){
+	return displaySteppers.Measured(stepper).Steps();
+}// End of GetMeasuredRevolution
+
+
+
+/// Set the steps per revolution of a stepper, which its face positions and the correction when passing home go by
+/// @param stepper The stepper
+/// @param steps The steps in one revolution
+void SetDisplayRevolution(BlockStepper stepper, uint16_t steps){
+	displaySteppers.SetRevolution(stepper, FullSteps(steps), FullSteps(rezeroWindowSteps));
+}// End of SetDisplayRevolution
+
+
+
+/// Get the steps a display stepper has taken since power on
+/// @param stepper The stepper
+/// @return The steps, in either direction
+uint32_t GetDisplayStepperSteps(BlockStepper stepper){
+	return displaySteppers.StepCount(stepper);
+}// End of GetDisplayStepperSteps
+
+
+
+/// Get the times a display stepper has started a move the other way from its last one since power on
+/// @param stepper The stepper
+/// @return The reversals
+uint32_t GetDisplayStepperReversals(BlockStepper stepper){
+	return displaySteppers.Reversals(stepper);
+}// End of GetDisplayStepperReversals
+
+
+
+/// Get the time until the display steppers take their next step
+/// @return The time in microseconds, 0 if a step is due now, or UINT32_MAX if none of the steppers are moving.
+uint32_t GetDisplayStepperSlackUs(){
+	if(DisplaySteppersIdle()){
+		return UINT32_MAX;
+	}
+
+	uint32_t sinceLastStep = displayStepperTimer;
+	if(sinceLastStep >= stepPeriodUs){
+		return 0;
+	}
+	return stepPeriodUs - sinceLastStep;
+}// End of GetDisplayStepperSlackUs
+
+
+
+/// Print the state and position of each display stepper over serial
+void PrintDisplayStepperStatus(){
+	const char *const stateNames[] = {"IDLE", "MOVING", "HOMING", "MEASURING"};
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		SERIAL_PRINTF("Display stepper %u: state %s, at %ld, target %ld, drift at last pass of home %ld\n", i, stateNames[displaySteppers.State(i)], displaySteppers.Position(i).Steps(), displaySteppers.Target(i).Steps(), displaySteppers.Drift(i).Steps());
+	}
+	SERIAL_PRINTF("Display steppers: active 0x%08lX, %u coils on\n", displaySteppers.ActiveMask(), DisplayCoilsEnergized());
+}// End of PrintDisplayStepperStatus
+
+
+
 // Move Steppers if needed. This function will be called in the main loop, and ran at a regular interval managed internally
 void MoveDisplaySteppers(){
 	// Check the time interval since the last time this function was called
 	if(displayStepperTimer >= stepPeriodUs){
 		displayStepperTimer = 0;	// Reset the timer
 
-		bool isMoving = false;		// Flag to check if any of the steppers are moving
-
-		// Loop through all the steppers
-		for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
-			// Check the stepper's state
-			switch(BlockSteppers[i].state){
-				case SR_STEPPER_IDLE:
-					// Do nothing / keep the stepper in the idle state
-
-					break;
-				case SR_STEPPER_MOVING:
-					// Verify that it should be moving, then move the stepper toward the target position
-					// If it is, set the state to idle
-					isMoving = true;
-					if(BlockSteppers[i].currentPos != BlockSteppers[i].targetPos){
-						setNextStepData((BlockStepper)i, BlockSteppers[i].currentStep, BlockSteppers[i].dir);
-						BlockSteppers[i].currentPos += (BlockSteppers[i].dir == SR_STEPPER_CW) ? 1 : -1;
-					}else{
-						// Set the stepper to idle and turn off the stepper
-						clearStepper((BlockStepper)i);
-					}
-					break;
-				case SR_STEPPER_HOMING:
-					// Move the stepper toward the home position until the limit switch is triggered, then set that as the home position
-					isMoving = true;
-					if(digitalRead(BlockRotationLimitSwitchPins[i])){
-						setNextStepData((BlockStepper)i, BlockSteppers[i].currentStep, BlockSteppers[i].dir);
-						BlockSteppers[i].currentPos += (BlockSteppers[i].dir == SR_STEPPER_CW) ? 1 : -1;
-					}else{
-						BlockSteppers[i].currentPos = 0; // Reset the home position to here
-						clearStepper((BlockStepper)i);
-					}
-					break;
-			}// End of switch
-		}// End of for
-
-		// If at least one stepper is moving, output the step data
-		if(isMoving){
-			outputStepData();
+		// Step every stepper that isn't idle, and shift out the new coil patterns if any changed
+		displaySteppers.Tick();
+
+		// Log the steppers that passed home and had their positions corrected
+		uint32_t rezeroed = displaySteppers.TakeRezeroed();
+		while(rezeroed != 0){
+			uint8_t i = __builtin_ctz(rezeroed);
+			rezeroed &= rezeroed - 1;
+			LOG_MSG(LOG_DISPLAY_REZERO, i, displaySteppers.Drift(i).Steps());
+		}
+		uint32_t ignored = displaySteppers.TakeIgnoredEdges();
+		while(ignored != 0){
+			uint8_t i = __builtin_ctz(ignored);
+			ignored &= ignored - 1;
+			LOG_MSG(LOG_DISPLAY_HOME_NOISE, i, displaySteppers.Drift(i).Steps());
 		}
 	}// End of if displayStepperTimer
 }// End of moveDisplaySteppers
-
-
@@ -14,6 +14,9 @@
 // typedef BlockColumn BlockStepper;
 // #define NUM_BLOCK_STEPPERS NUM_COLUMNS // Number of steppers
 
+// Get the bit for a stepper in a mask of steppers
+#define BLOCK_STEPPER_MASK(stepper) ((uint32_t)1 << (stepper))
+
 
 
 
@@ -43,11 +46,27 @@
 void InitShiftRegSteppers();
 
 
+/// Set all the pins for all steppers to off. Only call this while all the steppers are idle,
+/// the steppers pick up from their last step pattern the next time they move.
+void clearSteppers();
+
+
+/// Get the number of display stepper coils that are currently energized
+/// @return The number of coils that are on.
+uint8_t DisplayCoilsEnergized();
+
+
 /// Check if all the steppers are idle
 /// @return True if all the steppers are idle, false otherwise
 bool DisplaySteppersIdle();
 
 
+/// Check if all the steppers in a mask are idle
+/// @param stepperMask The steppers to check, built with BLOCK_STEPPER_MASK()
+/// @return True if all the steppers in the mask are idle, false otherwise
+bool DisplaySteppersIdle(uint32_t stepperMask);
+
+
 /// Move a stepper a given number of steps
 /// @param stepper The stepper to move
 /// @param steps The number of steps to move
@@ -56,14 +75,14 @@ void RotateSteps(BlockStepper stepper, int8_t steps);
 
 /// Move a Stepper to a specific position
 /// @param stepper The stepper to move
-/// @param position The position to move to
-void RotateToPositition(BlockStepper stepper, uint8_t position);
+/// @param position The position to move to, in steps from home
+void RotateToPositition(BlockStepper stepper, int32_t position);
 
 
 /// Move a stepper to a given block face
 /// @param stepper The stepper to move
 /// @param block The block which is currently on the stepper
-/// @param face The face to move to
+/// @param face The face to move to, 0 to MAX_FACES - 1. Face 0 is the one the block is stored on
 void RotateToFace(BlockStepper stepper, Block *block, uint8_t face);
 
 
@@ -72,5 +91,43 @@ void RotateToFace(BlockStepper stepper, Block *block, uint8_t face);
 void RotateToHome(BlockStepper stepper);
 
 
+/// Measure the steps per revolution of a stepper against its home switch. It goes back to where it was afterwards.
+/// @param stepper The stepper to measure
+void MeasureRevolution(BlockStepper stepper);
+
+
+/// Get the steps per revolution found by the last MeasureRevolution() of a stepper, once it is idle
+/// @param stepper The stepper
+/// @return The steps, or 0 if the home switch wasn't found
+uint16_t GetMeasuredRevolution(BlockStepper stepper);
+
+
+/// Set the steps per revolution of a stepper, which its face positions and the correction when passing home go by
+/// @param stepper The stepper
+/// @param steps The steps in one revolution
+void SetDisplayRevolution(BlockStepper stepper, uint16_t steps);
+
+
+/// Get the steps a display stepper has taken since power on
+/// @param stepper The stepper
+/// @return The steps, in either direction
+uint32_t GetDisplayStepperSteps(BlockStepper stepper);
+
+
+/// Get the times a display stepper has started a move the other way from its last one since power on
+/// @param stepper The stepper
+/// @return The reversals
+uint32_t GetDisplayStepperReversals(BlockStepper stepper);
+
+
+/// Get the time until the display steppers take their next step
+/// @return The time in microseconds, 0 if a step is due now, or UINT32_MAX if none of the steppers are moving.
+uint32_t GetDisplayStepperSlackUs();
+
+
+/// Print the state and position of each display stepper over serial
+void PrintDisplayStepperStatus();
+
+
 // Move Steppers if needed. This function will be called in the main loop, and ran at a regular interval managed internally
 void MoveDisplaySteppers();
@@ -0,0 +1,332 @@
+// Code for the SPI bus arbiter. Blocking users take the whole bus between DMA chunks, and queued transfers are split into
+// chunks of no more than SpiChunkMaxUs so a blocking user never waits for more than one. Everything here runs from the main loop except the DMA
+// completion callback, which only sets a flag.
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "Config.h"
+#include "SpiBus.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the SPI Bus code
+//	*************************************************************************************************
+
+// Struct to hold a queued transfer
+typedef struct {
+	bool inUse;				// If this slot holds a transfer
+	SpiClient client;		// The client the transfer is for
+	SpiPriority priority;	// The priority of the transfer
+	SPISettings settings;	// The SPI settings for the device
+	uint8_t csPin;			// The chip select pin of the device
+	bool csActiveHigh;		// If the chip select is active high
+	const uint8_t *data;	// The data to send
+	uint16_t length;		// The number of bytes to send
+	uint16_t chunkBytes;	// The most bytes to send in one chunk at the device's clock
+	uint16_t sent;			// The number of bytes sent so far
+	uint32_t queuedAt;		// When the transfer was queued, in micros
+	void (*onDone)();		// Called once the whole transfer is sent
+} SpiTransfer;
+
+
+
+// Struct to hold the bus stats of a client
+typedef struct {
+	uint32_t busyUs;		// The time the client has had the bus
+	uint32_t transactions;	// The number of times the client has had the bus
+	uint32_t worstWaitUs;	// The longest the client has waited for the bus
+} SpiClientStats;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the SPI Bus code
+//	*************************************************************************************************
+
+SpiTransfer spiQueue[SpiQueueLength];	// The queued transfers
+
+SpiTransfer *activeTransfer = nullptr;	// The transfer whose chunk is being sent
+uint16_t activeChunkBytes = 0;			// The size of the chunk being sent
+uint32_t chunkStartedAt = 0;			// When the chunk started, in micros
+volatile bool chunkDone = false;		// Set by the DMA callback once the chunk is sent
+
+bool spiHeld = false;					// If a client has the bus with SpiAcquire()
+uint8_t spiHoldDepth = 0;				// How many times the holder has called SpiAcquire() without SpiRelease()
+SpiClient spiHolder;					// The client that has the bus
+uint32_t heldAt = 0;					// When the bus was taken, in micros
+
+EventResponder spiEvent;				// Tells us when a DMA chunk is done
+
+SpiClientStats spiStats[NUM_SPI_CLIENTS];	// The bus stats of each client
+elapsedMicros spiStatsTimer;				// The time since the stats were reset
+
+const char *const SpiClientNames[NUM_SPI_CLIENTS] = {"Gantry", "Display"};
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the SPI Bus code
+//	*************************************************************************************************
+
+// Called by the SPI library when a DMA chunk is done. This can be in an interrupt, so it only sets a flag
+void SpiChunkCallback(EventResponderRef){
+	chunkDone = true;
+}// End of SpiChunkCallback()
+
+
+
+/// Set a chip select pin to selected or not
+/// @param pin The chip select pin.
+/// @param activeHigh If the chip select is active high.
+/// @param selected True to select the device.
+void SpiSelect(uint8_t pin, bool activeHigh, bool selected){
+	digitalWriteFast(pin, (selected == activeHigh) ? HIGH : LOW);
+}// End of SpiSelect()
+
+
+
+// Finish the chunk that was being sent, once it is done. Releases the chip select and the SPI transaction.
+void FinishSpiChunk(){
+	SpiSelect(activeTransfer->csPin, activeTransfer->csActiveHigh, false);
+	SPI.endTransaction();
+
+	spiStats[activeTransfer->client].busyUs += micros() - chunkStartedAt;
+	activeTransfer->sent += activeChunkBytes;
+
+	SpiTransfer *transfer = activeTransfer;
+	activeTransfer = nullptr;
+	chunkDone = false;
+
+	if(transfer->sent >= transfer->length){// The whole transfer is done
+		transfer->inUse = false;
+		if(transfer->onDone != nullptr){
+			transfer->onDone();
+		}
+	}
+}// End of FinishSpiChunk()
+
+
+
+// Start the next chunk of the highest priority queued transfer. Transfers of the same priority go in the order they were queued.
+void StartSpiChunk(){
+	SpiTransfer *next = nullptr;
+	for(uint8_t i = 0; i < SpiQueueLength; i++){
+		if(!spiQueue[i].inUse){
+			continue;
+		}
+		if((next == nullptr) || (spiQueue[i].priority > next->priority)
+			|| ((spiQueue[i].priority == next->priority) && ((int32_t)(spiQueue[i].queuedAt - next->queuedAt) < 0))){
+			next = &spiQueue[i];
+		}
+	}
+	if(next == nullptr){
+		return;
+	}
+
+	if(next->sent == 0){// First chunk, so this is the end of the wait
+		uint32_t waitUs = micros() - next->queuedAt;
+		if(waitUs > spiStats[next->client].worstWaitUs){
+			spiStats[next->client].worstWaitUs = waitUs;
+		}
+		spiStats[next->client].transactions++;
+	}
+
+	activeTransfer = next;
+	activeChunkBytes = next->length - next->sent;
+	if(activeChunkBytes > next->chunkBytes){
+		activeChunkBytes = next->chunkBytes;
+	}
+	chunkDone = false;
+	chunkStartedAt = micros();
+
+	SPI.beginTransaction(next->settings);
+	SpiSelect(next->csPin, next->csActiveHigh, true);
+	SPI.transfer(next->data + next->sent, nullptr, activeChunkBytes, spiEvent);
+}// End of StartSpiChunk()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the SPI Bus code
+//	*************************************************************************************************
+
+/// Initialize the SPI bus
+void InitSpiBus(){
+	SPI.begin();
+	spiEvent.attachImmediate(&SpiChunkCallback);
+
+	for(uint8_t i = 0; i < SpiQueueLength; i++){
+		spiQueue[i].inUse = false;
+	}
+	ResetSpiStats();
+}// End of InitSpiBus()
+
+
+
+/// Take the SPI bus for blocking transfers. If a DMA chunk is being sent, this waits for it to finish.
+/// A client that already has the bus can take it again, as long as every SpiAcquire() gets a SpiRelease().
+/// @param client The client taking the bus.
+void SpiAcquire(SpiClient client){
+	if(spiHeld && (spiHolder == client)){// Already held by this client, from a function further up
+		spiHoldDepth++;
+		return;
+	}
+
+	uint32_t startedAt = micros();
+	if(activeTransfer != nullptr){
+		while(!chunkDone){}// Wait for the chunk. This is at most SpiChunkMaxUs long
+		FinishSpiChunk();
+	}
+
+	uint32_t waitUs = micros() - startedAt;
+	if(waitUs > spiStats[client].worstWaitUs){
+		spiStats[client].worstWaitUs = waitUs;
+	}
+	spiStats[client].transactions++;
+
+	spiHeld = true;
+	spiHoldDepth = 1;
+	spiHolder = client;
+	heldAt = micros();
+}// End of SpiAcquire()
+
+
+
+/// Give the SPI bus back after SpiAcquire(), so queued transfers can continue
+void SpiRelease(){
+	if(!spiHeld){
+		return;
+	}
+	spiHoldDepth--;
+	if(spiHoldDepth > 0){// Still held by a function further up
+		return;
+	}
+	spiStats[spiHolder].busyUs += micros() - heldAt;
+	spiHeld = false;
+}// End of SpiRelease()
+
+
+
+/// Write the same 16 bit word layout to several devices back to back, in one SPI transaction. The bus must already be
+/// held with SpiAcquire(). The chip selects are active high, like the DRV8711's.
+/// @param settings The SPI settings for the devices.
+/// @param csPins The chip select pins of the devices.
+/// @param words The word to write to each device.
+/// @param count The number of devices.
+void SpiWriteBatch(const SPISettings &settings, const uint8_t *csPins, const uint16_t *words, uint8_t count){
+	SPI.beginTransaction(settings);
+	for(uint8_t i = 0; i < count; i++){
+		digitalWriteFast(csPins[i], HIGH);
+		delayNanoseconds(SpiCsDelayNs);
+		SPI.transfer16(words[i]);
+		delayNanoseconds(SpiCsDelayNs);
+		digitalWriteFast(csPins[i], LOW);
+		delayNanoseconds(SpiCsDelayNs);
+	}
+	SPI.endTransaction();
+}// End of SpiWriteBatch()
+
+
+
+/// Queue a long transfer to be sent over DMA. The data must stay valid until the transfer is done.
+/// @param client The client the transfer is for.
+/// @param priority The priority of the transfer.
+/// @param settings The SPI settings for the device.
+/// @param clockHz The SPI clock in the settings, to size the chunks from.
+/// @param csPin The chip select pin of the device.
+/// @param csActiveHigh True if the chip select is active high.
+/// @param data The data to send.
+/// @param length The number of bytes to send.
+/// @param onDone Called from UpdateSpiBus() once the whole transfer is sent. Can be nullptr.
+/// @return True if the transfer was queued, false if the queue is full.
+bool SpiQueueTransfer(SpiClient client, SpiPriority priority, const SPISettings &settings, uint32_t clockHz, uint8_t csPin, bool csActiveHigh,
+	const uint8_t *data, uint16_t length, void (*onDone)()){
+	if(length == 0){
+		return true;
+	}
+
+	for(uint8_t i = 0; i < SpiQueueLength; i++){
+		if(spiQueue[i].inUse){
+			continue;
+		}
+		spiQueue[i].client = client;
+		spiQueue[i].priority = priority;
+		spiQueue[i].settings = settings;
+		spiQueue[i].csPin = csPin;
+		spiQueue[i].csActiveHigh = csActiveHigh;
+		spiQueue[i].data = data;
+		spiQueue[i].length = length;
+		spiQueue[i].sent = 0;
+
+		// As many bytes as go out in SpiChunkMaxUs, and at least one. At the LCD's 300 kHz that is 3 bytes, 80 us
+		uint32_t chunkBytes = (uint64_t)clockHz * SpiChunkMaxUs / 8000000;
+		spiQueue[i].chunkBytes = (chunkBytes == 0) ? 1 : ((chunkBytes > SpiChunkMaxBytes) ? SpiChunkMaxBytes : chunkBytes);
+
+		spiQueue[i].queuedAt = micros();
+		spiQueue[i].onDone = onDone;
+		spiQueue[i].inUse = true;
+		return true;
+	}
+	return false;
+}// End of SpiQueueTransfer()
+
+
+
+/// Check if a client has any queued transfers that haven't finished
+/// @param client The client to check.
+/// @return True if the client has a transfer waiting or being sent.
+bool SpiClientBusy(SpiClient client){
+	for(uint8_t i = 0; i < SpiQueueLength; i++){
+		if(spiQueue[i].inUse && (spiQueue[i].client == client)){
+			return true;
+		}
+	}
+	return false;
+}// End of SpiClientBusy()
+
+
+
+/// Print how much each client has used the bus, and the longest each has waited for it, since the stats were last reset
+void PrintSpiStats(){
+	uint32_t elapsedUs = spiStatsTimer;
+	if(elapsedUs == 0){
+		elapsedUs = 1;
+	}
+	for(uint8_t i = 0; i < NUM_SPI_CLIENTS; i++){
+		SERIAL_PRINTF("SPI %s: %lu.%02lu%% busy, %lu transactions, worst wait %lu us\n", SpiClientNames[i],
+			(uint32_t)((uint64_t)spiStats[i].busyUs * 100 / elapsedUs), (uint32_t)((uint64_t)spiStats[i].busyUs * 10000 / elapsedUs % 100),
+			spiStats[i].transactions, spiStats[i].worstWaitUs);
+	}
+}// End of PrintSpiStats()
+
+
+
+/// Reset the bus stats
+void ResetSpiStats(){
+	for(uint8_t i = 0; i < NUM_SPI_CLIENTS; i++){
+		spiStats[i].busyUs = 0;
+		spiStats[i].transactions = 0;
+		spiStats[i].worstWaitUs = 0;
+	}
+	spiStatsTimer = 0;
+}// End of ResetSpiStats()
+
+
+
+/// Start the next DMA chunk if the bus is free, and finish chunks that are done. This function will be called in the main loop.
+void UpdateSpiBus(){
+	if((activeTransfer != nullptr) && chunkDone){
+		FinishSpiChunk();
+	}
+
+	if((activeTransfer == nullptr) && !spiHeld){
+		StartSpiChunk();
+	}
+}// End of UpdateSpiBus()
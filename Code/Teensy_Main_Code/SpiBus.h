@@ -0,0 +1,111 @@
+// Header for the SPI bus arbiter. The Gantry's stepper drivers share the SPI bus with anything else added later (like the LCD),
+// so everything that uses the bus goes through here.
+//
+// There are two ways to use the bus:
+//	- Short, time critical transactions (like stepping the Gantry) take the bus with SpiAcquire(), do their transfers
+//	  right away, and give it back with SpiRelease(). They only ever wait for the DMA chunk that is already going.
+//	- Long transfers (like pushing data to a display) are queued with SpiQueueTransfer(), and sent over DMA a chunk at a
+//	  time from UpdateSpiBus(), highest priority first. A new chunk is never started while the bus is held. Each chunk is
+//	  sized from the device's clock so it takes no more than SpiChunkMaxUs.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+#include <SPI.h>
+
+
+//	*************************************************************************************************
+//	Enumerations for the SPI Bus
+//	*************************************************************************************************
+
+// The things that use the SPI bus. Stats are kept for each one
+typedef enum {
+	SPI_CLIENT_GANTRY,		// The Gantry stepper drivers
+	SPI_CLIENT_DISPLAY,		// The status display
+	NUM_SPI_CLIENTS
+} SpiClient;
+
+
+
+// The priorities of queued transfers. Higher priorities are sent first
+typedef enum {
+	SPI_PRIORITY_BULK,		// Large transfers that can wait, like a full screen refresh
+	SPI_PRIORITY_NORMAL,	// Small transfers that should go out soon
+	NUM_SPI_PRIORITIES
+} SpiPriority;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the SPI Bus code
+//	*************************************************************************************************
+
+const uint8_t SpiQueueLength = 4;		// The most transfers that can be queued at once
+const uint16_t SpiChunkMaxUs = 100;		// The longest one DMA chunk takes to send. This is the longest a time critical transaction waits
+const uint16_t SpiChunkMaxBytes = 32;	// The most bytes sent in one DMA chunk, however fast the device's clock is
+const uint16_t SpiCsDelayNs = 400;		// The time chip select is held before and after a transfer, long enough for every device on the bus
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the SPI Bus code
+//	*************************************************************************************************
+
+/// Initialize the SPI bus
+void InitSpiBus();
+
+
+/// Take the SPI bus for blocking transfers. If a DMA chunk is being sent, this waits for it to finish.
+/// A client that already has the bus can take it again, as long as every SpiAcquire() gets a SpiRelease().
+/// @param client The client taking the bus.
+void SpiAcquire(SpiClient client);
+
+
+/// Give the SPI bus back after SpiAcquire(), so queued transfers can continue
+void SpiRelease();
+
+
+/// Write the same 16 bit word layout to several devices back to back, in one SPI transaction. The bus must already be
+/// held with SpiAcquire(). The chip selects are active high, like the DRV8711's.
+/// @param settings The SPI settings for the devices.
+/// @param csPins The chip select pins of the devices.
+/// @param words The word to write to each device.
+/// @param count The number of devices.
+void SpiWriteBatch(const SPISettings &settings, const uint8_t *csPins, const uint16_t *words, uint8_t count);
+
+
+/// Queue a long transfer to be sent over DMA. The data must stay valid until the transfer is done.
+/// @param client The client the transfer is for.
+/// @param priority The priority of the transfer.
+/// @param settings The SPI settings for the device.
+/// @param clockHz The SPI clock in the settings, to size the chunks from.
+/// @param csPin The chip select pin of the device.
+/// @param csActiveHigh True if the chip select is active high.
+/// @param data The data to send.
+/// @param length The number of bytes to send.
+/// @param onDone Called from UpdateSpiBus() once the whole transfer is sent. Can be nullptr.
+/// @return True if the transfer was queued, false if the queue is full.
+bool SpiQueueTransfer(SpiClient client, SpiPriority priority, const SPISettings &settings, uint32_t clockHz, uint8_t csPin, bool csActiveHigh,
+	const uint8_t *data, uint16_t length, void (*onDone)() = nullptr);
+
+
+/// Check if a client has any queued transfers that haven't finished
+/// @param client The client to check.
+/// @return True if the client has a transfer waiting or being sent.
+bool SpiClientBusy(SpiClient client);
+
+
+/// Print how much each client has used the bus, and the longest each has waited for it, since the stats were last reset
+void PrintSpiStats();
+
+
+/// Reset the bus stats
+void ResetSpiStats();
+
+
+/// Start the next DMA chunk if the bus is free, and finish chunks that are done. This function will be called in the main loop.
+void UpdateSpiBus();
@@ -0,0 +1,269 @@
+// Code for the status display. The LCD is an ST7920 in serial mode, where every byte is sent as 3 bytes: a sync byte that
+// says if it's a command or data, then the high and low nibbles. In text mode each address on a line holds 2 characters,
+// so cells are sent in pairs.
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <TimeLib.h>
+
+#include "Config.h"
+#include "StatusDisplay.h"
+#include "SpiBus.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "TimeManager.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Status Display code
+//	*************************************************************************************************
+
+// The ST7920 can only take a byte every 72us, and each byte is 24 bits in serial mode, so the clock has to be slow
+const uint32_t LcdSpiClockHz = 300000;
+const SPISettings LcdSpiSettings(LcdSpiClockHz, MSBFIRST, SPI_MODE3);
+const uint16_t LcdByteUs = 80;				// The time to send one LCD byte (3 SPI bytes) at this clock
+const uint16_t DisplaySlackMarginUs = 50;	// Extra time left before the next step, for starting and finishing the transfer
+
+// ST7920 commands
+const uint8_t LcdFunctionSet = 0x30;		// 8 bit interface, basic instructions
+const uint8_t LcdDisplayOn = 0x0C;			// Display on, no cursor
+const uint8_t LcdClear = 0x01;				// Clear the screen and go to address 0
+const uint8_t LcdEntryMode = 0x06;			// Move right after each character
+const uint8_t LcdLineAddress[DisplayLines] = {0x80, 0x90, 0x88, 0x98};	// The set address command for the start of each line
+
+char screenText[DisplayLines][DisplayColumns];	// The text that should be on the LCD
+char shownText[DisplayLines][DisplayColumns];	// The text that has been sent to the LCD
+
+uint8_t nextLine = 0;	// Where to start looking for changed cells, so every part of the screen gets its turn
+uint8_t nextColumn = 0;
+
+uint8_t lcdPacket[(1 + DisplayMaxRunChars) * 3];	// The transfer being sent. Has to stay valid until the SPI bus is done with it
+
+elapsedMillis displayRefreshTimer;	// Time since the text was rebuilt
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Status Display code
+//	*************************************************************************************************
+
+/// Encode an LCD byte as the 3 bytes sent in serial mode
+/// @param packet Where to write the 3 bytes.
+/// @param isData True for data (characters), false for commands.
+/// @param value The byte to send.
+void EncodeLcdByte(uint8_t *packet, bool isData, uint8_t value){
+	packet[0] = isData ? 0xFA : 0xF8;
+	packet[1] = value & 0xF0;
+	packet[2] = (value << 4) & 0xF0;
+}// End of EncodeLcdByte()
+
+
+
+/// Send a command to the LCD right away. Only used while initializing.
+/// @param command The command to send.
+/// @param waitUs How long the command takes the LCD.
+void LcdCommandBlocking(uint8_t command, uint16_t waitUs){
+	uint8_t packet[3];
+	EncodeLcdByte(packet, false, command);
+
+	SpiAcquire(SPI_CLIENT_DISPLAY);
+	SPI.beginTransaction(LcdSpiSettings);
+	digitalWriteFast(LcdCSPin, HIGH);
+	SPI.transfer(packet, 3);
+	digitalWriteFast(LcdCSPin, LOW);
+	SPI.endTransaction();
+	SpiRelease();
+
+	delayMicroseconds(waitUs);
+}// End of LcdCommandBlocking()
+
+
+
+/// Write a line of text into the screen buffer, padded with spaces
+/// @param line The line to write.
+/// @param format The printf format of the line.
+void SetDisplayLine(uint8_t line, const char *format, ...){
+	char text[DisplayColumns + 1];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	if(length < 0){
+		length = 0;
+	}
+	for(uint8_t i = 0; i < DisplayColumns; i++){
+		screenText[line][i] = (i < length) ? text[i] : ' ';
+	}
+}// End of SetDisplayLine()
+
+
+
+// Rebuild the text from the state of the clock
+void BuildStatusText(){
+	// Time, and how long ago it was synced
+	uint32_t syncAge = GetTimeSyncAge();
+	if(syncAge == UINT32_MAX){// Show why it hasn't synced yet
+		const char *const reasons[] = {"no esp", "portal", "no wifi", "no ntp", "no sync"};
+		SetDisplayLine(0, "%02d:%02d:%02d %s", hour(), minute(), second(), reasons[GetEsp32TimeStatus()]);
+	}else if(syncAge < 60){
+		SetDisplayLine(0, "%02d:%02d:%02d %2lus", hour(), minute(), second(), syncAge);
+	}else if(syncAge < 3600){
+		SetDisplayLine(0, "%02d:%02d:%02d %2lum", hour(), minute(), second(), syncAge / 60);
+	}else{
+		SetDisplayLine(0, "%02d:%02d:%02d %2luh", hour(), minute(), second(), syncAge / 3600);
+	}
+
+	// Gantry state and step
+	GantryState state = GetGantryState();
+	SetDisplayLine(1, "%s %u", GetGantryStateName(state), GetGantryStep());
+
+	// Display steppers and power
+	SetDisplayLine(2, "Steppers %s", DisplaySteppersIdle() ? "idle" : "move");
+
+	// Faults
+	bool stalled = GantryStalled();
+	bool error = (state == GANTRY_ERROR);
+	bool syncStale = (syncAge == UINT32_MAX) || (syncAge > 86400);
+	if(!stalled && !error && !syncStale){
+		SetDisplayLine(3, "OK");
+	}else{
+		SetDisplayLine(3, "%s%s%s", error ? "ERR " : "", stalled ? "STALL " : "", syncStale ? "SYNC" : "");
+	}
+}// End of BuildStatusText()
+
+
+
+/// Find the next run of changed cells, starting where the last search left off
+/// @param line Set to the line of the run.
+/// @param column Set to the first column of the run. This is always even, since cells go in pairs.
+/// @param maxChars The most characters the run can have.
+/// @return The number of characters in the run, or 0 if nothing changed.
+uint8_t FindChangedCells(uint8_t *line, uint8_t *column, uint8_t maxChars){
+	for(uint8_t checked = 0; checked < (DisplayLines * DisplayColumns / 2); checked++){
+		uint8_t l = nextLine;
+		uint8_t c = nextColumn;
+
+		nextColumn += 2;
+		if(nextColumn >= DisplayColumns){
+			nextColumn = 0;
+			nextLine = (nextLine + 1) % DisplayLines;
+		}
+
+		if((screenText[l][c] == shownText[l][c]) && (screenText[l][c + 1] == shownText[l][c + 1])){
+			continue;
+		}
+
+		// Found a changed pair, so keep going along the line while the pairs are changed
+		uint8_t length = 2;
+		while(((c + length) < DisplayColumns) && ((length + 2) <= maxChars)
+				&& ((screenText[l][c + length] != shownText[l][c + length]) || (screenText[l][c + length + 1] != shownText[l][c + length + 1]))){
+			length += 2;
+		}
+
+		*line = l;
+		*column = c;
+		nextLine = l;
+		nextColumn = c + length;
+		if(nextColumn >= DisplayColumns){
+			nextColumn = 0;
+			nextLine = (nextLine + 1) % DisplayLines;
+		}
+		return length;
+	}
+	return 0;
+}// End of FindChangedCells()
+
+
+
+// Send the next changed cells, if there's time before the next step
+void SendChangedCells(){
+	if(SpiClientBusy(SPI_CLIENT_DISPLAY)){// The last cells are still going out
+		return;
+	}
+
+	// Work out how many characters can be sent before the next step
+	uint32_t slackUs = GetGantryStepSlackUs();
+	uint32_t displaySlackUs = GetDisplayStepperSlackUs();
+	if(displaySlackUs < slackUs){
+		slackUs = displaySlackUs;
+	}
+	if(slackUs <= DisplaySlackMarginUs){
+		return;
+	}
+	uint32_t lcdBytes = (slackUs - DisplaySlackMarginUs) / LcdByteUs;
+	if(lcdBytes < 3){// Not even time for the address and one pair
+		return;
+	}
+	uint8_t maxChars = ((lcdBytes - 1) > DisplayMaxRunChars) ? DisplayMaxRunChars : ((lcdBytes - 1) & ~1);
+
+	uint8_t line;
+	uint8_t column;
+	uint8_t length = FindChangedCells(&line, &column, maxChars);
+	if(length == 0){
+		return;
+	}
+
+	// Set the address, then send the characters
+	EncodeLcdByte(lcdPacket, false, LcdLineAddress[line] + column / 2);
+	for(uint8_t i = 0; i < length; i++){
+		EncodeLcdByte(&lcdPacket[(1 + i) * 3], true, screenText[line][column + i]);
+	}
+
+	if(SpiQueueTransfer(SPI_CLIENT_DISPLAY, SPI_PRIORITY_NORMAL, LcdSpiSettings, LcdSpiClockHz, LcdCSPin, true, lcdPacket, (1 + length) * 3)){
+		memcpy(&shownText[line][column], &screenText[line][column], length);
+	}
+}// End of SendChangedCells()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Status Display code
+//	*************************************************************************************************
+
+/// Initialize the LCD and clear it. This blocks for a few milliseconds, so only call it before anything starts moving.
+void InitStatusDisplay(){
+	#if STATUS_DISPLAY
+		pinMode(LcdCSPin, OUTPUT);
+		digitalWriteFast(LcdCSPin, LOW);
+		delay(40);	// Wait for the LCD to power up
+
+		LcdCommandBlocking(LcdFunctionSet, 100);
+		LcdCommandBlocking(LcdFunctionSet, 100);
+		LcdCommandBlocking(LcdDisplayOn, 100);
+		LcdCommandBlocking(LcdClear, 1600);
+		LcdCommandBlocking(LcdEntryMode, 100);
+
+		// The LCD is blank now
+		memset(shownText, ' ', sizeof(shownText));
+		memset(screenText, ' ', sizeof(screenText));
+		BuildStatusText();
+	#endif
+}// End of InitStatusDisplay()
+
+
+
+/// Resend the whole screen. The cells are still sent a few at a time, so this doesn't hold anything up.
+void RedrawStatusDisplay(){
+	memset(shownText, 0, sizeof(shownText));	// No character is 0, so every cell counts as changed
+}// End of RedrawStatusDisplay()
+
+
+
+/// Rebuild the text when it is time to, and send the next changed cells if there's time before the next step.
+/// This function will be called in the main loop, before UpdateSpiBus().
+void UpdateStatusDisplay(){
+	#if STATUS_DISPLAY
+		if(displayRefreshTimer >= DisplayRefreshMs){
+			displayRefreshTimer = 0;
+			BuildStatusText();
+		}
+
+		SendChangedCells();
+	#endif
+}// End of UpdateStatusDisplay()
@@ -0,0 +1,39 @@
+// Header for the status display. This shows the state of the clock on the ST7920 LCD, in text mode: the time and how long
+// ago it was synced, the Gantry state and step, and any faults.
+//
+// The text is kept in a buffer of character cells, and only the cells that changed are sent to the LCD. They are sent a few
+// at a time over the SPI bus, only when no step is due for the Gantry or display steppers before the transfer is done.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Status Display code
+//	*************************************************************************************************
+
+const uint8_t DisplayLines = 4;				// The number of text lines on the LCD
+const uint8_t DisplayColumns = 16;			// The number of (half width) characters on a line
+const uint16_t DisplayRefreshMs = 250;		// How often the text is rebuilt from the state of the clock
+const uint8_t DisplayMaxRunChars = 8;		// The most characters sent to the LCD at once
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Status Display code
+//	*************************************************************************************************
+
+/// Initialize the LCD and clear it. This blocks for a few milliseconds, so only call it before anything starts moving.
+void InitStatusDisplay();
+
+
+/// Resend the whole screen. The cells are still sent a few at a time, so this doesn't hold anything up.
+void RedrawStatusDisplay();
+
+
+/// Rebuild the text when it is time to, and send the next changed cells if there's time before the next step.
+/// This function will be called in the main loop, before UpdateSpiBus().
+void UpdateStatusDisplay();
@@ -0,0 +1,186 @@
+// Backends for the stepper motion code. A backend is a struct of static functions that turns "step this motor" into whatever
+// the hardware needs. Every backend has the same functions, so code that moves motors takes the backend as a template
+// parameter, and the calls are resolved and inlined at compile time (no virtual functions in the step path).
+//
+//	static void Begin();									Set up the hardware
+//	static void SetDirection(uint8_t motor, bool forward);	Set the direction of a motor for the next steps
+//	static void Step(uint8_t motor);						Take one step on a motor
+//	static void Release(uint8_t motor);						Turn off a motor's coils, if the backend can
+//	static void Commit();									Send out anything held back by the other functions
+//
+// Backends are allowed to hold changes until Commit(), so several motors can be sent out together.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <HighPowerStepperDriver.h>
+
+#include "SpiBus.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Shift Register Coil Backend
+//	*************************************************************************************************
+
+// Unipolar steppers whose coils are driven straight from a chain of 74HC595 shift registers, 4 bits per stepper.
+// The coil patterns are packed into 32 bit words, and the whole chain is shifted out on Commit() if anything changed.
+template <uint8_t NumSteppers>
+struct ShiftRegCoilBackend {
+	static const uint8_t SteppersPerWord = 8;
+	static const uint8_t Words = (NumSteppers + SteppersPerWord - 1) / SteppersPerWord;
+	static constexpr uint8_t Patterns[4] = {0b1010, 0b0110, 0b0101, 0b1001};	// The coil patterns of the 4 full steps
+
+	static inline uint32_t coilData[Words] = {};		// The coil patterns for all the steppers. Stepper 0 is the lowest 4 bits of the first word
+	static inline uint8_t phase[NumSteppers] = {};		// The step pattern each stepper is on
+	static inline uint32_t forwardMask = 0;				// The steppers set to move forward (clockwise)
+	static inline bool changed = false;					// If the coils need to be shifted out
+
+	static void Begin(){
+		pinMode(DisplayStepperDataPin, OUTPUT);
+		pinMode(DisplayStepperClockPin, OUTPUT);
+		pinMode(DisplayStepperLatchPin, OUTPUT);
+	}
+
+	static void SetDirection(uint8_t motor, bool forward){
+		if(forward){
+			forwardMask |= ((uint32_t)1 << motor);
+		}else{
+			forwardMask &= ~((uint32_t)1 << motor);
+		}
+	}
+
+	static void Step(uint8_t motor){
+		phase[motor] = (forwardMask & ((uint32_t)1 << motor)) ? ((phase[motor] + 1) % 4) : ((phase[motor] + 3) % 4);
+		SetCoils(motor, Patterns[phase[motor]]);
+	}
+
+	static void Release(uint8_t motor){
+		SetCoils(motor, 0);
+	}
+
+	static void Commit(){
+		if(changed){
+			ShiftOut();
+		}
+	}
+
+	/// Turn off every stepper's coils right away
+	static void ReleaseAll(){
+		memset(coilData, 0, sizeof(coilData));
+		ShiftOut();
+	}
+
+	/// Get the number of coils that are on
+	static uint8_t CoilsEnergized(){
+		uint8_t coils = 0;
+		for(uint8_t i = 0; i < Words; i++){
+			coils += __builtin_popcount(coilData[i]);
+		}
+		return coils;
+	}
+
+	/// Set the 4 coil bits of one stepper
+	static void SetCoils(uint8_t motor, uint8_t pattern){
+		uint8_t shift = (motor % SteppersPerWord) * 4;
+		uint32_t *word = &coilData[motor / SteppersPerWord];
+		*word = (*word & ~((uint32_t)0b1111 << shift)) | ((uint32_t)pattern << shift);
+		changed = true;
+	}
+
+	/// Shift the coil patterns out to the chain of shift registers
+	static void ShiftOut(){
+		digitalWriteFast(DisplayStepperLatchPin, LOW);
+
+		for (int16_t i = NumSteppers*4 -1; i >=0 ; i--){// Loop through all the stepper's pins, last shift register first
+			delayNanoseconds(20);								// Delay for the minimum pulse duration of the Data Clock
+			digitalWriteFast(DisplayStepperClockPin, LOW);
+
+			digitalWriteFast(DisplayStepperDataPin, (coilData[i / 32] >> (i % 32)) & 1);
+			delayNanoseconds(24); // Delay for the minimum time for Data before Clock
+			digitalWriteFast(DisplayStepperClockPin, HIGH);
+		}
+
+		delayNanoseconds(18); // Delay for the minimum time for Data Clock before Latch Clock
+		digitalWriteFast(DisplayStepperLatchPin, HIGH);
+		changed = false;
+	}
+};
+
+
+
+
+
+//	*************************************************************************************************
+//	DRV8711 SPI Backend
+//	*************************************************************************************************
+
+// The Pololu driver, with the CTRL register words exposed so steps and directions for several drivers can be written back
+// to back in one SPI transaction
+class Drv8711Driver : public HighPowerStepperDriver {
+	public:
+		/// Get the word that makes the driver take one step. This is the CTRL register with the RSTEP bit set.
+		/// @return The word to write to the driver.
+		uint16_t StepWord(){
+			return ((uint16_t)HPSDRegAddr::CTRL << 12) | ((ctrl | (1 << 2)) & 0xFFF);
+		}
+
+		/// Set the direction of the driver without writing it, so it can be written along with the other drivers.
+		/// @param value The direction, like setDirection().
+		/// @return The word to write to the driver to set the direction.
+		uint16_t DirectionWord(bool value){
+			if(value){
+				ctrl |= (1 << 1);
+			}else{
+				ctrl &= ~(1 << 1);
+			}
+			return ((uint16_t)HPSDRegAddr::CTRL << 12) | (ctrl & 0xFFF);
+		}
+};
+
+
+
+// DRV8711 drivers stepped over SPI (the RSTEP bit), like the Gantry's. Steps and direction changes are queued, and written to
+// all the drivers in one SPI transaction on Commit(). The SPI bus has to be held with SpiAcquire() around Commit().
+// Begin() is left to the owner of the drivers, since their settings (current, decay, stall detection) are up to it.
+template <uint8_t NumMotors, Drv8711Driver *Drivers, const uint8_t *CsPins, const SPISettings *Settings>
+struct Drv8711Backend {
+	static const uint8_t QueueLength = NumMotors * 2;	// Room for two writes per driver between commits
+
+	static inline uint8_t queuedCs[QueueLength];
+	static inline uint16_t queuedWords[QueueLength];
+	static inline uint8_t queued = 0;
+
+	static void Begin(){
+	}
+
+	static void SetDirection(uint8_t motor, bool forward){
+		Queue(motor, Drivers[motor].DirectionWord(forward));
+	}
+
+	static void Step(uint8_t motor){
+		Queue(motor, Drivers[motor].StepWord());
+	}
+
+	static void Release(uint8_t motor){
+		// The drivers hold their current themselves, so power is handled by the owner
+	}
+
+	static void Commit(){
+		if(queued > 0){
+			SpiWriteBatch(*Settings, queuedCs, queuedWords, queued);
+			queued = 0;
+		}
+	}
+
+	/// Add a write to the queue, sending the queue first if it's full
+	static void Queue(uint8_t motor, uint16_t word){
+		if(queued == QueueLength){
+			Commit();
+		}
+		queuedCs[queued] = CsPins[motor];
+		queuedWords[queued] = word;
+		queued++;
+	}
+};
@@ -0,0 +1,384 @@
+// The motion code for a group of independent steppers, written once for any backend (see StepperBackends.h). Each stepper
+// can be moved to a position, moved by some steps, homed against a sensor, or have the steps in one turn measured against
+// the sensor, one full step per Tick(). Positions are
+// StepPositions, the same fixed point type the Gantry uses.
+//
+// The backend and the home sensor are template parameters, so everything is resolved at compile time. The home sensor is a
+// struct with one function:
+//	static bool AtHome(uint8_t motor);		True once the motor has reached its home position
+//
+// Steppers that turn all the way around can be given the steps in one turn with SetRevolution(). Their positions then stay
+// within one turn, and MoveTo() can be given a target past the end of the turn to go the short way round. Whenever a move
+// takes a stepper forward onto its home sensor, the same edge Home() stops on, its position is quietly corrected to the
+// nearest whole turn, so the steps it has missed don't build up between homings. Each stepper has its own turn, since geared
+// steppers don't all turn the same, and Measure() finds it by counting the steps from one home edge to the next.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "FixedPoint.h"
+
+
+//	*************************************************************************************************
+//	Enumerations for the Stepper Motion code
+//	*************************************************************************************************
+
+// The states of a stepper in a group
+typedef enum {
+	STEPPER_IDLE,
+	STEPPER_MOVING,
+	STEPPER_HOMING,
+	STEPPER_MEASURING
+} StepperState;
+
+
+
+
+
+//	*************************************************************************************************
+//	Stepper Group
+//	*************************************************************************************************
+
+template <typename Backend, typename HomeSensor, uint8_t NumSteppers>
+class StepperGroup {
+	static_assert(NumSteppers <= 32, "The active mask only has room for 32 steppers");
+
+	public:
+		/// Set up the backend and put every stepper at 0, idle
+		void Begin(){
+			Backend::Begin();
+			for(uint8_t i = 0; i < NumSteppers; i++){
+				steppers[i].state = STEPPER_IDLE;
+				steppers[i].forward = true;
+				steppers[i].position = StepPosition();
+				steppers[i].target = StepPosition();
+				steppers[i].atHome = false;
+				steppers[i].drift = StepPosition();
+				steppers[i].revolution = StepPosition();
+				steppers[i].rezeroWindow = StepPosition();
+				steppers[i].edges = 0;
+				steppers[i].measured = StepPosition();
+			}
+			active = 0;
+			rezeroed = 0;
+			ignoredEdges = 0;
+		}
+
+
+		/// Let a stepper turn all the way around, and correct its position each time a move passes home
+		/// @param stepper The stepper.
+		/// @param steps The steps in one turn.
+		/// @param window How far from a whole turn the home sensor can trip and still be trusted. Edges further off than this are
+		/// taken as switch noise and ignored.
+		void SetRevolution(uint8_t stepper, StepPosition steps, StepPosition window){
+			steppers[stepper].revolution = steps;
+			steppers[stepper].rezeroWindow = window;
+		}
+
+
+		/// Get the steps in one turn of a stepper
+		/// @return The steps, or 0 if the stepper doesn't wrap around.
+		StepPosition Revolution(uint8_t stepper) const{
+			return steppers[stepper].revolution;
+		}
+
+
+		/// Move a stepper to a position. If the stepper is homing or measuring, the move starts once it is done.
+		/// @param stepper The stepper to move.
+		/// @param target The position to move to.
+		void MoveTo(uint8_t stepper, StepPosition target){
+			if((steppers[stepper].state == STEPPER_HOMING) || (steppers[stepper].state == STEPPER_MEASURING)){// Its position means nothing until then
+				steppers[stepper].target = target;
+				return;
+			}
+			Start(stepper, STEPPER_MOVING, target > steppers[stepper].position);
+			steppers[stepper].target = target;
+		}
+
+
+		/// Move a stepper some steps from where it is
+		/// @param stepper The stepper to move.
+		/// @param steps The number of steps, positive for forward.
+		void MoveBy(uint8_t stepper, int16_t steps){
+			Start(stepper, STEPPER_MOVING, steps > 0);
+			steppers[stepper].target = steppers[stepper].position + FullSteps(steps);
+		}
+
+
+		/// Move a stepper forward until its home sensor trips, and make that position 0
+		/// @param stepper The stepper to home.
+		void Home(uint8_t stepper){
+			Start(stepper, STEPPER_HOMING, true);
+			steppers[stepper].target = StepPosition();
+		}
+
+
+		/// Measure the steps in one turn of a stepper. It goes forward to its home sensor, then on round to the sensor again,
+		/// counting the steps, and then back to the position it was at. Measured() has the result once it is idle.
+		/// @param stepper The stepper to measure.
+		void Measure(uint8_t stepper){
+			StepPosition returnTo = (steppers[stepper].state == STEPPER_IDLE) ? steppers[stepper].position : steppers[stepper].target;
+			Start(stepper, STEPPER_MEASURING, true);
+			steppers[stepper].atHome = HomeSensor::AtHome(stepper);	// Starting on the sensor isn't an edge
+			steppers[stepper].target = returnTo;
+			steppers[stepper].edges = 0;
+			steppers[stepper].measured = StepPosition();
+		}
+
+
+		/// Get the steps in one turn found by the last Measure() of a stepper
+		/// @return The steps, or 0 if the stepper hasn't been measured or the home sensor wasn't found.
+		StepPosition Measured(uint8_t stepper) const{
+			return steppers[stepper].measured;
+		}
+
+
+		/// Check if all the steppers are idle
+		bool Idle() const{
+			return active == 0;
+		}
+
+
+		/// Check if all the steppers in a mask are idle
+		/// @param mask The steppers to check, one bit per stepper.
+		bool Idle(uint32_t mask) const{
+			return (active & mask) == 0;
+		}
+
+
+		/// Get the steppers that aren't idle, one bit per stepper
+		uint32_t ActiveMask() const{
+			return active;
+		}
+
+
+		StepperState State(uint8_t stepper) const{
+			return steppers[stepper].state;
+		}
+
+
+		StepPosition Position(uint8_t stepper) const{
+			return steppers[stepper].position;
+		}
+
+
+		StepPosition Target(uint8_t stepper) const{
+			return steppers[stepper].target;
+		}
+
+
+		/// Get how far off a stepper's position was the last time a move passed home
+		StepPosition Drift(uint8_t stepper) const{
+			return steppers[stepper].drift;
+		}
+
+
+		/// Get the steps a stepper has taken since power on
+		uint32_t StepCount(uint8_t stepper) const{
+			return steppers[stepper].steps;
+		}
+
+
+		/// Get the times a stepper has started moving the other way from its last move since power on
+		uint32_t Reversals(uint8_t stepper) const{
+			return steppers[stepper].reversals;
+		}
+
+
+		/// Get the steppers corrected while passing home since the last call, one bit per stepper, and clear them
+		uint32_t TakeRezeroed(){
+			uint32_t mask = rezeroed;
+			rezeroed = 0;
+			return mask;
+		}
+
+
+		/// Get the steppers whose home sensor tripped too far from home since the last call, one bit per stepper, and clear them.
+		/// Their Drift() is how far off the sensor tripped.
+		uint32_t TakeIgnoredEdges(){
+			uint32_t mask = ignoredEdges;
+			ignoredEdges = 0;
+			return mask;
+		}
+
+
+		/// Take one step on every stepper that needs it, then commit the backend. Only the steppers that aren't idle are
+		/// looked at, so idle steppers cost nothing.
+		/// @return True if any stepper stepped or stopped, so the backend had something to send.
+		bool Tick(){
+			if(active == 0){
+				return false;
+			}
+
+			uint32_t pending = active;
+			while(pending != 0){
+				uint8_t i = __builtin_ctz(pending);
+				pending &= pending - 1;	// Clear the lowest bit
+
+				switch(steppers[i].state){
+					case STEPPER_IDLE:
+						break;
+					case STEPPER_MOVING:
+						if(steppers[i].revolution != StepPosition()){
+							CheckHomeEdge(i);
+						}
+
+						// Step toward the target, and stop once there. A correction at home can put the position past the target,
+						// so then turn back to it rather than go round looking for it
+						if(steppers[i].position == steppers[i].target){
+							Stop(i);
+						}else if((steppers[i].position > steppers[i].target) == steppers[i].forward){
+							Start(i, STEPPER_MOVING, !steppers[i].forward);
+						}else{
+							StepOnce(i);
+						}
+						break;
+					case STEPPER_HOMING:
+						// Step until the home sensor trips, then set that as position 0, and go on to any move asked for meanwhile
+						if(!HomeSensor::AtHome(i)){
+							StepOnce(i);
+						}else{
+							steppers[i].position = StepPosition();
+							FinishAtHome(i);
+						}
+						break;
+					case STEPPER_MEASURING:
+						// Step until the home sensor has come on twice, counting the steps between
+						if(MeasureStep(i)){
+							FinishAtHome(i);
+						}else{
+							StepOnce(i);
+						}
+						break;
+				}
+			}
+
+			Backend::Commit();
+			return true;
+		}
+
+	private:
+		struct {
+			StepperState state;		// The state of the stepper
+			bool forward;			// The direction the stepper is moving
+			StepPosition position;	// The current position of the stepper
+			StepPosition target;	// The target position of the stepper
+			bool atHome;			// If the home sensor was tripped at the last step, to find the edge while moving
+			StepPosition drift;		// How far off the position was the last time a move passed home
+			StepPosition revolution;	// The steps in one turn, or 0 if the stepper doesn't wrap around
+			StepPosition rezeroWindow;	// How far off a home edge can be and still be trusted
+			uint8_t edges;			// The home edges found so far while measuring
+			StepPosition measured;	// The steps in one turn found by the last measurement
+			uint32_t steps;			// The steps taken since power on
+			uint32_t reversals;		// The moves started the other way from the one before
+		} steppers[NumSteppers];
+
+		uint32_t active = 0;		// The steppers that aren't idle, one bit per stepper
+		uint32_t rezeroed = 0;		// The steppers corrected while passing home, for the owner to log
+		uint32_t ignoredEdges = 0;	// The steppers whose home sensor tripped too far from home
+
+
+		void Start(uint8_t stepper, StepperState state, bool forward){
+			if(forward != steppers[stepper].forward){
+				steppers[stepper].reversals++;
+			}
+			steppers[stepper].state = state;
+			steppers[stepper].forward = forward;
+			Backend::SetDirection(stepper, forward);
+			active |= ((uint32_t)1 << stepper);
+			if(steppers[stepper].revolution != StepPosition()){// Starting on the sensor isn't an edge
+				steppers[stepper].atHome = HomeSensor::AtHome(stepper);
+			}
+		}
+
+
+		/// Stop a stepper that has just found home at position 0, or go on to the move asked for while it was looking
+		void FinishAtHome(uint8_t stepper){
+			if(steppers[stepper].target != StepPosition()){
+				Start(stepper, STEPPER_MOVING, steppers[stepper].target > StepPosition());
+			}else{
+				Stop(stepper);
+			}
+		}
+
+
+		/// Look for a home edge while measuring a stepper. The first edge is made position 0, and the second is one turn on.
+		/// @return True once the measurement is done, found or not.
+		bool MeasureStep(uint8_t stepper){
+			bool atHome = HomeSensor::AtHome(stepper);
+			bool edge = atHome && !steppers[stepper].atHome;
+			steppers[stepper].atHome = atHome;
+			StepPosition revolution = steppers[stepper].revolution;
+
+			if(edge && (steppers[stepper].edges == 0)){
+				steppers[stepper].position = StepPosition();
+				steppers[stepper].edges = 1;
+			}else if(edge && ((revolution == StepPosition()) || (steppers[stepper].position > (revolution - steppers[stepper].rezeroWindow)))){
+				steppers[stepper].measured = steppers[stepper].position;
+				steppers[stepper].position = StepPosition();
+				return true;
+			}
+
+			// Give up if the sensor hasn't come on in twice the expected turn, so a broken switch doesn't spin it forever
+			if((revolution != StepPosition()) && (steppers[stepper].position > (revolution + revolution))){
+				steppers[stepper].position = StepPosition();
+				steppers[stepper].target = StepPosition();
+				return true;
+			}
+			return false;
+		}
+
+
+		/// Correct a moving stepper's position if it has just come onto its home sensor going forward. The sensor is read
+		/// before stepping, so it shows the position of the last step, which has already been sent out.
+		void CheckHomeEdge(uint8_t stepper){
+			bool atHome = HomeSensor::AtHome(stepper);
+			bool edge = atHome && !steppers[stepper].atHome && steppers[stepper].forward;
+			steppers[stepper].atHome = atHome;
+			if(!edge){
+				return;
+			}
+
+			// The edge is at a whole turn, so the position should be the nearest one
+			StepPosition revolution = steppers[stepper].revolution;
+			StepPosition rezeroWindow = steppers[stepper].rezeroWindow;
+			int32_t raw = steppers[stepper].position.Raw();
+			int32_t half = revolution.Raw() / 2;
+			int32_t turns = (raw >= 0) ? ((raw + half) / revolution.Raw()) : ((raw - half) / revolution.Raw());
+			StepPosition drift = steppers[stepper].position - StepPosition::FromRaw(turns * revolution.Raw());
+			steppers[stepper].drift = drift;
+			if((drift > rezeroWindow) || (drift < -rezeroWindow)){
+				ignoredEdges |= ((uint32_t)1 << stepper);
+				return;
+			}
+			steppers[stepper].position -= drift;
+			rezeroed |= ((uint32_t)1 << stepper);
+		}
+
+
+		void StepOnce(uint8_t stepper){
+			Backend::Step(stepper);
+			steppers[stepper].steps++;
+			steppers[stepper].position += steppers[stepper].forward ? StepPosition::FromRaw(StepOne) : StepPosition::FromRaw(-StepOne);
+		}
+
+
+		void Stop(uint8_t stepper){
+			Backend::Release(stepper);
+			steppers[stepper].state = STEPPER_IDLE;
+			active &= ~((uint32_t)1 << stepper);
+
+			// Bring the position back within one turn, after going the short way round past home
+			StepPosition revolution = steppers[stepper].revolution;
+			if(revolution != StepPosition()){
+				while(steppers[stepper].position >= revolution){
+					steppers[stepper].position -= revolution;
+				}
+				while(steppers[stepper].position < StepPosition()){
+					steppers[stepper].position += revolution;
+				}
+				steppers[stepper].target = steppers[stepper].position;
+			}
+		}
+};
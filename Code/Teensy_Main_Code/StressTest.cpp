@@ -0,0 +1,307 @@
+// Code for the Stress Test. Each iteration picks the displayed block in the next column (and every other round, a second
+// block stored in the same row, so paired swaps get tested too), spins it to another face and back with RotateToFace(),
+// then swaps it with SwapBlocks(). Going around the columns over and over swaps every block in and out of both rows.
+// The Gantry keeps the time each swap step takes and how each leg ended, and this keeps the totals for the whole test.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "StressTest.h"
+#include "BlockManager.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+
+
+//	*************************************************************************************************
+//	Local Enumerations for the Stress Test code
+//	*************************************************************************************************
+
+// The steps of one stress test iteration
+typedef enum {
+	STRESS_OFF,				// Not running
+	STRESS_PICK,			// Pick the block(s) for the next swap
+	STRESS_ROTATE_AWAY,		// Wait for the block(s) to rotate to another face
+	STRESS_ROTATE_BACK,		// Wait for the block(s) to rotate back to face 0, ready to be picked up
+	STRESS_SWAP,			// Wait for the Gantry to be free, then start the swap
+	STRESS_WAIT_SWAP,		// Wait for the swap to finish
+	STRESS_RECOVER			// Wait for the Gantry to home after an error
+} StressStep;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Stress Test code
+//	*************************************************************************************************
+
+StressStep stressStep = STRESS_OFF;	// The step the stress test is on
+
+uint32_t stressIterations = 0;		// The number of swaps to do, or 0 for no limit
+uint32_t stressMinutes = 0;			// The number of minutes to run for, or 0 for no limit
+uint32_t stressIteration = 0;		// The iteration the test is on
+
+Block *stressBlock1 = nullptr;		// The first block of the swap being tested
+Block *stressBlock2 = nullptr;		// The second block of the swap being tested, or nullptr
+
+elapsedMillis stressTimer;			// The time since the test started
+elapsedMillis swapTimer;			// The time since the swap being tested started
+uint32_t stressRunMs = 0;			// How long the test ran for, once it stopped
+
+uint32_t swapsDone = 0;				// The number of swaps that finished
+uint32_t pairedSwapsDone = 0;		// The number of those that moved two blocks
+uint32_t swapFailures = 0;			// The number of swaps that ended in an error or timed out
+uint32_t rotationsDone = 0;			// The number of RotateToFace() moves
+uint32_t swapTotalMs = 0;			// The total time of the swaps that finished
+uint32_t swapMinMs = 0;				// The shortest swap
+uint32_t swapMaxMs = 0;				// The longest swap
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Stress Test code
+//	*************************************************************************************************
+
+/// Find a displayed block that can be swapped in a column
+/// @param column The column to look in.
+/// @return The displayed block, or nullptr if it has no partner to swap with.
+Block *StressBlockInColumn(uint8_t column){
+	Block *block = GetDisplayedBlock((BlockColumn)column);
+	if((block == nullptr) || (GetPartnerBlock(block) == nullptr)){
+		return nullptr;
+	}
+	return block;
+}// End of StressBlockInColumn()
+
+
+
+/// Pick a face to spin a block to. It moves around as the test goes on, so every face gets used.
+/// @return A face other than 0.
+uint8_t StressFace(){
+	return 1 + (stressIteration % (MAX_FACES - 1));
+}// End of StressFace()
+
+
+
+// Pick the block(s) for the next swap and start rotating them away from face 0
+void PickStressBlocks(){
+	stressBlock1 = nullptr;
+	stressBlock2 = nullptr;
+
+	uint8_t column = stressIteration % NUM_COLUMNS;
+	for(uint8_t i = 0; (i < NUM_COLUMNS) && (stressBlock1 == nullptr); i++){// Skip over columns without a partner block
+		stressBlock1 = StressBlockInColumn((column + i) % NUM_COLUMNS);
+	}
+	if(stressBlock1 == nullptr){
+		SERIAL_PRINTF("%s\n", "Stress test: no blocks can be swapped");
+		StopStressTest();
+		return;
+	}
+
+	if(((stressIteration / NUM_COLUMNS) % 2) == 1){// Every other round, swap a second block from the same row along with it
+		for(uint8_t i = 0; i < NUM_COLUMNS; i++){
+			Block *other = StressBlockInColumn(i);
+			if((other != nullptr) && (other != stressBlock1) && (other->storageRow == stressBlock1->storageRow)){
+				stressBlock2 = other;
+				break;
+			}
+		}
+	}
+
+	if(!GantryClearOfColumn(stressBlock1->column) || ((stressBlock2 != nullptr) && !GantryClearOfColumn(stressBlock2->column))){// Pick again once the Gantry has moved up
+		return;
+	}
+
+	RotateToFace((BlockStepper)stressBlock1->column, stressBlock1, StressFace());
+	rotationsDone++;
+	if(stressBlock2 != nullptr){
+		RotateToFace((BlockStepper)stressBlock2->column, stressBlock2, StressFace());
+		rotationsDone++;
+	}
+	stressStep = STRESS_ROTATE_AWAY;
+}// End of PickStressBlocks()
+
+
+
+/// Get the display steppers under the block(s) being tested
+/// @return The steppers, built with BLOCK_STEPPER_MASK().
+uint32_t StressStepperMask(){
+	uint32_t mask = BLOCK_STEPPER_MASK(stressBlock1->column);
+	if(stressBlock2 != nullptr){
+		mask |= BLOCK_STEPPER_MASK(stressBlock2->column);
+	}
+	return mask;
+}// End of StressStepperMask()
+
+
+
+// Record a finished swap and move on to the next iteration, or stop if a limit is reached
+void StressSwapDone(){
+	uint32_t durationMs = swapTimer;
+	swapsDone++;
+	if(stressBlock2 != nullptr){
+		pairedSwapsDone++;
+	}
+	swapTotalMs += durationMs;
+	if((swapsDone == 1) || (durationMs < swapMinMs)){
+		swapMinMs = durationMs;
+	}
+	if(durationMs > swapMaxMs){
+		swapMaxMs = durationMs;
+	}
+
+	stressIteration++;
+	stressStep = STRESS_PICK;
+}// End of StressSwapDone()
+
+
+
+// Record a failed swap, and home the Gantry so the test can carry on
+void StressSwapFailed(){
+	swapFailures++;
+	SERIAL_PRINTF("Stress test: swap %lu failed in state %s, homing\n", stressIteration, GetGantryStateName(GetGantryState()));
+	stressIteration++;
+	HomeGantry();
+	stressStep = STRESS_RECOVER;
+	swapTimer = 0;	// The recovery gets its own StressSwapTimeoutMs
+}// End of StressSwapFailed()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Stress Test code
+//	*************************************************************************************************
+
+/// Start the stress test. It stops after whichever limit is reached first.
+/// @param iterations The number of swaps to do, or 0 for no limit.
+/// @param minutes The number of minutes to run for, or 0 for no limit.
+/// @return True if the test was started, false if it is already running or both limits are 0.
+bool StartStressTest(uint32_t iterations, uint32_t minutes){
+	if((stressStep != STRESS_OFF) || ((iterations == 0) && (minutes == 0))){
+		return false;
+	}
+
+	stressIterations = iterations;
+	stressMinutes = minutes;
+	stressIteration = 0;
+
+	swapsDone = 0;
+	pairedSwapsDone = 0;
+	swapFailures = 0;
+	rotationsDone = 0;
+	swapTotalMs = 0;
+	swapMinMs = 0;
+	swapMaxMs = 0;
+	ResetSwapStats();
+
+	stressTimer = 0;
+	stressStep = STRESS_PICK;
+	SERIAL_PRINTF("Stress test: %lu swaps, %lu minutes (0 is no limit)\n", iterations, minutes);
+	return true;
+}// End of StartStressTest()
+
+
+
+/// Stop the stress test and print its report
+void StopStressTest(){
+	if(stressStep == STRESS_OFF){
+		return;
+	}
+	stressRunMs = stressTimer;
+	stressStep = STRESS_OFF;
+	PrintStressReport();
+}// End of StopStressTest()
+
+
+
+/// Check if the stress test is running
+/// @return True while the stress test is running.
+bool StressTestRunning(){
+	return stressStep != STRESS_OFF;
+}// End of StressTestRunning()
+
+
+
+/// Print the throughput and reliability of the stress test so far, and the swap step stats, over serial
+void PrintStressReport(){
+	uint32_t runMs = StressTestRunning() ? (uint32_t)stressTimer : stressRunMs;
+	uint32_t swapsPerHour = (runMs == 0) ? 0 : (uint32_t)((uint64_t)swapsDone * 3600000 / runMs);
+
+	SERIAL_PRINTF("Stress test: %lu swaps (%lu paired), %lu failed, %lu rotations in %lu s\n", swapsDone, pairedSwapsDone, swapFailures, rotationsDone, runMs / 1000);
+	SERIAL_PRINTF("Throughput: %lu swaps/hour. Swap time min %lu ms, mean %lu ms, max %lu ms\n", swapsPerHour, swapMinMs,
+		(swapsDone == 0) ? 0 : (swapTotalMs / swapsDone), swapMaxMs);
+	PrintSwapStats();
+}// End of PrintStressReport()
+
+
+
+// Run the stress test. This function will be called in the main loop instead of UpdateBlocks() while the test is running.
+void UpdateStressTest(){
+	if(stressStep == STRESS_OFF){
+		return;
+	}
+
+	// Stop once a limit is reached, but let a swap that has started finish first
+	bool swapping = (stressStep == STRESS_WAIT_SWAP) || (stressStep == STRESS_RECOVER);
+	if(!swapping && (((stressIterations != 0) && (stressIteration >= stressIterations))
+		|| ((stressMinutes != 0) && (stressTimer >= stressMinutes * 60000)))){
+		StopStressTest();
+		return;
+	}
+
+	switch(stressStep){
+		case STRESS_OFF:
+			break;
+		case STRESS_PICK:
+			PickStressBlocks();
+			break;
+		case STRESS_ROTATE_AWAY:
+			if(DisplaySteppersIdle(StressStepperMask())){
+				RotateToFace((BlockStepper)stressBlock1->column, stressBlock1, 0);
+				rotationsDone++;
+				if(stressBlock2 != nullptr){
+					RotateToFace((BlockStepper)stressBlock2->column, stressBlock2, 0);
+					rotationsDone++;
+				}
+				stressStep = STRESS_ROTATE_BACK;
+			}
+			break;
+		case STRESS_ROTATE_BACK:
+			if(DisplaySteppersIdle(StressStepperMask())){
+				stressStep = STRESS_SWAP;
+			}
+			break;
+		case STRESS_SWAP:
+			if((GetGantryState() == GANTRY_IDLE) || (GetGantryState() == GANTRY_PARKING)){
+				SwapBlocks(stressBlock1, stressBlock2);
+				swapTimer = 0;
+				stressStep = STRESS_WAIT_SWAP;
+			}else if(GetGantryState() == GANTRY_ERROR){
+				StressSwapFailed();
+			}
+			break;
+		case STRESS_WAIT_SWAP:
+			if(GetGantryState() == GANTRY_ERROR){
+				StressSwapFailed();
+			}else if(GetGantryState() != GANTRY_SWAPPING_BLOCKS){
+				StressSwapDone();
+			}else if(swapTimer >= StressSwapTimeoutMs){// Something is stuck, so stop rather than keep driving the mechanism
+				swapFailures++;
+				SERIAL_PRINTF("Stress test: swap %lu timed out\n", stressIteration);
+				StopStressTest();
+			}
+			break;
+		case STRESS_RECOVER:
+			if(GetGantryState() == GANTRY_IDLE){
+				stressStep = STRESS_PICK;
+			}else if((GetGantryState() == GANTRY_ERROR) && (swapTimer >= StressSwapTimeoutMs)){
+				SERIAL_PRINTF("%s\n", "Stress test: the Gantry didn't recover");
+				StopStressTest();
+			}
+			break;
+	}
+}// End of UpdateStressTest()
@@ -0,0 +1,44 @@
+// Header for the Stress Test, which swaps and rotates blocks over and over to measure how many swaps an hour the mechanism
+// can keep up and how reliable it is. While it runs, BlockManager is paused so the clock doesn't try to show the time.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Stress Test code
+//	*************************************************************************************************
+
+const uint32_t StressSwapTimeoutMs = 120000;	// How long a swap can take before the test gives up on the mechanism
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Stress Test code
+//	*************************************************************************************************
+
+/// Start the stress test. It stops after whichever limit is reached first.
+/// @param iterations The number of swaps to do, or 0 for no limit.
+/// @param minutes The number of minutes to run for, or 0 for no limit.
+/// @return True if the test was started, false if it is already running or both limits are 0.
+bool StartStressTest(uint32_t iterations, uint32_t minutes);
+
+
+/// Stop the stress test and print its report
+void StopStressTest();
+
+
+/// Check if the stress test is running
+/// @return True while the stress test is running.
+bool StressTestRunning();
+
+
+/// Print the throughput and reliability of the stress test so far, and the swap step stats, over serial
+void PrintStressReport();
+
+
+// Run the stress test. This function will be called in the main loop instead of UpdateBlocks() while the test is running.
+void UpdateStressTest();
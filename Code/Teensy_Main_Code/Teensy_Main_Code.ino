@@ -7,8 +7,20 @@
 #include "Config.h" 			// The config file to use the configuration variables
 #include "TimeManager.h" 		// The time manager library deals with getting the time and setting the internal RTC
 #include "BlockManager.h" 		// The block manager library deals with deciding which block to display and/or rotate and when to do so
+#include "SpiBus.h" 			// The SPI bus arbiter shares the SPI bus between the stepper drivers and everything else on it
 #include "Gantry.h" 			// The gantry library manages moving the gantry to the correct position to move blocks
+#include "Electromagnet.h" 		// The electromagnet library drives the electromagnets on the gantry that pick up the blocks
+#include "PowerManager.h" 		// The power manager turns down the motors and coils while the clock is idle
+#include "ThermalModel.h" 		// The thermal model slows the gantry down if its motors are getting too hot
+#include "StatusDisplay.h" 		// The status display shows the state of the clock on the LCD
+#include "Lighting.h" 			// The lighting library drives the RGB accent lighting
 #include "ShiftRegSteppers.h" 	// The shift register steppers library manages the steppers that rotate the blocks, which are all controlled via shift registers
+#include "DisplayCalibration.h" 	// The display calibration measures and saves the steps per revolution and face trims of the display steppers
+#include "DeferredLog.h" 		// The deferred log sends logged messages as binary records for the computer to format
+#include "CommandConsole.h" 		// The command console lets the clock be driven by hand over serial
+#include "StressTest.h" 		// The stress test swaps blocks over and over to measure the mechanism
+#include "InputCapture.h" 		// The input capture records the inputs so a run can be replayed on a computer
+#include "UsageCounters.h" 		// The usage counters keep lifetime counts of the wear on the motors and blocks
 
 
 
@@ -17,11 +29,31 @@ void setup() {
 		Serial.begin(115200);
 	#endif
 
+	InitInputCapture();		// Start capturing inputs if it's set to from power on, before anything reads them
+
+	InitUsageCounters();	// Load the lifetime usage counts, before anything is counted
+
 	InitTime();				// Initialize the time manager
 
 	InitBlocks();			// Initialize the block manager
 
+	InitDisplayCalibration();	// Load the display stepper calibration, before the steppers use it
+
 	InitShiftRegSteppers();	// Initialize the shift register (display block rotation) steppers
+
+	InitSpiBus();			// Initialize the SPI bus, before anything that uses it
+
+	InitGantry();			// Initialize the gantry and its electromagnets
+
+	InitPowerManager();		// Initialize the power manager
+
+	InitThermalModel();		// Initialize the gantry motor thermal model
+
+	InitStatusDisplay();	// Initialize the status LCD
+
+	InitLighting();			// Initialize the RGB accent lighting
+
+	InitConsole();			// Initialize the serial command console
 }
 
 
@@ -30,7 +62,27 @@ void loop() {
 
 
 
+	if(StressTestRunning()){
+		UpdateStressTest();			// Swap and rotate blocks over and over instead of showing the time.
+	}else{
+		UpdateBlocks();				// Work out which blocks need to rotate or be swapped for the current time.
+	}
+
+	UpdateTime();					// Ask the ESP32 for the time until it has synced, then once an hour, between steps.
+
 	// Move things as needed. These functions will only run on internally managed intervals.
 	MoveGantry();					// Move the Gantry.
 	MoveDisplaySteppers();			// Move the display steppers.
+	UpdateDisplayCalibration();		// Pick up finished display stepper measurements, and save the calibration once nothing is moving.
+	UpdateElectromagnets();			// Drop the electromagnets to hold current or finish releasing them.
+	UpdatePowerManager();			// Turn things down while idle, and back up before they are needed.
+	UpdateThermalModel();			// Estimate the motor temperatures, and throttle the Gantry if they are getting too hot.
+	UpdateUsageCounters();			// Save the lifetime usage counts every so often, once nothing is moving.
+	UpdateLighting();				// Draw and send the next lighting frame, between steps.
+	UpdateStatusDisplay();			// Send any changed text to the status LCD, between steps.
+	UpdateSpiBus();					// Send queued SPI transfers while the stepper drivers aren't using the bus.
+
+	UpdateConsole();				// Read and run any commands typed over serial, between steps.
+	UpdateInputCapture();			// Send the next few records of an input capture, if one is being sent.
+	FlushLog();						// Send any logged messages, if the serial port has room for them.
 }
\ No newline at end of file
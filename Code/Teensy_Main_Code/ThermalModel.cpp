@@ -0,0 +1,184 @@
+// Code for the Thermal Model. Every update, each motor's temperature rise is stepped forward from the power going into it
+// (I^2 R in both coils, plus a loss for every step pulse) and the heat leaving it to the air. The temperature the hottest
+// motor would reach after ThermalHorizonMs more of full power running is then checked against the limits, and the Gantry's
+// step period and current are scaled back only as far as needed. A cool Gantry always runs at full speed and current.
+
+#include <Arduino.h>
+
+#include "Config.h"
+#include "DeferredLog.h"
+#include "ThermalModel.h"
+#include "Gantry.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Thermal Model code
+//	*************************************************************************************************
+
+const uint16_t ThermalUpdatePeriodMs = 100;			// How often the temperatures are updated
+const uint16_t ThrottleFull = 256;					// The throttle level for fully throttled
+const uint16_t ThrottleLogStep = 32;				// How much the throttle has to change before it is logged
+const uint16_t CurrentStepMa = 50;					// The current is only changed in steps of this, so the drivers aren't rewritten every update
+
+elapsedMillis thermalUpdateTimer;				// Timer for updating the temperatures
+
+int32_t tempRiseMicroC[NUM_MOTORS];				// The estimated temperature rise of each motor above ambient, in millionths of a degree C
+uint32_t lastMotorSteps[NUM_MOTORS];			// The step count of each motor at the last update
+int32_t predictedRiseMicroC = 0;				// The predicted rise of the hottest motor at the end of the horizon
+uint16_t throttle = 0;							// How throttled the Gantry is, from 0 (not at all) to ThrottleFull
+uint16_t loggedThrottle = 0;					// The throttle level that was last logged
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Thermal Model code
+//	*************************************************************************************************
+
+/// Get the coil power of one motor at a current
+/// @param currentMa The current through each phase.
+/// @return The power in mW.
+uint32_t MotorCoilPowerMw(uint16_t currentMa){
+	// Two phases, P = I^2 * R
+	return (uint32_t)2 * currentMa * currentMa / 1000 * GantryCoilMilliohms / 1000;
+}// End of MotorCoilPowerMw()
+
+
+
+/// Step a motor's temperature forward
+/// @param riseMicroC The temperature rise at the start.
+/// @param powerMw The power going into the motor.
+/// @param timeMs The time to step forward.
+/// @return The temperature rise at the end.
+int32_t StepTemperature(int32_t riseMicroC, uint32_t powerMw, uint32_t timeMs){
+	int64_t lossMw = (int64_t)riseMicroC / ((int32_t)MotorThermalResistanceCPerW * 1000);	// The heat leaving to the air
+	int64_t netUj = ((int64_t)powerMw - lossMw) * timeMs;									// mW * ms = uJ
+	int64_t rise = riseMicroC + netUj / MotorHeatCapacityJPerC;							// uJ / (J/C) = uC
+	if(rise < 0){
+		rise = 0;
+	}
+	return (int32_t)rise;
+}// End of StepTemperature()
+
+
+
+/// Turn the Gantry's current down in steps as the throttle goes up
+/// @return The current limit for the throttle level, in mA.
+uint16_t ThrottledCurrent(){
+	uint32_t reduction = (uint32_t)(StepperCurrentLimit - ThermalMinCurrent) * throttle / ThrottleFull;
+	reduction = ((reduction + CurrentStepMa - 1) / CurrentStepMa) * CurrentStepMa;	// Round up, so any throttling turns it down some
+	if(reduction > (uint32_t)(StepperCurrentLimit - ThermalMinCurrent)){
+		reduction = StepperCurrentLimit - ThermalMinCurrent;
+	}
+	return StepperCurrentLimit - reduction;
+}// End of ThrottledCurrent()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Thermal Model code
+//	*************************************************************************************************
+
+/// Initialize the Thermal Model. The motors are assumed to start at ambient.
+void InitThermalModel(){
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		tempRiseMicroC[i] = 0;
+		lastMotorSteps[i] = GetGantryMotorSteps((GantryMotor)i);
+	}
+	predictedRiseMicroC = 0;
+	throttle = 0;
+	loggedThrottle = 0;
+	thermalUpdateTimer = 0;
+}// End of InitThermalModel()
+
+
+
+/// Stretch a step period if the motors need to be throttled
+/// @param periodUs The step period the Gantry would use with cool motors.
+/// @return The step period to use.
+uint16_t ThermalStepPeriodUs(uint16_t periodUs){
+	return periodUs + (uint32_t)periodUs * ThermalMaxSlowdownPercent / 100 * throttle / ThrottleFull;
+}// End of ThermalStepPeriodUs()
+
+
+
+/// Tell the Thermal Model that a driver reported an over temperature fault, so the model is pulled up to the hard limit
+/// @param motor The motor whose driver reported the fault.
+void ThermalFaultDetected(GantryMotor motor){
+	int32_t hardLimitMicroC = (int32_t)MotorHardLimitC * 1000000;
+	if(tempRiseMicroC[motor] < hardLimitMicroC){// Only log when the model was behind, not every time the status is read
+		LOG_MSG(LOG_GANTRY_OVERTEMP, motor, tempRiseMicroC[motor] / 1000);
+		tempRiseMicroC[motor] = hardLimitMicroC;
+	}
+}// End of ThermalFaultDetected()
+
+
+
+/// Get the estimated temperature rise of a motor above ambient
+/// @param motor The motor to check.
+/// @return The rise in thousandths of a degree C.
+int32_t GetMotorTempRiseMilliC(GantryMotor motor){
+	return tempRiseMicroC[motor] / 1000;
+}// End of GetMotorTempRiseMilliC()
+
+
+
+/// Print the estimated temperature of each motor and the throttling over serial
+void PrintThermalStatus(){
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		SERIAL_PRINTF("Motor %u: %ld mC above ambient\n", i, GetMotorTempRiseMilliC((GantryMotor)i));
+	}
+	SERIAL_PRINTF("Predicted hottest: %ld mC, throttle %u/%u, %u us/step, %u mA\n", predictedRiseMicroC / 1000, throttle, ThrottleFull,
+		ThermalStepPeriodUs(StepPeriodUs), ThrottledCurrent());
+}// End of PrintThermalStatus()
+
+
+
+// Update the temperature estimates and the throttling. This function will be called in the main loop,
+// and only does anything at an interval managed internally.
+void UpdateThermalModel(){
+	uint32_t elapsedMs = thermalUpdateTimer;
+	if(elapsedMs < ThermalUpdatePeriodMs){
+		return;
+	}
+	thermalUpdateTimer = 0;
+
+	uint32_t coilPowerMw = MotorCoilPowerMw(GetGantryCurrent());				// Zero while the drivers are off, so idle time cools the motors
+	uint32_t fullPowerMw = MotorCoilPowerMw(StepperCurrentLimit) + (uint32_t)MotorStepLossUj * 1000 / StepPeriodUs;	// Running flat out at full current
+
+	int32_t hottestMicroC = 0;
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		// Step losses come from the steps this motor actually took since the last update
+		uint32_t steps = GetGantryMotorSteps((GantryMotor)i);
+		uint32_t stepPowerMw = (uint64_t)(steps - lastMotorSteps[i]) * MotorStepLossUj / elapsedMs;	// uJ / ms = mW
+		lastMotorSteps[i] = steps;
+
+		tempRiseMicroC[i] = StepTemperature(tempRiseMicroC[i], coilPowerMw + stepPowerMw, elapsedMs);
+		if(tempRiseMicroC[i] > hottestMicroC){
+			hottestMicroC = tempRiseMicroC[i];
+		}
+	}
+
+	// Predict where the hottest motor would be if the Gantry kept running at full power, and throttle only if that is too hot
+	predictedRiseMicroC = StepTemperature(hottestMicroC, fullPowerMw, ThermalHorizonMs);
+	int32_t softLimitMicroC = (int32_t)MotorSoftLimitC * 1000000;
+	int32_t hardLimitMicroC = (int32_t)MotorHardLimitC * 1000000;
+	if(predictedRiseMicroC <= softLimitMicroC){
+		throttle = 0;
+	}else if(predictedRiseMicroC >= hardLimitMicroC){
+		throttle = ThrottleFull;
+	}else{
+		throttle = (int64_t)(predictedRiseMicroC - softLimitMicroC) * ThrottleFull / (hardLimitMicroC - softLimitMicroC);
+	}
+
+	SetGantryCurrentLimit(ThrottledCurrent());
+
+	if(abs((int16_t)throttle - (int16_t)loggedThrottle) >= ThrottleLogStep || ((throttle == 0) != (loggedThrottle == 0))){
+		LOG_MSG(LOG_GANTRY_THROTTLE, throttle, hottestMicroC / 1000, predictedRiseMicroC / 1000);
+		loggedThrottle = throttle;
+	}
+}// End of UpdateThermalModel()
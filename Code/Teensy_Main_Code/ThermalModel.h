@@ -0,0 +1,63 @@
+// Header for the Thermal Model, which estimates how hot each Gantry motor is from its current, its step count and how long
+// it has been idle, and slows the Gantry down and turns its current down only when it is predicted to overheat.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Thermal Model code
+//	*************************************************************************************************
+
+// Each motor and its driver is modelled as one lump that heats up from its coil and step losses and cools to the air.
+// These are rough figures for a NEMA 17 motor that is rated for an 80 C rise at 1.7 A.
+const uint16_t MotorThermalResistanceCPerW = 9;		// The rise above ambient for each watt, once settled
+const uint16_t MotorHeatCapacityJPerC = 130;		// The energy it takes to heat the motor by 1 C (a ~20 minute time constant)
+const uint16_t MotorStepLossUj = 2000;				// The extra loss for each step pulse, from the iron and the driver switching
+
+const uint16_t MotorSoftLimitC = 55;			// The rise above ambient where throttling starts
+const uint16_t MotorHardLimitC = 75;			// The rise above ambient where the Gantry is fully throttled
+const uint32_t ThermalHorizonMs = 60000;		// How far ahead to predict the temperature, assuming the Gantry keeps moving at full power
+
+const uint16_t ThermalMaxSlowdownPercent = 100;	// How much the step period is stretched when fully throttled
+const uint16_t ThermalMinCurrent = 1100;		// The current the Gantry is turned down to when fully throttled, in mA
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Thermal Model code
+//	*************************************************************************************************
+
+/// Initialize the Thermal Model. The motors are assumed to start at ambient.
+void InitThermalModel();
+
+
+/// Stretch a step period if the motors need to be throttled
+/// @param periodUs The step period the Gantry would use with cool motors.
+/// @return The step period to use.
+uint16_t ThermalStepPeriodUs(uint16_t periodUs);
+
+
+/// Tell the Thermal Model that a driver reported an over temperature fault, so the model is pulled up to the hard limit
+/// @param motor The motor whose driver reported the fault.
+void ThermalFaultDetected(GantryMotor motor);
+
+
+/// Get the estimated temperature rise of a motor above ambient
+/// @param motor The motor to check.
+/// @return The rise in thousandths of a degree C.
+int32_t GetMotorTempRiseMilliC(GantryMotor motor);
+
+
+/// Print the estimated temperature of each motor and the throttling over serial
+void PrintThermalStatus();
+
+
+// Update the temperature estimates and the throttling. This function will be called in the main loop,
+// and only does anything at an interval managed internally.
+void UpdateThermalModel();
@@ -6,6 +6,34 @@
 
 #include "Config.h"
 #include "TimeManager.h"
+#include "DeferredLog.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+#include "InputCapture.h"
+#include "UsageCounters.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Time Manager code
+//	*************************************************************************************************
+
+// The ESP32's answer to a time request. This must match TimeResponse in ESP32_Time_Module.ino
+typedef struct __attribute__((packed)) {
+	uint32_t unixTime;		// The time in seconds since 1970, UTC
+	uint8_t flags;			// ESP32_TIME_* bits
+	uint16_t syncAgeS;		// The seconds since NTP last set the ESP32's clock, up to 0xFFFF
+	int32_t offsetUs;		// How far NTP last moved the ESP32's clock, in microseconds
+	uint32_t uncertaintyUs;	// How far off the ESP32's clock could be as of then, in microseconds
+	uint8_t servers;		// The NTP servers that agreed in the high nibble, and the servers answering in the low nibble
+	uint8_t checksum;		// The inverted sum of the bytes before it
+} Esp32TimeResponse;
+
+#define ESP32_TIME_SYNCED	(1 << 0)	// NTP has set the ESP32's clock, so the time can be used
+#define ESP32_TIME_WIFI		(1 << 1)	// The ESP32 is connected to WiFi
+#define ESP32_TIME_PORTAL	(1 << 2)	// The ESP32's WiFi config portal is open
+
+
+
 
 
 //	*************************************************************************************************
@@ -15,6 +43,20 @@
 // The address of the ESP32
 const uint8_t ESP32_ADDRESS = 4;
 
+const uint32_t TimeRetryPeriodMs = 1000;		// How often to ask the ESP32 for the time until it has synced
+const uint32_t TimeResyncPeriodMs = 3600000;	// How often to read the time again once it has
+const uint16_t TimeStartupWaitMs = 500;			// How long InitTime() waits for the ESP32 to answer at power on
+const uint16_t TimeReadBudgetUs = 1500;			// How long a read takes on the I2C bus. It waits until no step is due for this long
+const uint32_t TimeSyncMissedMs = TimeResyncPeriodMs + TimeResyncPeriodMs / 10;	// How long without a fresh NTP sync before a failed sync is counted. Past the hourly read, even if it waits on the steppers
+const uint16_t TimeSyncAgeSlackMs = 2000;		// How much younger the ESP32's sync has to be than the last one seen to be a fresh sync. The age is in whole seconds
+
+elapsedMillis timeSinceSync;	// The time since NTP set the ESP32's clock, as of the last read
+elapsedMillis timePollTimer;	// The time since the ESP32 was last asked for the time
+elapsedMillis syncMissedTimer;	// The time since a fresh NTP sync was last read, or a failed sync was last counted
+bool timeSynced = false;		// If the time has been read from the ESP32 since startup
+Esp32TimeStatus esp32Status = ESP32_NO_ANSWER;	// What the ESP32 said the last time it was asked
+Esp32TimeResponse lastResponse;					// The last good answer from the ESP32, for the sync quality
+
 
 
 
@@ -22,20 +64,54 @@ const uint8_t ESP32_ADDRESS = 4;
 //	Local Functions for the Time Manager code
 //	*************************************************************************************************
 
-/// @brief Get the unix time from the ESP32
-void GetTimeFromESP32(){
+/// @brief Get the unix time from the ESP32. The time is only set if the ESP32's clock has been synced.
+/// @return True if the ESP32 answered, even if it isn't synced yet.
+bool GetTimeFromESP32(){
+	timePollTimer = 0;
+
 	// Request the time from the ESP32
-	Wire.requestFrom(ESP32_ADDRESS, 4);
-	time_t time = 0;
-	for (int i = 0; i < 4; i++){
-		time |= Wire.read() << (i * 8);
+	Esp32TimeResponse response;
+	uint8_t *bytes = (uint8_t *)&response;
+	if(Wire.requestFrom(ESP32_ADDRESS, (uint8_t)sizeof(response)) != sizeof(response)){// The ESP32 didn't answer, so keep the time we have
+		CaptureTimeAnswer(bytes, 0);
+		esp32Status = ESP32_NO_ANSWER;
+		return false;
+	}
+	uint8_t sum = 0;
+	for(uint8_t i = 0; i < sizeof(response); i++){
+		bytes[i] = Wire.read();
+		if(i < offsetof(Esp32TimeResponse, checksum)){
+			sum += bytes[i];
+		}
+	}
+	CaptureTimeAnswer(bytes, sizeof(response));
+	if(response.checksum != (uint8_t)~sum){// Not a real answer, like a bus held high
+		esp32Status = ESP32_NO_ANSWER;
+		return false;
+	}
+	lastResponse = response;
+
+	if(!(response.flags & ESP32_TIME_SYNCED)){// Its clock is still counting from power on
+		esp32Status = (response.flags & ESP32_TIME_PORTAL) ? ESP32_WIFI_SETUP : ((response.flags & ESP32_TIME_WIFI) ? ESP32_NOT_SYNCED : ESP32_NO_WIFI);
+		return true;
+	}
+	esp32Status = ESP32_SYNCED;
+
+	// Only count the sync if NTP has set the ESP32's clock since the last read, not every read of the same sync
+	if((response.syncAgeS != 0xFFFF) && (!timeSynced || ((uint32_t)response.syncAgeS * 1000 + TimeSyncAgeSlackMs < timeSinceSync))){
+		CountTimeSync(true);
+		syncMissedTimer = 0;
 	}
 
 	// Set the time
-	setTime(time);
+	setTime(response.unixTime);
+	timeSinceSync = (uint32_t)response.syncAgeS * 1000;
+	timeSynced = true;
 
 	// Print the time
-	SERIAL_PRINTF("Time aquired from from ESP32: %lu\t%u/%u/%u %u:%u:%u\n", time, month(), day(), year(), hour(), minute(), second());
+	LOG_MSG(LOG_TIME_ACQUIRED, response.unixTime, month(), day(), year(), hour(), minute(), second());
+	LOG_MSG(LOG_TIME_QUALITY, response.offsetUs, response.uncertaintyUs, response.servers >> 4, response.servers & 0x0F);
+	return true;
 }
 
 
@@ -43,19 +119,90 @@ void GetTimeFromESP32(){
 //	Shared Functions for the Time Manager code
 //	*************************************************************************************************
 
-/// @brief Initialize the Time Manager
+/// @brief Initialize the Time Manager. The ESP32 answers as soon as it is powered, so this only waits briefly for it to boot.
 void InitTime()
 {
 	// Initialize the Wire library
 	Wire.begin();
+
+	elapsedMillis waitTimer;
+	while(!GetTimeFromESP32() && (waitTimer < TimeStartupWaitMs)){
+		delay(20);
+	}
+}
+
+
+
+/// @brief Read the time from the ESP32 now
+void SyncTime()
+{
 	GetTimeFromESP32();
 }
 
 
 
-/// @brief Update the time
+/// @brief Update the time. This function will be called in the main loop, and asks the ESP32 for the time every second until
+/// it has synced, then once an hour. The read waits until no step is due for as long as it takes.
 void UpdateTime()
 {
-	// Get the time from the ESP32
+	if(syncMissedTimer >= TimeSyncMissedMs){// No fresh NTP sync for a whole resync period, because the ESP32 didn't answer, has no WiFi, or NTP isn't getting through
+		CountTimeSync(false);
+		syncMissedTimer = 0;
+	}
+
+	uint32_t periodMs = (esp32Status == ESP32_SYNCED) ? TimeResyncPeriodMs : TimeRetryPeriodMs;
+	if(timePollTimer < periodMs){
+		return;
+	}
+	if((GetGantryStepSlackUs() < TimeReadBudgetUs) || (GetDisplayStepperSlackUs() < TimeReadBudgetUs)){
+		return;
+	}
+
 	GetTimeFromESP32();
+}
+
+
+
+/// @brief Get how long it has been since the ESP32's clock was synced over NTP
+/// @return The time in seconds, or UINT32_MAX if the time hasn't been read since startup.
+uint32_t GetTimeSyncAge()
+{
+	if(!timeSynced){
+		return UINT32_MAX;
+	}
+	return timeSinceSync / 1000;
+}
+
+
+
+/// @brief Get what the ESP32 said the last time it was asked for the time
+/// @return The status of the ESP32.
+Esp32TimeStatus GetEsp32TimeStatus()
+{
+	return esp32Status;
+}
+
+
+
+/// @brief Get how far off the ESP32 thinks its clock could be
+/// @return The uncertainty in microseconds, or UINT32_MAX if the time hasn't been read since startup.
+uint32_t GetTimeUncertaintyUs()
+{
+	if(!timeSynced){
+		return UINT32_MAX;
+	}
+	return lastResponse.uncertaintyUs;
+}
+
+
+
+/// @brief Print the time and how well it is synced over serial
+void PrintTimeStatus()
+{
+	const char *const statusNames[] = {"no answer", "WiFi setup portal open", "no WiFi", "waiting on NTP", "synced"};
+	SERIAL_PRINTF("Time: %lu, ESP32 %s\n", (uint32_t)now(), statusNames[esp32Status]);
+	if(timeSynced){
+		SERIAL_PRINTF("Synced %lu s ago, last NTP correction %ld us, uncertainty %lu us, %u of %u servers agreed\n", GetTimeSyncAge(),
+			lastResponse.offsetUs, lastResponse.uncertaintyUs, lastResponse.servers >> 4, lastResponse.servers & 0x0F);
+	}
 }
\ No newline at end of file
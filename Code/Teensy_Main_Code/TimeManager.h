@@ -2,11 +2,21 @@
 
 #pragma once // Include this file only once
 
+#include <Arduino.h>
+
 
 //	*************************************************************************************************
 //	Enumerations for the Time Manager
 //	*************************************************************************************************
 
+// What the ESP32 said the last time it was asked for the time
+typedef enum {
+	ESP32_NO_ANSWER,	// The ESP32 didn't answer, or the answer was garbled
+	ESP32_WIFI_SETUP,	// The ESP32's WiFi config portal is open, waiting for the network to be set up
+	ESP32_NO_WIFI,		// The ESP32 isn't connected to WiFi
+	ESP32_NOT_SYNCED,	// The ESP32 is on WiFi, but NTP hasn't set its clock yet
+	ESP32_SYNCED		// The ESP32's clock is synced, and the time was set from it
+} Esp32TimeStatus;
 
 
 
@@ -32,9 +42,33 @@
 //	Function prototypes for the Time code
 //	*************************************************************************************************
 
-/// @brief Initialize the Time Manager
+/// @brief Initialize the Time Manager. The ESP32 answers as soon as it is powered, so this only waits briefly for it to boot.
 void InitTime();
 
 
-/// @brief Update the time
-void UpdateTime();
\ No newline at end of file
+/// @brief Read the time from the ESP32 now
+void SyncTime();
+
+
+/// @brief Update the time. This function will be called in the main loop, and asks the ESP32 for the time every second until
+/// it has synced, then once an hour. The read waits until no step is due for as long as it takes.
+void UpdateTime();
+
+
+/// @brief Get how long it has been since the ESP32's clock was synced over NTP
+/// @return The time in seconds, or UINT32_MAX if the time hasn't been read since startup.
+uint32_t GetTimeSyncAge();
+
+
+/// @brief Get what the ESP32 said the last time it was asked for the time
+/// @return The status of the ESP32.
+Esp32TimeStatus GetEsp32TimeStatus();
+
+
+/// @brief Get how far off the ESP32 thinks its clock could be
+/// @return The uncertainty in microseconds, or UINT32_MAX if the time hasn't been read since startup.
+uint32_t GetTimeUncertaintyUs();
+
+
+/// @brief Print the time and how well it is synced over serial
+void PrintTimeStatus();
\ No newline at end of file
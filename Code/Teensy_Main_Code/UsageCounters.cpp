@@ -0,0 +1,282 @@
+// Code for the Usage Counters. The counts are kept in RAM and saved as one record, with a version, a sequence number and a
+// checksum, into the next of UsageSaveSlots slots in EEPROM each time. At power on the whole slot with the highest sequence
+// number is loaded, so a power cut while saving only loses that one save, and each slot is written 1/UsageSaveSlots as often.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Config.h"
+#include "DeferredLog.h"
+#include "UsageCounters.h"
+#include "Gantry.h"
+#include "ShiftRegSteppers.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Usage Counters code
+//	*************************************************************************************************
+
+// The lifetime counts
+typedef struct __attribute__((packed)) {
+	uint32_t gantrySteps[NUM_MOTORS];					// The step pulses sent to each Gantry motor, counting microsteps
+	uint32_t gantryReversals[NUM_MOTORS];				// The times each Gantry motor has been turned round
+	uint32_t displaySteps[NUM_BLOCK_STEPPERS];			// The steps taken by each display stepper
+	uint32_t displayReversals[NUM_BLOCK_STEPPERS];		// The moves each display stepper started the other way from the one before
+	uint32_t blockMoves[NUM_BLOCKS];					// The times each block has been picked up and moved
+	uint32_t emagPulls[NUM_EMAGS];						// The times each electromagnet has been turned on to pull in a block
+	uint32_t swaps;										// The finished block swaps
+	uint64_t swapTotalMs;								// The time taken by all of them
+	uint32_t swapMaxMs;									// The longest one
+	uint32_t limitStops;								// The swap legs stopped by a limit switch before reaching their target
+	uint32_t homings;									// The times the Gantry has been homed
+	uint32_t timeSyncs;									// The fresh NTP syncs read from the ESP32
+	uint32_t timeSyncFailures;							// The resync periods that ended without one
+	uint32_t powerOns;									// The times the clock has been turned on
+} UsageCounts;
+
+
+// The counts as they are saved in one EEPROM slot
+typedef struct __attribute__((packed)) {
+	uint16_t version;			// UsageVersion
+	uint32_t sequence;			// Counts up with each save, so the latest slot has the highest
+	UsageCounts counts;			// The counts
+	uint8_t checksum;			// The inverted sum of the bytes before it
+} UsageRecord;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Usage Counters code
+//	*************************************************************************************************
+
+const uint16_t EepromSize = 4284;	// The emulated EEPROM on a Teensy 4.1
+static_assert(UsageEepromAddress + UsageSaveSlots * sizeof(UsageRecord) <= EepromSize, "The usage counter slots don't fit in EEPROM");
+
+UsageCounts usage;					// The lifetime counts, up to the last time the steps were picked up
+uint32_t usageSequence = 0;			// The sequence number of the last save
+uint8_t usageNextSlot = 0;			// The slot the next save goes in
+elapsedMillis usageSaveTimer;		// The time since the last save
+bool usageSaveRequested = false;	// If a save was asked for before UsageSavePeriodMs is up
+
+// The since power on step counts that are already in the lifetime counts
+uint32_t countedGantrySteps[NUM_MOTORS];
+uint32_t countedGantryReversals[NUM_MOTORS];
+uint32_t countedDisplaySteps[NUM_BLOCK_STEPPERS];
+uint32_t countedDisplayReversals[NUM_BLOCK_STEPPERS];
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Usage Counters code
+//	*************************************************************************************************
+
+/// Get the checksum of a saved record
+/// @param record The record.
+/// @return The inverted sum of the bytes before the checksum.
+uint8_t UsageChecksum(const UsageRecord *record){
+	uint8_t sum = 0;
+	for(size_t i = 0; i < offsetof(UsageRecord, checksum); i++){
+		sum += ((const uint8_t*)record)[i];
+	}
+	return ~sum;
+}// End of UsageChecksum()
+
+
+
+/// Get where a save slot is in EEPROM
+/// @param slot The slot.
+/// @return The address of its first byte.
+uint16_t UsageSlotAddress(uint8_t slot){
+	return UsageEepromAddress + slot * sizeof(UsageRecord);
+}// End of UsageSlotAddress()
+
+
+
+/// Add the steps and reversals taken since they were last picked up to the lifetime counts
+void CollectStepCounts(){
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		uint32_t steps = GetGantryMotorSteps((GantryMotor)i);
+		uint32_t reversals = GetGantryMotorReversals((GantryMotor)i);
+		usage.gantrySteps[i] += steps - countedGantrySteps[i];
+		usage.gantryReversals[i] += reversals - countedGantryReversals[i];
+		countedGantrySteps[i] = steps;
+		countedGantryReversals[i] = reversals;
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		uint32_t steps = GetDisplayStepperSteps((BlockStepper)i);
+		uint32_t reversals = GetDisplayStepperReversals((BlockStepper)i);
+		usage.displaySteps[i] += steps - countedDisplaySteps[i];
+		usage.displayReversals[i] += reversals - countedDisplayReversals[i];
+		countedDisplaySteps[i] = steps;
+		countedDisplayReversals[i] = reversals;
+	}
+}// End of CollectStepCounts()
+
+
+
+/// Save the counts into the next slot
+void WriteUsageRecord(){
+	CollectStepCounts();
+
+	UsageRecord record;
+	record.version = UsageVersion;
+	record.sequence = ++usageSequence;
+	record.counts = usage;
+	record.checksum = UsageChecksum(&record);
+	EEPROM.put(UsageSlotAddress(usageNextSlot), record);
+
+	LOG_MSG(LOG_USAGE_SAVED, usageNextSlot, usageSequence);
+	usageNextSlot = (usageNextSlot + 1) % UsageSaveSlots;
+}// End of WriteUsageRecord()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Usage Counters code
+//	*************************************************************************************************
+
+/// Initialize the Usage Counters, loading the latest save from EEPROM and counting the power on. Call this before
+/// anything is moved or counted.
+void InitUsageCounters(){
+	memset(&usage, 0, sizeof(usage));
+	usageSequence = 0;
+	usageNextSlot = 0;
+
+	// Blank, old, or half written slots are skipped, and if none are good the counts start from 0
+	for(uint8_t i = 0; i < UsageSaveSlots; i++){
+		UsageRecord record;
+		EEPROM.get(UsageSlotAddress(i), record);
+		if((record.version != UsageVersion) || (record.checksum != UsageChecksum(&record))){
+			continue;
+		}
+		if(record.sequence > usageSequence){
+			usage = record.counts;
+			usageSequence = record.sequence;
+			usageNextSlot = (i + 1) % UsageSaveSlots;
+		}
+	}
+
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		countedGantrySteps[i] = GetGantryMotorSteps((GantryMotor)i);
+		countedGantryReversals[i] = GetGantryMotorReversals((GantryMotor)i);
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		countedDisplaySteps[i] = GetDisplayStepperSteps((BlockStepper)i);
+		countedDisplayReversals[i] = GetDisplayStepperReversals((BlockStepper)i);
+	}
+
+	usage.powerOns++;
+	usageSaveTimer = 0;
+	usageSaveRequested = false;
+}// End of InitUsageCounters()
+
+
+
+/// Count a block being picked up and moved by the Gantry
+/// @param block The block.
+void CountBlockMove(BlockType block){
+	usage.blockMoves[block]++;
+}// End of CountBlockMove()
+
+
+
+/// Count an electromagnet being turned on to pull in a block
+/// @param emag The electromagnet.
+void CountEmagPull(GantryEmag emag){
+	usage.emagPulls[emag]++;
+}// End of CountEmagPull()
+
+
+
+/// Count a finished block swap
+/// @param durationMs How long it took, from starting to placing the last block.
+void CountSwap(uint32_t durationMs){
+	usage.swaps++;
+	usage.swapTotalMs += durationMs;
+	if(durationMs > usage.swapMaxMs){
+		usage.swapMaxMs = durationMs;
+	}
+}// End of CountSwap()
+
+
+
+/// Count a swap leg that was stopped by a limit switch before reaching its target
+void CountLimitStop(){
+	usage.limitStops++;
+}// End of CountLimitStop()
+
+
+
+/// Count the Gantry being homed
+void CountGantryHoming(){
+	usage.homings++;
+}// End of CountGantryHoming()
+
+
+
+/// Count a time sync with the ESP32
+/// @param synced True for a fresh NTP sync read from the ESP32, false for a resync period that ended without one.
+void CountTimeSync(bool synced){
+	if(synced){
+		usage.timeSyncs++;
+	}else{
+		usage.timeSyncFailures++;
+	}
+}// End of CountTimeSync()
+
+
+
+/// Save the counters the next time nothing is moving, without waiting for UsageSavePeriodMs
+void SaveUsageCounters(){
+	usageSaveRequested = true;
+}// End of SaveUsageCounters()
+
+
+
+/// Print the lifetime counts over serial
+void PrintUsageCounters(){
+	CollectStepCounts();
+
+	SERIAL_PRINTF("Usage over %lu power ons, saved %lu times, last save %lu minutes ago\n", usage.powerOns, usageSequence, (uint32_t)usageSaveTimer / 60000);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		SERIAL_PRINTF("Gantry motor %u: %lu step pulses, %lu reversals\n", i, usage.gantrySteps[i], usage.gantryReversals[i]);
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		SERIAL_PRINTF("Display stepper %u: %lu steps, %lu reversals\n", i, usage.displaySteps[i], usage.displayReversals[i]);
+	}
+	for(uint8_t i = 0; i < NUM_BLOCKS; i++){
+		SERIAL_PRINTF("Block %u: moved %lu times\n", i, usage.blockMoves[i]);
+	}
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		SERIAL_PRINTF("Electromagnet %u: %lu pulls\n", i, usage.emagPulls[i]);
+	}
+
+	uint32_t averageMs = (usage.swaps == 0) ? 0 : (uint32_t)(usage.swapTotalMs / usage.swaps);
+	SERIAL_PRINTF("Swaps: %lu, average %lu ms, max %lu ms, %lu legs stopped by a limit switch\n", usage.swaps, averageMs, usage.swapMaxMs, usage.limitStops);
+	SERIAL_PRINTF("Gantry homings: %lu\n", usage.homings);
+	SERIAL_PRINTF("Time syncs: %lu, %lu failed\n", usage.timeSyncs, usage.timeSyncFailures);
+}// End of PrintUsageCounters()
+
+
+
+// Save the counters to EEPROM every UsageSavePeriodMs, once nothing is moving. This function will be called in the main loop.
+void UpdateUsageCounters(){
+	if(!usageSaveRequested && (usageSaveTimer < UsageSavePeriodMs)){
+		return;
+	}
+
+	// Writing EEPROM can stall for milliseconds while flash is erased, so wait until no stepper would miss a step
+	if(!DisplaySteppersIdle() || (GetGantryStepSlackUs() != UINT32_MAX)){
+		return;
+	}
+
+	WriteUsageRecord();
+	usageSaveTimer = 0;
+	usageSaveRequested = false;
+}// End of UpdateUsageCounters()
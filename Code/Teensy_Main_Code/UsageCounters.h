@@ -0,0 +1,77 @@
+// Header for the Usage Counters, which keep lifetime counts of the wear on the clock: the steps and reversals of each motor,
+// the moves of each block, the electromagnet pulls, the swaps and how long they take, the swap legs stopped by a limit
+// switch, the homings, and the time syncs that failed. They are kept in RAM and saved to EEPROM in one batch every so often,
+// so belts and motors can be replaced by how much they have done rather than on a guess.
+//
+// The steps are the counts the Gantry and display stepper code already keep since power on, picked up when the counters
+// are saved, so counting them costs nothing more on the step path. Everything else is one increment when it happens.
+
+#pragma once // Include this file only once
+
+#include <Arduino.h>
+
+#include "Blocks.h"
+#include "DisplayCalibration.h"
+#include "Pins.h"
+
+
+//	*************************************************************************************************
+//	Shared Variables and Constants for the Usage Counters code
+//	*************************************************************************************************
+
+const uint16_t UsageEepromAddress = DisplayCalibrationEepromAddress + DisplayCalibrationEepromSize;	// Where the first save slot is in EEPROM
+const uint8_t UsageSaveSlots = 8;					// The save slots the counters are written round, to spread the wear
+const uint16_t UsageVersion = 0x5501;				// Marks saved counters, and changes if their layout does
+const uint32_t UsageSavePeriodMs = 3600000;			// How often the counters are saved. At most this much counting is lost on a power cut
+
+
+
+
+
+//	*************************************************************************************************
+//	Function prototypes for the Usage Counters code
+//	*************************************************************************************************
+
+/// Initialize the Usage Counters, loading the latest save from EEPROM and counting the power on. Call this before
+/// anything is moved or counted.
+void InitUsageCounters();
+
+
+/// Count a block being picked up and moved by the Gantry
+/// @param block The block.
+void CountBlockMove(BlockType block);
+
+
+/// Count an electromagnet being turned on to pull in a block
+/// @param emag The electromagnet.
+void CountEmagPull(GantryEmag emag);
+
+
+/// Count a finished block swap
+/// @param durationMs How long it took, from starting to placing the last block.
+void CountSwap(uint32_t durationMs);
+
+
+/// Count a swap leg that was stopped by a limit switch before reaching its target
+void CountLimitStop();
+
+
+/// Count the Gantry being homed
+void CountGantryHoming();
+
+
+/// Count a time sync with the ESP32
+/// @param synced True for a fresh NTP sync read from the ESP32, false for a resync period that ended without one.
+void CountTimeSync(bool synced);
+
+
+/// Save the counters the next time nothing is moving, without waiting for UsageSavePeriodMs
+void SaveUsageCounters();
+
+
+/// Print the lifetime counts over serial
+void PrintUsageCounters();
+
+
+// Save the counters to EEPROM every UsageSavePeriodMs, once nothing is moving. This function will be called in the main loop.
+void UpdateUsageCounters();
@@ -0,0 +1,417 @@
+// Offline optimizer for which digits go on which faces of the paired second digit blocks. Each second digit column has two
+// blocks that swap in and out of the display row, and a swap takes far longer than turning a block, so the split of the ten
+// digits between the two blocks (and the order of the faces on each) sets how much the Gantry works every day.
+//
+// Every split of the digits over the two blocks, and every order of the faces on each block, is run through a whole day of
+// digit changes. Splits are ranked by swaps per day (every swap in a column makes the same Gantry moves, so this is the
+// Gantry travel), then by the slowest digit change, then by how far the display steppers turn in a day. The best face order
+// is kept for each split. The chosen layout is written out as FaceLayout.h, which BlockManager.cpp reads.
+//
+// Build (from Code/Tools):
+//	g++ -O2 -std=gnu++17 -Isim_stubs -I../Teensy_Main_Code face_optimizer.cpp -o face_optimizer
+//
+// Usage:
+//	./face_optimizer [--mode 12|24] [--top N] [--swap-ms MS] [--pick N] [--header FaceLayout.h]
+// The mode is the hour format the clock shows. Swap ms is how long one swap takes (8600 ms is what stress_sim measures).
+// Pick is the rank of the layout to write to the header, and 0 writes the layout in FaceLayout.h now, with its stats.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "Blocks.h"
+#include "FaceLayout.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Face Optimizer
+//	*************************************************************************************************
+
+// How the digits of a column are laid out over its two blocks
+typedef struct {
+	uint16_t onTwo;			// The digits on the second block, one bit per digit
+	int8_t faces[10];		// The face each digit is on, on whichever block it is on
+} FaceLayout;
+
+
+
+// How a layout does over a day
+typedef struct {
+	FaceLayout layout;
+	uint32_t swaps;			// The swaps in a day
+	uint32_t worstMs;		// The slowest digit change, from the old digit showing to the new one showing
+	uint64_t steps;			// The display stepper steps in a day
+} LayoutScore;
+
+
+
+// A column with two blocks, and how often each digit changes to each other digit in a day
+typedef struct {
+	const char *name;
+	BlockType one;			// The block that starts in the display row
+	BlockType two;			// The block that starts stored
+	uint32_t changes[10][10];	// The times a day the column changes from one digit to another
+} SplitColumn;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Face Optimizer
+//	*************************************************************************************************
+
+const uint32_t DisplayStepUs = 4900;							// Matches stepPeriodUs in ShiftRegSteppers.cpp
+const uint32_t StepsPerFace = DISPLAY_STEPS_PER_REV / MAX_FACES;	// Matches the stepsPerFace of the blocks in BlockManager.cpp
+
+uint32_t swapMs = 8600;		// How long one swap takes
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Face Optimizer
+//	*************************************************************************************************
+
+/// Get how many faces a block turns between two faces, going the short way round like RotateToFace()
+/// @param from The face it is on.
+/// @param to The face it goes to.
+/// @return The faces it turns.
+uint32_t FacesBetween(int8_t from, int8_t to){
+	uint32_t distance = abs(from - to);
+	return std::min(distance, MAX_FACES - distance);
+}// End of FacesBetween()
+
+
+
+/// Run a layout through a day of digit changes
+/// @param column The column, with its digit changes.
+/// @param layout The layout.
+/// @return How the layout did.
+LayoutScore ScoreLayout(const SplitColumn &column, const FaceLayout &layout){
+	LayoutScore score = {layout, 0, 0, 0};
+	for(uint8_t from = 0; from < 10; from++){
+		for(uint8_t to = 0; to < 10; to++){
+			uint32_t count = column.changes[from][to];
+			if(count == 0){
+				continue;
+			}
+
+			uint32_t faces;
+			uint32_t ms;
+			bool sameBlock = ((layout.onTwo >> from) & 1) == ((layout.onTwo >> to) & 1);
+			if(sameBlock){
+				faces = FacesBetween(layout.faces[from], layout.faces[to]);
+				ms = faces * StepsPerFace * DisplayStepUs / 1000;
+			}else{// Turn the old block back to face 0 to store it, swap, and turn the new block from face 0
+				faces = FacesBetween(layout.faces[from], 0) + FacesBetween(0, layout.faces[to]);
+				ms = faces * StepsPerFace * DisplayStepUs / 1000 + swapMs;
+				score.swaps += count;
+			}
+			score.steps += (uint64_t)faces * StepsPerFace * count;
+			score.worstMs = std::max(score.worstMs, ms);
+		}
+	}
+	return score;
+}// End of ScoreLayout()
+
+
+
+/// Check if one score is better than another: fewer swaps, then a faster slowest change, then fewer steps
+bool BetterScore(const LayoutScore &a, const LayoutScore &b){
+	if(a.swaps != b.swaps){
+		return a.swaps < b.swaps;
+	}
+	if(a.worstMs != b.worstMs){
+		return a.worstMs < b.worstMs;
+	}
+	return a.steps < b.steps;
+}// End of BetterScore()
+
+
+
+/// Call a function for every way of putting some digits on distinct faces of one block
+/// @param digits The digits on the block.
+/// @param count The number of digits.
+/// @param faces Filled in with the face of each digit, by digit.
+/// @param visit The function to call for each way.
+template <typename Visit>
+void ForEachFaceOrder(const uint8_t *digits, uint8_t count, int8_t *faces, Visit visit, uint8_t placed = 0, uint8_t used = 0){
+	if(placed == count){
+		visit();
+		return;
+	}
+	for(uint8_t face = 0; face < MAX_FACES; face++){
+		if(used & (1 << face)){
+			continue;
+		}
+		faces[digits[placed]] = face;
+		ForEachFaceOrder(digits, count, faces, visit, placed + 1, used | (1 << face));
+	}
+}// End of ForEachFaceOrder()
+
+
+
+/// Find the best face order for a split of the digits over the two blocks
+/// @param column The column.
+/// @param onTwo The digits on the second block.
+/// @return The best layout with that split, and its score.
+LayoutScore BestFaceOrder(const SplitColumn &column, uint16_t onTwo){
+	uint8_t oneDigits[10], twoDigits[10];
+	uint8_t oneCount = 0, twoCount = 0;
+	for(uint8_t digit = 0; digit < 10; digit++){
+		if((onTwo >> digit) & 1){
+			twoDigits[twoCount++] = digit;
+		}else{
+			oneDigits[oneCount++] = digit;
+		}
+	}
+
+	FaceLayout layout;
+	layout.onTwo = onTwo;
+	LayoutScore best = {layout, UINT32_MAX, UINT32_MAX, UINT64_MAX};
+	ForEachFaceOrder(oneDigits, oneCount, layout.faces, [&](){
+		ForEachFaceOrder(twoDigits, twoCount, layout.faces, [&](){
+			LayoutScore score = ScoreLayout(column, layout);
+			if(BetterScore(score, best)){
+				best = score;
+			}
+		});
+	});
+	return best;
+}// End of BestFaceOrder()
+
+
+
+/// Rank every split of the digits over the two blocks of a column
+/// @param column The column.
+/// @param keep How many of the best to return.
+/// @return The best layouts, best first.
+std::vector<LayoutScore> RankLayouts(const SplitColumn &column, uint32_t keep){
+	// The first block always has 0 on it, since swapping the two blocks' digits over gives the same layout
+	std::vector<uint16_t> splits;
+	for(uint16_t onTwo = 0; onTwo < (1 << 10); onTwo += 2){
+		uint8_t count = __builtin_popcount(onTwo);
+		if((count <= MAX_FACES) && ((10 - count) <= MAX_FACES)){
+			splits.push_back(onTwo);
+		}
+	}
+
+	// Work out the swaps for each split first, since they don't depend on the face order. Only the splits with the fewest
+	// swaps can make the list, so the face orders of the rest don't need trying.
+	FaceLayout noFaces = {0, {0}};
+	std::vector<std::pair<uint32_t, uint16_t>> bySwaps;
+	for(uint16_t onTwo : splits){
+		noFaces.onTwo = onTwo;
+		bySwaps.push_back({ScoreLayout(column, noFaces).swaps, onTwo});
+	}
+	std::sort(bySwaps.begin(), bySwaps.end());
+
+	std::vector<LayoutScore> ranked;
+	for(const auto &split : bySwaps){
+		if((ranked.size() >= keep) && (split.first > ranked[keep - 1].swaps)){
+			break;
+		}
+		ranked.push_back(BestFaceOrder(column, split.second));
+		std::sort(ranked.begin(), ranked.end(), BetterScore);
+	}
+	if(ranked.size() > keep){
+		ranked.resize(keep);
+	}
+	return ranked;
+}// End of RankLayouts()
+
+
+
+/// Get the layout of a column in FaceLayout.h now
+/// @param column The column.
+/// @return The layout.
+FaceLayout CurrentLayout(const SplitColumn &column){
+	FaceLayout layout = {0, {0}};
+	for(uint8_t digit = 0; digit < 10; digit++){
+		if(BlockDigitFaces[column.two][digit] >= 0){
+			layout.onTwo |= (1 << digit);
+			layout.faces[digit] = BlockDigitFaces[column.two][digit];
+		}else{
+			layout.faces[digit] = BlockDigitFaces[column.one][digit];
+		}
+	}
+	return layout;
+}// End of CurrentLayout()
+
+
+
+/// Write the digits on each face of one block of a layout, like "012345" with '-' for a blank face
+/// @param layout The layout.
+/// @param two True for the second block.
+/// @param text Filled in with the faces, at least MAX_FACES + 1 long.
+void FacesText(const FaceLayout &layout, bool two, char *text){
+	memset(text, '-', MAX_FACES);
+	text[MAX_FACES] = '\0';
+	for(uint8_t digit = 0; digit < 10; digit++){
+		if((((layout.onTwo >> digit) & 1) != 0) == two){
+			text[layout.faces[digit]] = '0' + digit;
+		}
+	}
+}// End of FacesText()
+
+
+
+/// Print a ranked layout
+/// @param rank The rank, or 0 for the current layout.
+/// @param score The layout and its score.
+void PrintScore(uint32_t rank, const LayoutScore &score){
+	char one[MAX_FACES + 1], two[MAX_FACES + 1];
+	FacesText(score.layout, false, one);
+	FacesText(score.layout, true, two);
+	if(rank == 0){
+		printf("  now");
+	}else{
+		printf("%5u", rank);
+	}
+	printf("  %9u  %9u  %13llu    %s    %s\n", score.swaps, score.worstMs, (unsigned long long)score.steps, one, two);
+}// End of PrintScore()
+
+
+
+/// Write one row of the BlockDigitFaces table
+/// @param file The header.
+/// @param faces The face of each digit, -1 if the digit isn't on the block.
+/// @param name The name of the block.
+void WriteFacesRow(FILE *file, const int8_t *faces, const char *name){
+	fprintf(file, "\t{");
+	for(uint8_t digit = 0; digit < 10; digit++){
+		fprintf(file, "%2d%s", faces[digit], (digit < 9) ? ", " : "");
+	}
+	fprintf(file, "},\t// %s\n", name);
+}// End of WriteFacesRow()
+
+
+
+/// Get the faces of one block of a layout
+/// @param layout The layout.
+/// @param two True for the second block.
+/// @param faces Filled in with the face of each digit, -1 if the digit isn't on the block.
+void BlockFaces(const FaceLayout &layout, bool two, int8_t *faces){
+	for(uint8_t digit = 0; digit < 10; digit++){
+		faces[digit] = ((((layout.onTwo >> digit) & 1) != 0) == two) ? layout.faces[digit] : -1;
+	}
+}// End of BlockFaces()
+
+
+
+/// Write FaceLayout.h
+/// @param path Where to write it.
+/// @param mode The hour format the layout was picked for.
+/// @param columns The hours and minutes columns.
+/// @param chosen The layout picked for each column.
+/// @return True if it was written.
+bool WriteHeader(const char *path, uint8_t mode, const SplitColumn *columns, const LayoutScore *chosen){
+	FILE *file = fopen(path, "w");
+	if(file == nullptr){
+		fprintf(stderr, "Could not open %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "// The digits on each face of each block. Generated by Code/Tools/face_optimizer.cpp for the %u hour clock, so run that\n", mode);
+	fprintf(file, "// again instead of editing this by hand. Face 0 is the face a block is stored on.\n//\n");
+	for(uint8_t i = 0; i < 2; i++){
+		fprintf(file, "// %s: %u swaps a day, slowest change %u ms, %llu display steps a day, with %u ms swaps\n", columns[i].name,
+			chosen[i].swaps, chosen[i].worstMs, (unsigned long long)chosen[i].steps, swapMs);
+	}
+	fprintf(file, "\n#pragma once // Include this file only once\n\n#include \"Blocks.h\"\n\n\n");
+	fprintf(file, "// The face each digit is on, by BlockType then digit. -1 if the digit isn't on that block\n");
+	fprintf(file, "const int8_t BlockDigitFaces[NUM_BLOCKS][10] = {\n");
+
+	const int8_t hoursFirst[10] = {0, 1, 2, -1, -1, -1, -1, -1, -1, -1};
+	const int8_t tensFirst[10] = {0, 1, 2, 3, 4, 5, -1, -1, -1, -1};
+	int8_t faces[10];
+	WriteFacesRow(file, hoursFirst, "HOURS_FIRST_DIGIT");
+	BlockFaces(chosen[0].layout, false, faces);
+	WriteFacesRow(file, faces, "HOURS_SECOND_DIGIT_ONE");
+	BlockFaces(chosen[0].layout, true, faces);
+	WriteFacesRow(file, faces, "HOURS_SECOND_DIGIT_TWO");
+	WriteFacesRow(file, tensFirst, "MINS_FIRST_DIGIT");
+	BlockFaces(chosen[1].layout, false, faces);
+	WriteFacesRow(file, faces, "MINS_SECOND_DIGIT_ONE");
+	BlockFaces(chosen[1].layout, true, faces);
+	WriteFacesRow(file, faces, "MINS_SECOND_DIGIT_TWO");
+	fprintf(file, "#if SHOW_SECONDS\t// The seconds change through the digits the same way the minutes do\n");
+	WriteFacesRow(file, tensFirst, "SECS_FIRST_DIGIT");
+	BlockFaces(chosen[1].layout, false, faces);
+	WriteFacesRow(file, faces, "SECS_SECOND_DIGIT_ONE");
+	BlockFaces(chosen[1].layout, true, faces);
+	WriteFacesRow(file, faces, "SECS_SECOND_DIGIT_TWO");
+	fprintf(file, "#endif\n};\n");
+	fclose(file);
+	return true;
+}// End of WriteHeader()
+
+
+
+int main(int argc, char *argv[]){
+	uint8_t mode = 24;
+	uint32_t top = 10;
+	uint32_t pick = 1;
+	const char *headerPath = nullptr;
+	for(int i = 1; i < argc; i++){
+		if((strcmp(argv[i], "--mode") == 0) && (i + 1 < argc)){
+			mode = atoi(argv[++i]);
+		}else if((strcmp(argv[i], "--top") == 0) && (i + 1 < argc)){
+			top = atoi(argv[++i]);
+		}else if((strcmp(argv[i], "--swap-ms") == 0) && (i + 1 < argc)){
+			swapMs = atoi(argv[++i]);
+		}else if((strcmp(argv[i], "--pick") == 0) && (i + 1 < argc)){
+			pick = atoi(argv[++i]);
+		}else if((strcmp(argv[i], "--header") == 0) && (i + 1 < argc)){
+			headerPath = argv[++i];
+		}else{
+			fprintf(stderr, "Usage: %s [--mode 12|24] [--top N] [--swap-ms MS] [--pick N] [--header FaceLayout.h]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(((mode != 12) && (mode != 24)) || (top == 0) || (pick > top)){
+		fprintf(stderr, "The mode is 12 or 24, top is at least 1, and pick is no more than top\n");
+		return 1;
+	}
+
+	// Count the digit changes in a day. The hours show 0 to 23, or 12 then 1 to 11 twice, and the minutes 0 to 59 each hour
+	SplitColumn columns[2] = {
+		{"Hours second digit", HOURS_SECOND_DIGIT_ONE, HOURS_SECOND_DIGIT_TWO, {}},
+		{"Minutes second digit", MINS_SECOND_DIGIT_ONE, MINS_SECOND_DIGIT_TWO, {}}
+	};
+	for(uint8_t hour = 0; hour < 24; hour++){
+		uint8_t shown = (mode == 24) ? hour : (((hour % 12) == 0) ? 12 : (hour % 12));
+		uint8_t nextHour = (hour + 1) % 24;
+		uint8_t nextShown = (mode == 24) ? nextHour : (((nextHour % 12) == 0) ? 12 : (nextHour % 12));
+		if((shown % 10) != (nextShown % 10)){
+			columns[0].changes[shown % 10][nextShown % 10]++;
+		}
+	}
+	for(uint16_t minute = 0; minute < 24 * 60; minute++){
+		columns[1].changes[minute % 10][(minute + 1) % 10]++;
+	}
+
+	LayoutScore chosen[2];
+	for(uint8_t i = 0; i < 2; i++){
+		printf("%s, %u hour clock, %u ms swaps\n", columns[i].name, mode, swapMs);
+		printf(" Rank  Swaps/day  Slowest ms  Steps/day    Block one  Block two\n");
+		LayoutScore current = ScoreLayout(columns[i], CurrentLayout(columns[i]));
+		PrintScore(0, current);
+
+		std::vector<LayoutScore> ranked = RankLayouts(columns[i], top);
+		for(uint32_t j = 0; j < ranked.size(); j++){
+			PrintScore(j + 1, ranked[j]);
+		}
+		printf("\n");
+		chosen[i] = (pick == 0) ? current : ranked[std::min<uint32_t>(pick, ranked.size()) - 1];
+	}
+
+	if((headerPath != nullptr) && !WriteHeader(headerPath, mode, columns, chosen)){
+		return 1;
+	}
+	return 0;
+}// End of main()
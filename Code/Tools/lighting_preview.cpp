@@ -0,0 +1,126 @@
+// Host side preview for the lighting effects. This compiles LightingEffects.cpp from the Teensy code on a computer,
+// draws the effects frame by frame, and shows them in the terminal (24 bit color) or saves them to an image.
+// It also times how long each frame takes to draw, to compare effects against each other.
+//
+// Build (from Code/Tools):
+//	g++ -O2 -std=c++17 -I../Teensy_Main_Code lighting_preview.cpp ../Teensy_Main_Code/LightingEffects.cpp -o lighting_preview
+//
+// Usage:
+//	./lighting_preview [pixels] [--ppm file.ppm]
+// The image has one row per frame, one column per pixel.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "LightingEffects.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Lighting Preview
+//	*************************************************************************************************
+
+// Struct to hold one scene to preview
+typedef struct {
+	const char *name;		// The name of the scene
+	LightingScene scene;	// What to draw
+	uint32_t durationMs;	// How long to draw it for
+} PreviewScene;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Lighting Preview
+//	*************************************************************************************************
+
+const uint32_t FrameMs = 20;	// Matches LightingFrameMs in Lighting.h
+
+// The scenes to preview. The colors match GantryStateColors in Lighting.cpp, and a sweep start of 0xFFFF0000 means no sweep
+const PreviewScene Scenes[] = {
+	{"Idle",					{0x302010, false, 0xFFFFFF, 0xFFFF0000, 96},	1000},
+	{"Idle, minute change",		{0x302010, false, 0xFFFFFF, 0, 96},		1400},
+	{"Swapping",				{0x0040FF, true, 0xFFFFFF, 0xFFFF0000, 96},	2000},
+	{"Error",					{0xFF0000, true, 0xFFFFFF, 0xFFFF0000, 96},	2000}
+};
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Lighting Preview
+//	*************************************************************************************************
+
+/// Print a frame as a row of colored blocks
+/// @param frame The frame.
+/// @param count The number of pixels.
+void PrintFrame(const uint32_t *frame, uint16_t count){
+	for(uint16_t i = 0; i < count; i++){
+		printf("\x1b[48;2;%u;%u;%um  ", (frame[i] >> 16) & 0xFF, (frame[i] >> 8) & 0xFF, frame[i] & 0xFF);
+	}
+	printf("\x1b[0m\n");
+}// End of PrintFrame()
+
+
+
+int main(int argc, char *argv[]){
+	uint16_t count = 30;	// Matches RgbStripLength in Pins.h
+	const char *ppmPath = nullptr;
+	for(int i = 1; i < argc; i++){
+		if((strcmp(argv[i], "--ppm") == 0) && (i + 1 < argc)){
+			ppmPath = argv[++i];
+		}else{
+			count = atoi(argv[i]);
+		}
+	}
+
+	std::vector<uint32_t> frame(count);
+	std::vector<uint32_t> image;	// Every frame, for the ppm
+	uint32_t rows = 0;
+
+	for(const PreviewScene &preview : Scenes){
+		double totalNs = 0;
+		double worstNs = 0;
+		uint32_t frames = 0;
+
+		if(ppmPath == nullptr){
+			printf("%s\n", preview.name);
+		}
+		for(uint32_t nowMs = 0; nowMs < preview.durationMs; nowMs += FrameMs){
+			auto start = std::chrono::steady_clock::now();
+			RenderLightingFrame(frame.data(), count, &preview.scene, nowMs);
+			double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+			totalNs += ns;
+			worstNs = (ns > worstNs) ? ns : worstNs;
+			frames++;
+
+			if(ppmPath != nullptr){
+				image.insert(image.end(), frame.begin(), frame.end());
+				rows++;
+			}else{
+				PrintFrame(frame.data(), count);
+			}
+		}
+		fprintf(stderr, "%-24s %4u frames, average %7.0f ns, worst %7.0f ns per frame\n", preview.name, frames, totalNs / frames, worstNs);
+	}
+
+	if(ppmPath != nullptr){
+		FILE *file = fopen(ppmPath, "wb");
+		if(file == nullptr){
+			fprintf(stderr, "Could not open %s\n", ppmPath);
+			return 1;
+		}
+		fprintf(file, "P6\n%u %u\n255\n", count, rows);
+		for(uint32_t color : image){
+			uint8_t rgb[3] = {(uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color};
+			fwrite(rgb, 1, 3, file);
+		}
+		fclose(file);
+	}
+	return 0;
+}// End of main()
@@ -0,0 +1,162 @@
+"""Decode the deferred log sent by the Teensy over USB serial.
+
+The Teensy sends each LOG_MSG() as a COBS encoded frame ending in a 0 byte. Each frame holds a 4 byte micros() timestamp,
+a 2 byte message ID, and 4 bytes per argument, all little endian. The formats are read from LogMessages.h, so the IDs
+line up with the firmware as long as this is run against the same copy of the code.
+
+Anything that doesn't decode as a frame (like text from Serial.printf) is printed as is.
+
+With --capture, the records of an input capture (LOG_CAPTURE_INPUT, sent by "capture send" on the console) are also saved
+to a file, one "time_us source channel value" line each, for replay_sim to play back.
+
+Usage:
+	python log_decoder.py COM5
+	python log_decoder.py /dev/ttyACM0 --messages ../Teensy_Main_Code/LogMessages.h
+	python log_decoder.py capture.bin		(a file saved from the serial port)
+	python log_decoder.py COM5 --capture field.cap
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+
+DEFAULT_MESSAGES = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Teensy_Main_Code", "LogMessages.h")
+
+# Matches one printf conversion, so each argument can be unpacked as the right type
+CONVERSION = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?(hh|h|ll|l|z|j|t)?([diuxXofeEgGc%])")
+LENGTH_MODIFIER = re.compile(r"(%[-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)(?=[diuxXofeEgGc])")
+
+
+def load_messages(path):
+	"""Read the message list from LogMessages.h, in order, so the index matches the firmware's message ID."""
+	with open(path) as file:
+		text = file.read()
+	return [(name, bytes(fmt, "utf-8").decode("unicode_escape")) for name, fmt in re.findall(r'X\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', text)]
+
+
+def cobs_decode(frame):
+	"""Undo the COBS encoding of a frame (without its 0 delimiter). Returns None if the frame is not valid."""
+	out = bytearray()
+	i = 0
+	while i < len(frame):
+		code = frame[i]
+		if code == 0 or i + code > len(frame):
+			return None
+		out += frame[i + 1:i + code]
+		i += code
+		if code < 0xFF and i < len(frame):
+			out.append(0)
+	return bytes(out)
+
+
+def unpack_record(record, messages):
+	"""Split a decoded record into its timestamp, message name, format, and arguments. Returns None if it doesn't look like
+	a log record."""
+	if len(record) < 6 or (len(record) - 6) % 4 != 0:
+		return None
+	timestamp, message_id = struct.unpack_from("<IH", record)
+	if message_id >= len(messages):
+		return None
+	name, fmt = messages[message_id]
+
+	words = [record[i:i + 4] for i in range(6, len(record), 4)]
+	args = []
+	for length, conversion in CONVERSION.findall(fmt):
+		if conversion == "%":
+			continue
+		if not words:
+			return None
+		word = words.pop(0)
+		if conversion in "fFeEgG":
+			args.append(struct.unpack("<f", word)[0])
+		elif conversion in "di":
+			args.append(struct.unpack("<i", word)[0])
+		else:
+			args.append(struct.unpack("<I", word)[0])
+	if words:
+		return None
+	return timestamp, name, fmt, args
+
+
+def format_record(record, messages, capture=None):
+	"""Turn a decoded record back into text, saving it to the capture file if it is a captured input. Returns None if it
+	doesn't look like a log record."""
+	unpacked = unpack_record(record, messages)
+	if unpacked is None:
+		return None
+	timestamp, name, fmt, args = unpacked
+	if capture is not None and name == "LOG_CAPTURE_INPUT":
+		capture.write("%u %u %u %u\n" % tuple(args))
+
+	try:
+		text = fmt % tuple(args)
+	except (TypeError, ValueError):
+		return None
+	return "[%10.6f] %s" % (timestamp / 1e6, text)
+
+
+def decode_frame(frame, messages, capture=None):
+	"""Turn the bytes before a 0 delimiter into text. Plain text (like console replies) can come right before a frame,
+	so if the whole thing doesn't decode, try again after each newline."""
+	start = 0
+	while True:
+		record = cobs_decode(frame[start:])
+		text = format_record(record, messages, capture) if record is not None else None
+		if text is not None:
+			return frame[:start].decode("utf-8", errors="replace") + text
+		start = frame.find(b"\n", start) + 1
+		if start == 0 or start >= len(frame):# Not a log frame, so show it as text
+			return frame.decode("utf-8", errors="replace")
+
+
+def decode_stream(stream, messages, out=sys.stdout, capture=None):
+	"""Read bytes until the stream ends, printing each frame as it is completed."""
+	# printf in python doesn't know about length modifiers, so drop them from the formats
+	messages = [(name, LENGTH_MODIFIER.sub(r"\1", fmt)) for name, fmt in messages]
+
+	pending = bytearray()
+	while True:
+		data = stream.read(1)
+		if not data:
+			break
+		if data[0] != 0:
+			pending += data
+			continue
+
+		out.write(decode_frame(bytes(pending), messages, capture))
+		out.flush()
+		pending.clear()
+
+	if pending:
+		out.write(pending.decode("utf-8", errors="replace"))
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Decode the Teensy's deferred log")
+	parser.add_argument("source", help="Serial port, or a file captured from the serial port")
+	parser.add_argument("--messages", default=DEFAULT_MESSAGES, help="Path to LogMessages.h")
+	parser.add_argument("--baud", type=int, default=115200, help="Baud rate (ignored by the Teensy's USB serial)")
+	parser.add_argument("--capture", help="Save the captured inputs in the log to this file, for replay_sim")
+	args = parser.parse_args()
+
+	messages = load_messages(args.messages)
+	capture = open(args.capture, "w") if args.capture else None
+
+	try:
+		if os.path.isfile(args.source):
+			with open(args.source, "rb") as stream:
+				decode_stream(stream, messages, capture=capture)
+		else:
+			import serial	# pyserial, only needed when reading from a port
+			with serial.Serial(args.source, args.baud) as stream:
+				decode_stream(stream, messages, capture=capture)
+	finally:
+		if capture is not None:
+			capture.close()
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,145 @@
+// Host side checks of the ESP32's NTP clock filter and selection (ESP32_Time_Module/NtpFilter.cpp). The filter has no
+// Arduino code in it, so it builds on a computer as it is, and is fed known samples here instead of waiting on servers.
+// ntp_standin.py is still the way to check the whole client on an ESP32 against a network.
+//
+// Build (from Code/Tools):
+//	g++ -O2 -std=gnu++17 -I../ESP32_Time_Module ntp_filter_test.cpp ../ESP32_Time_Module/NtpFilter.cpp -o ntp_filter_test
+//
+// Usage:
+//	./ntp_filter_test
+// Each check prints pass or FAIL, and it exits with 1 if any failed.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "NtpFilter.h"
+
+
+//	*************************************************************************************************
+//	Local Variables for the NTP Filter Test
+//	*************************************************************************************************
+
+uint32_t checksFailed = 0;	// The checks that have failed so far
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the NTP Filter Test
+//	*************************************************************************************************
+
+/// Print the result of a check
+/// @param passed If the check passed.
+/// @param name What was checked.
+void Check(bool passed, const char *name){
+	printf("%s: %s\n", passed ? "pass" : "FAIL", name);
+	if(!passed){
+		checksFailed++;
+	}
+}// End of Check()
+
+
+
+/// Fill a server's filter with samples around an offset, one poll apart
+/// @param filter The server's filter.
+/// @param offsetUs The server's offset.
+/// @param delayUs The lowest round trip delay of the samples.
+/// @param nowMs The time of the last sample, in millis.
+void FillFilter(NtpServerFilter *filter, int64_t offsetUs, int64_t delayUs, uint32_t nowMs){
+	NtpResetFilter(filter);
+	for(uint8_t i = 0; i < NtpFilterSamples; i++){
+		NtpAddSample(filter, offsetUs + (i % 3) * 100, delayUs + (i % 4) * 2000, nowMs - (NtpFilterSamples - 1 - i) * 64000);
+	}
+}// End of FillFilter()
+
+
+
+// Check the offset and delay worked out from the four timestamps
+void CheckMeasure(){
+	int64_t offsetUs, delayUs;
+
+	// The server is 5000 us ahead, 1000 us away each way, and holds the request for 200 us
+	NtpMeasure(0, 6000, 6200, 2200, &offsetUs, &delayUs);
+	Check((offsetUs == 5000) && (delayUs == 2000), "offset and delay from the timestamps");
+
+	// The server's hold time is longer than the round trip by our clock, which the clocks can't resolve
+	NtpMeasure(0, 100, 400, 200, &offsetUs, &delayUs);
+	Check(delayUs == 0, "a round trip shorter than the server's hold time is 0 delay");
+}// End of CheckMeasure()
+
+
+
+// Check a server's filter picks its lowest delay sample, and drops samples once they are too old
+void CheckServerFilter(){
+	NtpServerFilter filter;
+	NtpResetFilter(&filter);
+	Check(!filter.usable && (filter.reach == 0), "a reset server has nothing to use");
+
+	NtpAddSample(&filter, 100, 9000, 1000);
+	NtpAddSample(&filter, 300, 2000, 2000);
+	NtpAddSample(&filter, 500, 5000, 3000);
+	Check(filter.usable && (filter.offsetUs == 300) && (filter.delayUs == 2000), "the lowest delay sample is the server's offset");
+	Check(filter.jitterUs == 200, "the jitter is the RMS of the other samples from it");
+	Check(filter.reach == 0b111, "each answer is a bit of reach");
+
+	NtpMissedPoll(&filter, 4000);
+	Check(filter.usable && (filter.reach == 0b1110), "a missed poll shifts the reach but keeps the samples");
+
+	NtpMissedPoll(&filter, 3000 + NtpSampleMaxAgeMs + 1);
+	Check(!filter.usable, "samples older than NtpSampleMaxAgeMs aren't used");
+}// End of CheckServerFilter()
+
+
+
+// Check the selection across servers votes out one that is far off, and won't pick a side when there is no majority
+void CheckSelection(){
+	NtpServerFilter filters[4];
+	uint32_t nowMs = 1000000;
+
+	FillFilter(&filters[0], 1000, 10000, nowMs);
+	FillFilter(&filters[1], 1500, 10000, nowMs);
+	FillFilter(&filters[2], 2500000, 10000, nowMs);	// 2.5 s off, like ntp_standin.py --falseticker 2.5
+	NtpSelection selection = NtpSelect(filters, 3);
+	Check(selection.valid && (selection.candidates == 3) && (selection.survivors == 2), "a falseticker is voted out");
+	Check((selection.offsetUs >= 1000) && (selection.offsetUs <= 1500), "the offset is between the servers that agree");
+	Check((selection.uncertaintyUs > 0) && (selection.uncertaintyUs < 20000), "the uncertainty is about the best server's distance");
+
+	FillFilter(&filters[0], 0, 2000, nowMs);
+	FillFilter(&filters[1], 2500000, 2000, nowMs);
+	selection = NtpSelect(filters, 2);
+	Check(!selection.valid && (selection.candidates == 2), "two servers that disagree give no correction");
+
+	NtpResetFilter(&filters[1]);
+	selection = NtpSelect(filters, 2);
+	Check(selection.valid && (selection.candidates == 1) && (selection.survivors == 1), "a server that never answered isn't a candidate");
+
+	FillFilter(&filters[0], 40000, 10000, nowMs);
+	FillFilter(&filters[1], 40300, 12000, nowMs);
+	FillFilter(&filters[2], 39800, 10000, nowMs);
+	FillFilter(&filters[3], -900000, 10000, nowMs);
+	selection = NtpSelect(filters, 4);
+	int64_t offsetUs = selection.offsetUs;
+	Check(selection.valid && (selection.survivors == 3), "three of four servers agree");
+
+	NtpShiftSamples(filters, 4, offsetUs);
+	selection = NtpSelect(filters, 4);
+	Check(selection.valid && (llabs(selection.offsetUs) <= 1), "after the clock is corrected, the servers agree it is right");
+}// End of CheckSelection()
+
+
+
+
+
+//	*************************************************************************************************
+//	Main
+//	*************************************************************************************************
+
+int main(){
+	CheckMeasure();
+	CheckServerFilter();
+	CheckSelection();
+
+	printf("NTP filter: %lu checks failed\n", (unsigned long)checksFailed);
+	return (checksFailed == 0) ? 0 : 1;
+}// End of main()
@@ -0,0 +1,179 @@
+"""A local stand-in for NTP servers, for testing the ESP32's NTP client without the real servers.
+
+Each server answers NTP requests on its own UDP port with this computer's clock, plus an offset. The network delay, jitter,
+asymmetry, and dropped packets are added on purpose, so the clock filter and selection on the ESP32 can be checked against
+known answers. Each request is handled on its own thread, so a delayed reply doesn't hold up the others.
+
+Point the servers in NtpServers[] (ESP32_Time_Module/NtpClient.cpp) at this computer and the ports printed at startup.
+
+Usage:
+	python ntp_standin.py --servers 3 --delay 0.02 --jitter 0.005
+	python ntp_standin.py --servers 3 --falseticker 2.5		(the last server is 2.5 s off, and should be voted out)
+	python ntp_standin.py --servers 2 --asymmetry 0.9 --drop 0.2
+	python ntp_standin.py --check 127.0.0.1:12300 --count 8	(query a server and show what a client would measure)
+"""
+
+import argparse
+import random
+import socket
+import struct
+import threading
+import time
+
+
+NTP_EPOCH_OFFSET = 2208988800	# Seconds from 1900 (the NTP epoch) to 1970
+PACKET_SIZE = 48
+
+
+def to_ntp(unix_time):
+	"""Turn a unix time in seconds into a 64 bit NTP timestamp."""
+	seconds = int(unix_time) + NTP_EPOCH_OFFSET
+	fraction = int((unix_time % 1) * (1 << 32))
+	return ((seconds & 0xFFFFFFFF) << 32) | (fraction & 0xFFFFFFFF)
+
+
+def from_ntp(timestamp):
+	"""Turn a 64 bit NTP timestamp into a unix time in seconds."""
+	return (timestamp >> 32) - NTP_EPOCH_OFFSET + (timestamp & 0xFFFFFFFF) / (1 << 32)
+
+
+class StandinServer:
+	"""One stand-in server, answering on its own port."""
+
+	def __init__(self, port, offset, args):
+		self.port = port
+		self.offset = offset
+		self.args = args
+		self.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+		self.socket.bind((args.bind, port))
+		self.lock = threading.Lock()
+		self.answered = 0
+		self.dropped = 0
+
+	def network_delays(self):
+		"""Pick the delay on the way in and the way back for one request."""
+		total = max(0.0, random.gauss(self.args.delay, self.args.jitter))
+		return total * (1 - self.args.asymmetry), total * self.args.asymmetry
+
+	def answer(self, request, address):
+		"""Answer one request, after the delays for this exchange."""
+		if random.random() < self.args.drop:
+			with self.lock:
+				self.dropped += 1
+			return
+
+		to_server, to_client = self.network_delays()
+		time.sleep(to_server)
+		received = time.time() + self.offset
+		time.sleep(self.args.hold)	# Time the server holds the request, which the client takes out of the delay
+		transmitted = time.time() + self.offset
+
+		origin = struct.unpack_from("!Q", request, 40)[0]	# The client's transmit time, echoed back as the origin
+		reply = struct.pack("!BBbbII4sQQQQ",
+			(0 << 6) | (4 << 3) | 4,		# No leap second warning, version 4, server mode
+			self.args.stratum,
+			6,								# Poll interval, 2^6 s
+			-20,							# Precision, about a microsecond
+			0,								# Root delay
+			0,								# Root dispersion
+			b"SIM\0",						# Reference ID
+			to_ntp(transmitted - 16),		# Reference time, when this server was last set
+			origin,
+			to_ntp(received),
+			to_ntp(transmitted))
+
+		time.sleep(to_client)
+		self.socket.sendto(reply, address)
+		with self.lock:
+			self.answered += 1
+
+	def serve(self):
+		"""Answer requests until the program is stopped."""
+		while True:
+			request, address = self.socket.recvfrom(1024)
+			if len(request) < PACKET_SIZE or (request[0] & 0b111) != 3:	# Only answer client mode requests
+				continue
+			threading.Thread(target=self.answer, args=(request, address), daemon=True).start()
+
+
+def check(target, count, interval):
+	"""Query a server like the ESP32 does, and show each sample and the lowest delay one."""
+	host, port = target.rsplit(":", 1)
+	client = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+	client.settimeout(2)
+
+	samples = []
+	for i in range(count):
+		request = bytearray(PACKET_SIZE)
+		request[0] = (0 << 6) | (4 << 3) | 3
+		t1 = time.time()
+		struct.pack_into("!Q", request, 40, to_ntp(t1))
+		client.sendto(request, (host, int(port)))
+		try:
+			reply, _ = client.recvfrom(1024)
+		except socket.timeout:
+			print("%2u: no reply" % i)
+			continue
+		t4 = time.time()
+
+		t2 = from_ntp(struct.unpack_from("!Q", reply, 32)[0])
+		t3 = from_ntp(struct.unpack_from("!Q", reply, 40)[0])
+		offset = ((t2 - t1) + (t3 - t4)) / 2
+		delay = (t4 - t1) - (t3 - t2)
+		samples.append((delay, offset))
+		print("%2u: offset %+10.3f ms, delay %8.3f ms" % (i, offset * 1e3, delay * 1e3))
+		time.sleep(interval)
+
+	if samples:
+		delay, offset = min(samples)
+		print("Lowest delay sample: offset %+.3f ms, delay %.3f ms" % (offset * 1e3, delay * 1e3))
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Stand-in NTP servers with network delay and jitter added on purpose")
+	parser.add_argument("--port", type=int, default=12300, help="The port of the first server, the rest follow it")
+	parser.add_argument("--bind", default="0.0.0.0", help="The address to listen on")
+	parser.add_argument("--servers", type=int, default=3, help="The number of servers")
+	parser.add_argument("--offset", type=float, default=0.0, help="How far ahead of this computer the servers are, in seconds")
+	parser.add_argument("--spread", type=float, default=0.0, help="The servers' offsets are spread over this many seconds")
+	parser.add_argument("--falseticker", type=float, default=0.0, help="Put the last server this many seconds further off")
+	parser.add_argument("--delay", type=float, default=0.01, help="The mean round trip network delay, in seconds")
+	parser.add_argument("--jitter", type=float, default=0.002, help="The standard deviation of the delay, in seconds")
+	parser.add_argument("--asymmetry", type=float, default=0.5, help="The part of the delay on the way back, from 0 to 1")
+	parser.add_argument("--hold", type=float, default=0.0005, help="How long the server holds each request, in seconds")
+	parser.add_argument("--drop", type=float, default=0.0, help="The chance a request is dropped, from 0 to 1")
+	parser.add_argument("--stratum", type=int, default=2, help="The stratum to answer with. 0 sends kiss-o'-death replies")
+	parser.add_argument("--seed", type=int, help="Seed the random delays, so a run can be repeated")
+	parser.add_argument("--check", metavar="HOST:PORT", help="Query a server instead of serving")
+	parser.add_argument("--count", type=int, default=8, help="The number of queries for --check")
+	parser.add_argument("--interval", type=float, default=0.5, help="The time between queries for --check, in seconds")
+	args = parser.parse_args()
+
+	if args.check:
+		check(args.check, args.count, args.interval)
+		return
+
+	random.seed(args.seed)
+	servers = []
+	for i in range(args.servers):
+		offset = args.offset
+		if args.servers > 1:
+			offset += args.spread * (i / (args.servers - 1) - 0.5)
+		if args.falseticker and i == args.servers - 1:
+			offset += args.falseticker
+		servers.append(StandinServer(args.port + i, offset, args))
+		print("Server %u on port %u, offset %+.3f ms" % (i, args.port + i, offset * 1e3))
+
+	for server in servers:
+		threading.Thread(target=server.serve, daemon=True).start()
+
+	try:
+		while True:
+			time.sleep(10)
+			print("Answered %s, dropped %s" % ([s.answered for s in servers], [s.dropped for s in servers]))
+	except KeyboardInterrupt:
+		pass
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,79 @@
+"""Check that input captures from stress_sim replay to the same run.
+
+Each case runs stress_sim with --capture and --log, pulls the capture out of the log with log_decoder.py --capture, and
+plays it back with replay_sim. A replay that doesn't read the same inputs at the same times drives the outputs
+differently, so the "Sim: outputs hash" line of the two runs has to match.
+
+stress_sim and replay_sim have to be built first (see the top of each file).
+
+Usage:
+	python replay_check.py
+	python replay_check.py --swaps 12 --sim ./stress_sim --replay ./replay_sim
+Each case prints pass or FAIL, and it exits with 1 if any failed.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+TOOLS = os.path.dirname(os.path.abspath(__file__))
+
+# The stress_sim options of each case. --calibrate is passed on to replay_sim too, the rest come back from the capture
+CASES = [
+	[],
+	["--calibrate"],
+	["--miss-rate", "0.02"],
+]
+
+OUTPUTS_HASH = re.compile(r"Sim: outputs hash (\w+)")
+
+
+def outputs_hash(command):
+	"""Run a sim and return its outputs hash, or None if it failed or didn't print one."""
+	result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+	match = OUTPUTS_HASH.search(result.stdout)
+	if result.returncode != 0 or match is None:
+		sys.stdout.write(result.stdout)
+		return None
+	return match.group(1)
+
+
+def check_case(options, args, folder):
+	"""Capture a stress test, replay it, and return True if both runs drove the outputs the same."""
+	log = os.path.join(folder, "run.bin")
+	capture = os.path.join(folder, "run.cap")
+	swaps = str(args.swaps)
+
+	sim_hash = outputs_hash([args.sim, swaps, "--capture", "--log", log] + options)
+	with open(os.devnull, "w") as quiet:
+		subprocess.run([sys.executable, os.path.join(TOOLS, "log_decoder.py"), log, "--capture", capture], stdout=quiet, check=True)
+	replay_hash = outputs_hash([args.replay, capture, "--stress", swaps] + [option for option in options if option == "--calibrate"])
+
+	passed = sim_hash is not None and sim_hash == replay_hash
+	print("%s: %s swaps %s, stress_sim %s, replay_sim %s" % ("pass" if passed else "FAIL", swaps, " ".join(options) or "(plain)", sim_hash, replay_hash))
+	return passed
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Check that stress_sim captures replay to the same outputs hash")
+	parser.add_argument("--swaps", type=int, default=5, help="Swaps in each stress test")
+	parser.add_argument("--sim", default=os.path.join(TOOLS, "stress_sim"), help="Path to the built stress_sim")
+	parser.add_argument("--replay", default=os.path.join(TOOLS, "replay_sim"), help="Path to the built replay_sim")
+	args = parser.parse_args()
+
+	failed = 0
+	with tempfile.TemporaryDirectory() as folder:
+		for options in CASES:
+			if not check_case(options, args, folder):
+				failed += 1
+
+	print("Replay: %d cases failed" % failed)
+	sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+	main()
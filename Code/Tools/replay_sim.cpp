@@ -0,0 +1,117 @@
+// Host side replay of an input capture. This builds the whole Teensy code on a computer like stress_sim does, and runs it on
+// simulated time with the inputs played back from a capture (see InputCapture.h): the limit and home switches, the Gantry
+// driver status, and the ESP32's time answers. SwapBlocksProcess(), HomeGantryProcess() and MoveDisplaySteppers() then see
+// what they saw in the field at the same micros(), so a failure can be run again, looked at with --log and --vcd, and run
+// against a fix. The outputs hash at the end only matches between runs that did exactly the same thing.
+//
+// Getting a capture: set CAPTURE_INPUTS_AT_BOOT in Config.h (or type "capture start"), then "capture send" on the console
+// with log_decoder.py --capture field.cap reading the serial port. stress_sim --capture makes one on the computer.
+//
+// Build (from Code/Tools):
+//	g++ -O2 -std=gnu++17 -Isim_stubs -I../Teensy_Main_Code replay_sim.cpp sim_hardware.cpp sim_vcd.cpp ../Teensy_Main_Code/*.cpp -o replay_sim
+//
+// Usage:
+//	./replay_sim field.cap [--stress swaps] [--calibrate] [--after S] [--log file.bin] [--vcd file.vcd] [--vcd-seconds S]
+// A capture from stress_sim is replayed with --stress and the same number of swaps, and --calibrate if it was made with
+// that, since those were started on the computer rather than by an input. Otherwise the replay runs until S seconds
+// (default 10) after the last record. replay_check.py checks that stress_sim captures replay to the same outputs hash.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sim_hardware.h"
+#include "Teensy_Main_Code.ino"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Replay Sim
+//	*************************************************************************************************
+
+const uint32_t SimLoopUs = 10;					// How long each pass through loop() takes on the Teensy. Matches stress_sim
+const time_t SimStartTime = 1704110400;			// The time until a captured ESP32 answer sets it. Matches stress_sim
+
+
+
+
+
+//	*************************************************************************************************
+//	Main
+//	*************************************************************************************************
+
+int main(int argc, char **argv){
+	uint32_t stressSwaps = 0;
+	bool calibrate = false;
+	double afterSeconds = 10;
+	SimSettings settings = {0.0, 1, 300, 120, 700, DISPLAY_STEPS_PER_REV, nullptr, nullptr, 0, nullptr};	// The same start as stress_sim
+
+	for(int i = 1; i < argc; i++){
+		if((strcmp(argv[i], "--stress") == 0) && (i + 1 < argc)){
+			stressSwaps = strtoul(argv[++i], nullptr, 10);
+		}else if(strcmp(argv[i], "--calibrate") == 0){
+			calibrate = true;
+		}else if((strcmp(argv[i], "--after") == 0) && (i + 1 < argc)){
+			afterSeconds = strtod(argv[++i], nullptr);
+		}else if((strcmp(argv[i], "--log") == 0) && (i + 1 < argc)){
+			settings.logPath = argv[++i];
+		}else if((strcmp(argv[i], "--vcd") == 0) && (i + 1 < argc)){
+			settings.vcdPath = argv[++i];
+		}else if((strcmp(argv[i], "--vcd-seconds") == 0) && (i + 1 < argc)){
+			settings.vcdSeconds = strtod(argv[++i], nullptr);
+		}else if((argv[i][0] != '-') && (settings.replayPath == nullptr)){
+			settings.replayPath = argv[i];
+		}else{
+			settings.replayPath = nullptr;
+			break;
+		}
+	}
+	if(settings.replayPath == nullptr){
+		fprintf(stderr, "Usage: %s capture [--stress swaps] [--calibrate] [--after S] [--log file.bin] [--vcd file.vcd] [--vcd-seconds S]\n", argv[0]);
+		return 1;
+	}
+
+	SimBegin(settings);
+	if(SimReplayEndUs() == 0){
+		fprintf(stderr, "There is nothing to play back in %s\n", settings.replayPath);
+		return 1;
+	}
+	setTime(SimStartTime);
+	setup();
+
+	if(calibrate){// Measure the display steppers first, like stress_sim --calibrate
+		StartDisplayCalibration(BLOCK_STEPPER_MASK(NUM_BLOCK_STEPPERS) - 1);
+		while(DisplayCalibrationRunning()){
+			loop();
+			SimSampleStates();
+			SimAdvance(SimLoopUs);
+		}
+		PrintDisplayCalibration();
+	}
+
+	auto startedAt = std::chrono::steady_clock::now();
+	if(stressSwaps > 0){
+		StartStressTest(stressSwaps, 0);
+		while(StressTestRunning()){
+			loop();
+			SimSampleStates();
+			SimAdvance(SimLoopUs);
+		}
+	}else{
+		uint64_t endUs = SimReplayEndUs() + (uint64_t)(afterSeconds * 1e6);
+		while(SimMicros() < endUs){
+			loop();
+			SimSampleStates();
+			SimAdvance(SimLoopUs);
+		}
+	}
+	double realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+
+	PrintGantryStatus();
+	PrintSwapStats();
+	PrintDisplayStepperStatus();
+	SimPrintReport();
+	printf("Sim: %.1f simulated seconds in %.1f s\n", SimMicros() / 1e6, realSeconds);
+	SimEnd();
+	return 0;
+}// End of main()
@@ -0,0 +1,985 @@
+// The simulated clock hardware for stress_sim. This implements the stand-in libraries in sim_stubs (time, pins, SPI, the
+// DRV8711s, Serial, and TimeLib) on top of a model of the Gantry mechanism. See sim_hardware.h for what is modelled.
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <HighPowerStepperDriver.h>
+#include <TimeLib.h>
+#include <Wire.h>
+#include <EEPROM.h>
+#include <algorithm>
+#include <vector>
+
+#include "sim_hardware.h"
+#include "sim_vcd.h"
+#include "Pins.h"
+#include "Blocks.h"
+#include "Gantry.h"
+#include "Electromagnet.h"
+#include "ShiftRegSteppers.h"
+#include "InputCapture.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the Simulated Hardware
+//	*************************************************************************************************
+
+// Struct to hold the state of one simulated DRV8711 and the motor it drives
+typedef struct {
+	uint16_t regs[8];		// The registers, by HPSDRegAddr
+	int32_t position;		// How far the motor has turned, in 1/SimSubsteps of a full step. Positive is the RDIR = 1 direction
+} SimDriver;
+
+
+
+// Struct to hold one record of an input capture being played back
+typedef struct {
+	uint64_t timeUs;		// micros() on the Teensy when it was read, unwrapped past 32 bits
+	uint8_t source;			// CaptureSource
+	uint8_t channel;
+	uint16_t value;
+} SimReplayRecord;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the Simulated Hardware
+//	*************************************************************************************************
+
+// The Gantry travel, in full steps. These match GANTRY_ABS_BOTTOM and GANTRY_BACK in Gantry.cpp
+const int32_t SimFrameBottom = 400;		// Where the down limit switches trip
+const int32_t SimFrameBack = 2000;		// Where the back limit switches trip
+const int32_t SimHardStopSteps = 6;		// How far past a limit switch the hard stop is
+
+const int32_t SimSubsteps = 256;		// Motor positions are kept in 1/256 steps, the finest DRV8711 step mode
+
+const uint8_t SimPins = 64;				// The number of pins that are kept track of
+
+const int32_t SimDisplayHomeSteps = 20;	// How many steps of each turn a display stepper's home switch is pressed for
+const uint8_t SimCoilPatterns[4] = {0b1010, 0b0110, 0b0101, 0b1001};	// The coil patterns of the 4 full steps, in order
+
+const uint16_t SimStatusStall = (1 << (uint8_t)HPSDStatusBit::StD) | (1 << (uint8_t)HPSDStatusBit::StDLat);	// The status bits set by running into a hard stop
+
+SimSettings simSettings;				// The settings for the run
+SimStats simStats;						// What the hardware saw during the run
+SimDriver simDrivers[NUM_MOTORS];		// The DRV8711s, in GantryMotor order
+
+uint64_t simUs = 0;						// The simulated time, in microseconds
+uint32_t simNs = 0;						// The part of a microsecond waited in delayNanoseconds() so far
+time_t simTimeOffset = 0;				// The unix time when simUs was 0
+
+uint8_t simPinOutputs[SimPins];			// The level each pin was last written to
+uint32_t simRandom = 1;					// The state of the random number generator for missed steps
+
+uint64_t simShiftRegister = 0;					// The bits shifted into the display stepper shift registers, not latched yet
+int32_t simDisplayPositions[NUM_BLOCK_STEPPERS];	// Where each display stepper really is, in steps past home
+int8_t simDisplayPhases[NUM_BLOCK_STEPPERS];		// The coil pattern each display stepper was last on, or -1 if none yet
+
+FILE *simLogFile = nullptr;				// Where Serial.write() goes
+
+uint64_t simDataChangedNs = 0;			// When the display shift register data pin last changed level
+bool simDataChanged = false;			// If the data pin changed since the last clock
+uint64_t simClockRoseNs = 0;			// When the display shift register clock last rose
+bool simSpiOpen = false;				// If an SPI transaction is going on
+uint64_t simFirstStepNs = 0;			// When the first Gantry motor step of this transaction was
+uint64_t simLastStepNs = 0;				// When the last Gantry motor step of this transaction was
+uint8_t simTransactionSteps = 0;		// The Gantry motor steps in this transaction
+
+// The waveform signals, from VcdAddSignal(). -1 for anything without one.
+int16_t simPinSignals[SimPins];						// Each pin the Teensy code writes
+int16_t simDutySignals[SimPins];					// The PWM duty of the pins written with analogWrite()
+int16_t simLimitSignals[NUM_LS];					// The Gantry limit switches, as the code read them
+int16_t simHomeSignals[NUM_BLOCK_STEPPERS];			// The display home switches, as the code read them
+int16_t simStepSignals[NUM_MOTORS];					// The steps each Gantry motor was sent
+int16_t simSpiWordSignal = -1;						// The last word written to a DRV8711
+int16_t simSpiSkewSignal = -1;						// The skew between the motor steps in the last SPI transaction
+int16_t simDisplayPositionSignals[NUM_BLOCK_STEPPERS];	// Where each display stepper really is
+int16_t simGantryStateSignal = -1;					// GetGantryState()
+int16_t simGantryStepSignal = -1;					// GetGantryStep()
+int16_t simEmagSignals[NUM_COLUMNS];			// GetEmagState() for the columns with an electromagnet
+int16_t simDisplayBusySignals[NUM_BLOCK_STEPPERS];	// If each display stepper is moving
+
+std::vector<SimReplayRecord> simReplay;		// The capture being played back, in time order
+size_t simReplayNext = 0;					// The next pin or status record to take effect
+size_t simReplayNextAnswer = 0;				// Where to look for the next ESP32 answer
+int16_t simReplayPins[SimPins];				// The captured level of each pin, or -1 if it hasn't been captured yet
+int16_t simReplayStatus[NUM_MOTORS];		// The captured status of each driver, or -1 if it hasn't been captured yet
+uint8_t simWireBytes[32];					// The ESP32 answer being read
+uint8_t simWireLength = 0;					// The bytes in the answer
+uint8_t simWirePosition = 0;				// The next byte to read
+
+usb_serial_class Serial;
+SPIClass SPI;
+TwoWire Wire;
+EEPROMClass EEPROM;
+volatile uint32_t ARM_DWT_CYCCNT = 0;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Simulated Hardware
+//	*************************************************************************************************
+
+/// Get the simulated time in nanoseconds, including the part of a microsecond waited in delayNanoseconds()
+/// @return The time.
+uint64_t SimNowNs(){
+	return simUs * 1000 + simNs;
+}// End of SimNowNs()
+
+
+
+/// Add some bytes to the output hash
+/// @param data The bytes.
+/// @param length The number of bytes.
+void SimHash(const void *data, size_t length){
+	for(size_t i = 0; i < length; i++){
+		simStats.outputHash = (simStats.outputHash ^ ((const uint8_t *)data)[i]) * 16777619u;
+	}
+}// End of SimHash()
+
+
+
+/// Load an input capture to play back. Each line is "time_us source channel value", as log_decoder.py --capture saves them.
+/// @param path The capture.
+/// @return True if it was loaded.
+bool SimLoadReplay(const char *path){
+	FILE *file = fopen(path, "r");
+	if(file == nullptr){
+		fprintf(stderr, "Can't open %s for the capture\n", path);
+		return false;
+	}
+
+	simReplay.clear();
+	char line[128];
+	uint64_t wraps = 0;
+	uint32_t lastUs = 0;
+	while(fgets(line, sizeof(line), file) != nullptr){
+		unsigned long timeUs;
+		unsigned source, channel, value;
+		if(sscanf(line, "%lu %u %u %u", &timeUs, &source, &channel, &value) != 4){
+			continue;
+		}
+		if((uint32_t)timeUs < lastUs){// micros() wrapped around, after 71 minutes
+			wraps += 1ull << 32;
+		}
+		lastUs = (uint32_t)timeUs;
+		if((source == CAPTURE_START) && (value != CaptureVersion)){
+			fprintf(stderr, "%s is capture version %u, but this build reads version %u\n", path, value, CaptureVersion);
+			fclose(file);
+			return false;
+		}
+		simReplay.push_back({wraps + (uint32_t)timeUs, (uint8_t)source, (uint8_t)channel, (uint16_t)value});
+	}
+	fclose(file);
+	return true;
+}// End of SimLoadReplay()
+
+
+
+/// Bring the captured pin levels and driver status up to the simulated time
+void SimAdvanceReplay(){
+	while((simReplayNext < simReplay.size()) && (simReplay[simReplayNext].timeUs <= simUs)){
+		const SimReplayRecord *record = &simReplay[simReplayNext++];
+		if((record->source == CAPTURE_PIN) && (record->channel < SimPins)){
+			simReplayPins[record->channel] = record->value;
+		}else if((record->source == CAPTURE_DRIVER_STATUS) && (record->channel < NUM_MOTORS)){
+			simReplayStatus[record->channel] = record->value;
+		}
+	}
+}// End of SimAdvanceReplay()
+
+
+
+/// Get a random number from 0 to 1. This is xorshift32, so runs repeat exactly for the same seed.
+/// @return The random number.
+double SimRandom(){
+	simRandom ^= simRandom << 13;
+	simRandom ^= simRandom >> 17;
+	simRandom ^= simRandom << 5;
+	return (double)simRandom / 4294967296.0;
+}// End of SimRandom()
+
+
+
+/// Get the position of one side of the Gantry, from the motor positions and the start position
+/// @param side The side, 0 for left and 1 for right.
+/// @param positions The motor positions to use, in GantryMotor order.
+/// @param x Set to the position back from the front, in 1/SimSubsteps of a full step.
+/// @param y Set to the position down from the top, in 1/SimSubsteps of a full step.
+void SimSideSubsteps(uint8_t side, const int32_t *positions, int32_t *x, int32_t *y){
+	// Both motors turning the same way moves the side vertically, and turning opposite ways moves it horizontally.
+	// The right side motors are mirrored, so they turn the other way to move the Gantry down.
+	int32_t top = positions[(side == 0) ? GANTRY_LEFT_TOP_MOTOR : GANTRY_RIGHT_TOP_MOTOR];
+	int32_t bottom = positions[(side == 0) ? GANTRY_LEFT_BOTM_MOTOR : GANTRY_RIGHT_BOTM_MOTOR];
+	*x = simSettings.startX * SimSubsteps + (top - bottom) / 2;
+	*y = simSettings.startY * SimSubsteps + ((side == 0) ? (top + bottom) : -(top + bottom)) / 2;
+}// End of SimSideSubsteps()
+
+
+
+/// Check if a side of the Gantry is past one of its hard stops
+/// @param x The position back from the front, in 1/SimSubsteps of a full step.
+/// @param y The position down from the top, in 1/SimSubsteps of a full step.
+/// @return True if the side would be into a hard stop.
+bool SimPastHardStop(int32_t x, int32_t y){
+	int32_t stop = SimHardStopSteps * SimSubsteps;
+	return (y < -stop) || (y > SimFrameBottom * SimSubsteps + stop) || (x < -stop) || (x > SimFrameBack * SimSubsteps + stop);
+}// End of SimPastHardStop()
+
+
+
+/// Step one motor, unless it misses the step or the Gantry is against a hard stop
+/// @param motor The motor to step.
+void SimStepMotor(uint8_t motor){
+	SimDriver *driver = &simDrivers[motor];
+	simStats.stepPulses++;
+
+	uint64_t nowNs = SimNowNs();
+	VcdChange(simStepSignals[motor], 1, nowNs);
+	if(simSpiOpen){
+		if(simTransactionSteps == 0){
+			simFirstStepNs = nowNs;
+		}
+		simLastStepNs = nowNs;
+		simTransactionSteps++;
+	}
+
+	if((simSettings.missedStepRate > 0) && (SimRandom() < simSettings.missedStepRate)){
+		simStats.missedSteps++;
+		return;
+	}
+
+	uint8_t mode = (driver->regs[(uint8_t)HPSDRegAddr::CTRL] >> 3) & 0b1111;
+	if(mode > 8){
+		mode = 8;
+	}
+	int32_t distance = SimSubsteps >> mode;
+	if(!((driver->regs[(uint8_t)HPSDRegAddr::CTRL] >> 1) & 1)){
+		distance = -distance;
+	}
+
+	int32_t positions[NUM_MOTORS];
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		positions[i] = simDrivers[i].position;
+	}
+	positions[motor] += distance;
+
+	int32_t x, y;
+	SimSideSubsteps(motor / 2, positions, &x, &y);
+	if(SimPastHardStop(x, y)){// The motor can't turn, so the driver sees the back-EMF drop and flags a stall
+		simStats.hardStopSteps++;
+		driver->regs[(uint8_t)HPSDRegAddr::STATUS] |= SimStatusStall;
+		return;
+	}
+
+	driver->position += distance;
+}// End of SimStepMotor()
+
+
+
+/// Find the simulated driver for a chip select pin
+/// @param csPin The chip select pin.
+/// @return The driver, or nullptr if no driver uses that pin.
+SimDriver *SimDriverForPin(uint8_t csPin){
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		if(StepperDriverCSPins[i] == csPin){
+			return &simDrivers[i];
+		}
+	}
+	return nullptr;
+}// End of SimDriverForPin()
+
+
+
+/// Check a Gantry limit switch
+/// @param limitSwitch The limit switch, numbered by GantryLimitSwitch.
+/// @return True if the switch is tripped.
+bool SimLimitSwitch(uint8_t limitSwitch){
+	int32_t positions[NUM_MOTORS];
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		positions[i] = simDrivers[i].position;
+	}
+
+	int32_t x, y;
+	SimSideSubsteps((limitSwitch < GANTRY_RIGHT_UP_LIMIT_SWITCH) ? 0 : 1, positions, &x, &y);
+	switch(limitSwitch % 4){
+		case GANTRY_LEFT_UP_LIMIT_SWITCH:
+			return y <= 0;
+		case GANTRY_LEFT_DOWN_LIMIT_SWITCH:
+			return y >= SimFrameBottom * SimSubsteps;
+		case GANTRY_LEFT_FW_LIMIT_SWITCH:
+			return x <= 0;
+		default:
+			return x >= SimFrameBack * SimSubsteps;
+	}
+}// End of SimLimitSwitch()
+
+
+
+/// Turn the display steppers for a new set of coil patterns, latched out of the shift registers
+void SimLatchDisplaySteppers(){
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		uint8_t pattern = (simShiftRegister >> (i * 4)) & 0b1111;
+		int8_t phase = -1;
+		for(uint8_t j = 0; j < 4; j++){
+			if(SimCoilPatterns[j] == pattern){
+				phase = j;
+			}
+		}
+		if(phase < 0){// Off, so the stepper stays where it is and picks up from its last pattern
+			continue;
+		}
+		if(simDisplayPhases[i] >= 0){
+			uint8_t change = (phase - simDisplayPhases[i]) & 3;
+			if((change == 1) || (change == 3)){
+				simStats.displaySteps++;
+				if((simSettings.missedStepRate > 0) && (SimRandom() < simSettings.missedStepRate)){
+					simStats.displayMissedSteps++;
+				}else{
+					simDisplayPositions[i] += (change == 1) ? 1 : -1;
+				}
+			}
+		}
+		simDisplayPhases[i] = phase;
+		VcdChange(simDisplayPositionSignals[i], SimDisplayPosition(i), SimNowNs());
+	}
+}// End of SimLatchDisplaySteppers()
+
+
+
+/// Get the time a number of bits takes on the SPI bus
+/// @param bits The number of bits.
+/// @param clock The SPI clock, in Hz.
+/// @return The time in nanoseconds.
+uint32_t SimSpiNs(uint32_t bits, uint32_t clock){
+	return (uint32_t)((uint64_t)bits * 1000000000 / clock);
+}// End of SimSpiNs()
+
+
+
+/// Add a name for a pin. Pins with more than one use (the placeholder pins that aren't assigned yet) get all their names.
+/// @param names The names of the pins so far.
+/// @param pin The pin.
+/// @param name The name to add.
+void SimNamePin(char names[][64], uint8_t pin, const char *name){
+	if(pin >= SimPins){
+		return;
+	}
+	size_t length = strlen(names[pin]);
+	snprintf(names[pin] + length, 64 - length, "%s%s", (length > 0) ? "_" : "", name);
+}// End of SimNamePin()
+
+
+
+/// Set up the waveform file and its signals
+/// @param path Where to write it.
+/// @param seconds How many simulated seconds to save, or 0 for the whole run.
+void SimBeginVcd(const char *path, double seconds){
+	const char *const motorNames[NUM_MOTORS] = {"left_top", "left_botm", "right_top", "right_botm"};
+	const char *const limitNames[NUM_LS] = {"left_up", "left_down", "left_fw", "left_bw", "right_up", "right_down", "right_fw", "right_bw"};
+	char name[80];
+
+	if(!VcdOpen(path)){
+		return;
+	}
+	if(seconds > 0){
+		VcdStopAt((uint64_t)(seconds * 1e9));
+	}
+
+	// Only the pins the Teensy code has a name for are saved
+	char pinNames[SimPins][64] = {};
+	SimNamePin(pinNames, DisplayStepperDataPin, "disp_data");
+	SimNamePin(pinNames, DisplayStepperClockPin, "disp_clock");
+	SimNamePin(pinNames, DisplayStepperLatchPin, "disp_latch");
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		snprintf(name, sizeof(name), "cs_%s", motorNames[i]);
+		SimNamePin(pinNames, StepperDriverCSPins[i], name);
+	}
+	SimNamePin(pinNames, LcdCSPin, "lcd_cs");
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		snprintf(name, sizeof(name), "emag%u", i);
+		SimNamePin(pinNames, EmagPins[i], name);
+		snprintf(name, sizeof(name), "emag%u_rev", i);
+		SimNamePin(pinNames, EmagReversePins[i], name);
+	}
+	for(uint8_t i = 0; i < SimPins; i++){
+		simPinSignals[i] = (pinNames[i][0] != '\0') ? VcdAddSignal("pins", pinNames[i], VCD_WIRE) : -1;
+		simDutySignals[i] = -1;
+	}
+	for(uint8_t i = 0; i < NUM_EMAGS; i++){
+		if(simDutySignals[EmagPins[i]] < 0){
+			snprintf(name, sizeof(name), "%s_duty", pinNames[EmagPins[i]]);
+			simDutySignals[EmagPins[i]] = VcdAddSignal("pins", name, VCD_VECTOR, 8);
+		}
+	}
+
+	for(uint8_t i = 0; i < NUM_LS; i++){
+		snprintf(name, sizeof(name), "limit_%s", limitNames[i]);
+		simLimitSignals[i] = VcdAddSignal("switches", name, VCD_WIRE);
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		snprintf(name, sizeof(name), "disp%u_home", i);
+		simHomeSignals[i] = VcdAddSignal("switches", name, VCD_WIRE);
+	}
+
+	simSpiWordSignal = VcdAddSignal("gantry", "drv8711_word", VCD_VECTOR, 16);
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		snprintf(name, sizeof(name), "step_%s", motorNames[i]);
+		simStepSignals[i] = VcdAddSignal("gantry", name, VCD_EVENT);
+	}
+	simSpiSkewSignal = VcdAddSignal("gantry", "step_skew_ns", VCD_VECTOR, 32);
+	simGantryStateSignal = VcdAddSignal("gantry", "state", VCD_VECTOR, 8);
+	simGantryStepSignal = VcdAddSignal("gantry", "swap_step", VCD_VECTOR, 8);
+
+	for(uint8_t i = 0; i < NUM_COLUMNS; i++){
+		simEmagSignals[i] = -1;
+		if(ColumnHasEmag((BlockColumn)i)){
+			snprintf(name, sizeof(name), "column%u_state", i);
+			simEmagSignals[i] = VcdAddSignal("emags", name, VCD_VECTOR, 8);
+		}
+	}
+
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		snprintf(name, sizeof(name), "disp%u_position", i);
+		simDisplayPositionSignals[i] = VcdAddSignal("display", name, VCD_VECTOR, 16);
+		snprintf(name, sizeof(name), "disp%u_busy", i);
+		simDisplayBusySignals[i] = VcdAddSignal("display", name, VCD_WIRE);
+	}
+
+	VcdStart();
+}// End of SimBeginVcd()
+
+
+
+/// Get a time field from a unix time
+/// @param t The unix time.
+/// @return The broken down time, in UTC.
+struct tm SimBreakTime(time_t t){
+	struct tm fields;
+	gmtime_r(&t, &fields);
+	return fields;
+}// End of SimBreakTime()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Simulated Hardware
+//	*************************************************************************************************
+
+/// Set up the simulated hardware. This has to be called before the Teensy code's setup().
+/// @param settings The settings for the run.
+void SimBegin(const SimSettings &settings){
+	simSettings = settings;
+	memset(&simStats, 0, sizeof(simStats));
+	memset(simDrivers, 0, sizeof(simDrivers));
+	memset(simPinOutputs, 0, sizeof(simPinOutputs));
+	simRandom = (settings.seed == 0) ? 1 : settings.seed;
+	simShiftRegister = 0;
+	memset(EEPROM.data, 0xFF, sizeof(EEPROM.data));	// Blank, like a new Teensy
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		simDisplayPositions[i] = settings.displayStart + i * 100;
+		simDisplayPhases[i] = -1;
+	}
+	simUs = 0;
+	simNs = 0;
+	simDataChanged = false;
+	simSpiOpen = false;
+	simStats.minDataSetupNs = UINT32_MAX;
+	simStats.minLatchSetupNs = UINT32_MAX;
+	simStats.outputHash = 2166136261u;
+
+	simReplay.clear();
+	simReplayNext = 0;
+	simReplayNextAnswer = 0;
+	simWireLength = 0;
+	simWirePosition = 0;
+	memset(simReplayPins, 0xFF, sizeof(simReplayPins));
+	memset(simReplayStatus, 0xFF, sizeof(simReplayStatus));
+	if(settings.replayPath != nullptr){
+		SimLoadReplay(settings.replayPath);
+	}
+
+	if(settings.logPath != nullptr){
+		simLogFile = fopen(settings.logPath, "wb");
+		if(simLogFile == nullptr){
+			fprintf(stderr, "Can't open %s for the log\n", settings.logPath);
+		}
+	}
+
+	// Without a waveform file every signal stays -1, so nothing is recorded
+	memset(simPinSignals, 0xFF, sizeof(simPinSignals));
+	memset(simDutySignals, 0xFF, sizeof(simDutySignals));
+	memset(simLimitSignals, 0xFF, sizeof(simLimitSignals));
+	memset(simHomeSignals, 0xFF, sizeof(simHomeSignals));
+	memset(simStepSignals, 0xFF, sizeof(simStepSignals));
+	memset(simDisplayPositionSignals, 0xFF, sizeof(simDisplayPositionSignals));
+	memset(simEmagSignals, 0xFF, sizeof(simEmagSignals));
+	memset(simDisplayBusySignals, 0xFF, sizeof(simDisplayBusySignals));
+	if(settings.vcdPath != nullptr){
+		SimBeginVcd(settings.vcdPath, settings.vcdSeconds);
+	}
+}// End of SimBegin()
+
+
+
+/// Get how long the capture being played back runs for
+/// @return The micros() of its last record, or 0 if there is no capture.
+uint64_t SimReplayEndUs(){
+	return simReplay.empty() ? 0 : simReplay.back().timeUs;
+}// End of SimReplayEndUs()
+
+
+
+/// Move the simulated clock forward
+/// @param us The time to move forward, in microseconds.
+void SimAdvance(uint32_t us){
+	simUs += us;
+}// End of SimAdvance()
+
+
+
+/// Get the simulated time since the run started
+/// @return The time in microseconds.
+uint64_t SimMicros(){
+	return simUs;
+}// End of SimMicros()
+
+
+
+/// Get where one side of the Gantry really is, which can be different from where the Teensy thinks it is
+/// @param side The side, 0 for left and 1 for right.
+/// @param x Set to the position back from the front, in full steps.
+/// @param y Set to the position down from the top, in full steps.
+void SimSidePosition(uint8_t side, double *x, double *y){
+	int32_t positions[NUM_MOTORS];
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){
+		positions[i] = simDrivers[i].position;
+	}
+
+	int32_t subX, subY;
+	SimSideSubsteps(side, positions, &subX, &subY);
+	*x = (double)subX / SimSubsteps;
+	*y = (double)subY / SimSubsteps;
+}// End of SimSidePosition()
+
+
+
+/// Get where a display stepper really is
+/// @param stepper The stepper.
+/// @return The steps past home, within one turn.
+int32_t SimDisplayPosition(uint8_t stepper){
+	int32_t revolution = simSettings.displayRevolution;
+	return ((simDisplayPositions[stepper] % revolution) + revolution) % revolution;
+}// End of SimDisplayPosition()
+
+
+
+/// Record the states of the Teensy code in the waveforms. Call this after each pass through loop().
+void SimSampleStates(){
+	uint64_t nowNs = SimNowNs();
+	if(!VcdRecording(nowNs)){
+		return;
+	}
+	VcdChange(simGantryStateSignal, GetGantryState(), nowNs);
+	VcdChange(simGantryStepSignal, GetGantryStep(), nowNs);
+	for(uint8_t i = 0; i < NUM_COLUMNS; i++){
+		if(simEmagSignals[i] >= 0){
+			VcdChange(simEmagSignals[i], GetEmagState((BlockColumn)i), nowNs);
+		}
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		VcdChange(simDisplayBusySignals[i], !DisplaySteppersIdle(BLOCK_STEPPER_MASK(i)), nowNs);
+	}
+}// End of SimSampleStates()
+
+
+
+/// Get what the simulated hardware saw during the run
+/// @return The stats.
+SimStats SimGetStats(){
+	return simStats;
+}// End of SimGetStats()
+
+
+
+/// Print where the Gantry really is and what the simulated hardware saw during the run
+void SimPrintReport(){
+	const char *const sideNames[2] = {"Left", "Right"};
+	for(uint8_t i = 0; i < 2; i++){
+		double x, y;
+		SimSidePosition(i, &x, &y);
+		printf("Sim: %s side really at X %.3f, Y %.3f\n", sideNames[i], x, y);
+	}
+	printf("Sim: %u step pulses, %u missed on purpose, %u into a hard stop, %u driver writes\n", simStats.stepPulses,
+		simStats.missedSteps, simStats.hardStopSteps, simStats.spiWords);
+	printf("Sim: %u display steps, %u missed on purpose. Display steppers really at", simStats.displaySteps, simStats.displayMissedSteps);
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){
+		printf(" %d", SimDisplayPosition(i));
+	}
+	printf("\n");
+	if(simStats.minDataSetupNs != UINT32_MAX){
+		printf("Sim: display shift register data set at least %u ns before the clock, clock at least %u ns before the latch\n",
+			simStats.minDataSetupNs, simStats.minLatchSetupNs);
+	}
+	printf("Sim: Gantry motor steps in one SPI transaction up to %u ns apart\n", simStats.maxStepSkewNs);
+	if(!simReplay.empty()){
+		printf("Sim: played back %u of %u captured records, %u reads and %u ESP32 answers came from the capture\n",
+			(uint32_t)simReplayNext, (uint32_t)simReplay.size(), simStats.replayedReads, simStats.replayedAnswers);
+	}
+	printf("Sim: outputs hash %08x\n", simStats.outputHash);
+}// End of SimPrintReport()
+
+
+
+/// Finish the run, closing the log and waveform files
+void SimEnd(){
+	VcdClose();
+	if(simLogFile != nullptr){
+		fclose(simLogFile);
+		simLogFile = nullptr;
+	}
+}// End of SimEnd()
+
+
+
+
+
+//	*************************************************************************************************
+//	Time
+//	*************************************************************************************************
+
+uint32_t micros(){
+	return (uint32_t)simUs;
+}
+
+uint32_t millis(){
+	return (uint32_t)(simUs / 1000);
+}
+
+void delay(uint32_t ms){
+	simUs += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us){
+	simUs += us;
+}
+
+void delayNanoseconds(uint32_t ns){
+	simNs += ns;
+	simUs += simNs / 1000;
+	simNs %= 1000;
+}
+
+void setTime(time_t t){
+	simTimeOffset = t - (time_t)(simUs / 1000000);
+}
+
+time_t now(){
+	return simTimeOffset + (time_t)(simUs / 1000000);
+}
+
+int hour(time_t t){ return SimBreakTime(t).tm_hour; }
+int hourFormat12(time_t t){ int h = hour(t) % 12; return (h == 0) ? 12 : h; }
+int minute(time_t t){ return SimBreakTime(t).tm_min; }
+int second(time_t t){ return SimBreakTime(t).tm_sec; }
+int day(time_t t){ return SimBreakTime(t).tm_mday; }
+int weekday(time_t t){ return SimBreakTime(t).tm_wday + 1; }
+int month(time_t t){ return SimBreakTime(t).tm_mon + 1; }
+int year(time_t t){ return SimBreakTime(t).tm_year + 1900; }
+
+
+
+
+
+//	*************************************************************************************************
+//	Pins
+//	*************************************************************************************************
+
+void pinMode(uint8_t pin, uint8_t mode){
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+	if(pin >= SimPins){
+		return;
+	}
+	bool rising = (value == HIGH) && (simPinOutputs[pin] == LOW);
+	uint64_t nowNs = SimNowNs();
+	if((pin == DisplayStepperDataPin) && (value != simPinOutputs[pin])){
+		simDataChangedNs = nowNs;
+		simDataChanged = true;
+	}
+	simPinOutputs[pin] = value;
+	VcdChange(simPinSignals[pin], value, nowNs);
+	SimHash(&nowNs, sizeof(nowNs));
+	SimHash(&pin, sizeof(pin));
+	SimHash(&value, sizeof(value));
+
+	// The 74HC595s shift in on the rising edge of the clock, and put the shifted bits out on the rising edge of the latch.
+	// The data has to be set up before the clock, and the last clock has to be before the latch.
+	if(rising && (pin == DisplayStepperClockPin)){
+		simShiftRegister = (simShiftRegister << 1) | (simPinOutputs[DisplayStepperDataPin] & 1);
+		if(simDataChanged){
+			simStats.minDataSetupNs = std::min(simStats.minDataSetupNs, (uint32_t)(nowNs - simDataChangedNs));
+			simDataChanged = false;
+		}
+		simClockRoseNs = nowNs;
+	}else if(rising && (pin == DisplayStepperLatchPin)){
+		simStats.minLatchSetupNs = std::min(simStats.minLatchSetupNs, (uint32_t)(nowNs - simClockRoseNs));
+		SimLatchDisplaySteppers();
+	}
+}
+
+void digitalWriteFast(uint8_t pin, uint8_t value){
+	digitalWrite(pin, value);
+}
+
+int digitalRead(uint8_t pin){
+	SimAdvanceReplay();
+	if((pin < SimPins) && (simReplayPins[pin] >= 0)){
+		simStats.replayedReads++;
+		return simReplayPins[pin];
+	}
+
+	for(uint8_t i = 0; i < NUM_LS; i++){
+		if(pin == GantryLimitSwitchPins[i]){
+			int level = SimLimitSwitch(i) ? HIGH : LOW;
+			VcdChange(simLimitSignals[i], level, SimNowNs());
+			return level;
+		}
+	}
+	for(uint8_t i = 0; i < NUM_BLOCK_STEPPERS; i++){// The display home switches read low while pressed
+		if(pin == BlockRotationLimitSwitchPins[i]){
+			int level = (SimDisplayPosition(i) < SimDisplayHomeSteps) ? LOW : HIGH;
+			VcdChange(simHomeSignals[i], level, SimNowNs());
+			return level;
+		}
+	}
+	return (pin < SimPins) ? simPinOutputs[pin] : LOW;
+}
+
+int digitalReadFast(uint8_t pin){
+	return digitalRead(pin);
+}
+
+void analogWrite(uint8_t pin, int value){
+	if(pin < SimPins){
+		VcdChange(simDutySignals[pin], value, SimNowNs());
+	}
+}
+
+void analogWriteFrequency(uint8_t pin, float frequency){
+}
+
+void analogWriteResolution(int bits){
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	SPI and the DRV8711s
+//	*************************************************************************************************
+
+void SimDriverWrite(uint8_t csPin, uint16_t word){
+	SimDriver *driver = SimDriverForPin(csPin);
+	if(driver == nullptr){
+		return;
+	}
+	simStats.spiWords++;
+
+	uint8_t address = (word >> 12) & 0b111;
+	uint16_t data = word & 0xFFF;
+	if(address == (uint8_t)HPSDRegAddr::STATUS){// Writing a 0 clears a latched status bit
+		driver->regs[address] &= data;
+		return;
+	}
+
+	uint64_t nowNs = SimNowNs();
+	VcdChange(simSpiWordSignal, word, nowNs);
+	SimHash(&nowNs, sizeof(nowNs));
+	SimHash(&csPin, sizeof(csPin));
+	SimHash(&word, sizeof(word));
+	driver->regs[address] = data & ~(1 << 2);	// RSTEP clears itself
+	if((address == (uint8_t)HPSDRegAddr::CTRL) && (data & (1 << 0)) && (data & (1 << 2))){// Enabled and RSTEP set
+		SimStepMotor(driver - simDrivers);
+	}
+}
+
+uint16_t SimDriverRead(uint8_t csPin, uint8_t address){
+	SimDriver *driver = SimDriverForPin(csPin);
+	if(driver == nullptr){
+		return 0;
+	}
+	SimAdvanceReplay();
+	uint8_t motor = driver - simDrivers;
+	if(((address & 0b111) == (uint8_t)HPSDRegAddr::STATUS) && (simReplayStatus[motor] >= 0)){
+		simStats.replayedReads++;
+		return simReplayStatus[motor];
+	}
+	return driver->regs[address & 0b111];
+}
+
+void SimSpiBegin(){
+	simSpiOpen = true;
+	simTransactionSteps = 0;
+}
+
+void SimSpiEnd(){
+	simSpiOpen = false;
+	if(simTransactionSteps > 1){
+		uint32_t skew = (uint32_t)(simLastStepNs - simFirstStepNs);
+		simStats.maxStepSkewNs = std::max(simStats.maxStepSkewNs, skew);
+		VcdChange(simSpiSkewSignal, skew, SimNowNs());
+	}
+}
+
+uint8_t SPIClass::transfer(uint8_t data){
+	delayNanoseconds(SimSpiNs(8, clock));
+	return 0;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data){
+	delayNanoseconds(SimSpiNs(16, clock));
+	for(uint8_t i = 0; i < NUM_MOTORS; i++){// The DRV8711 chip selects are active high
+		if(simPinOutputs[StepperDriverCSPins[i]] == HIGH){
+			SimDriverWrite(StepperDriverCSPins[i], data);
+		}
+	}
+	return 0;
+}
+
+void SPIClass::transfer(void *buffer, size_t count){
+	delayNanoseconds(SimSpiNs(count * 8, clock));
+}
+
+bool SPIClass::transfer(const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event){
+	event.triggerEvent();	// Nothing on the bus reads the DMA transfers back, so they are done right away
+	return true;
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	I2C and the ESP32
+//	*************************************************************************************************
+
+uint8_t SimWireRequest(uint8_t quantity){
+	// The answers are given back in the order they were captured, whenever the code asks, so a request that comes a little
+	// earlier or later than it did on the Teensy still gets the same answer
+	simWireLength = 0;
+	simWirePosition = 0;
+	while((simReplayNextAnswer < simReplay.size()) && (simReplay[simReplayNextAnswer].source != CAPTURE_TIME_LENGTH)){
+		simReplayNextAnswer++;
+	}
+	if(simReplayNextAnswer == simReplay.size()){// Nothing captured, so the ESP32 doesn't answer
+		return 0;
+	}
+
+	uint8_t length = std::min<uint16_t>(simReplay[simReplayNextAnswer++].value, sizeof(simWireBytes));
+	while((simReplayNextAnswer < simReplay.size()) && (simReplay[simReplayNextAnswer].source == CAPTURE_TIME_BYTES)){
+		const SimReplayRecord *record = &simReplay[simReplayNextAnswer++];
+		for(uint8_t i = 0; i < 2; i++){
+			if((record->channel + i) < length){
+				simWireBytes[record->channel + i] = record->value >> (i * 8);
+			}
+		}
+	}
+	simWireLength = length;
+	simStats.replayedAnswers++;
+	return length;
+}
+
+int SimWireRead(){
+	return (simWirePosition < simWireLength) ? simWireBytes[simWirePosition++] : -1;
+}
+
+int SimWireAvailable(){
+	return simWireLength - simWirePosition;
+}
+
+
+
+
+
+//	*************************************************************************************************
+//	Serial
+//	*************************************************************************************************
+
+size_t Print::write(uint8_t value){
+	return write(&value, 1);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size){
+	if(simLogFile != nullptr){
+		fwrite(buffer, 1, size, simLogFile);
+	}
+	return size;
+}
+
+int Print::printf(const char *format, ...){
+	// A long is 32 bits on the Teensy, so the code prints uint32_t with %lu. Take the l off so the arguments line up here
+	char hostFormat[256];
+	size_t length = 0;
+	for(const char *c = format; (*c != '\0') && (length < sizeof(hostFormat) - 1); c++){
+		hostFormat[length++] = *c;
+		if(*c != '%'){
+			continue;
+		}
+		for(c++; (*c != '\0') && (length < sizeof(hostFormat) - 1); c++){// Copy the rest of the conversion
+			if((*c == 'l') && (c[1] != 'l')){
+				continue;
+			}
+			hostFormat[length++] = *c;
+			if(*c == 'l'){// %llu really is 64 bits, so keep both
+				hostFormat[length++] = *(++c);
+				continue;
+			}
+			if(strchr("%diouxXcspfeEgGn", *c) != nullptr){
+				break;
+			}
+		}
+		if(*c == '\0'){
+			break;
+		}
+	}
+	hostFormat[length] = '\0';
+
+	va_list args;
+	va_start(args, format);
+	int written = vprintf(hostFormat, args);
+	va_end(args);
+	return written;
+}
+
+size_t Print::print(const char *text){
+	return fputs(text, stdout) < 0 ? 0 : strlen(text);
+}
+
+size_t Print::println(const char *text){
+	return print(text) + println();
+}
+
+size_t Print::println(){
+	return fputs("\n", stdout) < 0 ? 0 : 1;
+}
+
+int Stream::available(){
+	return 0;
+}
+
+int Stream::read(){
+	return -1;
+}
+
+int Stream::availableForWrite(){
+	return 4096;
+}
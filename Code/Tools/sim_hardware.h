@@ -0,0 +1,117 @@
+// The simulated clock hardware behind the stand-in libraries in sim_stubs. This is the part of the clock the Teensy code
+// can't see directly: the four DRV8711s and the Gantry they move, the Gantry limit switches, and the hard stops, and the
+// display steppers on their shift registers with their home switches.
+//
+// The DRV8711s are driven by the same SPI words the Teensy sends. Each step moves a motor by 1/microsteps of a full step in the
+// direction of its RDIR bit, and the two motors on a side move that side of the Gantry like the belts do on the real clock.
+// The limit switches trip at the Gantry's end positions, and a few steps past them is a hard stop that stalls the motors.
+//
+// The display steppers are driven by the coil patterns shifted out to the 74HC595s. Each latch that moves a stepper's pattern
+// one phase on turns it a step, and its home switch is pressed for the first few steps of each turn.
+//
+// A run can also be saved as a VCD file for GTKWave (see sim_vcd.h). It has every pin the Teensy code writes, the limit and
+// home switches as the code read them, each word sent to the DRV8711s and each step it made, and the Gantry, electromagnet and
+// display stepper states. The timing of the shift register pins and the skew between the Gantry motors' steps are also
+// checked on every run, and shown in the report.
+//
+// The inputs can be played back from an input capture (see InputCapture.h) instead of coming from the model. Captured pins
+// and driver status read as they were at the same micros() on the Teensy, and the ESP32's time answers are given back in
+// order. Every pin written and driver word sent is hashed with its time, so two runs can be checked for matching exactly.
+
+#pragma once
+
+#include <stdint.h>
+
+
+//	*************************************************************************************************
+//	Shared Structs for the Simulated Hardware
+//	*************************************************************************************************
+
+// The settings for the simulation
+typedef struct {
+	double missedStepRate;		// The chance a motor misses any one step pulse, from 0 to 1
+	uint32_t seed;				// The seed for the missed steps, so a run can be repeated
+	int32_t startX;				// Where the Gantry starts, in full steps back from the front
+	int32_t startY;				// Where the Gantry starts, in full steps down from the top
+	int32_t displayStart;		// Where the first display stepper starts, in steps past home. Each one after is 100 steps further
+	int32_t displayRevolution;	// The steps in one turn of the display steppers, which can differ from DISPLAY_STEPS_PER_REV
+	const char *logPath;		// The file the binary log (Serial.write) is saved to, or nullptr to drop it
+	const char *vcdPath;		// The file the waveforms are saved to, or nullptr for none
+	double vcdSeconds;			// How many simulated seconds of waveforms to save, or 0 for the whole run
+	const char *replayPath;		// The input capture to play back, from log_decoder.py --capture, or nullptr to use the model
+} SimSettings;
+
+
+
+// What the simulated hardware saw during the run
+typedef struct {
+	uint32_t stepPulses;		// The step pulses sent to all the motors
+	uint32_t missedSteps;		// The step pulses the motors missed on purpose
+	uint32_t hardStopSteps;		// The step pulses that ran a motor into a hard stop, and stalled it
+	uint32_t spiWords;			// The words written to the drivers
+	uint32_t displaySteps;		// The steps the display steppers were told to take
+	uint32_t displayMissedSteps;	// The display steps missed on purpose
+	uint32_t minDataSetupNs;	// The shortest time the shift register data was set before the clock rose
+	uint32_t minLatchSetupNs;	// The shortest time from the last shift register clock to the latch
+	uint32_t maxStepSkewNs;		// The longest time from the first to the last Gantry motor step in one SPI transaction
+	uint32_t replayedReads;		// The pin and driver status reads answered from the capture
+	uint32_t replayedAnswers;	// The ESP32 time requests answered from the capture
+	uint32_t outputHash;		// The FNV-1a hash of every pin written and driver word sent, with its time
+} SimStats;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the Simulated Hardware
+//	*************************************************************************************************
+
+/// Set up the simulated hardware. This has to be called before the Teensy code's setup().
+/// @param settings The settings for the run.
+void SimBegin(const SimSettings &settings);
+
+
+/// Get how long the capture being played back runs for
+/// @return The micros() of its last record, or 0 if there is no capture.
+uint64_t SimReplayEndUs();
+
+
+/// Move the simulated clock forward
+/// @param us The time to move forward, in microseconds.
+void SimAdvance(uint32_t us);
+
+
+/// Get the simulated time since the run started
+/// @return The time in microseconds.
+uint64_t SimMicros();
+
+
+/// Get where one side of the Gantry really is, which can be different from where the Teensy thinks it is
+/// @param side The side, 0 for left and 1 for right.
+/// @param x Set to the position back from the front, in full steps.
+/// @param y Set to the position down from the top, in full steps.
+void SimSidePosition(uint8_t side, double *x, double *y);
+
+
+/// Get where a display stepper really is
+/// @param stepper The stepper.
+/// @return The steps past home, within one turn.
+int32_t SimDisplayPosition(uint8_t stepper);
+
+
+/// Record the states of the Teensy code in the waveforms. Call this after each pass through loop().
+void SimSampleStates();
+
+
+/// Get what the simulated hardware saw during the run
+/// @return The stats.
+SimStats SimGetStats();
+
+
+/// Print where the Gantry really is and what the simulated hardware saw during the run
+void SimPrintReport();
+
+
+/// Finish the run, closing the log and waveform files
+void SimEnd();
@@ -0,0 +1,108 @@
+// Stand-in for the Teensy core, so the Teensy code can be built and run on a computer by stress_sim. Time is simulated,
+// and the pins, SPI bus, and stepper drivers are backed by the mechanism model in sim_hardware.cpp.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+#define DMAMEM
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define bitRead(value, bit) (((value) >> (bit)) & 1)
+
+#define F_CPU_ACTUAL 600000000
+
+
+//	*************************************************************************************************
+//	Time. The clock only moves when the simulation moves it, or when the code waits
+//	*************************************************************************************************
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void delayNanoseconds(uint32_t ns);
+
+extern volatile uint32_t ARM_DWT_CYCCNT;
+
+// Timer that counts up in microseconds, like the Teensy core's
+class elapsedMicros {
+	public:
+		elapsedMicros(){ startUs = micros(); }
+		operator uint32_t() const { return micros() - startUs; }
+		elapsedMicros &operator=(uint32_t value){ startUs = micros() - value; return *this; }
+	private:
+		uint32_t startUs;
+};
+
+// Timer that counts up in milliseconds, like the Teensy core's
+class elapsedMillis {
+	public:
+		elapsedMillis(){ startMs = millis(); }
+		operator uint32_t() const { return millis() - startMs; }
+		elapsedMillis &operator=(uint32_t value){ startMs = millis() - value; return *this; }
+	private:
+		uint32_t startMs;
+};
+
+
+//	*************************************************************************************************
+//	Pins
+//	*************************************************************************************************
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void digitalWriteFast(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int digitalReadFast(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+void analogWriteFrequency(uint8_t pin, float frequency);
+void analogWriteResolution(int bits);
+
+inline void noInterrupts(){}
+inline void interrupts(){}
+
+
+//	*************************************************************************************************
+//	Serial. Text goes to stdout, and binary (the deferred log) goes to a file
+//	*************************************************************************************************
+
+class Print {
+	public:
+		size_t write(uint8_t value);
+		size_t write(const uint8_t *buffer, size_t size);
+		int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+		size_t print(const char *text);
+		size_t println(const char *text);
+		size_t println();
+};
+
+class Stream : public Print {
+	public:
+		int available();
+		int read();
+		int availableForWrite();
+};
+
+class usb_serial_class : public Stream {
+	public:
+		void begin(long baud){}
+		operator bool(){ return true; }
+};
+
+extern usb_serial_class Serial;
@@ -0,0 +1,42 @@
+// Stand-in for the Teensy EEPROM library, kept in memory for the length of a run
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+
+class EEPROMClass {
+	public:
+		static const uint16_t Size = 4284;	// The emulated EEPROM on a Teensy 4.1
+
+		uint8_t read(int address){
+			return data[address];
+		}
+
+		void write(int address, uint8_t value){
+			data[address] = value;
+		}
+
+		void update(int address, uint8_t value){
+			data[address] = value;
+		}
+
+		uint16_t length(){
+			return Size;
+		}
+
+		template <typename T> T &get(int address, T &value){
+			memcpy(&value, &data[address], sizeof(T));
+			return value;
+		}
+
+		template <typename T> const T &put(int address, const T &value){
+			memcpy(&data[address], &value, sizeof(T));
+			return value;
+		}
+
+		uint8_t data[Size];
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,117 @@
+// Stand-in for the Pololu HighPowerStepperDriver library. The register layout and settings match the real library, but the
+// registers are written straight to the simulated DRV8711 for the chip select pin instead of going over SPI.
+
+#pragma once
+
+#include <Arduino.h>
+
+enum class HPSDStepMode : uint16_t {
+	MicroStep256 = 256, MicroStep128 = 128, MicroStep64 = 64, MicroStep32 = 32, MicroStep16 = 16,
+	MicroStep8 = 8, MicroStep4 = 4, MicroStep2 = 2, MicroStep1 = 1
+};
+
+enum class HPSDDecayMode : uint8_t {
+	Slow = 0b000, SlowIncMixedDec = 0b001, Fast = 0b010, Mixed = 0b011, SlowIncAutoMixedDec = 0b100, AutoMixed = 0b101
+};
+
+enum class HPSDStatusBit : uint8_t {
+	OTS = 0, AOCP = 1, BOCP = 2, APDF = 3, BPDF = 4, UVLO = 5, StD = 6, StDLat = 7
+};
+
+enum class HPSDRegAddr : uint8_t {
+	CTRL = 0x00, TORQUE = 0x01, OFF = 0x02, BLANK = 0x03, DECAY = 0x04, STALL = 0x05, DRIVE = 0x06, STATUS = 0x07
+};
+
+// Implemented by the mechanism model in sim_hardware.cpp
+void SimDriverWrite(uint8_t csPin, uint16_t word);
+uint16_t SimDriverRead(uint8_t csPin, uint8_t address);
+
+class HPSDSPI {
+	public:
+		void init(uint8_t pin){ csPin = pin; }
+		uint16_t readReg(uint8_t address){ return SimDriverRead(csPin, address & 0b111); }
+		uint16_t readReg(HPSDRegAddr address){ return readReg((uint8_t)address); }
+		void writeReg(uint8_t address, uint16_t value){ SimDriverWrite(csPin, ((address & 0b111) << 12) | (value & 0xFFF)); }
+		void writeReg(HPSDRegAddr address, uint16_t value){ writeReg((uint8_t)address, value); }
+	private:
+		uint8_t csPin = 0;
+};
+
+class HighPowerStepperDriver {
+	public:
+		void setChipSelectPin(uint8_t pin){ driver.init(pin); }
+
+		void resetSettings(){
+			ctrl = 0xC10; torque = 0x1FF; off = 0x030; blank = 0x080; decay = 0x110; stall = 0x040; drive = 0xA59;
+			applySettings();
+		}
+
+		bool verifySettings(){ return driver.readReg(HPSDRegAddr::CTRL) == ctrl; }
+
+		void applySettings(){
+			writeTORQUE();
+			driver.writeReg(HPSDRegAddr::OFF, off);
+			driver.writeReg(HPSDRegAddr::BLANK, blank);
+			writeDECAY();
+			driver.writeReg(HPSDRegAddr::DRIVE, drive);
+			driver.writeReg(HPSDRegAddr::STALL, stall);
+			writeCTRL();
+		}
+
+		void enableDriver(){ ctrl |= (1 << 0); writeCTRL(); }
+		void disableDriver(){ ctrl &= ~(1 << 0); writeCTRL(); }
+
+		void setDirection(bool value){
+			if(value){
+				ctrl |= (1 << 1);
+			}else{
+				ctrl &= ~(1 << 1);
+			}
+			writeCTRL();
+		}
+		bool getDirection(){ return (ctrl >> 1) & 1; }
+
+		void step(){ driver.writeReg(HPSDRegAddr::CTRL, ctrl | (1 << 2)); }
+
+		void setStepMode(HPSDStepMode mode){ setStepMode((uint16_t)mode); }
+		void setStepMode(uint16_t mode){
+			uint8_t sm = 0b0010;	// Quarter steps, like the real library falls back to
+			for(uint8_t i = 0; i <= 8; i++){
+				if(mode == (1 << i)){
+					sm = i;
+				}
+			}
+			ctrl = (ctrl & 0b111110000111) | (sm << 3);
+			writeCTRL();
+		}
+
+		void setCurrentMilliamps36v4(uint16_t current){
+			if(current > 8000){
+				current = 8000;
+			}
+			// The real library picks the ISGAIN and TORQUE for the current. Only the TORQUE register is kept here, scaled to the current
+			torque = (torque & 0b111100000000) | (uint16_t)((uint32_t)current * 255 / 8000);
+			writeTORQUE();
+		}
+		void setCurrentMilliamps36v8(uint16_t current){ setCurrentMilliamps36v4(current); }
+
+		void setDecayMode(HPSDDecayMode mode){
+			decay = (decay & 0b00011111111) | (((uint8_t)mode & 0b111) << 8);
+			writeDECAY();
+		}
+
+		uint8_t readStatus(){ return driver.readReg(HPSDRegAddr::STATUS); }
+		void clearStatus(){ driver.writeReg(HPSDRegAddr::STATUS, 0); }
+		uint8_t readFaults(){ return readStatus() & 0b00111111; }
+		void clearFaults(){ driver.writeReg(HPSDRegAddr::STATUS, ~0b00111111); }
+
+	protected:
+		uint16_t ctrl, torque, off, blank, decay, stall, drive;
+
+		void writeCTRL(){ driver.writeReg(HPSDRegAddr::CTRL, ctrl); }
+		void writeTORQUE(){ driver.writeReg(HPSDRegAddr::TORQUE, torque); }
+		void writeDECAY(){ driver.writeReg(HPSDRegAddr::DECAY, decay); }
+
+	public:
+		HPSDSPI driver;
+};
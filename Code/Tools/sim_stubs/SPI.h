@@ -0,0 +1,49 @@
+// Stand-in for the Teensy SPI library. Words sent while a stepper driver's chip select is high go to the simulated driver.
+// DMA transfers finish right away, so the bus arbiter never waits on them.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+struct SPISettings {
+	SPISettings() : clock(4000000) {}
+	SPISettings(uint32_t clockHz, uint8_t bitOrder, uint8_t dataMode) : clock(clockHz) {}
+	uint32_t clock;
+};
+
+// Implemented by the mechanism model in sim_hardware.cpp, to time the words sent in each transaction
+void SimSpiBegin();
+void SimSpiEnd();
+
+class EventResponder;
+typedef EventResponder &EventResponderRef;
+typedef void (*EventResponderFunction)(EventResponderRef);
+
+class EventResponder {
+	public:
+		void attachImmediate(EventResponderFunction function){ callback = function; }
+		void triggerEvent(){ if(callback != nullptr){ callback(*this); } }
+		void clearEvent(){}
+	private:
+		EventResponderFunction callback = nullptr;
+};
+
+class SPIClass {
+	public:
+		void begin(){}
+		void beginTransaction(SPISettings settings){ clock = settings.clock; SimSpiBegin(); }
+		void endTransaction(){ SimSpiEnd(); }
+		uint8_t transfer(uint8_t data);
+		uint16_t transfer16(uint16_t data);
+		void transfer(void *buffer, size_t count);
+		bool transfer(const void *txBuffer, void *rxBuffer, size_t count, EventResponderRef event);
+	private:
+		uint32_t clock = 4000000;
+};
+
+extern SPIClass SPI;
@@ -0,0 +1,5 @@
+// Stand-in for the TimeAlarms library. The clock code doesn't set any alarms yet, so only the include is needed
+
+#pragma once
+
+#include <TimeLib.h>
@@ -0,0 +1,30 @@
+// Stand-in for the TimeLib library, running off the simulated clock
+
+#pragma once
+
+#include <Arduino.h>
+#include <time.h>
+
+#define SECS_PER_MIN ((time_t)(60UL))
+#define SECS_PER_HOUR ((time_t)(3600UL))
+
+void setTime(time_t t);
+time_t now();
+
+int hour(time_t t);
+int hourFormat12(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int day(time_t t);
+int weekday(time_t t);
+int month(time_t t);
+int year(time_t t);
+
+inline int hour(){ return hour(now()); }
+inline int hourFormat12(){ return hourFormat12(now()); }
+inline int minute(){ return minute(now()); }
+inline int second(){ return second(now()); }
+inline int day(){ return day(now()); }
+inline int weekday(){ return weekday(now()); }
+inline int month(){ return month(now()); }
+inline int year(){ return year(now()); }
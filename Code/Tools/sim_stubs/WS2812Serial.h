@@ -0,0 +1,18 @@
+// Stand-in for the WS2812Serial library. The strip isn't simulated, the frames are just dropped. Use lighting_preview to
+// see the effects.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define WS2812_GRB 1
+
+class WS2812Serial {
+	public:
+		WS2812Serial(uint16_t num, void *displayBuffer, void *drawingBuffer, uint8_t pin, uint8_t config){}
+		bool begin(){ return true; }
+		void setPixel(uint32_t num, uint32_t color){}
+		void show(){}
+		bool busy(){ return false; }
+		void setBrightness(uint8_t brightness){}
+};
@@ -0,0 +1,24 @@
+// Stand-in for the Wire library. There is no ESP32 on the bus, so every request goes unanswered and the time stays
+// at whatever the simulation set it to, unless a capture is being played back and has the ESP32's answers in it.
+
+#pragma once
+
+#include <Arduino.h>
+
+// Implemented by the mechanism model in sim_hardware.cpp, to play back captured answers
+uint8_t SimWireRequest(uint8_t quantity);
+int SimWireRead();
+int SimWireAvailable();
+
+class TwoWire : public Stream {
+	public:
+		void begin(){}
+		void begin(uint8_t address){}
+		uint8_t requestFrom(int address, int quantity){ return SimWireRequest(quantity); }
+		int available(){ return SimWireAvailable(); }
+		int read(){ return SimWireRead(); }
+		void onRequest(void (*function)()){}
+		void onReceive(void (*function)(int)){}
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,11 @@
+// Stand-in for the Teensy 4.1 pin definitions. Only the pins the clock code names are here
+
+#pragma once
+
+#define LED_BUILTIN 13
+
+const uint8_t MOSI = 11;
+const uint8_t MISO = 12;
+const uint8_t SCK = 13;
+const uint8_t SDA = 18;
+const uint8_t SCL = 19;
@@ -0,0 +1,220 @@
+// Writer for Value Change Dump files. See sim_vcd.h.
+
+#include <cstdio>
+#include <cstring>
+
+#include "sim_vcd.h"
+
+
+//	*************************************************************************************************
+//	Local Structs for the VCD Writer
+//	*************************************************************************************************
+
+// Struct to hold one signal
+typedef struct {
+	char scope[24];
+	char name[48];
+	char id[4];				// The short code the file uses for the signal
+	VcdKind kind;
+	uint8_t width;
+	bool known;				// If the signal has had a value yet
+	uint32_t value;			// The last value written
+} VcdSignal;
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Variables for the VCD Writer
+//	*************************************************************************************************
+
+const uint16_t VcdMaxSignals = 256;		// The most signals a file can have
+
+FILE *vcdFile = nullptr;				// The file being written
+VcdSignal vcdSignals[VcdMaxSignals];	// The signals, in the order they were added
+uint16_t vcdSignalCount = 0;			// The number of signals added
+uint64_t vcdLastNs = 0;					// The time of the last change written
+uint64_t vcdStopNs = UINT64_MAX;		// When to stop recording
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the VCD Writer
+//	*************************************************************************************************
+
+/// Make the short code the file uses for a signal. The codes are in base 94, using the printable characters '!' to '~'.
+/// @param index The signal's number.
+/// @param id Filled in with the code, at least 4 long.
+void VcdMakeId(uint16_t index, char *id){
+	uint8_t length = 0;
+	do{
+		id[length++] = '!' + (index % 94);
+		index /= 94;
+	}while(index > 0);
+	id[length] = '\0';
+}// End of VcdMakeId()
+
+
+
+/// Write a signal's value
+/// @param signal The signal.
+/// @param value The value.
+void VcdWriteValue(const VcdSignal *signal, uint32_t value){
+	if(signal->kind == VCD_VECTOR){
+		char bits[33];
+		uint8_t length = 0;
+		for(int8_t bit = signal->width - 1; bit >= 0; bit--){
+			if((length > 0) || ((value >> bit) & 1) || (bit == 0)){// Leading zeros are left off
+				bits[length++] = '0' + ((value >> bit) & 1);
+			}
+		}
+		bits[length] = '\0';
+		fprintf(vcdFile, "b%s %s\n", bits, signal->id);
+	}else{
+		fprintf(vcdFile, "%c%s\n", (value != 0) ? '1' : '0', signal->id);
+	}
+}// End of VcdWriteValue()
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the VCD Writer
+//	*************************************************************************************************
+
+/// Start a VCD file. Signals are then added with VcdAddSignal(), and VcdStart() ends the list of them.
+/// @param path Where to write the file.
+/// @return True if the file was opened.
+bool VcdOpen(const char *path){
+	vcdFile = fopen(path, "w");
+	if(vcdFile == nullptr){
+		fprintf(stderr, "Can't open %s for the waveforms\n", path);
+		return false;
+	}
+	vcdSignalCount = 0;
+	vcdLastNs = 0;
+	vcdStopNs = UINT64_MAX;
+	return true;
+}// End of VcdOpen()
+
+
+
+/// Add a signal, before VcdStart()
+/// @param scope The group the signal is shown in.
+/// @param name The name of the signal.
+/// @param kind The kind of signal.
+/// @param width How many bits wide a VCD_VECTOR is.
+/// @return The signal's number, to pass to VcdChange(), or -1 if no file is open.
+int16_t VcdAddSignal(const char *scope, const char *name, VcdKind kind, uint8_t width){
+	if((vcdFile == nullptr) || (vcdSignalCount == VcdMaxSignals)){
+		return -1;
+	}
+	VcdSignal *signal = &vcdSignals[vcdSignalCount];
+	snprintf(signal->scope, sizeof(signal->scope), "%s", scope);
+	snprintf(signal->name, sizeof(signal->name), "%s", name);
+	VcdMakeId(vcdSignalCount, signal->id);
+	signal->kind = kind;
+	signal->width = (kind == VCD_VECTOR) ? width : 1;
+	signal->known = false;
+	signal->value = 0;
+	return vcdSignalCount++;
+}// End of VcdAddSignal()
+
+
+
+/// End the list of signals, and set them all to unknown until they first change
+void VcdStart(){
+	if(vcdFile == nullptr){
+		return;
+	}
+	fprintf(vcdFile, "$version stress_sim $end\n$timescale 1 ns $end\n$scope module clock $end\n");
+
+	// Write the signals grouped by scope, in the order each scope was first used
+	bool written[VcdMaxSignals] = {};
+	for(uint16_t i = 0; i < vcdSignalCount; i++){
+		if(written[i]){
+			continue;
+		}
+		fprintf(vcdFile, "$scope module %s $end\n", vcdSignals[i].scope);
+		for(uint16_t j = i; j < vcdSignalCount; j++){
+			if(written[j] || (strcmp(vcdSignals[j].scope, vcdSignals[i].scope) != 0)){
+				continue;
+			}
+			const VcdSignal *signal = &vcdSignals[j];
+			const char *type = (signal->kind == VCD_EVENT) ? "event" : ((signal->kind == VCD_VECTOR) ? "reg" : "wire");
+			fprintf(vcdFile, "$var %s %u %s %s $end\n", type, signal->width, signal->id, signal->name);
+			written[j] = true;
+		}
+		fprintf(vcdFile, "$upscope $end\n");
+	}
+	fprintf(vcdFile, "$upscope $end\n$enddefinitions $end\n");
+
+	fprintf(vcdFile, "#0\n$dumpvars\n");
+	for(uint16_t i = 0; i < vcdSignalCount; i++){
+		if(vcdSignals[i].kind == VCD_VECTOR){
+			fprintf(vcdFile, "bx %s\n", vcdSignals[i].id);
+		}else if(vcdSignals[i].kind == VCD_WIRE){
+			fprintf(vcdFile, "x%s\n", vcdSignals[i].id);
+		}
+	}
+	fprintf(vcdFile, "$end\n");
+}// End of VcdStart()
+
+
+
+/// Record a signal changing. Changes to the value it already has are left out.
+/// @param signal The signal's number, from VcdAddSignal(). Nothing is written for -1.
+/// @param value The new value. This is ignored for a VCD_EVENT.
+/// @param timeNs When it changed. This can't be before the last change.
+void VcdChange(int16_t signal, uint32_t value, uint64_t timeNs){
+	if((signal < 0) || !VcdRecording(timeNs)){
+		return;
+	}
+	VcdSignal *changed = &vcdSignals[signal];
+	if(changed->kind == VCD_EVENT){
+		value = 1;
+	}else if(changed->known && (changed->value == value)){
+		return;
+	}
+
+	if(timeNs > vcdLastNs){
+		fprintf(vcdFile, "#%llu\n", (unsigned long long)timeNs);
+		vcdLastNs = timeNs;
+	}
+	VcdWriteValue(changed, value);
+	changed->known = true;
+	changed->value = value;
+}// End of VcdChange()
+
+
+
+/// Stop recording changes after a time, to keep long runs to a sensible file size
+/// @param timeNs The time to stop at.
+void VcdStopAt(uint64_t timeNs){
+	vcdStopNs = timeNs;
+}// End of VcdStopAt()
+
+
+
+/// Check if changes are being recorded
+/// @param timeNs The time now.
+/// @return True if a file is open and it is before the stop time.
+bool VcdRecording(uint64_t timeNs){
+	return (vcdFile != nullptr) && (timeNs <= vcdStopNs);
+}// End of VcdRecording()
+
+
+
+/// Finish the file
+void VcdClose(){
+	if(vcdFile == nullptr){
+		return;
+	}
+	fprintf(vcdFile, "#%llu\n", (unsigned long long)vcdLastNs);
+	fclose(vcdFile);
+	vcdFile = nullptr;
+}// End of VcdClose()
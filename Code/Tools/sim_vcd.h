@@ -0,0 +1,67 @@
+// Writer for Value Change Dump files, the waveform format GTKWave opens. sim_hardware.cpp declares the signals it records
+// (pins, SPI words, step pulses, and the states of the Teensy code), and then writes each change with the simulated time.
+// Times are in nanoseconds, so the short delays between pin changes in the Teensy code show up.
+
+#pragma once
+
+#include <stdint.h>
+
+
+//	*************************************************************************************************
+//	Shared Enumerations for the VCD Writer
+//	*************************************************************************************************
+
+// The kinds of signal
+typedef enum {
+	VCD_WIRE,		// One bit, like a pin
+	VCD_VECTOR,		// A number some bits wide, like a register or a state
+	VCD_EVENT		// Something that happened at an instant, with no level, like a step
+} VcdKind;
+
+
+
+
+
+//	*************************************************************************************************
+//	Shared Functions for the VCD Writer
+//	*************************************************************************************************
+
+/// Start a VCD file. Signals are then added with VcdAddSignal(), and VcdStart() ends the list of them.
+/// @param path Where to write the file.
+/// @return True if the file was opened.
+bool VcdOpen(const char *path);
+
+
+/// Add a signal, before VcdStart()
+/// @param scope The group the signal is shown in.
+/// @param name The name of the signal.
+/// @param kind The kind of signal.
+/// @param width How many bits wide a VCD_VECTOR is.
+/// @return The signal's number, to pass to VcdChange(), or -1 if no file is open.
+int16_t VcdAddSignal(const char *scope, const char *name, VcdKind kind, uint8_t width = 1);
+
+
+/// End the list of signals, and set them all to unknown until they first change
+void VcdStart();
+
+
+/// Record a signal changing. Changes to the value it already has are left out.
+/// @param signal The signal's number, from VcdAddSignal(). Nothing is written for -1.
+/// @param value The new value. This is ignored for a VCD_EVENT.
+/// @param timeNs When it changed. This can't be before the last change.
+void VcdChange(int16_t signal, uint32_t value, uint64_t timeNs);
+
+
+/// Stop recording changes after a time, to keep long runs to a sensible file size
+/// @param timeNs The time to stop at.
+void VcdStopAt(uint64_t timeNs);
+
+
+/// Check if changes are being recorded
+/// @param timeNs The time now.
+/// @return True if a file is open and it is before the stop time.
+bool VcdRecording(uint64_t timeNs);
+
+
+/// Finish the file
+void VcdClose();
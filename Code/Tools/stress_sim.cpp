@@ -0,0 +1,185 @@
+// Host side run of the block swap stress test. This builds the whole Teensy code on a computer against the stand-in libraries
+// in sim_stubs, and runs it on simulated time with the Gantry mechanism modelled in sim_hardware.cpp. Hours of swapping run
+// in seconds, and missed steps can be added on purpose to check that the swap stats catch them.
+//
+// Build (from Code/Tools):
+//	g++ -O2 -std=gnu++17 -Isim_stubs -I../Teensy_Main_Code stress_sim.cpp sim_hardware.cpp sim_vcd.cpp ../Teensy_Main_Code/*.cpp -o stress_sim
+//
+// Usage:
+//	./stress_sim [swaps] [--minutes N] [--miss-rate R] [--seed N] [--log file.bin] [--display-rev N] [--calibrate]
+//		[--vcd file.vcd] [--vcd-seconds S] [--capture] [--clock N]
+// The swaps and minutes are passed to StartStressTest(), and 0 is no limit. The miss rate is the chance each step pulse is
+// missed. The log file gets the deferred log, which log_decoder.py can read. The display rev is the steps in one turn of the
+// simulated display steppers, and --calibrate measures them with StartDisplayCalibration() before the stress test starts.
+// The VCD file gets the waveforms of the run for GTKWave, and --vcd-seconds stops them after that many simulated seconds,
+// since every step is in them and a whole run makes a large file. --capture records the inputs from power on like
+// CAPTURE_INPUTS_AT_BOOT, and sends them into the log at the end for log_decoder.py --capture and replay_sim.
+// --clock runs the clock showing the time for N simulated minutes instead of the stress test. The Gantry isn't allowed to
+// wait at the staging height for the first half, so the second half can be checked against it: the run fails unless the
+// Gantry staged for some swaps and they were faster than the ones from the default parking spot.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sim_hardware.h"
+#include "Teensy_Main_Code.ino"
+
+
+//	*************************************************************************************************
+//	Local Variables for the Stress Sim
+//	*************************************************************************************************
+
+const uint32_t SimLoopUs = 10;					// How long each pass through loop() takes on the Teensy
+const time_t SimStartTime = 1704110400;			// 2024-01-01 12:00:00 UTC, the time the ESP32 would have given
+const uint64_t SimTimeoutUs = 48ull * 3600 * 1000000;	// Give up after 48 simulated hours, in case the test never stops
+
+
+
+
+
+//	*************************************************************************************************
+//	Local Functions for the Stress Sim
+//	*************************************************************************************************
+
+/// Run the clock showing the time, with staging off for the first half, and check that staging saved time in the second half
+/// @param minutes The simulated minutes to run for.
+/// @return 0 if the check passed, 1 if not.
+int RunClock(uint32_t minutes){
+	uint64_t startUs = SimMicros();
+	uint64_t endUs = startUs + (uint64_t)minutes * 60000000;
+	uint64_t halfUs = startUs + (uint64_t)minutes * 30000000;
+
+	auto startedAt = std::chrono::steady_clock::now();
+	SetGantryStaging(false);
+	while(SimMicros() < endUs){
+		if(SimMicros() >= halfUs){
+			SetGantryStaging(true);
+		}
+		loop();
+		SimSampleStates();
+		SimAdvance(SimLoopUs);
+	}
+	double realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+
+	PrintGantryStatus();
+	PrintUsageCounters();
+	SimPrintReport();
+	printf("Sim: %.1f simulated seconds in %.1f s\n", SimMicros() / 1e6, realSeconds);
+
+	uint32_t defaultMs;
+	uint32_t stagedMs;
+	uint32_t defaultSwaps = GetParkedSwaps(false, &defaultMs);
+	uint32_t stagedSwaps = GetParkedSwaps(true, &stagedMs);
+	bool passed = (stagedSwaps > 0) && (defaultSwaps > 0) && (stagedMs < defaultMs);
+	printf("Sim: staging %s, %lu staged swaps averaging %lu ms, %lu from the default parking spot averaging %lu ms\n", passed ? "passed" : "FAILED",
+		(unsigned long)stagedSwaps, (unsigned long)stagedMs, (unsigned long)defaultSwaps, (unsigned long)defaultMs);
+	SimEnd();
+	return passed ? 0 : 1;
+}// End of RunClock()
+
+
+
+
+
+//	*************************************************************************************************
+//	Main
+//	*************************************************************************************************
+
+int main(int argc, char **argv){
+	uint32_t swaps = 100;
+	uint32_t minutes = 0;
+	SimSettings settings = {0.0, 1, 300, 120, 700, DISPLAY_STEPS_PER_REV, nullptr, nullptr, 0, nullptr};	// No missed steps, starting part way back and part way down
+	bool calibrate = false;
+	bool capture = false;
+	uint32_t clockMinutes = 0;
+
+	for(int i = 1; i < argc; i++){
+		if((strcmp(argv[i], "--minutes") == 0) && (i + 1 < argc)){
+			minutes = strtoul(argv[++i], nullptr, 10);
+		}else if((strcmp(argv[i], "--miss-rate") == 0) && (i + 1 < argc)){
+			settings.missedStepRate = strtod(argv[++i], nullptr);
+		}else if((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)){
+			settings.seed = strtoul(argv[++i], nullptr, 10);
+		}else if((strcmp(argv[i], "--log") == 0) && (i + 1 < argc)){
+			settings.logPath = argv[++i];
+		}else if((strcmp(argv[i], "--display-rev") == 0) && (i + 1 < argc)){
+			settings.displayRevolution = strtol(argv[++i], nullptr, 10);
+		}else if((strcmp(argv[i], "--vcd") == 0) && (i + 1 < argc)){
+			settings.vcdPath = argv[++i];
+		}else if((strcmp(argv[i], "--vcd-seconds") == 0) && (i + 1 < argc)){
+			settings.vcdSeconds = strtod(argv[++i], nullptr);
+		}else if(strcmp(argv[i], "--capture") == 0){
+			capture = true;
+		}else if((strcmp(argv[i], "--clock") == 0) && (i + 1 < argc)){
+			clockMinutes = strtoul(argv[++i], nullptr, 10);
+		}else if(strcmp(argv[i], "--calibrate") == 0){
+			calibrate = true;
+		}else if(argv[i][0] != '-'){
+			swaps = strtoul(argv[i], nullptr, 10);
+		}else{
+			fprintf(stderr, "Usage: %s [swaps] [--minutes N] [--miss-rate R] [--seed N] [--log file.bin] [--display-rev N] [--calibrate] [--vcd file.vcd] [--vcd-seconds S] [--capture] [--clock N]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	SimBegin(settings);
+	setTime(SimStartTime);
+	if(capture){
+		StartInputCapture();
+	}
+	setup();
+
+	if(calibrate){// Measure the display steppers before swapping, like a first power on would
+		StartDisplayCalibration(BLOCK_STEPPER_MASK(NUM_BLOCK_STEPPERS) - 1);
+		while(DisplayCalibrationRunning()){
+			loop();
+			SimSampleStates();
+			SimAdvance(SimLoopUs);
+		}
+		PrintDisplayCalibration();
+	}
+
+	if(clockMinutes > 0){
+		return RunClock(clockMinutes);
+	}
+
+	if(!StartStressTest(swaps, minutes)){
+		fprintf(stderr, "The stress test needs a number of swaps or minutes\n");
+		return 1;
+	}
+
+	auto startedAt = std::chrono::steady_clock::now();
+	while(StressTestRunning()){
+		loop();
+		SimSampleStates();
+		SimAdvance(SimLoopUs);
+		if(SimMicros() > SimTimeoutUs){
+			printf("Sim: gave up after %llu simulated hours\n", (unsigned long long)(SimTimeoutUs / 3600000000ull));
+			StopStressTest();
+		}
+	}
+	double realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+
+	PrintGantryStatus();
+	PrintDisplayStepperStatus();
+	PrintUsageCounters();
+	SimPrintReport();
+	printf("Sim: %.1f simulated seconds in %.1f s\n", SimMicros() / 1e6, realSeconds);
+
+	if(capture){// Send the capture into the log, after the report so the outputs hash only covers the run
+		SendInputCapture();
+		while(InputCaptureSending()){
+			loop();
+			SimAdvance(SimLoopUs);
+		}
+		for(uint32_t i = 0; i < 1000; i++){// Let the log flush
+			loop();
+			SimAdvance(SimLoopUs);
+		}
+		PrintInputCaptureStatus();
+	}
+	SimEnd();
+	return 0;
+}// End of main()